@@ -25,12 +25,17 @@
 #include <memory.h>
 #include <poll.h>
 #include <pthread.h>
+#include <sched.h>
 #include <semaphore.h>
+#include <stddef.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/file.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/resource.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/un.h>
 #include <linux/netlink.h>
@@ -128,6 +133,7 @@ typedef EGLSyncKHR (*PREALEGLCREATESYNCKHR)(EGLDisplay, EGLenum, const EGLint *a
 typedef EGLBoolean (*PREALEGLDESTROYSYNCKHR)(EGLDisplay, EGLSyncKHR);
 typedef EGLint (*PREALEGLCLIENTWAITSYNCKHR)(EGLDisplay, EGLSyncKHR, EGLint, EGLint);
 typedef EGLint (*PREALEGLWAITSYNCKHR)(EGLDisplay, EGLSyncKHR, EGLint);
+typedef EGLint (*PREALEGLDUPNATIVEFENCEFDANDROID)(EGLDisplay, EGLSyncKHR);
 #endif
 
 #ifdef USE_REFRESH_LOCK
@@ -139,8 +145,145 @@ typedef struct _VideoServerCtx VideoServerCtx;
 typedef struct _DisplayServerCtx DisplayServerCtx;
 typedef struct _WstOverlayPlane WstOverlayPlane;
 
+/*
+ * A video frame buffer registered with DRM.  Video frames reference
+ * it by fbId.  An fb created through a connection's cache is reused for
+ * each frame received in the same decoder buffer and is only removed
+ * once it has been evicted from the cache and no frame still refers to it.
+ */
+typedef struct _VideoFb
+{
+   struct _VideoFb *next;
+   uint32_t fbId;
+   uint32_t handle0;
+   uint32_t handle1;
+   int refCnt;
+   bool cached;
+} VideoFb;
+
+typedef struct _VideoFbKey
+{
+   int bufferId;
+   uint32_t handle0;
+   uint32_t handle1;
+   uint32_t frameWidth;
+   uint32_t frameHeight;
+   uint32_t frameFormat;
+   int offset0;
+   int stride0;
+   int offset1;
+   int stride1;
+   uint32_t skipX;
+   uint32_t skipY;
+} VideoFbKey;
+
+typedef struct _VideoFbCacheEntry
+{
+   VideoFbKey key;
+   VideoFb *fb;
+} VideoFbCacheEntry;
+
+#define VIDEO_FB_CACHE_SIZE (16)
+
+/*
+ * Video server protocol version 2 adds a shared memory frame ring.  A client
+ * that negotiates it ('N') hands over a shared memory region and two eventfd
+ * doorbells ('M') and registers each of its decoder buffers once ('O'),
+ * dropping the registrations when its buffers are reallocated ('X').
+ * Frames and buffer releases then pass through single producer/single
+ * consumer rings in the shared region rather than as socket messages with
+ * dup'd fds.  The layout below must match the one used by westeros-sink.
+ */
+#define VIDEO_SERVER_PROTOCOL_VERSION (2)
+#define VIDEO_RING_MAGIC (0x57535246)
+#define VIDEO_RING_VERSION (1)
+#define VIDEO_RING_CAPACITY (32)
+#define VIDEO_POOL_SIZE (32)
+
+typedef struct _VideoRingFrame
+{
+   int32_t bufferId;
+   uint32_t frameWidth;
+   uint32_t frameHeight;
+   uint32_t frameFormat;
+   int32_t rectX;
+   int32_t rectY;
+   int32_t rectW;
+   int32_t rectH;
+   int32_t offset[3];
+   int32_t stride[3];
+   int64_t frameTime __attribute__((aligned(8)));
+} VideoRingFrame;
+
+typedef struct _VideoRingShm
+{
+   uint32_t magic;
+   uint32_t capacity;
+   uint32_t version;
+   uint32_t frameHead __attribute__((aligned(64)));
+   uint32_t frameTail __attribute__((aligned(64)));
+   uint32_t releaseHead __attribute__((aligned(64)));
+   uint32_t releaseTail __attribute__((aligned(64)));
+   VideoRingFrame frames[VIDEO_RING_CAPACITY];
+   int32_t releases[VIDEO_RING_CAPACITY];
+} VideoRingShm;
+
+/*
+ * Pin the ring layout so it can't drift from the copy in westeros-sink
+ * (westeros-sink/v4l2/westeros-sink-soc.h), which checks the same values.
+ * Any layout change must bump VIDEO_RING_VERSION on both sides.
+ */
+_Static_assert( sizeof(VideoRingFrame) == 64, "VideoRingFrame layout changed" );
+_Static_assert( offsetof(VideoRingFrame, offset) == 32, "VideoRingFrame layout changed" );
+_Static_assert( offsetof(VideoRingFrame, stride) == 44, "VideoRingFrame layout changed" );
+_Static_assert( offsetof(VideoRingFrame, frameTime) == 56, "VideoRingFrame layout changed" );
+_Static_assert( sizeof(VideoRingShm) == 2496, "VideoRingShm layout changed" );
+_Static_assert( offsetof(VideoRingShm, version) == 8, "VideoRingShm layout changed" );
+_Static_assert( offsetof(VideoRingShm, frameHead) == 64, "VideoRingShm layout changed" );
+_Static_assert( offsetof(VideoRingShm, frameTail) == 128, "VideoRingShm layout changed" );
+_Static_assert( offsetof(VideoRingShm, releaseHead) == 192, "VideoRingShm layout changed" );
+_Static_assert( offsetof(VideoRingShm, releaseTail) == 256, "VideoRingShm layout changed" );
+_Static_assert( offsetof(VideoRingShm, frames) == 264, "VideoRingShm layout changed" );
+_Static_assert( offsetof(VideoRingShm, releases) == 2312, "VideoRingShm layout changed" );
+
+/*
+ * A client buffer registered for use with the frame ring.  The fds are
+ * owned by the connection; when the pool is full the oldest registration
+ * is replaced, which the client mirrors.  Sizes are 0 when not known.
+ */
+typedef struct _VideoPoolBuffer
+{
+   int bufferId;
+   int fd0;
+   int fd1;
+   int fd2;
+   off_t size0;
+   off_t size1;
+} VideoPoolBuffer;
+
+#define VIDEO_FRAME_DIMENSION_MAX (16384)
+
+/*
+ * Every fd the epoll video server waits on is registered with one of these
+ * as its epoll_event data so events can be dispatched by type.
+ */
+typedef enum _VideoEpollType
+{
+   VideoEpollType_server,
+   VideoEpollType_wake,
+   VideoEpollType_connection,
+   VideoEpollType_doorbell
+} VideoEpollType;
+
+typedef struct _VideoEpollTag
+{
+   VideoEpollType type;
+   struct _VideoServerConnection *conn;
+} VideoEpollTag;
+
 typedef struct _VideoServerConnection
 {
+   struct _VideoServerConnection *next;
    pthread_mutex_t mutex;
    VideoServerCtx *server;
    WstOverlayPlane *videoPlane;
@@ -155,10 +298,23 @@ typedef struct _VideoServerConnection
    int syncType;
    int sessionId;
    int videoResourceId;
+   int fbCacheCount;
+   VideoFbCacheEntry fbCache[VIDEO_FB_CACHE_SIZE];
+   int protocolVersion;
+   VideoRingShm *ring;
+   int frameDoorbellFd;
+   int releaseDoorbellFd;
+   int poolCount;
+   int poolNext;
+   VideoPoolBuffer pool[VIDEO_POOL_SIZE];
+   VideoEpollTag socketTag;
+   VideoEpollTag doorbellTag;
+   bool destroyed;
 } VideoServerConnection;
 
 typedef struct _DisplayServerConnection
 {
+   struct _DisplayServerConnection *next;
    pthread_mutex_t mutex;
    DisplayServerCtx *server;
    int socketFd;
@@ -168,6 +324,8 @@ typedef struct _DisplayServerConnection
    int responseCode;
    int responseLen;
    char response[256+3];
+   int statsPeriod;
+   long long statsNext;
 } DisplayServerConnection;
 
 #define MAX_SUN_PATH (80)
@@ -185,20 +343,44 @@ typedef struct _WstServerCtx
    bool threadStopRequested;
 } WstServerCtx;
 
-#define MAX_VIDEO_CONNECTIONS (4)
+/*
+ * Video server connections are all multiplexed by the server thread when
+ * useEpoll is set, otherwise each is serviced by a thread of its own.  In
+ * epoll mode wakeFd is an eventfd used to have the server thread push state
+ * changes such as refresh rate and zoom mode out to every connection, and
+ * dropped connections are queued to the teardown thread since releasing
+ * their plane waits for the display.
+ */
 typedef struct _VideoServerCtx
 {
    WstServerCtx *server;
-   VideoServerConnection* connections[MAX_VIDEO_CONNECTIONS];
+   bool useEpoll;
+   int epollFd;
+   int wakeFd;
+   VideoEpollTag serverTag;
+   VideoEpollTag wakeTag;
+   VideoServerConnection *connections;
+   pthread_mutex_t teardownMutex;
+   pthread_cond_t teardownCond;
+   pthread_t teardownThreadId;
+   bool teardownThreadStarted;
+   bool teardownStopRequested;
+   VideoServerConnection *teardownQueue;
 } VideoServerCtx;
 
-#define MAX_DISPLAY_CONNECTIONS (4)
 typedef struct _DisplayServerCtx
 {
    WstServerCtx *server;
-   DisplayServerConnection* connections[MAX_VIDEO_CONNECTIONS];
+   DisplayServerConnection *connections;
 } DisplayServerCtx;
 
+/*
+ * Optional flags word following the frame time in a 'F' message.  With
+ * VIDEO_FRAME_FLAG_ACQUIRE_FENCE the last fd passed with the message is a
+ * sync file that signals once the frame has been written.
+ */
+#define VIDEO_FRAME_FLAG_ACQUIRE_FENCE (1<<0)
+
 typedef struct _VideoFrame
 {
    WstOverlayPlane *plane;
@@ -212,6 +394,7 @@ typedef struct _VideoFrame
    int fd0;
    int fd1;
    int fd2;
+   int fenceFd;
    uint32_t frameWidth;
    uint32_t frameHeight;
    uint32_t frameFormat;
@@ -237,10 +420,12 @@ typedef struct _AVSyncCtrl
 } AVSyncCtrl;
 #endif
 
+/* Frame queue is a ring: capacity must be a power of two */
 #define VFM_QUEUE_CAPACITY (16)
 typedef struct _VideoFrameManager
 {
    VideoServerConnection *conn;
+   int queueHead;
    int queueSize;
    int queueCapacity;
    VideoFrame *queue;
@@ -261,6 +446,8 @@ typedef struct _VideoFrameManager
    long long expireLimit;
    int dropFrameCount;
    int dropFrameCountReported;
+   int lateFrameCount;
+   int underflowCount;
    bool underflowDetected;
    bool underflowReported;
    int bufferIdCurrent;
@@ -322,6 +509,11 @@ typedef struct _WstOverlayPlane
    VideoServerConnection *conn;
    int formatCount;
    WstFormatInfo *formats;
+   bool scanout;
+   int scanoutRetired;
+   int scanoutHideFrame;
+   WstGLScanoutRetireCallback scanoutRetireCB;
+   void *scanoutUserData;
 } WstOverlayPlane;
 
 typedef struct _WstOverlayPlanes
@@ -335,6 +527,29 @@ typedef struct _WstOverlayPlanes
    WstOverlayPlane *primary;
 } WstOverlayPlanes;
 
+/*
+ * Overlay plane showing client buffers directly.  Frames on a scanout plane
+ * have no video server connection: their fbs are removed once retired.
+ */
+typedef struct _WstGLScanout
+{
+   WstOverlayPlane *plane;
+   int frameNumber;
+} WstGLScanout;
+
+/*
+ * Framebuffer attached to a graphics surface buffer as gbm user data.  Each
+ * buffer gets one fb for its lifetime which is removed when gbm destroys
+ * the buffer.
+ */
+typedef struct _WstGraphicsFb
+{
+   int drmFd;
+   uint32_t fbId;
+   int width;
+   int height;
+} WstGraphicsFb;
+
 typedef struct _NativeWindowItem
 {
    struct _NativeWindowItem *next;
@@ -342,12 +557,15 @@ typedef struct _NativeWindowItem
    EGLSurface surface;
    WstOverlayPlane *windowPlane;
    uint32_t fbId;
-   uint32_t prevFbId;
    struct gbm_bo *bo;
    struct gbm_bo *prevBo;
    int width;
    int height;
    bool dirty;
+   #ifdef DRM_USE_NATIVE_FENCE
+   int renderFenceFd;
+   int commitFenceFd;
+   #endif
    #ifdef USE_REFRESH_LOCK
    bool active;
    pthread_mutex_t mutexRefresh;
@@ -380,6 +598,8 @@ typedef struct _WstOffloadVideoFrameResources
 
 typedef struct _WstOffloadMsg
 {
+   struct _WstOffloadMsg *next;
+   unsigned int seq;
    uint32_t msgType;
    void *param_pvoid;
    long long param_long_long;
@@ -387,17 +607,84 @@ typedef struct _WstOffloadMsg
    void *param_pvoid2;
 } WstOffloadMsg;
 
+/* Must be a power of two */
 #define OFFLOAD_QUEUE_CAPACITY (64)
+#define OFFLOAD_POP_SPIN_LIMIT (100)
 
+/*
+ * Multi-producer ring of offload messages.  Producers, chiefly the refresh thread,
+ * never block: they claim a slot with a CAS on writeIdx and publish it through the
+ * slot's seq.  When the ring is full messages go onto the overflow list, which is
+ * allocated per message and pushed lock free.  Consumers (the offload thread and
+ * connection flushes) are serialized by mutex and take the ring before the overflow.
+ * A connection flush takes only that connection's messages and moves the rest to
+ * the held list, which the offload thread takes first.  Messages are run outside
+ * the mutex; busyConn is the connection the offload thread is running one for.
+ */
 typedef struct _WstOffloadMsgQ
 {
    WstOffloadMsg msg[OFFLOAD_QUEUE_CAPACITY];
-   int readIdx;
-   int writeIdx;
+   unsigned int readIdx;
+   unsigned int writeIdx;
+   WstOffloadMsg *overflow;
+   WstOffloadMsg *overflowPending;
+   WstOffloadMsg overflowMark;
+   WstOffloadMsg *held;
+   WstOffloadMsg *heldTail;
+   VideoServerConnection *busyConn;
+   unsigned int pushCount;
+   unsigned int popCount;
+   unsigned int highWater;
+   unsigned int overflowCount;
    pthread_mutex_t mutex;
+   pthread_cond_t idle;
    sem_t sem;
 } WstOffloadMsgQ;
 
+#define COMMIT_SAMPLE_COUNT (32)
+#define COMMIT_PERCENTILE (95)
+#define COMMIT_MARGIN_DEFAULT (2000LL)
+
+/*
+ * Times (us) taken by the refresh thread to check planes and commit.  With a
+ * commit deadline the thread sleeps after each vblank until the commit work,
+ * at COMMIT_PERCENTILE of recent samples, plus a safety margin would just
+ * complete before the next vblank, so the newest frames are latched.
+ */
+typedef struct _WstCommitSched
+{
+   bool enabled;
+   long long margin;
+   int sampleCount;
+   int sampleNext;
+   long long samples[COMMIT_SAMPLE_COUNT];
+   long long estimate;
+   unsigned int missCount;
+} WstCommitSched;
+
+/*
+ * Refresh thread counters reported by the display server 'get stats'
+ * commands.  The flip rate and commit times (us) cover the last complete
+ * one second window.
+ */
+typedef struct _WstGLStats
+{
+   unsigned int flipCount;
+   unsigned int vblankMissCount;
+   long long commitTimeLast;
+   int flipRate;
+   long long commitTimeAvg;
+   long long commitTimeMax;
+   long long windowStart;
+   int windowFlips;
+   long long windowCommitTotal;
+   long long windowCommitMax;
+} WstGLStats;
+
+#define STATS_WINDOW (1000000LL)
+#define STATS_RESPONSE_MAX (254)
+#define STATS_PERIOD_MIN (100)
+
 typedef struct _WstGLCtx
 {
    pthread_mutex_t mutex;
@@ -449,6 +736,13 @@ typedef struct _WstGLCtx
    bool dirty;
    bool forceDirty;
    bool useVBlank;
+   bool vblankMonotonic;
+   WstCommitSched commitSched;
+   pthread_mutex_t mutexStats;
+   WstGLStats stats;
+   pthread_mutex_t mutexVBlank;
+   bool haveVBlankInfo;
+   WstGLVBlankInfo vblankInfo;
    pthread_t refreshThreadId;
    bool refreshThreadStarted;
    bool refreshThreadStopRequested;
@@ -480,7 +774,13 @@ static void avProgLog( long long nanoTime, int syncGroup, const char *edge, cons
 static void wstStartOffloadMsgThread( WstGLCtx *ctx );
 static void wstOffloadMsgExecute(uint32_t msgType, void *param_pv, long long param_ll, int param_int, void *param_pv2);
 static void wstOffloadFlushConn( VideoServerConnection *conn );
+static WstOffloadMsg* wstOffloadTakeConn( VideoServerConnection *conn );
+static void wstOffloadRunConn( VideoServerConnection *conn, WstOffloadMsg *list );
 static void wstOffloadMsgPush(uint32_t type, void *param_pv, long long param_ll, int param_int, void *param_pv2);
+static bool wstOffloadMsgTake( WstOffloadMsgQ *pMsgQ, WstOffloadMsg *msg );
+static bool wstOffloadMsgPop( WstOffloadMsgQ *pMsgQ, WstOffloadMsg *msg );
+static VideoServerConnection* wstOffloadMsgConn( WstOffloadMsg *msg );
+static bool wstOffloadMsgPending( WstOffloadMsgQ *pMsgQ );
 static void wstOffloadSendBufferRelease( VideoServerConnection *conn, VideoFrame* f);
 static void wstOffloadSendStatus( VideoServerConnection *conn, VideoFrameManager *vfm, long long displayedFrameTime, int dropFrameCount );
 static void wstOffloadSendUnderflow( VideoServerConnection *conn, long long displayedFrameTime);
@@ -499,15 +799,43 @@ static long long wstVideoFrameMangerGetTimeSyncCtrl( VideoFrameManager *vfm, boo
 static void wstVideoFrameManagerUpdateRect( VideoFrameManager *vfm, int rectX, int rectY, int rectW, int rectH );
 static void wstVideoFrameManagerPushFrame( VideoFrameManager *vfm, VideoFrame *f );
 static VideoFrame* wstVideoFrameManagerPopFrame( VideoFrameManager *vfm );
+static VideoFrame* wstVideoFrameManagerQueueFrame( VideoFrameManager *vfm, int i );
+static void wstVideoFrameManagerQueuePopFront( VideoFrameManager *vfm );
+static void wstVideoFrameManagerQueueRemove( VideoFrameManager *vfm, int i );
 static void wstVideoFrameManagerEos( VideoFrameManager *vfm );
 static void wstVideoFrameManagerPause( VideoFrameManager *vfm, bool pause );
 static void wstVideoFrameManagerFrameAdvance( VideoFrameManager *vfm );
 static void wstDestroyVideoServerConnection( VideoServerConnection *conn );
 static void wstDestroyDisplayServerConnection( DisplayServerConnection *conn );
 static void wstClosePrimeFDHandles( WstGLCtx *ctx, uint32_t handle0, uint32_t handle1, int line );
+static void wstVideoFbUnlink( VideoFb *fb );
+static void wstReleaseVideoFb( uint32_t fbId, uint32_t handle0, uint32_t handle1, int line );
+static bool wstVideoFbKeyInit( VideoFbKey *key, int fd0, int fd1, int bufferId );
+static VideoFb* wstVideoFbCacheAcquire( VideoServerConnection *conn, VideoFbKey *key );
+static void wstVideoFbCacheAdd( VideoServerConnection *conn, VideoFbKey *key, uint32_t fbId, uint32_t handle0, uint32_t handle1 );
+static void wstVideoFbCacheEvict( VideoServerConnection *conn, int index );
+static void wstVideoFbCacheClear( VideoServerConnection *conn );
 static void wstSetVideoFrameRect( VideoFrame *vf, int rectX, int rectY, int rectW, int rectH, uint32_t *skipX, uint32_t *skipY );
 static void wstFreeVideoFrameResources( VideoFrame *f );
 static void wstVideoServerSendBufferRelease( VideoServerConnection *conn, int bufferId );
+static void wstVideoServerSendProtocolVersion( VideoServerConnection *conn, int version );
+static void wstVideoServerSendRingStatus( VideoServerConnection *conn, bool active );
+static void wstVideoServerSendUpdates( VideoServerConnection *conn );
+static bool wstVideoServerQueueFrame( VideoServerConnection *conn, VideoRingFrame *desc, int fd0, int fd1, int fd2, int fenceFd, bool pooled );
+static bool wstVideoServerProcessMessage( VideoServerConnection *conn );
+static bool wstVideoServerProcessRing( VideoServerConnection *conn );
+static bool wstVideoServerSetupRing( VideoServerConnection *conn, int shmFd, int frameDoorbellFd, int releaseDoorbellFd );
+static void wstVideoServerTermRing( VideoServerConnection *conn );
+static void wstVideoServerRegisterBuffer( VideoServerConnection *conn, int bufferId, int fd0, int fd1, int fd2 );
+static void wstVideoServerPurgePool( VideoServerConnection *conn );
+static VideoPoolBuffer* wstVideoServerFindBuffer( VideoServerConnection *conn, int bufferId );
+static bool wstVideoServerCheckFrame( VideoPoolBuffer *pb, VideoRingFrame *desc );
+static void wstVideoServerConnectionCleanup( VideoServerConnection *conn );
+static void wstVideoServerAddConnection( VideoServerCtx *server, VideoServerConnection *conn );
+static void wstVideoServerRemoveConnection( VideoServerCtx *server, VideoServerConnection *conn );
+static void wstVideoServerWake( void );
+static void wstVideoServerQueueTeardown( VideoServerCtx *server, VideoServerConnection *conns );
+static void *wstVideoServerTeardownThread( void *arg );
 static void wstVideoServerSendStatus( VideoServerConnection *conn, long long displayedFrameTime, int dropFrameCount );
 static void wstVideoServerSendUnderflow( VideoServerConnection *conn, long long displayedFrameTime );
 static void wstVideoServerSendZoomMode( VideoServerConnection *conn, WstGLCtx *ctx, int zoomMode );
@@ -519,6 +847,9 @@ static void wstSelectRate( WstGLCtx *ctx, int rateNum, int rateDenom );
 static void wstStartRefreshThread( WstGLCtx *ctx );
 static void wstSwapDRMBuffers( WstGLCtx *ctx );
 static void wstSwapDRMBuffersAtomic( WstGLCtx *ctx );
+#ifdef DRM_USE_OUT_FENCE
+static bool wstSwapCheckFence( WstGLCtx *ctx, int timeoutMs );
+#endif
 
 
 static PFNEGLGETPLATFORMDISPLAYEXTPROC gRealEGLGetPlatformDisplay= 0;
@@ -531,6 +862,7 @@ static PREALEGLCREATESYNCKHR gRealEGLCreateSyncKHR= 0;
 static PREALEGLDESTROYSYNCKHR gRealEGLDestroySyncKHR= 0;
 static PREALEGLCLIENTWAITSYNCKHR gRealEGLClientWaitSyncKHR= 0;
 static PREALEGLWAITSYNCKHR gRealEGLWaitSyncKHR= 0;
+static PREALEGLDUPNATIVEFENCEFDANDROID gRealEGLDupNativeFenceFDANDROID= 0;
 #endif
 static pthread_mutex_t gMutex= PTHREAD_MUTEX_INITIALIZER;
 static WstGLCtx *gCtx= 0;
@@ -570,6 +902,8 @@ typedef struct _WstResources
 } WstResources;
 static pthread_mutex_t resMutex= PTHREAD_MUTEX_INITIALIZER;
 static WstResources *gResources= 0;
+static pthread_mutex_t gFbMutex= PTHREAD_MUTEX_INITIALIZER;
+static VideoFb *gVideoFbs= 0;
 
 #ifdef USE_AMLOGIC_MESON
 #include "avsync/aml-meson/avsync.c"
@@ -686,7 +1020,7 @@ static void avProgTerm()
 static char *wstDispFullness( VideoFrameManager *vfm )
 {
    static char desc[64];
-   if ( gAvProgOut )
+   if ( gAvProgOut && vfm )
    {
       sprintf( desc, "(%d)", vfm->queueSize );
       return desc;
@@ -708,6 +1042,12 @@ static void wstOffloadSendBufferRelease( VideoServerConnection *conn, VideoFrame
       return;
    }
 
+   if ( f->fenceFd >= 0 )
+   {
+      wstOffloadCloseFileHande( f->fenceFd );
+      f->fenceFd= -1;
+   }
+
    TRACE1("OLM: release buffer %d to client", f->bufferId);
    r= (WstOffloadVideoFrameResources *)calloc(1, sizeof(WstOffloadVideoFrameResources));
    if ( r )
@@ -769,10 +1109,8 @@ static void wstOffloadFreeVideoFrameResources(WstOffloadVideoFrameResources *f )
       }
       if ( f->fbId )
       {
-         wstUpdateResources( WSTRES_FB_VIDEO, false, f->fbId, __LINE__);
-         drmModeRmFB( gCtx->drmFd, f->fbId );
+         wstReleaseVideoFb( f->fbId, f->handle0, f->handle1, __LINE__ );
          f->fbId= 0;
-         wstClosePrimeFDHandles( gCtx, f->handle0, f->handle1, __LINE__ );
          f->handle0= 0;
          f->handle1= 0;
       }
@@ -1099,6 +1437,11 @@ static void wstOverlayFree( WstOverlayPlanes *planes, WstOverlayPlane *overlay )
       }
       overlay->inUse= false;
       overlay->conn= 0;
+      overlay->scanout= false;
+      overlay->scanoutRetired= 0;
+      overlay->scanoutHideFrame= 0;
+      overlay->scanoutRetireCB= 0;
+      overlay->scanoutUserData= 0;
       overlay->videoResourceId= -1;
       overlay->keepLastFrame= false;
       if ( planes->usedCount <= 0 )
@@ -1210,6 +1553,206 @@ static void wstClosePrimeFDHandles( WstGLCtx *ctx, uint32_t handle0, uint32_t ha
    }
 }
 
+static void wstVideoFbUnlink( VideoFb *fb )
+{
+   VideoFb *iter, *prev;
+
+   prev= 0;
+   iter= gVideoFbs;
+   while( iter )
+   {
+      if ( iter == fb )
+      {
+         if ( prev )
+         {
+            prev->next= fb->next;
+         }
+         else
+         {
+            gVideoFbs= fb->next;
+         }
+         break;
+      }
+      prev= iter;
+      iter= iter->next;
+   }
+}
+
+static void wstReleaseVideoFb( uint32_t fbId, uint32_t handle0, uint32_t handle1, int line )
+{
+   VideoFb *fb;
+   bool remove= true;
+
+   pthread_mutex_lock( &gFbMutex );
+   fb= gVideoFbs;
+   while( fb )
+   {
+      if ( fb->fbId == fbId )
+      {
+         remove= false;
+         if ( (--fb->refCnt <= 0) && !fb->cached )
+         {
+            wstVideoFbUnlink( fb );
+            free( fb );
+            remove= true;
+         }
+         break;
+      }
+      fb= fb->next;
+   }
+   pthread_mutex_unlock( &gFbMutex );
+
+   if ( remove )
+   {
+      wstUpdateResources( WSTRES_FB_VIDEO, false, fbId, line);
+      drmModeRmFB( gCtx->drmFd, fbId );
+      wstClosePrimeFDHandles( gCtx, handle0, handle1, line );
+   }
+}
+
+/*
+ * Identify the memory behind a frame's dmabufs by their GEM handles.  Importing
+ * a dmabuf whose object is already open on the drm fd yields the existing
+ * handle, and cached fbs hold their handles open, so a handle cannot be reused
+ * for different memory while an entry keyed on it exists.  Dmabuf inode numbers
+ * are not usable here since older kernels give all dmabufs the same inode.
+ */
+static bool wstVideoFbKeyInit( VideoFbKey *key, int fd0, int fd1, int bufferId )
+{
+   bool result= false;
+   int rc;
+
+   memset( key, 0, sizeof(VideoFbKey) );
+   key->bufferId= bufferId;
+   rc= drmPrimeFDToHandle( gCtx->drmFd, fd0, &key->handle0 );
+   if ( !rc )
+   {
+      key->handle1= key->handle0;
+      if ( fd1 >= 0 )
+      {
+         rc= drmPrimeFDToHandle( gCtx->drmFd, fd1, &key->handle1 );
+      }
+      result= (rc == 0);
+   }
+
+   return result;
+}
+
+static VideoFb* wstVideoFbCacheAcquire( VideoServerConnection *conn, VideoFbKey *key )
+{
+   VideoFb *fb= 0;
+   int i;
+
+   for( i= 0; i < conn->fbCacheCount; ++i )
+   {
+      VideoFbCacheEntry *entry= &conn->fbCache[i];
+      if ( (entry->key.frameWidth != key->frameWidth) ||
+           (entry->key.frameHeight != key->frameHeight) ||
+           (entry->key.frameFormat != key->frameFormat) )
+      {
+         /* Decoder output has changed resolution or format so none of the cached fbs can be used again */
+         DEBUG("video fb cache: frame change %dx%d %X to %dx%d %X",
+               entry->key.frameWidth, entry->key.frameHeight, entry->key.frameFormat,
+               key->frameWidth, key->frameHeight, key->frameFormat );
+         wstVideoFbCacheClear( conn );
+         break;
+      }
+      if ( entry->key.bufferId == key->bufferId )
+      {
+         if ( memcmp( &entry->key, key, sizeof(VideoFbKey) ) == 0 )
+         {
+            fb= entry->fb;
+            pthread_mutex_lock( &gFbMutex );
+            ++fb->refCnt;
+            pthread_mutex_unlock( &gFbMutex );
+         }
+         else
+         {
+            /* Same decoder buffer id now refers to different memory or a different crop */
+            wstVideoFbCacheEvict( conn, i );
+         }
+         break;
+      }
+   }
+
+   return fb;
+}
+
+static void wstVideoFbCacheAdd( VideoServerConnection *conn, VideoFbKey *key, uint32_t fbId, uint32_t handle0, uint32_t handle1 )
+{
+   VideoFb *fb;
+   VideoFbCacheEntry *entry;
+
+   fb= (VideoFb*)calloc( 1, sizeof(VideoFb) );
+   if ( !fb )
+   {
+      /* The frame still owns the fb and will remove it when freed */
+      ERROR("No memory for video fb cache entry");
+      return;
+   }
+   fb->fbId= fbId;
+   fb->handle0= handle0;
+   fb->handle1= handle1;
+   fb->refCnt= 1;
+   fb->cached= true;
+
+   if ( conn->fbCacheCount >= VIDEO_FB_CACHE_SIZE )
+   {
+      /* Evict the oldest entry */
+      wstVideoFbCacheEvict( conn, 0 );
+   }
+   entry= &conn->fbCache[conn->fbCacheCount++];
+   memcpy( &entry->key, key, sizeof(VideoFbKey) );
+   entry->fb= fb;
+
+   pthread_mutex_lock( &gFbMutex );
+   fb->next= gVideoFbs;
+   gVideoFbs= fb;
+   pthread_mutex_unlock( &gFbMutex );
+
+   TRACE2("video fb cache: add buffer %d fbId %u count %d", key->bufferId, fbId, conn->fbCacheCount);
+}
+
+static void wstVideoFbCacheEvict( VideoServerConnection *conn, int index )
+{
+   VideoFb *fb= conn->fbCache[index].fb;
+   uint32_t fbId= fb->fbId;
+   uint32_t handle0= fb->handle0;
+   uint32_t handle1= fb->handle1;
+   bool remove;
+
+   pthread_mutex_lock( &gFbMutex );
+   fb->cached= false;
+   remove= (fb->refCnt <= 0);
+   if ( remove )
+   {
+      wstVideoFbUnlink( fb );
+      free( fb );
+   }
+   pthread_mutex_unlock( &gFbMutex );
+
+   if ( remove )
+   {
+      wstUpdateResources( WSTRES_FB_VIDEO, false, fbId, __LINE__);
+      drmModeRmFB( gCtx->drmFd, fbId );
+      wstClosePrimeFDHandles( gCtx, handle0, handle1, __LINE__ );
+   }
+
+   --conn->fbCacheCount;
+   if ( index < conn->fbCacheCount )
+   {
+      memmove( &conn->fbCache[index], &conn->fbCache[index+1], (conn->fbCacheCount-index)*sizeof(VideoFbCacheEntry) );
+   }
+}
+
+static void wstVideoFbCacheClear( VideoServerConnection *conn )
+{
+   while( conn->fbCacheCount > 0 )
+   {
+      wstVideoFbCacheEvict( conn, conn->fbCacheCount-1 );
+   }
+}
+
 static void wstSetVideoFrameRect( VideoFrame *vf, int rectX, int rectY, int rectW, int rectH, uint32_t *skipX, uint32_t *skipY )
 {
    uint32_t frameWidth, frameHeight;
@@ -1287,10 +1830,8 @@ static void wstFreeVideoFrameResources( VideoFrame *f )
       }
       if ( f->fbId )
       {
-         wstUpdateResources( WSTRES_FB_VIDEO, false, f->fbId, __LINE__);
-         drmModeRmFB( gCtx->drmFd, f->fbId );
+         wstReleaseVideoFb( f->fbId, f->handle0, f->handle1, __LINE__ );
          f->fbId= 0;
-         wstClosePrimeFDHandles( gCtx, f->handle0, f->handle1, __LINE__ );
          f->handle0= 0;
          f->handle1= 0;
       }
@@ -1310,6 +1851,11 @@ static void wstFreeVideoFrameResources( VideoFrame *f )
             f->fd2= -1;
          }
       }
+      if ( f->fenceFd >= 0 )
+      {
+         close( f->fenceFd );
+         f->fenceFd= -1;
+      }
    }
 }
 
@@ -1342,7 +1888,7 @@ static void wstVideoServerFlush( VideoServerConnection *conn )
 
    DEBUG("wstVideoServerFlush: enter");
 
-   wstOffloadFlushConn( conn );
+   wstVideoFbCacheClear( conn );
 
    if ( conn->videoPlane->vfm )
    {
@@ -1454,6 +2000,26 @@ static void wstVideoServerSendBufferRelease( VideoServerConnection *conn, int bu
 
    pthread_mutex_lock( &conn->mutex );
 
+   if ( conn->ring )
+   {
+      VideoRingShm *ring= conn->ring;
+      uint32_t head= ring->releaseHead;
+      if ( head-__atomic_load_n( &ring->releaseTail, __ATOMIC_ACQUIRE ) < VIDEO_RING_CAPACITY )
+      {
+         uint64_t value= 1;
+         ring->releases[head & (VIDEO_RING_CAPACITY-1)]= bufferId;
+         __atomic_store_n( &ring->releaseHead, head+1, __ATOMIC_RELEASE );
+         if ( write( conn->releaseDoorbellFd, &value, sizeof(value) ) != sizeof(value) )
+         {
+            TRACE1("wstVideoServerSendBufferRelease: doorbell write failed: errno %d", errno);
+         }
+         FRAME("ring release buffer %d to client", bufferId);
+         pthread_mutex_unlock( &conn->mutex );
+         return;
+      }
+      /* Release ring full: fall back to a socket message */
+   }
+
    msg.msg_name= NULL;
    msg.msg_namelen= 0;
    msg.msg_iov= iov;
@@ -1486,11 +2052,11 @@ static void wstVideoServerSendBufferRelease( VideoServerConnection *conn, int bu
    pthread_mutex_unlock( &conn->mutex );
 }
 
-static void wstVideoServerSendStatus( VideoServerConnection *conn, long long displayedFrameTime, int dropFrameCount )
+static void wstVideoServerSendProtocolVersion( VideoServerConnection *conn, int version )
 {
    struct msghdr msg;
    struct iovec iov[1];
-   unsigned char mbody[4+8+4];
+   unsigned char mbody[4+4];
    int len;
    int sentLen;
 
@@ -1507,10 +2073,9 @@ static void wstVideoServerSendStatus( VideoServerConnection *conn, long long dis
    len= 0;
    mbody[len++]= 'V';
    mbody[len++]= 'S';
-   mbody[len++]= 13;
-   mbody[len++]= 'S';
-   len += wstPutS64( &mbody[len], displayedFrameTime );
-   len += wstPutU32( &mbody[len], dropFrameCount );
+   mbody[len++]= 5;
+   mbody[len++]= 'N';
+   len += wstPutU32( &mbody[4], version );
 
    iov[0].iov_base= (char*)mbody;
    iov[0].iov_len= len;
@@ -1523,17 +2088,17 @@ static void wstVideoServerSendStatus( VideoServerConnection *conn, long long dis
 
    if ( sentLen == len )
    {
-      FRAME("send status: frameTime %lld dropCount %d to client", displayedFrameTime, dropFrameCount);
+      DEBUG("sent protocol version %d to client", version);
    }
 
    pthread_mutex_unlock( &conn->mutex );
 }
 
-static void wstVideoServerSendUnderflow( VideoServerConnection *conn, long long displayedFrameTime )
+static void wstVideoServerSendRingStatus( VideoServerConnection *conn, bool active )
 {
    struct msghdr msg;
    struct iovec iov[1];
-   unsigned char mbody[4+8];
+   unsigned char mbody[4+4];
    int len;
    int sentLen;
 
@@ -1550,9 +2115,9 @@ static void wstVideoServerSendUnderflow( VideoServerConnection *conn, long long
    len= 0;
    mbody[len++]= 'V';
    mbody[len++]= 'S';
-   mbody[len++]= 9;
-   mbody[len++]= 'U';
-   len += wstPutS64( &mbody[len], displayedFrameTime );
+   mbody[len++]= 5;
+   mbody[len++]= 'M';
+   len += wstPutU32( &mbody[4], (active ? 1 : 0) );
 
    iov[0].iov_base= (char*)mbody;
    iov[0].iov_len= len;
@@ -1565,17 +2130,17 @@ static void wstVideoServerSendUnderflow( VideoServerConnection *conn, long long
 
    if ( sentLen == len )
    {
-      FRAME("send underflow: frameTime %lld to client", displayedFrameTime);
+      DEBUG("sent frame ring status %d to client", active);
    }
 
    pthread_mutex_unlock( &conn->mutex );
 }
 
-static void wstVideoServerSendZoomMode( VideoServerConnection *conn, WstGLCtx *ctx, int zoomMode )
+static void wstVideoServerSendStatus( VideoServerConnection *conn, long long displayedFrameTime, int dropFrameCount )
 {
    struct msghdr msg;
    struct iovec iov[1];
-   unsigned char mbody[4+4+4+4];
+   unsigned char mbody[4+8+4];
    int len;
    int sentLen;
 
@@ -1593,10 +2158,9 @@ static void wstVideoServerSendZoomMode( VideoServerConnection *conn, WstGLCtx *c
    mbody[len++]= 'V';
    mbody[len++]= 'S';
    mbody[len++]= 13;
-   mbody[len++]= 'Z';
-   len += wstPutU32( &mbody[len], ctx->globalZoomActive );
-   len += wstPutU32( &mbody[len], ctx->allow4kZoom );
-   len += wstPutU32( &mbody[len], zoomMode );
+   mbody[len++]= 'S';
+   len += wstPutS64( &mbody[len], displayedFrameTime );
+   len += wstPutU32( &mbody[len], dropFrameCount );
 
    iov[0].iov_base= (char*)mbody;
    iov[0].iov_len= len;
@@ -1609,19 +2173,17 @@ static void wstVideoServerSendZoomMode( VideoServerConnection *conn, WstGLCtx *c
 
    if ( sentLen == len )
    {
-      DEBUG("sent zoomMode %d to client", zoomMode);
-      conn->zoomPolicyVersion= ctx->zoomPolicyVersion;
-      conn->zoomMode= zoomMode;
+      FRAME("send status: frameTime %lld dropCount %d to client", displayedFrameTime, dropFrameCount);
    }
 
    pthread_mutex_unlock( &conn->mutex );
 }
 
-static void wstVideoServerSendDebugLevel( VideoServerConnection *conn, int debugLevel )
+static void wstVideoServerSendUnderflow( VideoServerConnection *conn, long long displayedFrameTime )
 {
    struct msghdr msg;
    struct iovec iov[1];
-   unsigned char mbody[4+4];
+   unsigned char mbody[4+8];
    int len;
    int sentLen;
 
@@ -1638,9 +2200,9 @@ static void wstVideoServerSendDebugLevel( VideoServerConnection *conn, int debug
    len= 0;
    mbody[len++]= 'V';
    mbody[len++]= 'S';
-   mbody[len++]= 5;
-   mbody[len++]= 'D';
-   len += wstPutU32( &mbody[4], debugLevel );
+   mbody[len++]= 9;
+   mbody[len++]= 'U';
+   len += wstPutS64( &mbody[len], displayedFrameTime );
 
    iov[0].iov_base= (char*)mbody;
    iov[0].iov_len= len;
@@ -1653,566 +2215,1101 @@ static void wstVideoServerSendDebugLevel( VideoServerConnection *conn, int debug
 
    if ( sentLen == len )
    {
-      DEBUG("sent videoDebugLevel %d to client", debugLevel);
-      conn->videoDebugLevel= debugLevel;
+      FRAME("send underflow: frameTime %lld to client", displayedFrameTime);
    }
 
    pthread_mutex_unlock( &conn->mutex );
 }
 
-static int wstAdaptFd( int fdin )
-{
-   int fdout= fdin;
-   if ( fdin >= 0 )
-   {
-      int fddup= fcntl( fdin, F_DUPFD_CLOEXEC, 0 );
-      if ( fddup >= 0 )
-      {
-         close( fdin );
-         fdout= fddup;
-      }
-   }
-   return fdout;
-}
-
-static void *wstVideoServerConnectionThread( void *arg )
+static void wstVideoServerSendZoomMode( VideoServerConnection *conn, WstGLCtx *ctx, int zoomMode )
 {
-   VideoServerConnection *conn= (VideoServerConnection*)arg;
    struct msghdr msg;
-   struct cmsghdr *cmsg;
    struct iovec iov[1];
-   unsigned char mbody[4+64];
-   char cmbody[CMSG_SPACE(3*sizeof(int))];
-   int moff= 0, len, i, rc;
-   uint32_t fbId= 0;
-   uint32_t frameWidth, frameHeight;
-   uint32_t frameFormat;
-   uint32_t frameSkipX, frameSkipY;
-   int rectX, rectY, rectW, rectH;
-   int fd0, fd1, fd2;
-   int offset0, offset1, offset2;
-   int stride0, stride1, stride2;
-   int bufferId= 0;
-   int bufferIdRel;
-   long long frameTime= 0;
-   VideoFrame videoFrame;
-
-   DEBUG("wstVideoServerConnectionThread: enter");
+   unsigned char mbody[4+4+4+4];
+   int len;
+   int sentLen;
 
-   conn->zoomMode= -1;
-   conn->zoomPolicyVersion= -1;
-   conn->videoDebugLevel= -1;
+   pthread_mutex_lock( &conn->mutex );
 
-   conn->threadStarted= true;
-   while( !conn->threadStopRequested )
+   msg.msg_name= NULL;
+   msg.msg_namelen= 0;
+   msg.msg_iov= iov;
+   msg.msg_iovlen= 1;
+   msg.msg_control= 0;
+   msg.msg_controllen= 0;
+   msg.msg_flags= 0;
+
+   len= 0;
+   mbody[len++]= 'V';
+   mbody[len++]= 'S';
+   mbody[len++]= 13;
+   mbody[len++]= 'Z';
+   len += wstPutU32( &mbody[len], ctx->globalZoomActive );
+   len += wstPutU32( &mbody[len], ctx->allow4kZoom );
+   len += wstPutU32( &mbody[len], zoomMode );
+
+   iov[0].iov_base= (char*)mbody;
+   iov[0].iov_len= len;
+
+   do
+   {
+      sentLen= sendmsg( conn->socketFd, &msg, MSG_NOSIGNAL );
+   }
+   while ( (sentLen < 0) && (errno == EINTR));
+
+   if ( sentLen == len )
    {
-      if ( gCtx->modeInfo && gCtx->modeInfo->vrefresh != conn->refreshRate )
+      DEBUG("sent zoomMode %d to client", zoomMode);
+      conn->zoomPolicyVersion= ctx->zoomPolicyVersion;
+      conn->zoomMode= zoomMode;
+   }
+
+   pthread_mutex_unlock( &conn->mutex );
+}
+
+static void wstVideoServerSendDebugLevel( VideoServerConnection *conn, int debugLevel )
+{
+   struct msghdr msg;
+   struct iovec iov[1];
+   unsigned char mbody[4+4];
+   int len;
+   int sentLen;
+
+   pthread_mutex_lock( &conn->mutex );
+
+   msg.msg_name= NULL;
+   msg.msg_namelen= 0;
+   msg.msg_iov= iov;
+   msg.msg_iovlen= 1;
+   msg.msg_control= 0;
+   msg.msg_controllen= 0;
+   msg.msg_flags= 0;
+
+   len= 0;
+   mbody[len++]= 'V';
+   mbody[len++]= 'S';
+   mbody[len++]= 5;
+   mbody[len++]= 'D';
+   len += wstPutU32( &mbody[4], debugLevel );
+
+   iov[0].iov_base= (char*)mbody;
+   iov[0].iov_len= len;
+
+   do
+   {
+      sentLen= sendmsg( conn->socketFd, &msg, MSG_NOSIGNAL );
+   }
+   while ( (sentLen < 0) && (errno == EINTR));
+
+   if ( sentLen == len )
+   {
+      DEBUG("sent videoDebugLevel %d to client", debugLevel);
+      conn->videoDebugLevel= debugLevel;
+   }
+
+   pthread_mutex_unlock( &conn->mutex );
+}
+
+static int wstAdaptFd( int fdin )
+{
+   int fdout= fdin;
+   if ( fdin >= 0 )
+   {
+      int fddup= fcntl( fdin, F_DUPFD_CLOEXEC, 0 );
+      if ( fddup >= 0 )
       {
-         wstVideoServerSendRefreshRate( conn, gCtx->modeInfo->vrefresh );
+         close( fdin );
+         fdout= fddup;
       }
-      if ( (gCtx->zoomPolicyVersion != conn->zoomPolicyVersion) ||
-           ((gCtx->zoomMode != -1) && (gCtx->zoomMode != conn->zoomMode)) )
+   }
+   return fdout;
+}
+
+static void wstVideoServerSendUpdates( VideoServerConnection *conn )
+{
+   if ( gCtx->modeInfo && gCtx->modeInfo->vrefresh != conn->refreshRate )
+   {
+      wstVideoServerSendRefreshRate( conn, gCtx->modeInfo->vrefresh );
+   }
+   if ( (gCtx->zoomPolicyVersion != conn->zoomPolicyVersion) ||
+        ((gCtx->zoomMode != -1) && (gCtx->zoomMode != conn->zoomMode)) )
+   {
+      wstVideoServerSendZoomMode( conn, gCtx, gCtx->zoomMode );
+   }
+   if ( (gCtx->videoDebugLevel != -1) && (gCtx->videoDebugLevel != conn->videoDebugLevel) )
+   {
+      wstVideoServerSendDebugLevel( conn, gCtx->videoDebugLevel );
+   }
+}
+
+/*
+ * Queue a frame received from a client for display.  Frames from the
+ * shared memory ring use the connection's registered buffer fds, which stay
+ * owned by the pool.  Otherwise the frame takes ownership of the fds on
+ * success.
+ */
+static bool wstVideoServerQueueFrame( VideoServerConnection *conn, VideoRingFrame *desc, int fd0, int fd1, int fd2, int fenceFd, bool pooled )
+{
+   int rc;
+   uint32_t fbId= 0;
+   uint32_t handle0, handle1;
+   uint32_t frameWidth, frameHeight;
+   uint32_t frameSkipX, frameSkipY;
+   VideoFbKey fbKey;
+   VideoFb *fb;
+   bool haveFbKey;
+   VideoFrame videoFrame;
+
+   if ( !conn->videoPlane )
+   {
+      ERROR("wstVideoServerQueueFrame: no video plane for conn %p", conn);
+      return false;
+   }
+
+   memset( &videoFrame, 0, sizeof(videoFrame) );
+
+   frameWidth= (desc->frameWidth & ~1);
+   frameHeight= ((desc->frameHeight+1) & ~1);
+   FRAME("got frame %d buffer %d frameTime %lld%s", conn->videoPlane->frameCount, desc->bufferId, desc->frameTime, (pooled ? " (ring)" : ""));
+
+   TRACE2("got frame fd %d,%d,%d fence %d (%dx%d) %X (%d, %d, %d, %d) off(%d, %d, %d) stride(%d, %d, %d)",
+          fd0, fd1, fd2, fenceFd, frameWidth, frameHeight, desc->frameFormat,
+          desc->rectX, desc->rectY, desc->rectW, desc->rectH,
+          desc->offset[0], desc->offset[1], desc->offset[2], desc->stride[0], desc->stride[1], desc->stride[2] );
+
+   videoFrame.frameWidth= frameWidth;
+   videoFrame.frameHeight= frameHeight;
+   wstSetVideoFrameRect( &videoFrame, desc->rectX, desc->rectY, desc->rectW, desc->rectH, &frameSkipX, &frameSkipY );
+
+   fb= 0;
+   haveFbKey= wstVideoFbKeyInit( &fbKey, fd0, fd1, desc->bufferId );
+   if ( haveFbKey )
+   {
+      fbKey.frameWidth= frameWidth;
+      fbKey.frameHeight= frameHeight;
+      fbKey.frameFormat= desc->frameFormat;
+      fbKey.offset0= desc->offset[0];
+      fbKey.stride0= desc->stride[0];
+      fbKey.offset1= desc->offset[1];
+      fbKey.stride1= desc->stride[1];
+      fbKey.skipX= frameSkipX;
+      fbKey.skipY= frameSkipY;
+      fb= wstVideoFbCacheAcquire( conn, &fbKey );
+   }
+   if ( fb )
+   {
+      /* Reuse the fb already created for this decoder buffer */
+      fbId= fb->fbId;
+      handle0= fb->handle0;
+      handle1= fb->handle1;
+      rc= 0;
+   }
+   else
+   {
+      /* Import again: a cache eviction above may have closed the handles in the key */
+      rc= drmPrimeFDToHandle( gCtx->drmFd, fd0, &handle0 );
+      if ( !rc )
       {
-         wstVideoServerSendZoomMode( conn, gCtx, gCtx->zoomMode );
+         wstUpdateResources( WSTRES_HD_VIDEO, true, handle0, __LINE__);
+         handle1= handle0;
+         if ( fd1 >= 0 )
+         {
+            rc= drmPrimeFDToHandle( gCtx->drmFd, fd1, &handle1 );
+            if ( !rc )
+            {
+               wstUpdateResources( WSTRES_HD_VIDEO, true, handle1, __LINE__);
+            }
+         }
       }
-      if ( (gCtx->videoDebugLevel != -1) && (gCtx->videoDebugLevel != conn->videoDebugLevel) )
+      if ( !rc )
+      {
+         uint32_t handles[4]= { handle0,
+                                handle1,
+                                0,
+                                0 };
+         uint32_t pitches[4]= { desc->stride[0],
+                                desc->stride[1],
+                                0,
+                                0 };
+         uint32_t offsets[4]= { desc->offset[0]+frameSkipX+frameSkipY*desc->stride[0],
+                                desc->offset[1]+frameSkipX+frameSkipY*(desc->stride[1]/2),
+                                0,
+                                0};
+
+         rc= drmModeAddFB2( gCtx->drmFd,
+                            frameWidth-frameSkipX,
+                            frameHeight-frameSkipY,
+                            desc->frameFormat,
+                            handles,
+                            pitches,
+                            offsets,
+                            &fbId,
+                            0 // flags
+                          );
+         if ( !rc )
+         {
+            wstUpdateResources( WSTRES_FB_VIDEO, true, fbId, __LINE__);
+            if ( haveFbKey )
+            {
+               wstVideoFbCacheAdd( conn, &fbKey, fbId, handle0, handle1 );
+            }
+         }
+         else
+         {
+            ERROR("wstVideoServerQueueFrame: drmModeAddFB2 failed: rc %d errno %d", rc, errno);
+            wstClosePrimeFDHandles( gCtx, handle0, handle1, __LINE__ );
+         }
+      }
+      else
       {
-         wstVideoServerSendDebugLevel( conn, gCtx->videoDebugLevel );
+         ERROR("wstVideoServerQueueFrame: drmPrimeFDToHandle failed: rc %d errno %d", rc, errno);
       }
+   }
+   if ( !rc )
+   {
+      videoFrame.plane= conn->videoPlane;
+      videoFrame.hide= false;
+      videoFrame.fbId= fbId;
+      videoFrame.handle0= handle0;
+      videoFrame.handle1= handle1;
+      videoFrame.fd0= (pooled ? -1 : fd0);
+      videoFrame.fd1= (pooled ? -1 : fd1);
+      videoFrame.fd2= (pooled ? -1 : fd2);
+      videoFrame.fenceFd= fenceFd;
+      videoFrame.frameFormat= desc->frameFormat;
+      videoFrame.bufferId= desc->bufferId;
+      videoFrame.frameTime= desc->frameTime;
+      videoFrame.frameNumber= conn->videoPlane->frameCount++;
+      videoFrame.vf= 0;
+      videoFrame.canExpire= true;
+      videoFrame.dropped= false;
+      conn->videoPlane->hidden= false;
+      wstVideoFrameManagerPushFrame( conn->videoPlane->vfm, &videoFrame );
+   }
 
-      iov[0].iov_base= (char*)mbody;
-      iov[0].iov_len= 4;
+   return (rc == 0);
+}
 
-      cmsg= (struct cmsghdr*)cmbody;
-      cmsg->cmsg_len= CMSG_LEN(3*sizeof(int));
-      cmsg->cmsg_level= SOL_SOCKET;
-      cmsg->cmsg_type= SCM_RIGHTS;
+/*
+ * Receive and handle one message from a video client.  Returns false if the
+ * peer has disconnected or the connection can no longer be serviced.
+ */
+static bool wstVideoServerProcessMessage( VideoServerConnection *conn )
+{
+   struct msghdr msg;
+   struct cmsghdr *cmsg;
+   struct iovec iov[1];
+   unsigned char mbody[4+68];
+   char cmbody[CMSG_SPACE(4*sizeof(int))];
+   int moff= 0, len, i;
+   int rectX, rectY, rectW, rectH;
+   int fd0, fd1, fd2, fd3, fenceFd;
+   int numFds;
+   int bufferIdRel;
+   int recvFlags;
+   bool result= true;
 
-      msg.msg_name= NULL;
-      msg.msg_namelen= 0;
-      msg.msg_iov= iov;
-      msg.msg_iovlen= 1;
-      msg.msg_control= cmsg;
-      msg.msg_controllen= cmsg->cmsg_len;
-      msg.msg_flags= 0;
+   iov[0].iov_base= (char*)mbody;
+   iov[0].iov_len= 4;
 
-      do
+   cmsg= (struct cmsghdr*)cmbody;
+   cmsg->cmsg_len= CMSG_LEN(4*sizeof(int));
+   cmsg->cmsg_level= SOL_SOCKET;
+   cmsg->cmsg_type= SCM_RIGHTS;
+
+   msg.msg_name= NULL;
+   msg.msg_namelen= 0;
+   msg.msg_iov= iov;
+   msg.msg_iovlen= 1;
+   msg.msg_control= cmsg;
+   msg.msg_controllen= cmsg->cmsg_len;
+   msg.msg_flags= 0;
+
+   /* The epoll server thread must never block on one client */
+   recvFlags= (conn->server->useEpoll ? MSG_DONTWAIT : 0);
+
+   do
+   {
+      len= recvmsg( conn->socketFd, &msg, recvFlags );
+   }
+   while ( (len < 0) && (errno == EINTR));
+
+   if ( (len < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)) )
+   {
+      goto exit;
+   }
+
+   if ( len > 0 )
+   {
+      fd0= fd1= fd2= fd3= fenceFd= -1;
+      numFds= 0;
+
+      if ( g_activeLevel >= 7 )
       {
-         len= recvmsg( conn->socketFd, &msg, 0 );
+         wstDumpMessage( mbody, len );
       }
-      while ( (len < 0) && (errno == EINTR));
-
-      if ( len > 0 )
+      if ( len == 4 )
       {
-         fd0= fd1= fd2= -1;
-
-         if ( g_activeLevel >= 7 )
-         {
-            wstDumpMessage( mbody, len );
-         }
-         if ( len == 4 )
+         unsigned char *m= mbody;
+         if ( (m[0] == 'V') && (m[1] == 'S') )
          {
-            unsigned char *m= mbody;
-            if ( (m[0] == 'V') && (m[1] == 'S') )
+            int mlen, id;
+            mlen= m[2];
+            id= m[3];
+            switch( id )
             {
-               int mlen, id;
-               mlen= m[2];
-               id= m[3];
-               switch( id )
-               {
-                  case 'F':
-                  #ifdef USE_GENERIC_AVSYNC
-                  case 'I':
-                  #endif
-                     cmsg= CMSG_FIRSTHDR(&msg);
-                     if ( cmsg &&
-                          cmsg->cmsg_level == SOL_SOCKET &&
-                          cmsg->cmsg_type == SCM_RIGHTS &&
-                          cmsg->cmsg_len >= CMSG_LEN(sizeof(int)) )
+               case 'F':
+               case 'M':
+               case 'O':
+               #ifdef USE_GENERIC_AVSYNC
+               case 'I':
+               #endif
+                  cmsg= CMSG_FIRSTHDR(&msg);
+                  if ( cmsg &&
+                       cmsg->cmsg_level == SOL_SOCKET &&
+                       cmsg->cmsg_type == SCM_RIGHTS &&
+                       cmsg->cmsg_len >= CMSG_LEN(sizeof(int)) )
+                  {
+                     fd0 = wstAdaptFd( ((int*)CMSG_DATA(cmsg))[0] );
+                     numFds= 1;
+                     if ( cmsg->cmsg_len >= CMSG_LEN(2*sizeof(int)) )
                      {
-                        fd0 = wstAdaptFd( ((int*)CMSG_DATA(cmsg))[0] );
-                        if ( cmsg->cmsg_len >= CMSG_LEN(2*sizeof(int)) )
-                        {
-                           fd1 = wstAdaptFd( ((int*)CMSG_DATA(cmsg))[1] );
-                        }
-                        if ( cmsg->cmsg_len >= CMSG_LEN(3*sizeof(int)) )
-                        {
-                           fd2 = wstAdaptFd( ((int*)CMSG_DATA(cmsg))[2] );
-                        }
+                        fd1 = wstAdaptFd( ((int*)CMSG_DATA(cmsg))[1] );
+                        numFds= 2;
                      }
-                     break;
-                  default:
-                     break;
-               }
+                     if ( cmsg->cmsg_len >= CMSG_LEN(3*sizeof(int)) )
+                     {
+                        fd2 = wstAdaptFd( ((int*)CMSG_DATA(cmsg))[2] );
+                        numFds= 3;
+                     }
+                     if ( cmsg->cmsg_len >= CMSG_LEN(4*sizeof(int)) )
+                     {
+                        fd3 = wstAdaptFd( ((int*)CMSG_DATA(cmsg))[3] );
+                        numFds= 4;
+                     }
+                  }
+                  break;
+               default:
+                  break;
+            }
 
-               if ( mlen > sizeof(mbody) )
+            if ( mlen > sizeof(mbody) )
+            {
+               ERROR("bad message length: %d : truncating");
+               mlen= sizeof(mbody);
+            }
+            if ( mlen > 1 )
+            {
+               iov[0].iov_base= (char*)mbody+4;
+               iov[0].iov_len= mlen-1;
+
+               msg.msg_name= NULL;
+               msg.msg_namelen= 0;
+               msg.msg_iov= iov;
+               msg.msg_iovlen= 1;
+               msg.msg_control= 0;
+               msg.msg_controllen= 0;
+               msg.msg_flags= 0;
+
+               /* A message is sent whole so its body is queued with its header */
+               do
                {
-                  ERROR("bad message length: %d : truncating");
-                  mlen= sizeof(mbody);
+                  len= recvmsg( conn->socketFd, &msg, recvFlags );
                }
-               if ( mlen > 1 )
+               while ( (len < 0) && (errno == EINTR));
+            }
+
+            if ( len > 0 )
+            {
+               len += 4;
+               m += 3;
+               if ( g_activeLevel >= 7 )
                {
-                  iov[0].iov_base= (char*)mbody+4;
-                  iov[0].iov_len= mlen-1;
-
-                  msg.msg_name= NULL;
-                  msg.msg_namelen= 0;
-                  msg.msg_iov= iov;
-                  msg.msg_iovlen= 1;
-                  msg.msg_control= 0;
-                  msg.msg_controllen= 0;
-                  msg.msg_flags= 0;
-
-                  do
-                  {
-                     len= recvmsg( conn->socketFd, &msg, 0 );
-                  }
-                  while ( (len < 0) && (errno == EINTR));
+                  wstDumpMessage( mbody, len );
                }
-
-               if ( len > 0 )
+               switch( id )
                {
-                  len += 4;
-                  m += 3;
-                  if ( g_activeLevel >= 7 )
-                  {
-                     wstDumpMessage( mbody, len );
-                  }
-                  switch( id )
-                  {
-                     case 'F':
-                        if ( fd0 >= 0 )
+                  case 'F':
+                     if ( fd0 >= 0 )
+                     {
+                        VideoRingFrame desc;
+
+                        wstUpdateResources( WSTRES_FD_VIDEO, true, fd0, __LINE__);
+                        desc.frameWidth= wstGetU32( m+1 );
+                        desc.frameHeight= wstGetU32( m+5 );
+                        desc.frameFormat= wstGetU32( m+9);
+                        desc.rectX= (int)wstGetU32( m+13 );
+                        desc.rectY= (int)wstGetU32( m+17 );
+                        desc.rectW= (int)wstGetU32( m+21 );
+                        desc.rectH= (int)wstGetU32( m+25 );
+                        desc.offset[0]= (int)wstGetU32( m+29 );
+                        desc.stride[0]= (int)wstGetU32( m+33 );
+                        desc.offset[1]= (int)wstGetU32( m+37 );
+                        desc.stride[1]= (int)wstGetU32( m+41 );
+                        desc.offset[2]= (int)wstGetU32( m+45 );
+                        desc.stride[2]= (int)wstGetU32( m+49 );
+                        desc.bufferId= (int)wstGetU32( m+53 );
+                        desc.frameTime= (long long)wstGetS64( m+57 );
+                        if ( (mlen >= 69) && (wstGetU32( m+65 ) & VIDEO_FRAME_FLAG_ACQUIRE_FENCE) )
                         {
-                           uint32_t handle0, handle1;
-
-                           wstUpdateResources( WSTRES_FD_VIDEO, true, fd0, __LINE__);
-                           frameWidth= (wstGetU32( m+1 ) & ~1);
-                           frameHeight= ((wstGetU32( m+5)+1) & ~1);
-                           frameFormat= wstGetU32( m+9);
-                           rectX= (int)wstGetU32( m+13 );
-                           rectY= (int)wstGetU32( m+17 );
-                           rectW= (int)wstGetU32( m+21 );
-                           rectH= (int)wstGetU32( m+25 );
-                           offset0= (int)wstGetU32( m+29 );
-                           stride0= (int)wstGetU32( m+33 );
-                           offset1= (int)wstGetU32( m+37 );
-                           stride1= (int)wstGetU32( m+41 );
-                           offset2= (int)wstGetU32( m+45 );
-                           stride2= (int)wstGetU32( m+49 );
-                           bufferId= (int)wstGetU32( m+53 );
-                           frameTime= (long long)wstGetS64( m+57 );
-                           FRAME("got frame %d buffer %d frameTime %lld", conn->videoPlane->frameCount, bufferId, frameTime);
-
-                           TRACE2("got frame fd %d,%d,%d (%dx%d) %X (%d, %d, %d, %d) off(%d, %d, %d) stride(%d, %d, %d)",
-                                  fd0, fd1, fd2, frameWidth, frameHeight, frameFormat, rectX, rectY, rectW, rectH,
-                                  offset0, offset1, offset2, stride0, stride1, stride2 );
-
-
-                           videoFrame.frameWidth= frameWidth;
-                           videoFrame.frameHeight= frameHeight;
-                           wstSetVideoFrameRect( &videoFrame, rectX, rectY, rectW, rectH, &frameSkipX, &frameSkipY );
-
-                           rc= drmPrimeFDToHandle( gCtx->drmFd, fd0, &handle0 );
-                           if ( !rc )
+                           /* The acquire fence is always the last fd sent with the frame */
+                           switch( numFds )
                            {
-                              wstUpdateResources( WSTRES_HD_VIDEO, true, handle0, __LINE__);
-                              handle1= handle0;
-                              if ( fd1 >= 0 )
-                              {
-                                 rc= drmPrimeFDToHandle( gCtx->drmFd, fd1, &handle1 );
-                                 if ( !rc )
-                                 {
-                                    wstUpdateResources( WSTRES_HD_VIDEO, true, handle1, __LINE__);
-                                 }
-                              }
+                              case 4:
+                                 fenceFd= fd3;
+                                 fd3= -1;
+                                 break;
+                              case 3:
+                                 fenceFd= fd2;
+                                 fd2= -1;
+                                 break;
+                              case 2:
+                                 fenceFd= fd1;
+                                 fd1= -1;
+                                 break;
+                              default:
+                                 break;
+                           }
+                        }
+
+                        if ( !wstVideoServerQueueFrame( conn, &desc, fd0, fd1, fd2, fenceFd, false ) )
+                        {
+                           wstUpdateResources( WSTRES_FD_VIDEO, false, fd0, __LINE__);
+                           close( fd0 );
+                           if ( fd1 >= 0 )
+                           {
+                              close( fd1 );
                            }
-                           if ( !rc )
+                           if ( fd2 >= 0 )
                            {
-                              uint32_t handles[4]= { handle0,
-                                                     handle1,
-                                                     0,
-                                                     0 };
-                              uint32_t pitches[4]= { stride0,
-                                                     stride1,
-                                                     0,
-                                                     0 };
-                              uint32_t offsets[4]= { offset0+frameSkipX+frameSkipY*stride0,
-                                                     offset1+frameSkipX+frameSkipY*(stride1/2),
-                                                     0,
-                                                     0};
-
-                              rc= drmModeAddFB2( gCtx->drmFd,
-                                                 frameWidth-frameSkipX,
-                                                 frameHeight-frameSkipY,
-                                                 frameFormat,
-                                                 handles,
-                                                 pitches,
-                                                 offsets,
-                                                 &fbId,
-                                                 0 // flags
-                                               );
-                              if ( !rc )
-                              {
-                                 wstUpdateResources( WSTRES_FB_VIDEO, true, fbId, __LINE__);
-                                 videoFrame.hide= false;
-                                 videoFrame.fbId= fbId;
-                                 videoFrame.handle0= handle0;
-                                 videoFrame.handle1= handle1;
-                                 videoFrame.fd0= fd0;
-                                 videoFrame.fd1= fd1;
-                                 videoFrame.fd2= fd2;
-                                 videoFrame.frameFormat= frameFormat;
-                                 videoFrame.bufferId= bufferId;
-                                 videoFrame.frameTime= frameTime;
-                                 videoFrame.frameNumber= conn->videoPlane->frameCount++;
-                                 videoFrame.vf= 0;
-                                 videoFrame.canExpire= true;
-                                 videoFrame.dropped= false;
-                                 conn->videoPlane->hidden= false;
-                                 wstVideoFrameManagerPushFrame( conn->videoPlane->vfm, &videoFrame );
-                              }
-                              else
-                              {
-                                 ERROR("wstVideoServerConnectionThread: drmModeAddFB2 failed: rc %d errno %d", rc, errno);
-                                 wstClosePrimeFDHandles( gCtx, handle0, handle1, __LINE__ );
-                                 wstUpdateResources( WSTRES_FD_VIDEO, false, fd0, __LINE__);
-                                 close( fd0 );
-                                 if ( fd1 >= 0 )
-                                 {
-                                    close( fd1 );
-                                 }
-                                 if ( fd2 >= 0 )
-                                 {
-                                    close( fd2 );
-                                 }
-                              }
+                              close( fd2 );
                            }
-                           else
+                           if ( fenceFd >= 0 )
                            {
-                              ERROR("wstVideoServerConnectionThread: drmPrimeFDToHandle failed: rc %d errno %d", rc, errno);
-                              wstUpdateResources( WSTRES_FD_VIDEO, false, fd0, __LINE__);
-                              close( fd0 );
-                              if ( fd1 >= 0 )
-                              {
-                                 close( fd1 );
-                              }
-                              if ( fd2 >= 0 )
-                              {
-                                 close( fd2 );
-                              }
+                              close( fenceFd );
                            }
                         }
-                        break;
-                     case 'V':
+                     }
+                     if ( fd3 >= 0 )
+                     {
+                        close( fd3 );
+                     }
+                     break;
+                  case 'N':
+                     {
+                        int version= (int)wstGetU32( m+1 );
+                        DEBUG("client %p requests protocol version %d", conn, version);
+                        if ( version > VIDEO_SERVER_PROTOCOL_VERSION )
                         {
-                           int videoResourceId= wstGetU32( m+1 );
-                           bool primary= (videoResourceId == 0);
-                           DEBUG("got video resource id %d from conn %p", videoResourceId, conn );
-                           if ( conn->videoPlane && (conn->videoPlane->videoResourceId != videoResourceId))
-                           {
-                              wstOverlayFree( &gCtx->overlayPlanes, conn->videoPlane );
-                              conn->videoPlane= 0;
-                           }
-                           if ( !conn->videoPlane )
+                           version= VIDEO_SERVER_PROTOCOL_VERSION;
+                        }
+                        conn->protocolVersion= version;
+                        wstVideoServerSendProtocolVersion( conn, version );
+                     }
+                     break;
+                  case 'M':
+                     {
+                        bool active= false;
+                        if ( (conn->protocolVersion >= 2) && (numFds == 3) )
+                        {
+                           active= wstVideoServerSetupRing( conn, fd0, fd1, fd2 );
+                        }
+                        else
+                        {
+                           ERROR("bad frame ring setup: version %d fd count %d", conn->protocolVersion, numFds);
+                           if ( fd0 >= 0 ) close( fd0 );
+                           if ( fd1 >= 0 ) close( fd1 );
+                           if ( fd2 >= 0 ) close( fd2 );
+                           if ( fd3 >= 0 ) close( fd3 );
+                        }
+                        wstVideoServerSendRingStatus( conn, active );
+                     }
+                     break;
+                  case 'X':
+                     DEBUG("conn %p: purge buffer pool", conn);
+                     wstVideoServerPurgePool( conn );
+                     /* Buffer ids are about to be reused for newly allocated buffers */
+                     wstVideoFbCacheClear( conn );
+                     break;
+                  case 'O':
+                     if ( fd0 >= 0 )
+                     {
+                        int bufferId= (int)wstGetU32( m+1 );
+                        wstVideoServerRegisterBuffer( conn, bufferId, fd0, fd1, fd2 );
+                        if ( fd3 >= 0 )
+                        {
+                           close( fd3 );
+                        }
+                     }
+                     break;
+                  case 'V':
+                     {
+                        int videoResourceId= wstGetU32( m+1 );
+                        bool primary= (videoResourceId == 0);
+                        DEBUG("got video resource id %d from conn %p", videoResourceId, conn );
+                        if ( conn->videoPlane && (conn->videoPlane->videoResourceId != videoResourceId))
+                        {
+                           wstOverlayFree( &gCtx->overlayPlanes, conn->videoPlane );
+                           conn->videoPlane= 0;
+                        }
+                        if ( !conn->videoPlane )
+                        {
+                           int retries= 3;
+                           pthread_mutex_lock( &gMutex );
+                           conn->videoPlane= wstOverlayAlloc( &gCtx->overlayPlanes, false, primary );
+                           pthread_mutex_unlock( &gMutex );
+                           while ( !conn->videoPlane )
                            {
-                              int retries= 3;
+                              long long delay= 16667*2LL;
+                              if ( gCtx->modeInfo && gCtx->modeInfo->vrefresh )
+                              {
+                                 delay= (1000000LL+(gCtx->modeInfo->vrefresh/2))/gCtx->modeInfo->vrefresh;
+                              }
+                              usleep( delay );
                               pthread_mutex_lock( &gMutex );
                               conn->videoPlane= wstOverlayAlloc( &gCtx->overlayPlanes, false, primary );
                               pthread_mutex_unlock( &gMutex );
-                              while ( !conn->videoPlane )
-                              {
-                                 long long delay= 16667*2LL;
-                                 if ( gCtx->modeInfo && gCtx->modeInfo->vrefresh )
-                                 {
-                                    delay= (1000000LL+(gCtx->modeInfo->vrefresh/2))/gCtx->modeInfo->vrefresh;
-                                 }
-                                 usleep( delay );
-                                 pthread_mutex_lock( &gMutex );
-                                 conn->videoPlane= wstOverlayAlloc( &gCtx->overlayPlanes, false, primary );
-                                 pthread_mutex_unlock( &gMutex );
-                                 if ( --retries <= 0 ) break;
-                              }
-                              INFO("video plane %p : zorder: %d videoResourceId %d",
-                                   conn->videoPlane, (conn->videoPlane ? conn->videoPlane->zOrder: -1), videoResourceId );
+                              if ( --retries <= 0 ) break;
+                           }
+                           INFO("video plane %p : zorder: %d videoResourceId %d",
+                                conn->videoPlane, (conn->videoPlane ? conn->videoPlane->zOrder: -1), videoResourceId );
 
-                              if ( !conn->videoPlane )
-                              {
-                                 ERROR("No video plane avaialble");
+                           if ( !conn->videoPlane )
+                           {
+                              ERROR("No video plane avaialble");
+                              result= false;
                                  goto exit;
-                              }
+                           }
 
-                              conn->videoResourceId= videoResourceId;
-                              conn->videoPlane->videoResourceId= videoResourceId;
+                           conn->videoResourceId= videoResourceId;
+                           conn->videoPlane->videoResourceId= videoResourceId;
 
-                              conn->videoPlane->vfm= wstCreateVideoFrameManager( conn );
-                              if ( !conn->videoPlane->vfm )
-                              {
-                                 ERROR("Unable to allocate vfm");
+                           conn->videoPlane->vfm= wstCreateVideoFrameManager( conn );
+                           if ( !conn->videoPlane->vfm )
+                           {
+                              ERROR("Unable to allocate vfm");
+                              result= false;
                                  goto exit;
-                              }
-
-                              videoFrame.plane= conn->videoPlane;
-                              for( i= 0; i < ACTIVE_FRAMES; ++i )
-                              {
-                                 conn->videoPlane->videoFrame[i].plane= conn->videoPlane;
-                              }
-
-                              conn->videoPlane->conn= conn;
                            }
-                        }
-                        break;
-                     case 'H':
-                        {
-                           bool hide= (m[1] == 1);
-                           DEBUG("got hide (%d) video plane %d", hide, conn->videoPlane->plane->plane_id);
-                           pthread_mutex_lock( &gMutex );
-                           gCtx->dirty= true;
-                           if ( conn->videoPlane->vfm->paused )
+
+                           for( i= 0; i < ACTIVE_FRAMES; ++i )
                            {
-                              gCtx->forceDirty= true;
-                              conn->videoPlane->readyToFlip= true;
+                              conn->videoPlane->videoFrame[i].plane= conn->videoPlane;
                            }
-                           conn->videoPlane->dirty= true;
-                           conn->videoPlane->hide= hide;
-                           pthread_mutex_unlock( &gMutex );
+
+                           conn->videoPlane->conn= conn;
                         }
-                        break;
-                     case 'S':
+                     }
+                     break;
+                  case 'H':
+                     {
+                        bool hide= (m[1] == 1);
+                        DEBUG("got hide (%d) video plane %d", hide, conn->videoPlane->plane->plane_id);
+                        pthread_mutex_lock( &gMutex );
+                        gCtx->dirty= true;
+                        if ( conn->videoPlane->vfm->paused )
                         {
-                           DEBUG("got flush video plane %d", conn->videoPlane->plane->plane_id);
-                           FRAME("got flush video plane %d", conn->videoPlane->plane->plane_id);
-                           pthread_mutex_lock( &gMutex );
-                           conn->videoPlane->flipTimeBase= 0LL;
-                           conn->videoPlane->frameTimeBase= 0LL;
-                           wstVideoServerFlush( conn );
-                           pthread_mutex_unlock( &gMutex );
+                           gCtx->forceDirty= true;
+                           conn->videoPlane->readyToFlip= true;
                         }
-                        break;
-                     case 'P':
+                        conn->videoPlane->dirty= true;
+                        conn->videoPlane->hide= hide;
+                        pthread_mutex_unlock( &gMutex );
+                     }
+                     break;
+                  case 'S':
+                     {
+                        DEBUG("got flush video plane %d", conn->videoPlane->plane->plane_id);
+                        FRAME("got flush video plane %d", conn->videoPlane->plane->plane_id);
+                        WstOffloadMsg *pending;
+                        pthread_mutex_lock( &gMutex );
+                        pending= wstOffloadTakeConn( conn );
+                        conn->videoPlane->flipTimeBase= 0LL;
+                        conn->videoPlane->frameTimeBase= 0LL;
+                        wstVideoServerFlush( conn );
+                        pthread_mutex_unlock( &gMutex );
+                        /* Releases can wait on video fences so run them without gMutex */
+                        wstOffloadRunConn( conn, pending );
+                     }
+                     break;
+                  case 'P':
+                     {
+                        float rate= 1.0;
+                        bool pause= (m[1] == 1);
+                        if ( mlen >= 10 )
                         {
-                           float rate= 1.0;
-                           bool pause= (m[1] == 1);
-                           if ( mlen >= 10 )
+                           int num= (int)wstGetU32( m+2 );
+                           int denom= (int)wstGetU32( m+6 );
+                           if ( denom )
                            {
-                              int num= (int)wstGetU32( m+2 );
-                              int denom= (int)wstGetU32( m+6 );
-                              if ( denom )
-                              {
-                                 rate= (float)num/(float)denom;
-                              }
+                              rate= (float)num/(float)denom;
                            }
-                           DEBUG("got pause (%d) rate (%f) video plane %d", pause, rate, conn->videoPlane->plane->plane_id);
-                           pthread_mutex_lock( &gMutex );
-                           conn->videoPlane->vfm->rate= rate;
-                           wstVideoFrameManagerPause( conn->videoPlane->vfm, pause );
-                           pthread_mutex_unlock( &gMutex );
                         }
-                        break;
-                     case 'I':
+                        DEBUG("got pause (%d) rate (%f) video plane %d", pause, rate, conn->videoPlane->plane->plane_id);
+                        pthread_mutex_lock( &gMutex );
+                        conn->videoPlane->vfm->rate= rate;
+                        wstVideoFrameManagerPause( conn->videoPlane->vfm, pause );
+                        pthread_mutex_unlock( &gMutex );
+                     }
+                     break;
+                  case 'I':
+                     {
+                        int syncType= m[1];
+                        int sessionId= wstGetU32( m+2 );
+                        DEBUG("got session info: sync type %d sessionId %d video plane %d", syncType, sessionId, conn->videoPlane->plane->plane_id);
+                        pthread_mutex_lock( &gMutex );
+                        if ( conn->videoPlane->vfm )
                         {
-                           int syncType= m[1];
-                           int sessionId= wstGetU32( m+2 );
-                           DEBUG("got session info: sync type %d sessionId %d video plane %d", syncType, sessionId, conn->videoPlane->plane->plane_id);
-                           pthread_mutex_lock( &gMutex );
-                           if ( conn->videoPlane->vfm )
+                           if (
+                                (conn->sessionId != sessionId) ||
+                                (syncType == SYNC_IMMEDIATE) ||
+                                (
+                                  (conn->syncType != syncType) &&
+                                  (
+                                    (conn->syncType > 1) || /* current not video, not audio */
+                                    (syncType > 1)  /* new not video, not audio */
+                                  )
+                                )
+                              )
                            {
-                              if (
-                                   (conn->sessionId != sessionId) ||
-                                   (syncType == SYNC_IMMEDIATE) ||
-                                   (
-                                     (conn->syncType != syncType) &&
-                                     (
-                                       (conn->syncType > 1) || /* current not video, not audio */
-                                       (syncType > 1)  /* new not video, not audio */
-                                     )
-                                   )
-                                 )
-                              {
-                                 wstDestroyVideoFrameManager( conn->videoPlane->vfm );
-                                 conn->videoPlane->vfm= 0;
-                              }
-                              else if ( conn->syncType != syncType )
-                              {
-                                 conn->syncType= syncType;
-                                 wstVideoFrameManagerSetSyncType( conn->videoPlane->vfm, syncType );
-                              }
+                              wstDestroyVideoFrameManager( conn->videoPlane->vfm );
+                              conn->videoPlane->vfm= 0;
                            }
-                           if ( !conn->videoPlane->vfm )
+                           else if ( conn->syncType != syncType )
                            {
                               conn->syncType= syncType;
-                              conn->sessionId= sessionId;
-                              conn->videoPlane->vfm= wstCreateVideoFrameManager( conn );
+                              wstVideoFrameManagerSetSyncType( conn->videoPlane->vfm, syncType );
                            }
-                           pthread_mutex_unlock( &gMutex );
-                           #ifdef WESTEROS_GL_AVSYNC
-                           if ( conn->videoPlane->vfm )
+                        }
+                        if ( !conn->videoPlane->vfm )
+                        {
+                           conn->syncType= syncType;
+                           conn->sessionId= sessionId;
+                           conn->videoPlane->vfm= wstCreateVideoFrameManager( conn );
+                        }
+                        pthread_mutex_unlock( &gMutex );
+                        #ifdef WESTEROS_GL_AVSYNC
+                        if ( conn->videoPlane->vfm )
+                        {
+                           VideoFrameManager *vfm= conn->videoPlane->vfm;
+                           if ( !vfm->syncInit && (syncType != SYNC_IMMEDIATE) )
                            {
-                              VideoFrameManager *vfm= conn->videoPlane->vfm;
-                              if ( !vfm->syncInit && (syncType != SYNC_IMMEDIATE) )
-                              {
-                                 vfm->syncInit= true;
-                                 wstAVSyncInit( vfm, vfm->conn->sessionId );
-                              }
+                              vfm->syncInit= true;
+                              wstAVSyncInit( vfm, vfm->conn->sessionId );
                            }
-                           #endif
-                           #ifdef USE_GENERIC_AVSYNC
-                           if ( g_useGenericAVSync )
+                        }
+                        #endif
+                        #ifdef USE_GENERIC_AVSYNC
+                        if ( g_useGenericAVSync )
+                        {
+                           if ( len >= 10 )
                            {
-                              if ( len >= 10 )
+                              int avsCtrlSize= wstGetU32( m+6 );
+                              if ( (avsCtrlSize > 0) && (fd0 >= 0 ) )
                               {
-                                 int avsCtrlSize= wstGetU32( m+6 );
-                                 if ( (avsCtrlSize > 0) && (fd0 >= 0 ) )
-                                 {
-                                    if ( wstVideoFrameManagerSetSyncCtrl( conn->videoPlane->vfm, fd0, avsCtrlSize ) )
-                                    {
-                                       fd0= -1;
-                                    }
-                                 }
-                                 if ( fd0 >= 0 )
+                                 if ( wstVideoFrameManagerSetSyncCtrl( conn->videoPlane->vfm, fd0, avsCtrlSize ) )
                                  {
-                                    close( fd0 );
+                                    fd0= -1;
                                  }
                               }
+                              if ( fd0 >= 0 )
+                              {
+                                 close( fd0 );
+                              }
                            }
-                           #endif
-                        }
-                        break;
-                     case 'A':
-                        {
-                           DEBUG("got frame advance video plane %d", conn->videoPlane->plane->plane_id);
-                           pthread_mutex_lock( &gMutex );
-                           wstVideoFrameManagerFrameAdvance( conn->videoPlane->vfm );
-                           pthread_mutex_unlock( &gMutex );
                         }
-                        break;
-                    case 'W':
+                        #endif
+                     }
+                     break;
+                  case 'A':
+                     {
+                        DEBUG("got frame advance video plane %d", conn->videoPlane->plane->plane_id);
+                        pthread_mutex_lock( &gMutex );
+                        wstVideoFrameManagerFrameAdvance( conn->videoPlane->vfm );
+                        pthread_mutex_unlock( &gMutex );
+                     }
+                     break;
+                 case 'W':
+                     {
+                        rectX= (int)wstGetU32( m+1 );
+                        rectY= (int)wstGetU32( m+5 );
+                        rectW= (int)wstGetU32( m+9 );
+                        rectH= (int)wstGetU32( m+13 );
+                        DEBUG("got position video plane %d: (%d, %d, %d, %d)",
+                               conn->videoPlane->plane->plane_id,
+                               rectX, rectY, rectW, rectH);
+                        wstVideoFrameManagerUpdateRect( conn->videoPlane->vfm, rectX, rectY, rectW, rectH );
+                     }
+                     break;
+                  case 'R':
+                     {
+                        int num, denom;
+                        pthread_mutex_lock( &gMutex );
+                        num= (int)wstGetU32( m+1 );
+                        denom= (int)wstGetU32( m+5 );
+                        DEBUG("got frame rate video plane %d: (%d / %d)", conn->videoPlane->plane->plane_id, num, denom);
+                        if ( (num == 0) && (gCtx->defaultRate > 0) )
                         {
-                           rectX= (int)wstGetU32( m+1 );
-                           rectY= (int)wstGetU32( m+5 );
-                           rectW= (int)wstGetU32( m+9 );
-                           rectH= (int)wstGetU32( m+13 );
-                           DEBUG("got position video plane %d: (%d, %d, %d, %d)",
-                                  conn->videoPlane->plane->plane_id,
-                                  rectX, rectY, rectW, rectH);
-                           wstVideoFrameManagerUpdateRect( conn->videoPlane->vfm, rectX, rectY, rectW, rectH );
+                           num= gCtx->defaultRate;
+                           denom= 1;
+                           DEBUG("frame rate unknown, use default rate video plane %d: (%d / %d)", conn->videoPlane->plane->plane_id, num, denom);
                         }
-                        break;
-                     case 'R':
+                        if ( (num > 0) && (denom > 0) )
                         {
-                           int num, denom;
-                           pthread_mutex_lock( &gMutex );
-                           num= (int)wstGetU32( m+1 );
-                           denom= (int)wstGetU32( m+5 );
-                           DEBUG("got frame rate video plane %d: (%d / %d)", conn->videoPlane->plane->plane_id, num, denom);
-                           if ( (num == 0) && (gCtx->defaultRate > 0) )
+                           conn->videoPlane->frameRateNum= num;
+                           conn->videoPlane->frameRateDenom= denom;
+                           if ( gCtx->autoFRMModeEnabled && conn->videoPlane->frameRateMatchingPlane )
                            {
-                              num= gCtx->defaultRate;
-                              denom= 1;
-                              DEBUG("frame rate unknown, use default rate video plane %d: (%d / %d)", conn->videoPlane->plane->plane_id, num, denom);
+                              wstSelectRate( gCtx, num, denom );
                            }
-                           if ( (num > 0) && (denom > 0) )
+                           if ( conn->videoPlane->vfm )
                            {
-                              conn->videoPlane->frameRateNum= num;
-                              conn->videoPlane->frameRateDenom= denom;
-                              if ( gCtx->autoFRMModeEnabled && conn->videoPlane->frameRateMatchingPlane )
-                              {
-                                 wstSelectRate( gCtx, num, denom );
-                              }
-                              if ( conn->videoPlane->vfm )
+                              int rate;
+                              VideoFrameManager *vfm= conn->videoPlane->vfm;
+                              vfm->expireLimit= 0;
+                              rate= conn->videoPlane->frameRateNum / conn->videoPlane->frameRateDenom;
+                              if ( rate < 10 )
                               {
-                                 int rate;
-                                 VideoFrameManager *vfm= conn->videoPlane->vfm;
-                                 vfm->expireLimit= 0;
-                                 rate= conn->videoPlane->frameRateNum / conn->videoPlane->frameRateDenom;
-                                 if ( rate < 10 )
-                                 {
-                                    vfm->expireLimit= 1000000LL;
-                                 }
+                                 vfm->expireLimit= 1000000LL;
                               }
                            }
-                           pthread_mutex_unlock( &gMutex );
-                        }
-                        break;
-                     case 'K':
-                        {
-                           bool keep= (m[1] != 0);
-                           DEBUG("got keep frame (%d) video plane %d", keep, conn->videoPlane->plane->plane_id);
-                           pthread_mutex_lock( &gMutex );
-                           conn->videoPlane->keepLastFrame= keep;
-                           pthread_mutex_unlock( &gMutex );
-                        }
-                        break;
-                     case 'E':
-                        {
-                           DEBUG("got eos video plane %d", conn->videoPlane->plane->plane_id);
-                           pthread_mutex_lock( &gMutex );
-                           wstVideoFrameManagerEos( conn->videoPlane->vfm );
-                           pthread_mutex_unlock( &gMutex );
                         }
-                        break;
-                     default:
-                        ERROR("got unknown video server message: mlen %d", mlen);
-                        wstDumpMessage( mbody, mlen+3 );
-                        break;
-                  }
+                        pthread_mutex_unlock( &gMutex );
+                     }
+                     break;
+                  case 'K':
+                     {
+                        bool keep= (m[1] != 0);
+                        DEBUG("got keep frame (%d) video plane %d", keep, conn->videoPlane->plane->plane_id);
+                        pthread_mutex_lock( &gMutex );
+                        conn->videoPlane->keepLastFrame= keep;
+                        pthread_mutex_unlock( &gMutex );
+                     }
+                     break;
+                  case 'E':
+                     {
+                        DEBUG("got eos video plane %d", conn->videoPlane->plane->plane_id);
+                        pthread_mutex_lock( &gMutex );
+                        wstVideoFrameManagerEos( conn->videoPlane->vfm );
+                        pthread_mutex_unlock( &gMutex );
+                     }
+                     break;
+                  default:
+                     ERROR("got unknown video server message: mlen %d", mlen);
+                     wstDumpMessage( mbody, mlen+3 );
+                     break;
                }
             }
-            else
-            {
-               ERROR("msg bad header");
-               wstDumpMessage( mbody, len );
-               len= 0;
-            }
          }
+         else
+         {
+            ERROR("msg bad header");
+            wstDumpMessage( mbody, len );
+            len= 0;
+         }
+      }
+   }
+   else
+   {
+      DEBUG("video server peer disconnected");
+      result= false;
+   }
+
+exit:
+   return result;
+}
+
+static VideoPoolBuffer* wstVideoServerFindBuffer( VideoServerConnection *conn, int bufferId )
+{
+   VideoPoolBuffer *pb= 0;
+   int i;
+
+   for( i= 0; i < conn->poolCount; ++i )
+   {
+      if ( conn->pool[i].bufferId == bufferId )
+      {
+         pb= &conn->pool[i];
+         break;
+      }
+   }
+
+   return pb;
+}
+
+static void wstVideoServerRegisterBuffer( VideoServerConnection *conn, int bufferId, int fd0, int fd1, int fd2 )
+{
+   VideoPoolBuffer *pb;
+
+   pb= wstVideoServerFindBuffer( conn, bufferId );
+   if ( !pb )
+   {
+      /* Replace the oldest registration once the pool is full */
+      pb= &conn->pool[conn->poolNext];
+      conn->poolNext= (conn->poolNext+1) % VIDEO_POOL_SIZE;
+      if ( conn->poolCount < VIDEO_POOL_SIZE )
+      {
+         ++conn->poolCount;
+      }
+      else
+      {
+         DEBUG("conn %p: buffer %d replaces buffer %d in pool", conn, bufferId, pb->bufferId);
+      }
+   }
+   if ( pb->fd0 >= 0 ) close( pb->fd0 );
+   if ( pb->fd1 >= 0 ) close( pb->fd1 );
+   if ( pb->fd2 >= 0 ) close( pb->fd2 );
+   pb->bufferId= bufferId;
+   pb->fd0= fd0;
+   pb->fd1= fd1;
+   pb->fd2= fd2;
+   pb->size0= lseek( fd0, 0, SEEK_END );
+   if ( pb->size0 < 0 ) pb->size0= 0;
+   pb->size1= pb->size0;
+   if ( fd1 >= 0 )
+   {
+      pb->size1= lseek( fd1, 0, SEEK_END );
+      if ( pb->size1 < 0 ) pb->size1= 0;
+   }
+   TRACE1("conn %p: registered buffer %d fd (%d, %d, %d)", conn, bufferId, fd0, fd1, fd2);
+}
+
+/*
+ * Check a frame descriptor taken from the client writable ring against the
+ * buffer it names before it is used to create an fb.  The luma and chroma
+ * planes must lie within the registered buffers when their sizes are known.
+ */
+static bool wstVideoServerCheckFrame( VideoPoolBuffer *pb, VideoRingFrame *desc )
+{
+   bool result= false;
+   uint32_t frameHeight;
+   long long end;
+
+   if ( (desc->frameWidth == 0) || (desc->frameWidth > VIDEO_FRAME_DIMENSION_MAX) ||
+        (desc->frameHeight == 0) || (desc->frameHeight > VIDEO_FRAME_DIMENSION_MAX) )
+   {
+      goto exit;
+   }
+   if ( (desc->offset[0] < 0) || (desc->stride[0] < (int32_t)desc->frameWidth) ||
+        (desc->offset[1] < 0) || (desc->stride[1] < 0) )
+   {
+      goto exit;
+   }
+   /* Frames are queued with their height rounded up to even */
+   frameHeight= ((desc->frameHeight+1) & ~1);
+   if ( pb->size0 )
+   {
+      end= (long long)desc->offset[0]+(long long)desc->stride[0]*frameHeight;
+      if ( end > pb->size0 )
+      {
+         goto exit;
+      }
+   }
+   if ( pb->size1 )
+   {
+      end= (long long)desc->offset[1]+(long long)desc->stride[1]*(frameHeight/2);
+      if ( end > pb->size1 )
+      {
+         goto exit;
+      }
+   }
+
+   result= true;
+
+exit:
+   return result;
+}
+
+static bool wstVideoServerSetupRing( VideoServerConnection *conn, int shmFd, int frameDoorbellFd, int releaseDoorbellFd )
+{
+   bool result= false;
+   VideoRingShm *ring= 0;
+   struct stat st;
+
+   if ( conn->ring )
+   {
+      ERROR("wstVideoServerSetupRing: conn %p already has a frame ring", conn);
+      goto exit;
+   }
+
+   if ( (fstat( shmFd, &st ) < 0) || (st.st_size < (off_t)sizeof(VideoRingShm)) )
+   {
+      ERROR("wstVideoServerSetupRing: bad frame ring size: errno %d", errno);
+      goto exit;
+   }
+
+   ring= (VideoRingShm*)mmap( NULL, sizeof(VideoRingShm), PROT_READ|PROT_WRITE, MAP_SHARED, shmFd, 0 );
+   if ( ring == MAP_FAILED )
+   {
+      ERROR("wstVideoServerSetupRing: unable to map frame ring: errno %d", errno);
+      ring= 0;
+      goto exit;
+   }
+
+   if ( (ring->magic != VIDEO_RING_MAGIC) || (ring->capacity != VIDEO_RING_CAPACITY) || (ring->version != VIDEO_RING_VERSION) )
+   {
+      ERROR("wstVideoServerSetupRing: bad frame ring: magic %X capacity %u version %u", ring->magic, ring->capacity, ring->version);
+      goto exit;
+   }
+
+   if ( conn->server->useEpoll )
+   {
+      struct epoll_event ev;
+      memset( &ev, 0, sizeof(ev) );
+      ev.events= EPOLLIN;
+      ev.data.ptr= &conn->doorbellTag;
+      if ( epoll_ctl( conn->server->epollFd, EPOLL_CTL_ADD, frameDoorbellFd, &ev ) < 0 )
+      {
+         ERROR("wstVideoServerSetupRing: unable to add doorbell to epoll: errno %d", errno);
+         goto exit;
+      }
+   }
+
+   pthread_mutex_lock( &conn->mutex );
+   conn->ring= ring;
+   conn->frameDoorbellFd= frameDoorbellFd;
+   conn->releaseDoorbellFd= releaseDoorbellFd;
+   pthread_mutex_unlock( &conn->mutex );
+   ring= 0;
+
+   INFO("conn %p: frame ring active", conn);
+   result= true;
+
+exit:
+   close( shmFd );
+   if ( !result )
+   {
+      if ( ring )
+      {
+         munmap( ring, sizeof(VideoRingShm) );
       }
-      else
+      close( frameDoorbellFd );
+      close( releaseDoorbellFd );
+   }
+
+   return result;
+}
+
+static void wstVideoServerTermRing( VideoServerConnection *conn )
+{
+   pthread_mutex_lock( &conn->mutex );
+   if ( conn->ring )
+   {
+      munmap( conn->ring, sizeof(VideoRingShm) );
+      conn->ring= 0;
+   }
+   if ( conn->frameDoorbellFd >= 0 )
+   {
+      if ( conn->server->useEpoll )
       {
-         DEBUG("video server peer disconnected");
-         break;
+         epoll_ctl( conn->server->epollFd, EPOLL_CTL_DEL, conn->frameDoorbellFd, NULL );
+      }
+      close( conn->frameDoorbellFd );
+      conn->frameDoorbellFd= -1;
+   }
+   if ( conn->releaseDoorbellFd >= 0 )
+   {
+      close( conn->releaseDoorbellFd );
+      conn->releaseDoorbellFd= -1;
+   }
+   pthread_mutex_unlock( &conn->mutex );
+
+   wstVideoServerPurgePool( conn );
+}
+
+static void wstVideoServerPurgePool( VideoServerConnection *conn )
+{
+   int i;
+
+   for( i= 0; i < conn->poolCount; ++i )
+   {
+      if ( conn->pool[i].fd0 >= 0 ) close( conn->pool[i].fd0 );
+      if ( conn->pool[i].fd1 >= 0 ) close( conn->pool[i].fd1 );
+      if ( conn->pool[i].fd2 >= 0 ) close( conn->pool[i].fd2 );
+      conn->pool[i].bufferId= -1;
+      conn->pool[i].fd0= conn->pool[i].fd1= conn->pool[i].fd2= -1;
+      conn->pool[i].size0= conn->pool[i].size1= 0;
+   }
+   conn->poolCount= 0;
+   conn->poolNext= 0;
+}
+
+/*
+ * Take frames from a connection's shared memory ring.  Pending socket
+ * messages are handled first since the client sends buffer registrations
+ * and control messages ahead of any ring frames that follow them.
+ */
+static bool wstVideoServerProcessRing( VideoServerConnection *conn )
+{
+   bool result= true;
+   VideoRingShm *ring;
+   VideoRingFrame desc;
+   VideoPoolBuffer *pb;
+   struct pollfd pfd;
+   uint64_t value;
+   uint32_t head, tail;
+
+   pfd.fd= conn->socketFd;
+   pfd.events= POLLIN;
+   pfd.revents= 0;
+   while ( poll( &pfd, 1, 0 ) == 1 )
+   {
+      if ( !wstVideoServerProcessMessage( conn ) )
+      {
+         result= false;
+         goto exit;
+      }
+   }
+
+   ring= conn->ring;
+   if ( !ring )
+   {
+      goto exit;
+   }
+
+   if ( read( conn->frameDoorbellFd, &value, sizeof(value) ) < 0 )
+   {
+      TRACE3("wstVideoServerProcessRing: doorbell read: errno %d", errno);
+   }
+
+   /* Both indices are written by the client: a ring holding more than its capacity is corrupt */
+   tail= ring->frameTail;
+   head= __atomic_load_n( &ring->frameHead, __ATOMIC_ACQUIRE );
+   if ( head-tail > VIDEO_RING_CAPACITY )
+   {
+      ERROR("wstVideoServerProcessRing: conn %p: bad ring indices head %u tail %u", conn, head, tail);
+      result= false;
+      goto exit;
+   }
+   while( tail != head )
+   {
+      desc= ring->frames[tail & (VIDEO_RING_CAPACITY-1)];
+      ++tail;
+      __atomic_store_n( &ring->frameTail, tail, __ATOMIC_RELEASE );
+
+      pb= wstVideoServerFindBuffer( conn, desc.bufferId );
+      if ( pb && !wstVideoServerCheckFrame( pb, &desc ) )
+      {
+         ERROR("wstVideoServerProcessRing: buffer %d: bad frame %ux%u off(%d, %d) stride(%d, %d)",
+               desc.bufferId, desc.frameWidth, desc.frameHeight,
+               desc.offset[0], desc.offset[1], desc.stride[0], desc.stride[1] );
+         wstVideoServerSendBufferRelease( conn, desc.bufferId );
+         continue;
+      }
+      if ( !pb || !wstVideoServerQueueFrame( conn, &desc, pb->fd0, pb->fd1, pb->fd2, -1, true ) )
+      {
+         ERROR("wstVideoServerProcessRing: unable to queue buffer %d (%s)", desc.bufferId, (pb ? "failed" : "not registered"));
+         wstVideoServerSendBufferRelease( conn, desc.bufferId );
       }
    }
 
 exit:
+   return result;
+}
+
+static void wstVideoServerConnectionCleanup( VideoServerConnection *conn )
+{
+   int rc;
+
    if ( conn->videoPlane && gCtx )
    {
       pthread_mutex_lock( &gMutex );
@@ -2228,7 +3325,7 @@ exit:
       conn->videoPlane->inUse= false;
       if ( !conn->videoPlane->keepLastFrame )
       {
-         DEBUG("wstVideoServerConnectionThread: drmModeSetPlane plane_id %d crtc_id %d", plane->plane_id, plane->crtc_id);
+         DEBUG("wstVideoServerConnectionCleanup: drmModeSetPlane plane_id %d crtc_id %d", plane->plane_id, plane->crtc_id);
          rc= drmModeSetPlane( gCtx->drmFd,
                               plane->plane_id,
                               plane->crtc_id,
@@ -2249,7 +3346,7 @@ exit:
             {
                delay= (1000000LL+(gCtx->modeInfo->vrefresh/2))/gCtx->modeInfo->vrefresh;
             }
-            DEBUG("wstVideoServerConnectionThread: delay for %lld us", delay);
+            DEBUG("wstVideoServerConnectionCleanup: delay for %lld us", delay);
             pthread_mutex_unlock( &gCtx->mutex );
             pthread_mutex_unlock( &gMutex );
             usleep( delay );
@@ -2274,21 +3371,64 @@ exit:
       pthread_mutex_unlock( &gMutex );
    }
 
-   conn->threadStarted= false;
+   if ( gCtx )
+   {
+      /* Frames still being displayed keep their fbs until they are freed */
+      wstVideoFbCacheClear( conn );
+   }
+}
 
-   if ( !conn->threadStopRequested )
+static void *wstVideoServerConnectionThread( void *arg )
+{
+   VideoServerConnection *conn= (VideoServerConnection*)arg;
+
+   DEBUG("wstVideoServerConnectionThread: enter");
+
+   conn->threadStarted= true;
+   while( !conn->threadStopRequested )
    {
-      int i;
-      pthread_mutex_lock( &conn->server->server->mutex );
-      for( i= 0; i < MAX_VIDEO_CONNECTIONS; ++i )
+      wstVideoServerSendUpdates( conn );
+
+      if ( conn->ring )
       {
-         if ( conn->server->connections[i] == conn )
+         struct pollfd pfd[2];
+
+         pfd[0].fd= conn->socketFd;
+         pfd[0].events= POLLIN;
+         pfd[0].revents= 0;
+         pfd[1].fd= conn->frameDoorbellFd;
+         pfd[1].events= POLLIN;
+         pfd[1].revents= 0;
+
+         if ( poll( pfd, 2, -1 ) < 0 )
+         {
+            if ( errno == EINTR )
+            {
+               continue;
+            }
+            ERROR("wstVideoServerConnectionThread: poll failed: errno %d", errno);
+            break;
+         }
+         if ( !wstVideoServerProcessRing( conn ) )
          {
-            conn->server->connections[i]= 0;
             break;
          }
+         continue;
       }
-      pthread_mutex_unlock( &conn->server->server->mutex );
+
+      if ( !wstVideoServerProcessMessage( conn ) )
+      {
+         break;
+      }
+   }
+
+   wstVideoServerConnectionCleanup( conn );
+
+   conn->threadStarted= false;
+
+   if ( !conn->threadStopRequested )
+   {
+      wstVideoServerRemoveConnection( conn->server, conn );
 
       wstDestroyVideoServerConnection( conn );
    }
@@ -2301,7 +3441,7 @@ exit:
 static VideoServerConnection *wstCreateVideoServerConnection( VideoServerCtx *server, int fd )
 {
    VideoServerConnection *conn= 0;
-   int rc;
+   int i, rc;
    bool error= false;
 
    conn= (VideoServerConnection*)calloc( 1, sizeof(VideoServerConnection) );
@@ -2312,6 +3452,27 @@ static VideoServerConnection *wstCreateVideoServerConnection( VideoServerCtx *se
       conn->socketFd= fd;
       conn->server= server;
       conn->videoResourceId= -1;
+      conn->zoomMode= -1;
+      conn->zoomPolicyVersion= -1;
+      conn->videoDebugLevel= -1;
+      conn->protocolVersion= 1;
+      conn->frameDoorbellFd= -1;
+      conn->releaseDoorbellFd= -1;
+      conn->socketTag.type= VideoEpollType_connection;
+      conn->socketTag.conn= conn;
+      conn->doorbellTag.type= VideoEpollType_doorbell;
+      conn->doorbellTag.conn= conn;
+      for( i= 0; i < VIDEO_POOL_SIZE; ++i )
+      {
+         conn->pool[i].bufferId= -1;
+         conn->pool[i].fd0= conn->pool[i].fd1= conn->pool[i].fd2= -1;
+      }
+
+      if ( server->useEpoll )
+      {
+         /* Serviced by the server thread */
+         goto exit;
+      }
 
       rc= pthread_attr_init( &attr );
       if ( rc )
@@ -2375,90 +3536,334 @@ static void wstDestroyVideoServerConnection( VideoServerConnection *conn )
          }
       }
 
-      if ( conn->socketFd >= 0 )
+      if ( conn->socketFd >= 0 )
+      {
+         shutdown( conn->socketFd, SHUT_RDWR );
+      }
+
+      if ( conn->socketFd >= 0 )
+      {
+         close( conn->socketFd );
+         conn->socketFd= -1;
+      }
+
+      if ( conn->threadStarted )
+      {
+         conn->threadStopRequested= true;
+         pthread_join( conn->threadId, NULL );
+      }
+
+      wstVideoServerTermRing( conn );
+
+      pthread_mutex_destroy( &conn->mutex );
+
+      free( conn );
+   }
+}
+
+static void wstVideoServerAddConnection( VideoServerCtx *server, VideoServerConnection *conn )
+{
+   pthread_mutex_lock( &server->server->mutex );
+   conn->next= server->connections;
+   server->connections= conn;
+   pthread_mutex_unlock( &server->server->mutex );
+}
+
+static void wstVideoServerRemoveConnection( VideoServerCtx *server, VideoServerConnection *conn )
+{
+   VideoServerConnection *iter, *prev= 0;
+
+   pthread_mutex_lock( &server->server->mutex );
+   iter= server->connections;
+   while( iter )
+   {
+      if ( iter == conn )
+      {
+         if ( prev )
+         {
+            prev->next= iter->next;
+         }
+         else
+         {
+            server->connections= iter->next;
+         }
+         iter->next= 0;
+         break;
+      }
+      prev= iter;
+      iter= iter->next;
+   }
+   pthread_mutex_unlock( &server->server->mutex );
+}
+
+/*
+ * Have the video server push state changes (refresh rate, zoom mode, debug level)
+ * out to its clients.  Only needed in epoll mode: in thread-per-connection mode
+ * each connection thread checks for changes itself.
+ */
+static void wstVideoServerWake( void )
+{
+   if ( gVideoServer && (gVideoServer->wakeFd >= 0) )
+   {
+      uint64_t value= 1;
+      if ( write( gVideoServer->wakeFd, &value, sizeof(value) ) != sizeof(value) )
+      {
+         TRACE1("wstVideoServerWake: write failed: errno %d", errno);
+      }
+   }
+}
+
+static void wstVideoServerAccept( VideoServerCtx *server )
+{
+   int fd;
+   struct sockaddr_un addr;
+   socklen_t addrLen= sizeof(addr);
+
+   DEBUG("waiting for connections...");
+   fd= accept4( server->server->socketFd, (struct sockaddr *)&addr, &addrLen, SOCK_CLOEXEC );
+   if ( fd >= 0 )
+   {
+      if ( !server->server->threadStopRequested )
+      {
+         VideoServerConnection *conn= 0;
+
+         DEBUG("video server received connection: fd %d", fd);
+
+         conn= wstCreateVideoServerConnection( server, fd );
+         if ( conn )
+         {
+            DEBUG("created video server connection %p for fd %d", conn, fd );
+            wstVideoServerAddConnection( server, conn );
+            if ( server->useEpoll )
+            {
+               struct epoll_event ev;
+               memset( &ev, 0, sizeof(ev) );
+               ev.events= EPOLLIN;
+               ev.data.ptr= &conn->socketTag;
+               if ( epoll_ctl( server->epollFd, EPOLL_CTL_ADD, fd, &ev ) < 0 )
+               {
+                  ERROR("unable to add video connection fd %d to epoll: errno %d", fd, errno);
+                  wstVideoServerRemoveConnection( server, conn );
+                  wstVideoServerQueueTeardown( server, conn );
+               }
+               else
+               {
+                  wstVideoServerSendUpdates( conn );
+               }
+            }
+         }
+         else
+         {
+            ERROR("failed to create video server connection for fd %d", fd);
+         }
+      }
+      else
+      {
+         close( fd );
+      }
+   }
+   else if ( !server->useEpoll )
+   {
+      usleep( 10000 );
+   }
+}
+
+static void wstVideoServerEpollLoop( VideoServerCtx *server )
+{
+   struct epoll_event events[16];
+   struct epoll_event ev;
+   VideoEpollTag *tag;
+   VideoServerConnection *conn, *destroyed;
+   int i, count;
+   bool ok;
+
+   server->serverTag.type= VideoEpollType_server;
+   server->serverTag.conn= 0;
+   server->wakeTag.type= VideoEpollType_wake;
+   server->wakeTag.conn= 0;
+
+   memset( &ev, 0, sizeof(ev) );
+   ev.events= EPOLLIN;
+   ev.data.ptr= &server->serverTag;
+   if ( epoll_ctl( server->epollFd, EPOLL_CTL_ADD, server->server->socketFd, &ev ) < 0 )
+   {
+      ERROR("wstVideoServerEpollLoop: unable to add server socket to epoll: errno %d", errno);
+      goto exit;
+   }
+   ev.data.ptr= &server->wakeTag;
+   if ( epoll_ctl( server->epollFd, EPOLL_CTL_ADD, server->wakeFd, &ev ) < 0 )
+   {
+      ERROR("wstVideoServerEpollLoop: unable to add wake fd to epoll: errno %d", errno);
+      goto exit;
+   }
+
+   while( !server->server->threadStopRequested )
+   {
+      count= epoll_wait( server->epollFd, events, sizeof(events)/sizeof(events[0]), -1 );
+      if ( count < 0 )
+      {
+         if ( errno == EINTR )
+         {
+            continue;
+         }
+         ERROR("wstVideoServerEpollLoop: epoll_wait failed: errno %d", errno);
+         break;
+      }
+      /*
+       * Connections that fail are only freed once the whole batch is
+       * handled since later events in it may refer to them
+       */
+      destroyed= 0;
+      for( i= 0; (i < count) && !server->server->threadStopRequested; ++i )
+      {
+         tag= (VideoEpollTag*)events[i].data.ptr;
+         switch( tag->type )
+         {
+            case VideoEpollType_server:
+               wstVideoServerAccept( server );
+               break;
+            case VideoEpollType_wake:
+               {
+                  uint64_t value;
+                  if ( read( server->wakeFd, &value, sizeof(value) ) == sizeof(value) )
+                  {
+                     pthread_mutex_lock( &server->server->mutex );
+                     conn= server->connections;
+                     while( conn )
+                     {
+                        wstVideoServerSendUpdates( conn );
+                        conn= conn->next;
+                     }
+                     pthread_mutex_unlock( &server->server->mutex );
+                  }
+               }
+               break;
+            case VideoEpollType_connection:
+            case VideoEpollType_doorbell:
+               conn= tag->conn;
+               if ( conn->destroyed )
+               {
+                  TRACE3("wstVideoServerEpollLoop: skip event for destroyed conn %p", conn);
+                  break;
+               }
+               if ( tag->type == VideoEpollType_doorbell )
+               {
+                  ok= wstVideoServerProcessRing( conn );
+               }
+               else
+               {
+                  ok= wstVideoServerProcessMessage( conn );
+               }
+               if ( ok )
+               {
+                  wstVideoServerSendUpdates( conn );
+               }
+               else
+               {
+                  epoll_ctl( server->epollFd, EPOLL_CTL_DEL, conn->socketFd, NULL );
+                  if ( conn->frameDoorbellFd >= 0 )
+                  {
+                     epoll_ctl( server->epollFd, EPOLL_CTL_DEL, conn->frameDoorbellFd, NULL );
+                  }
+                  wstVideoServerRemoveConnection( server, conn );
+                  conn->destroyed= true;
+                  conn->next= destroyed;
+                  destroyed= conn;
+               }
+               break;
+            default:
+               ERROR("wstVideoServerEpollLoop: unknown event type %d", tag->type);
+               break;
+         }
+      }
+      if ( destroyed )
+      {
+         wstVideoServerQueueTeardown( server, destroyed );
+      }
+   }
+
+exit:
+   return;
+}
+
+/*
+ * Hand a list of connections, linked by next, to the teardown thread.
+ */
+static void wstVideoServerQueueTeardown( VideoServerCtx *server, VideoServerConnection *conns )
+{
+   VideoServerConnection *last= conns;
+
+   while( last->next )
+   {
+      last= last->next;
+   }
+   pthread_mutex_lock( &server->teardownMutex );
+   last->next= server->teardownQueue;
+   server->teardownQueue= conns;
+   pthread_cond_signal( &server->teardownCond );
+   pthread_mutex_unlock( &server->teardownMutex );
+}
+
+/*
+ * Tear down connections dropped by the epoll server thread, which waits for
+ * the display to stop scanning out their frames.
+ */
+static void *wstVideoServerTeardownThread( void *arg )
+{
+   VideoServerCtx *server= (VideoServerCtx*)arg;
+   VideoServerConnection *conn;
+
+   DEBUG("wstVideoServerTeardownThread: enter");
+
+   pthread_mutex_lock( &server->teardownMutex );
+   for( ; ; )
+   {
+      conn= server->teardownQueue;
+      if ( conn )
       {
-         shutdown( conn->socketFd, SHUT_RDWR );
-      }
+         server->teardownQueue= conn->next;
+         pthread_mutex_unlock( &server->teardownMutex );
 
-      if ( conn->socketFd >= 0 )
+         DEBUG("wstVideoServerTeardownThread: destroy conn %p", conn);
+         wstVideoServerConnectionCleanup( conn );
+         wstDestroyVideoServerConnection( conn );
+
+         pthread_mutex_lock( &server->teardownMutex );
+      }
+      else if ( server->teardownStopRequested )
       {
-         close( conn->socketFd );
-         conn->socketFd= -1;
+         break;
       }
-
-      if ( conn->threadStarted )
+      else
       {
-         conn->threadStopRequested= true;
-         pthread_join( conn->threadId, NULL );
+         pthread_cond_wait( &server->teardownCond, &server->teardownMutex );
       }
+   }
+   pthread_mutex_unlock( &server->teardownMutex );
 
-      pthread_mutex_destroy( &conn->mutex );
+   DEBUG("wstVideoServerTeardownThread: exit");
 
-      free( conn );
-   }
+   return 0;
 }
 
 static void *wstVideoServerThread( void *arg )
 {
-   int rc;
    VideoServerCtx *server= (VideoServerCtx*)arg;
 
    DEBUG("wstVideoServerThread: enter");
 
-   while( !server->server->threadStopRequested )
+   if ( server->useEpoll )
    {
-      int fd;
-      struct sockaddr_un addr;
-      socklen_t addrLen= sizeof(addr);
-
-      DEBUG("waiting for connections...");
-      fd= accept4( server->server->socketFd, (struct sockaddr *)&addr, &addrLen, SOCK_CLOEXEC );
-      if ( fd >= 0 )
-      {
-         if ( !server->server->threadStopRequested )
-         {
-            VideoServerConnection *conn= 0;
-
-            DEBUG("video server received connection: fd %d", fd);
-
-            conn= wstCreateVideoServerConnection( server, fd );
-            if ( conn )
-            {
-               int i;
-               DEBUG("created video server connection %p for fd %d", conn, fd );
-               pthread_mutex_lock( &server->server->mutex );
-               for( i= 0; i < MAX_VIDEO_CONNECTIONS; ++i )
-               {
-                  if ( conn->server->connections[i] == 0 )
-                  {
-                     conn->server->connections[i]= conn;
-                     break;
-                  }
-               }
-               if ( i >= MAX_VIDEO_CONNECTIONS )
-               {
-                  ERROR("too many video connections");
-                  wstDestroyVideoServerConnection( conn );
-               }
-               pthread_mutex_unlock( &server->server->mutex );
-            }
-            else
-            {
-               ERROR("failed to create video server connection for fd %d", fd);
-            }
-         }
-         else
-         {
-            close( fd );
-         }
-      }
-      else
+      wstVideoServerEpollLoop( server );
+   }
+   else
+   {
+      while( !server->server->threadStopRequested )
       {
-         usleep( 10000 );
+         wstVideoServerAccept( server );
       }
    }
 
-exit:
    server->server->threadStarted= false;
    DEBUG("wstVideoServerThread: exit");
 
@@ -2629,12 +4034,48 @@ static bool wstInitVideoServer( VideoServerCtx *server )
 
    avProgInit();
 
+   server->epollFd= -1;
+   server->wakeFd= -1;
+   pthread_mutex_init( &server->teardownMutex, 0 );
+   pthread_cond_init( &server->teardownCond, 0 );
+
    if ( !wstInitServiceServer( "video", &server->server ) )
    {
       ERROR("wstInitVideoServer: Error: unable to start service server");
       goto exit;
    }
 
+   if ( !getenv("WESTEROS_GL_VIDEO_SERVER_NO_EPOLL") )
+   {
+      server->epollFd= epoll_create1( EPOLL_CLOEXEC );
+      server->wakeFd= eventfd( 0, EFD_CLOEXEC|EFD_NONBLOCK );
+      if ( (server->epollFd >= 0) && (server->wakeFd >= 0) )
+      {
+         rc= pthread_create( &server->teardownThreadId, NULL, wstVideoServerTeardownThread, server );
+         if ( rc == 0 )
+         {
+            server->teardownThreadStarted= true;
+            server->useEpoll= true;
+         }
+      }
+      if ( !server->useEpoll )
+      {
+         ERROR("wstInitVideoServer: unable to create epoll (%d), wake fd (%d) or teardown thread: errno %d: using connection threads",
+               server->epollFd, server->wakeFd, errno);
+         if ( server->epollFd >= 0 )
+         {
+            close( server->epollFd );
+            server->epollFd= -1;
+         }
+         if ( server->wakeFd >= 0 )
+         {
+            close( server->wakeFd );
+            server->wakeFd= -1;
+         }
+      }
+   }
+   INFO("westeros-gl: video server epoll: %d", server->useEpoll);
+
    rc= pthread_create( &server->server->threadId, NULL, wstVideoServerThread, server );
    if ( rc )
    {
@@ -2646,6 +4087,15 @@ static bool wstInitVideoServer( VideoServerCtx *server )
    result= true;
 
 exit:
+   if ( !result && server->teardownThreadStarted )
+   {
+      pthread_mutex_lock( &server->teardownMutex );
+      server->teardownStopRequested= true;
+      pthread_cond_signal( &server->teardownCond );
+      pthread_mutex_unlock( &server->teardownMutex );
+      pthread_join( server->teardownThreadId, NULL );
+      server->teardownThreadStarted= false;
+   }
    return result;
 }
 
@@ -2653,24 +4103,66 @@ static void wstTermVideoServer( VideoServerCtx *server )
 {
    if ( server )
    {
-      int i;
+      VideoServerConnection *conn, *next;
 
       avProgTerm();
 
-      wstTermServiceServer( server->server );
+      if ( server->useEpoll )
+      {
+         /* The server thread services connections and may need gMutex */
+         server->server->threadStopRequested= true;
+         wstVideoServerWake();
+         pthread_mutex_unlock( &gMutex );
+         wstTermServiceServer( server->server );
+         pthread_mutex_lock( &gMutex );
+      }
+      else
+      {
+         wstTermServiceServer( server->server );
+      }
       server->server= 0;
 
-      for( i= 0; i < MAX_VIDEO_CONNECTIONS; ++i )
+      if ( server->teardownThreadStarted )
       {
-         VideoServerConnection *conn= server->connections[i];
-         if ( conn )
+         /* Dropped connections still queued are torn down before it exits */
+         pthread_mutex_lock( &server->teardownMutex );
+         server->teardownStopRequested= true;
+         pthread_cond_signal( &server->teardownCond );
+         pthread_mutex_unlock( &server->teardownMutex );
+         pthread_mutex_unlock( &gMutex );
+         pthread_join( server->teardownThreadId, NULL );
+         pthread_mutex_lock( &gMutex );
+         server->teardownThreadStarted= false;
+      }
+
+      conn= server->connections;
+      server->connections= 0;
+      while( conn )
+      {
+         next= conn->next;
+         pthread_mutex_unlock( &gMutex );
+         if ( server->useEpoll )
          {
-            pthread_mutex_unlock( &gMutex );
-            wstDestroyVideoServerConnection( conn );
-            pthread_mutex_lock( &gMutex );
-            server->connections[i]= 0;
+            wstVideoServerConnectionCleanup( conn );
          }
+         wstDestroyVideoServerConnection( conn );
+         pthread_mutex_lock( &gMutex );
+         conn= next;
+      }
+
+      if ( server->epollFd >= 0 )
+      {
+         close( server->epollFd );
+         server->epollFd= -1;
+      }
+      if ( server->wakeFd >= 0 )
+      {
+         int fd= server->wakeFd;
+         server->wakeFd= -1;
+         close( fd );
       }
+      pthread_cond_destroy( &server->teardownCond );
+      pthread_mutex_destroy( &server->teardownMutex );
       free( server );
    }
 }
@@ -2717,6 +4209,146 @@ static void wstDisplayServerSendResponse( DisplayServerConnection *conn )
    pthread_mutex_unlock( &conn->mutex );
 }
 
+/*
+ * Format one family of 'get stats' counters as key=value pairs.  Returns
+ * false for an unknown family.  The video family has one entry per
+ * connection starting at connection index 'first'.  When the entries do not
+ * all fit in one response it ends with 'next=<index>' and 'next' is set to
+ * the index to request next, otherwise 'next' is set to -1.
+ */
+static bool wstDisplayServerGetStats( char *response, const char *family, int first, int *next )
+{
+   bool result= true;
+   int len;
+
+   *next= -1;
+   if ( !strcmp( family, "display" ) )
+   {
+      WstGLStats stats;
+      pthread_mutex_lock( &gCtx->mutexStats );
+      stats= gCtx->stats;
+      pthread_mutex_unlock( &gCtx->mutexStats );
+      snprintf( response, STATS_RESPONSE_MAX+1,
+                "%d: stats display flips=%u flip-rate=%d vblank-missed=%u commit-us-last=%lld commit-us-avg=%lld commit-us-max=%lld", 0,
+                stats.flipCount, stats.flipRate, stats.vblankMissCount,
+                stats.commitTimeLast, stats.commitTimeAvg, stats.commitTimeMax );
+   }
+   else if ( !strcmp( family, "resources" ) )
+   {
+      WstResources res;
+      memset( &res, 0, sizeof(res) );
+      pthread_mutex_lock( &resMutex );
+      if ( gResources )
+      {
+         res= *gResources;
+      }
+      pthread_mutex_unlock( &resMutex );
+      snprintf( response, STATS_RESPONSE_MAX+1,
+                "%d: stats resources fd-video=%d gem-video=%d fb-video=%d bo-graphics=%d fb-graphics=%d", 0,
+                res.fdVideoCount, res.handleVideoCount, res.fbVideoCount,
+                res.boGraphicsCount, res.fbGraphicsCount );
+   }
+   else if ( !strcmp( family, "offload" ) )
+   {
+      WstOffloadMsgQ *pMsgQ= &gCtx->offloadMsgQ;
+      unsigned int depth= __atomic_load_n( &pMsgQ->pushCount, __ATOMIC_ACQUIRE ) -
+                          __atomic_load_n( &pMsgQ->popCount, __ATOMIC_ACQUIRE );
+      snprintf( response, STATS_RESPONSE_MAX+1,
+                "%d: stats offload depth=%d high-water=%u capacity=%d overflow=%u", 0,
+                (int)depth > 0 ? (int)depth : 0,
+                __atomic_load_n( &pMsgQ->highWater, __ATOMIC_RELAXED ),
+                OFFLOAD_QUEUE_CAPACITY,
+                __atomic_load_n( &pMsgQ->overflowCount, __ATOMIC_RELAXED ) );
+   }
+   else if ( !strcmp( family, "video" ) )
+   {
+      VideoServerConnection *conn;
+      char entries[STATS_RESPONSE_MAX+1];
+      char entry[STATS_RESPONSE_MAX+1];
+      int count= 0, elen= 0, avail;
+
+      /* Room for the header and a trailing next=<index> must be kept */
+      avail= STATS_RESPONSE_MAX-64;
+      entries[0]= '\0';
+      if ( first < 0 )
+      {
+         first= 0;
+      }
+      pthread_mutex_lock( &gMutex );
+      if ( gVideoServer && gVideoServer->server )
+      {
+         pthread_mutex_lock( &gVideoServer->server->mutex );
+         conn= gVideoServer->connections;
+         while( conn )
+         {
+            if ( conn->videoPlane && conn->videoPlane->vfm )
+            {
+               if ( (count >= first) && (*next < 0) )
+               {
+                  VideoFrameManager *vfm= conn->videoPlane->vfm;
+                  int queueSize;
+                  pthread_mutex_lock( &vfm->mutex );
+                  queueSize= vfm->queueSize;
+                  pthread_mutex_unlock( &vfm->mutex );
+                  len= snprintf( entry, sizeof(entry),
+                                 " conn=%d resource=%d queue=%d dropped=%d late=%d underflows=%d",
+                                 count, conn->videoResourceId, queueSize,
+                                 vfm->dropFrameCount, vfm->lateFrameCount, vfm->underflowCount );
+                  if ( elen+len <= avail )
+                  {
+                     strcpy( entries+elen, entry );
+                     elen += len;
+                  }
+                  else
+                  {
+                     *next= count;
+                  }
+               }
+               ++count;
+            }
+            conn= conn->next;
+         }
+         pthread_mutex_unlock( &gVideoServer->server->mutex );
+      }
+      pthread_mutex_unlock( &gMutex );
+      len= snprintf( response, STATS_RESPONSE_MAX+1, "%d: stats video connections=%d%s", 0, count, entries );
+      if ( *next >= 0 )
+      {
+         snprintf( response+len, STATS_RESPONSE_MAX+1-len, " next=%d", *next );
+      }
+   }
+   else
+   {
+      result= false;
+   }
+
+   return result;
+}
+
+/*
+ * Push every family of counters to a connection subscribed with
+ * 'set stats-stream'.
+ */
+static void wstDisplayServerSendStats( DisplayServerConnection *conn )
+{
+   static const char *families[]= { "display", "resources", "offload", "video" };
+   int i, first, next;
+
+   for( i= 0; i < (int)(sizeof(families)/sizeof(families[0])); ++i )
+   {
+      /* Families too large for one response are sent as several */
+      first= 0;
+      do
+      {
+         wstDisplayServerGetStats( conn->response, families[i], first, &next );
+         conn->responseLen= strlen(conn->response);
+         wstDisplayServerSendResponse( conn );
+         first= next;
+      }
+      while ( next >= 0 );
+   }
+}
+
 static void wstDisplayServerProcessMessage( DisplayServerConnection *conn, int mlen, char *m )
 {
    char *tok, *ctx;
@@ -2835,10 +4467,43 @@ static void wstDisplayServerProcessMessage( DisplayServerConnection *conn, int m
                   {
                      sprintf( conn->response, "%d: video-debug-level %d", 0, gCtx->videoDebugLevel );
                   }
+                  else if ( (tlen == 13) && !strncmp( tok, "offload-queue", tlen ) )
+                  {
+                     WstOffloadMsgQ *pMsgQ= &gCtx->offloadMsgQ;
+                     unsigned int depth= __atomic_load_n( &pMsgQ->pushCount, __ATOMIC_ACQUIRE ) -
+                                         __atomic_load_n( &pMsgQ->popCount, __ATOMIC_ACQUIRE );
+                     sprintf( conn->response, "%d: offload-queue depth %d high-water %u capacity %d overflow %u", 0,
+                              (int)depth > 0 ? (int)depth : 0,
+                              __atomic_load_n( &pMsgQ->highWater, __ATOMIC_RELAXED ),
+                              OFFLOAD_QUEUE_CAPACITY,
+                              __atomic_load_n( &pMsgQ->overflowCount, __ATOMIC_RELAXED ) );
+                  }
                   else if ( (tlen == 8) && !strncmp( tok, "loglevel", tlen ) )
                   {
                      sprintf( conn->response, "%d: loglevel %d", 0, g_activeLevel );
                   }
+                  else if ( (tlen == 5) && !strncmp( tok, "stats", tlen ) )
+                  {
+                     tok= strtok_r( 0, " ", &ctx );
+                     if ( tok )
+                     {
+                        char *family= tok;
+                        int first= 0, next;
+                        tok= strtok_r( 0, " ", &ctx );
+                        if ( tok )
+                        {
+                           first= atoi( tok );
+                        }
+                        if ( !wstDisplayServerGetStats( conn->response, family, first, &next ) )
+                        {
+                           sprintf( conn->response, "%d: %s", -1, "get stats bad argument(s)" );
+                        }
+                     }
+                     else
+                     {
+                        sprintf( conn->response, "%d: %s", -1, "get stats missing argument(s): display|resources|offload|video [first]" );
+                     }
+                  }
                   else
                   {
                      sprintf( conn->response, "%d: %s", -1, "get bad argument(s)" );
@@ -3163,6 +4828,29 @@ static void wstDisplayServerProcessMessage( DisplayServerConnection *conn, int m
                         sprintf( conn->response, "%d: set loglevel %d", 0, g_activeLevel );
                      }
                   }
+                  else if ( (tlen == 12) && !strncmp( tok, "stats-stream", tlen ) )
+                  {
+                     tok= strtok_r( 0, " ", &ctx );
+                     if ( tok )
+                     {
+                        int value= atoi(tok);
+                        if ( value > 0 )
+                        {
+                           if ( value < STATS_PERIOD_MIN ) value= STATS_PERIOD_MIN;
+                           conn->statsNext= getMonotonicTimeMicros()+value*1000LL;
+                        }
+                        else
+                        {
+                           value= 0;
+                        }
+                        conn->statsPeriod= value;
+                        sprintf( conn->response, "%d: set stats-stream %d", 0, conn->statsPeriod );
+                     }
+                     else
+                     {
+                        sprintf( conn->response, "%d: %s", -1, "set stats-stream missing argument(s)" );
+                     }
+                  }
                   else
                   {
                      sprintf( conn->response, "%d: %s", -1, "set bad argument(s)" );
@@ -3187,6 +4875,9 @@ static void wstDisplayServerProcessMessage( DisplayServerConnection *conn, int m
    conn->responseLen= strlen(conn->response);
 
    wstDisplayServerSendResponse( conn );
+
+   /* Settings such as zoom mode may need to be pushed to video clients */
+   wstVideoServerWake();
 }
 
 static void *wstDisplayServerConnectionThread( void *arg )
@@ -3202,6 +4893,34 @@ static void *wstDisplayServerConnectionThread( void *arg )
    conn->threadStarted= true;
    while( !conn->threadStopRequested )
    {
+      if ( conn->statsPeriod )
+      {
+         struct pollfd pfd;
+         long long now= getMonotonicTimeMicros();
+         int rc;
+
+         if ( now >= conn->statsNext )
+         {
+            wstDisplayServerSendStats( conn );
+            conn->statsNext += conn->statsPeriod*1000LL;
+            if ( conn->statsNext <= now )
+            {
+               conn->statsNext= now+conn->statsPeriod*1000LL;
+            }
+            continue;
+         }
+
+         /* Wait for a command until the next stats update is due */
+         pfd.fd= conn->socketFd;
+         pfd.events= POLLIN;
+         pfd.revents= 0;
+         rc= poll( &pfd, 1, (int)((conn->statsNext-now+999LL)/1000LL) );
+         if ( rc == 0 )
+         {
+            continue;
+         }
+      }
+
       iov[0].iov_base= (char*)mbody;
       iov[0].iov_len= sizeof(mbody);
 
@@ -3259,15 +4978,26 @@ static void *wstDisplayServerConnectionThread( void *arg )
 
    if ( !conn->threadStopRequested )
    {
-      int i;
+      DisplayServerConnection *iter, *prev;
       pthread_mutex_lock( &conn->server->server->mutex );
-      for( i= 0; i < MAX_DISPLAY_CONNECTIONS; ++i )
+      prev= 0;
+      iter= conn->server->connections;
+      while( iter )
       {
-         if ( conn->server->connections[i] == conn )
+         if ( iter == conn )
          {
-            conn->server->connections[i]= 0;
+            if ( prev )
+            {
+               prev->next= iter->next;
+            }
+            else
+            {
+               conn->server->connections= iter->next;
+            }
             break;
          }
+         prev= iter;
+         iter= iter->next;
       }
       pthread_mutex_unlock( &conn->server->server->mutex );
 
@@ -3378,31 +5108,24 @@ static void *wstDisplayServerThread( void *arg )
 
             DEBUG("display server received connection: fd %d", fd);
 
+            /*
+             * Hold the server mutex until the connection is linked in so a
+             * connection thread that exits right away can't unlink it first
+             */
+            pthread_mutex_lock( &server->server->mutex );
             conn= wstCreateDisplayServerConnection( server, fd );
             if ( conn )
             {
-               int i;
                DEBUG("created display server connection %p for fd %d", conn, fd );
-               pthread_mutex_lock( &server->server->mutex );
-               for( i= 0; i < MAX_DISPLAY_CONNECTIONS; ++i )
-               {
-                  if ( conn->server->connections[i] == 0 )
-                  {
-                     conn->server->connections[i]= conn;
-                     break;
-                  }
-               }
-               if ( i >= MAX_DISPLAY_CONNECTIONS )
-               {
-                  ERROR("too many display connections");
-                  wstDestroyDisplayServerConnection( conn );
-               }
-               pthread_mutex_unlock( &server->server->mutex );
+               conn->next= server->connections;
+               server->connections= conn;
             }
             else
             {
-               ERROR("failed to create video server connection for fd %d", fd);
+               ERROR("failed to create display server connection for fd %d", fd);
+               close( fd );
             }
+            pthread_mutex_unlock( &server->server->mutex );
          }
          else
          {
@@ -3473,12 +5196,14 @@ static void wstDestroyVideoFrameManager( VideoFrameManager *vfm )
          pthread_mutex_lock( &vfm->mutex);
          for( i= 0; i < vfm->queueSize; ++i )
          {
-            if ( vfm->bufferIdCurrent != vfm->queue[i].bufferId )
+            VideoFrame *vf= wstVideoFrameManagerQueueFrame( vfm, i );
+            if ( vfm->bufferIdCurrent != vf->bufferId )
             {
-               wstFreeVideoFrameResources( &vfm->queue[i] );
-               wstVideoServerSendBufferRelease( vfm->conn, vfm->queue[i].bufferId );
+               wstFreeVideoFrameResources( vf );
+               wstVideoServerSendBufferRelease( vfm->conn, vf->bufferId );
             }
          }
+         vfm->queueHead= 0;
          vfm->queueSize= 0;
          free( vfm->queue );
          vfm->queue= 0;
@@ -3518,6 +5243,7 @@ static VideoFrameManager *wstCreateVideoFrameManager( VideoServerConnection *con
 
       pthread_mutex_init( &vfm->mutex, 0);
       vfm->queueCapacity= VFM_QUEUE_CAPACITY;
+      vfm->queueHead= 0;
       vfm->queueSize= 0;
       vfm->bufferIdCurrent= -1;
       vfm->syncSession= -1;
@@ -3528,6 +5254,7 @@ static VideoFrameManager *wstCreateVideoFrameManager( VideoServerConnection *con
          vfm->queue[i].fd0= -1;
          vfm->queue[i].fd1= -1;
          vfm->queue[i].fd2= -1;
+         vfm->queue[i].fenceFd= -1;
          vfm->queue[i].bufferId= -1;
       }
    }
@@ -3637,7 +5364,7 @@ static void wstVideoFrameManagerUpdateRect( VideoFrameManager *vfm, int rectX, i
    pthread_mutex_lock( &vfm->mutex);
    for( i= 0; i < vfm->queueSize; ++i )
    {
-      VideoFrame *vf= &vfm->queue[i];
+      VideoFrame *vf= wstVideoFrameManagerQueueFrame( vfm, i );
       wstSetVideoFrameRect( vf, rectX, rectY, rectW, rectH, NULL, NULL );
    }
    if ( vfm->paused || (vfm->queueSize < 2) )
@@ -3652,28 +5379,72 @@ static void wstVideoFrameManagerUpdateRect( VideoFrameManager *vfm, int rectX, i
    pthread_mutex_unlock( &gMutex );
 }
 
+static VideoFrame* wstVideoFrameManagerQueueFrame( VideoFrameManager *vfm, int i )
+{
+   return &vfm->queue[(vfm->queueHead+i) & (vfm->queueCapacity-1)];
+}
+
+static void wstVideoFrameManagerQueuePopFront( VideoFrameManager *vfm )
+{
+   vfm->queueHead= (vfm->queueHead+1) & (vfm->queueCapacity-1);
+   --vfm->queueSize;
+}
+
+static void wstVideoFrameManagerQueueRemove( VideoFrameManager *vfm, int i )
+{
+   int j;
+   int mask= vfm->queueCapacity-1;
+
+   // Close the gap from whichever end of the ring is nearer.  The refresh thread
+   // only ever removes the head or the frame just after it, so this is constant time.
+   if ( i < vfm->queueSize-1-i )
+   {
+      for( j= i; j > 0; --j )
+      {
+         vfm->queue[(vfm->queueHead+j) & mask]= vfm->queue[(vfm->queueHead+j-1) & mask];
+      }
+      wstVideoFrameManagerQueuePopFront( vfm );
+   }
+   else
+   {
+      for( j= i; j < vfm->queueSize-1; ++j )
+      {
+         vfm->queue[(vfm->queueHead+j) & mask]= vfm->queue[(vfm->queueHead+j+1) & mask];
+      }
+      --vfm->queueSize;
+   }
+}
+
 static void wstVideoFrameManagerPushFrame( VideoFrameManager *vfm, VideoFrame *f )
 {
+   // Only the connection thread pushes frames so the ring is only ever grown here,
+   // never by the refresh thread.  Growth doubles capacity to keep it a power of two.
    if ( vfm->queueSize+1 > vfm->queueCapacity )
    {
       int orgCapacity= vfm->queueCapacity;
-      int newCapacity= 2*vfm->queueCapacity+1;
+      int newCapacity= 2*vfm->queueCapacity;
       VideoFrame *newQueue= (VideoFrame*)calloc( newCapacity, sizeof(VideoFrame) );
       if ( newQueue )
       {
-         int i;
+         int i, count;
          VideoFrame *toFree= vfm->queue;
-         pthread_mutex_lock( &vfm->mutex);
-         memcpy( newQueue, vfm->queue, vfm->queueSize*sizeof(VideoFrame) );
-         for( i= vfm->queueSize; i < newCapacity; ++i )
+         for( i= 0; i < newCapacity; ++i )
          {
             newQueue[i].fd0= -1;
             newQueue[i].fd1= -1;
             newQueue[i].fd2= -1;
+            newQueue[i].fenceFd= -1;
             newQueue[i].bufferId= -1;
          }
+         pthread_mutex_lock( &vfm->mutex);
+         count= vfm->queueSize;
+         for( i= 0; i < count; ++i )
+         {
+            newQueue[i]= *wstVideoFrameManagerQueueFrame( vfm, i );
+         }
          vfm->queue= newQueue;
          vfm->queueCapacity= newCapacity;
+         vfm->queueHead= 0;
          pthread_mutex_unlock( &vfm->mutex);
          FRAME("vfm expand queue capacity from %d to %d", orgCapacity, newCapacity);
          free( toFree );
@@ -3701,7 +5472,8 @@ static void wstVideoFrameManagerPushFrame( VideoFrameManager *vfm, VideoFrame *f
    }
    #endif
 
-   vfm->queue[vfm->queueSize++]= *f;
+   *wstVideoFrameManagerQueueFrame( vfm, vfm->queueSize )= *f;
+   ++vfm->queueSize;
    pthread_mutex_unlock( &vfm->mutex);
 }
 
@@ -3743,7 +5515,8 @@ static VideoFrame* wstVideoFrameManagerPopFrame( VideoFrameManager *vfm )
             }
             else
             {
-               long long frameGap= vfm->queue[1].frameTime - vfm->queue[0].frameTime;
+               long long frameGap= wstVideoFrameManagerQueueFrame( vfm, 1 )->frameTime -
+                                   wstVideoFrameManagerQueueFrame( vfm, 0 )->frameTime;
                if ( frameGap > expireLimit )
                {
                   DEBUG("underflow: frame expired, queue size %d gap %lld us", vfm->queueSize, frameGap );
@@ -3758,7 +5531,7 @@ static VideoFrame* wstVideoFrameManagerPopFrame( VideoFrameManager *vfm )
       }
       else if ( vfm->paused && vfm->frameAdvance && (vfm->bufferIdCurrent == -1) && vfm->queueSize )
       {
-         f= &vfm->queue[0];
+         f= wstVideoFrameManagerQueueFrame( vfm, 0 );
          f->canExpire= false;
          vfm->frameAdvance= false;
       }
@@ -3784,9 +5557,10 @@ static VideoFrame* wstVideoFrameManagerPopFrame( VideoFrameManager *vfm )
          pthread_mutex_lock( &vfm->mutex);
          if ( vfm->queueSize > 0 )
          {
-            f= &vfm->queue[0];
+            // Drop to latest: release everything but the newest frame
             while( vfm->queueSize > 1 )
             {
+               f= wstVideoFrameManagerQueueFrame( vfm, 0 );
                if ( vfm->bufferIdCurrent != f->bufferId )
                {
                   avProgLog( f->frameTime*1000LL, vfm->conn->videoResourceId, "WtoD", "drop");
@@ -3795,9 +5569,9 @@ static VideoFrame* wstVideoFrameManagerPopFrame( VideoFrameManager *vfm )
                   f->dropped= true;
                   wstOffloadSendBufferRelease(vfm->conn, f );
                }
-               memmove( &vfm->queue[0], &vfm->queue[1], (vfm->queueSize-(1))*sizeof(VideoFrame) );
-               --vfm->queueSize;
+               wstVideoFrameManagerQueuePopFront( vfm );
             }
+            f= wstVideoFrameManagerQueueFrame( vfm, 0 );
          }
          pthread_mutex_unlock( &vfm->mutex);
       }
@@ -3808,7 +5582,7 @@ static VideoFrame* wstVideoFrameManagerPopFrame( VideoFrameManager *vfm )
          if ( vfm->flipTimeBase == 0)
          {
             vfm->flipTimeBase= vfm->vblankTime;
-            vfm->frameTimeBase= vfm->queue[0].frameTime;
+            vfm->frameTimeBase= wstVideoFrameManagerQueueFrame( vfm, 0 )->frameTime;
             FRAME("set base: flipTimeBase %lld frameTimeBase %lld", vfm->flipTimeBase, vfm->frameTimeBase);
          }
          i= 0;
@@ -3819,7 +5593,7 @@ static VideoFrame* wstVideoFrameManagerPopFrame( VideoFrameManager *vfm )
          }
          while ( i < vfm->queueSize )
          {
-            VideoFrame *fCheck= &vfm->queue[i];
+            VideoFrame *fCheck= wstVideoFrameManagerQueueFrame( vfm, i );
             flipTime= ((fCheck->frameTime - vfm->frameTimeBase)/vfm->rate) + vfm->flipTimeBase;
             FRAME("i %d flipTime %lld flipTimeCurrent %lld frameTimeCurrent %lld frameTime %lld frameTimeBase %lld flipTimeBase %lld frameAdvance %d",
                   i, flipTime, vfm->flipTimeCurrent, vfm->frameTimeCurrent, fCheck->frameTime, vfm->frameTimeBase, vfm->flipTimeBase, vfm->frameAdvance);
@@ -3844,11 +5618,7 @@ static VideoFrame* wstVideoFrameManagerPopFrame( VideoFrameManager *vfm )
                      wstOffloadSendBufferRelease(vfm->conn, fCheck);
                   }
                   pthread_mutex_lock( &vfm->mutex);
-                  if ( vfm->queueSize > i+1 )
-                  {
-                     memmove( &vfm->queue[i], &vfm->queue[i+1], (vfm->queueSize-(i+1))*sizeof(VideoFrame) );
-                  }
-                  --vfm->queueSize;
+                  wstVideoFrameManagerQueueRemove( vfm, i );
                   pthread_mutex_unlock( &vfm->mutex);
                   if ( vfm->conn->videoPlane->videoFrame[FRAME_CURR].bufferId != -1)
                   {
@@ -3864,9 +5634,8 @@ static VideoFrame* wstVideoFrameManagerPopFrame( VideoFrameManager *vfm )
                if ( i > 0 )
                {
                   pthread_mutex_lock( &vfm->mutex);
-                  memmove( &vfm->queue[0], &vfm->queue[1], (vfm->queueSize-1)*sizeof(VideoFrame) );
-                  --vfm->queueSize;
-                  f= &vfm->queue[0];
+                  wstVideoFrameManagerQueuePopFront( vfm );
+                  f= wstVideoFrameManagerQueueFrame( vfm, 0 );
                   pthread_mutex_unlock( &vfm->mutex);
                   i= 0;
                }
@@ -3877,6 +5646,11 @@ static VideoFrame* wstVideoFrameManagerPopFrame( VideoFrameManager *vfm )
                if ( f->bufferId != vfm->bufferIdCurrent )
                {
                   FRAME("  time to flip frame %d buffer %d", f->frameNumber, f->bufferId);
+                  if ( US_TO_MS(flipTime) < US_TO_MS(vfm->vblankTime) )
+                  {
+                     /* The frame was due at an earlier vblank */
+                     vfm->lateFrameCount += 1;
+                  }
                   f->canExpire= !vfm->frameAdvance;
                   vfm->adjust= ((vfm->flipTimeCurrent != 0) ? (vfm->vblankInterval-(f->frameTime-vfm->frameTimeCurrent)) : 0);
                   vfm->flipTimeCurrent= flipTime;
@@ -3902,6 +5676,7 @@ done:
       INFO("f %p paused %d bufferIdCurrent %d vfm->queueSize %d", f, vfm->paused, vfm->bufferIdCurrent, vfm->queueSize);
       #endif
       vfm->underflowDetected= true;
+      vfm->underflowCount += 1;
       INFO("underflow detected video plane %p", vfm->conn->videoPlane);
    }
    if ( f )
@@ -4411,6 +6186,8 @@ static WstGLCtx *wstInitCtx( void )
       drmVersionPtr drmver= 0;
 
       pthread_mutex_init( &ctx->mutex, 0 );
+      pthread_mutex_init( &ctx->mutexStats, 0 );
+      pthread_mutex_init( &ctx->mutexVBlank, 0 );
       ctx->refCnt= 1;
       ctx->outputEnable= true;
       ctx->graphicsEnable= true;
@@ -4461,6 +6238,14 @@ static WstGLCtx *wstInitCtx( void )
          INFO("westeros-gl: no vblank");
          ctx->useVBlank= false;
       }
+      env= getenv("WESTEROS_GL_COMMIT_DEADLINE");
+      if ( env )
+      {
+         long long margin= atoll( env );
+         ctx->commitSched.enabled= true;
+         ctx->commitSched.margin= (margin > 0) ? margin : COMMIT_MARGIN_DEFAULT;
+         INFO("westeros-gl: commit deadline: margin %lld us", ctx->commitSched.margin);
+      }
       env= getenv("WESTEROS_SECURE_GRAPHICS");
       if ( env && atoi(env) )
       {
@@ -4511,6 +6296,16 @@ static WstGLCtx *wstInitCtx( void )
       ctx->nativeOutputFenceFd= -1;
       #endif
 
+      {
+         uint64_t value= 0;
+         // vblank timestamps are only reported to clients if they use CLOCK_MONOTONIC
+         if ( (drmGetCap( ctx->drmFd, DRM_CAP_TIMESTAMP_MONOTONIC, &value ) == 0) && value )
+         {
+            ctx->vblankMonotonic= true;
+         }
+         INFO("westeros-gl: vblank timestamps monotonic: %d", ctx->vblankMonotonic);
+      }
+
       drmver= drmGetVersion( ctx->drmFd );
       if ( drmver )
       {
@@ -4839,6 +6634,7 @@ static WstGLCtx *wstInitCtx( void )
                            newPlane->videoFrame[i].fd0= -1;
                            newPlane->videoFrame[i].fd1= -1;
                            newPlane->videoFrame[i].fd2= -1;
+                           newPlane->videoFrame[i].fenceFd= -1;
                            newPlane->videoFrame[i].bufferId= -1;
                         }
                         TRACE3("plane zorder %d primary %d overlay %d video %d gfx %d crtc_id %d",
@@ -5070,6 +6866,8 @@ static void wstTermCtx( WstGLCtx *ctx )
          close( ctx->drmFd );
          ctx->drmFd= -1;
       }
+      pthread_mutex_destroy( &ctx->mutexVBlank );
+      pthread_mutex_destroy( &ctx->mutexStats );
       pthread_mutex_destroy( &ctx->mutex );
       free( ctx );
 
@@ -5269,6 +7067,7 @@ static void wstSelectMode( WstGLCtx *ctx, int width, int height )
          }
       }
       INFO("choosing output mode: %dx%dx%d", ctx->modeInfo->hdisplay, ctx->modeInfo->vdisplay, ctx->modeInfo->vrefresh);
+      wstVideoServerWake();
    }
 }
 
@@ -5482,13 +7281,10 @@ static void wstReleasePreviousBuffers( WstGLCtx *ctx )
       if ( nw->prevBo )
       {
          struct gbm_surface* gs= (struct gbm_surface*)nw->nativeWindow;
-         wstUpdateResources( WSTRES_FB_GRAPHICS, false, nw->prevFbId, __LINE__);
-         drmModeRmFB( ctx->drmFd, nw->prevFbId );
          wstUpdateResources( WSTRES_BO_GRAPHICS, false, (long long)nw->prevBo, __LINE__);
          gbm_surface_release_buffer(gs, nw->prevBo);
       }
       nw->prevBo= 0;
-      nw->prevFbId= 0;
 
       nw= nw->next;
    }
@@ -5499,7 +7295,26 @@ static void wstReleasePreviousBuffers( WstGLCtx *ctx )
       WstOverlayPlane *iter= ctx->overlayPlanes.usedHead;
       while( iter )
       {
-         wstOffloadSendBufferRelease( iter->conn, &iter->videoFrame[FRAME_FREE]);
+         if ( iter->scanout )
+         {
+            int retired;
+
+            /* The last commit has completed so every frame before the current one is off screen */
+            wstFreeVideoFrameResources( &iter->videoFrame[FRAME_FREE] );
+            retired= (iter->videoFrame[FRAME_CURR].fbId ? iter->videoFrame[FRAME_CURR].frameNumber-1 : iter->scanoutHideFrame);
+            if ( retired > iter->scanoutRetired )
+            {
+               iter->scanoutRetired= retired;
+               if ( iter->scanoutRetireCB )
+               {
+                  iter->scanoutRetireCB( iter->scanoutUserData, retired );
+               }
+            }
+         }
+         else
+         {
+            wstOffloadSendBufferRelease( iter->conn, &iter->videoFrame[FRAME_FREE]);
+         }
          iter->videoFrame[FRAME_FREE].bufferId= -1;
          iter= iter->next;
       }
@@ -5538,6 +7353,102 @@ static void wstWindowsRefreshStop( WstGLCtx *ctx )
 }
 #endif
 
+static void wstStatsUpdate( WstGLCtx *ctx, long long now, long long commitTime )
+{
+   WstGLStats *stats= &ctx->stats;
+
+   pthread_mutex_lock( &ctx->mutexStats );
+   if ( commitTime >= 0 )
+   {
+      ++stats->flipCount;
+      stats->commitTimeLast= commitTime;
+      ++stats->windowFlips;
+      stats->windowCommitTotal += commitTime;
+      if ( commitTime > stats->windowCommitMax )
+      {
+         stats->windowCommitMax= commitTime;
+      }
+   }
+   if ( !stats->windowStart )
+   {
+      stats->windowStart= now;
+   }
+   else if ( now-stats->windowStart >= STATS_WINDOW )
+   {
+      stats->flipRate= (int)((stats->windowFlips*STATS_WINDOW+(now-stats->windowStart)/2)/(now-stats->windowStart));
+      stats->commitTimeAvg= (stats->windowFlips ? stats->windowCommitTotal/stats->windowFlips : 0);
+      stats->commitTimeMax= stats->windowCommitMax;
+      stats->windowStart= now;
+      stats->windowFlips= 0;
+      stats->windowCommitTotal= 0;
+      stats->windowCommitMax= 0;
+   }
+   pthread_mutex_unlock( &ctx->mutexStats );
+}
+
+static void wstStatsVBlankMissed( WstGLCtx *ctx, unsigned int count )
+{
+   pthread_mutex_lock( &ctx->mutexStats );
+   ctx->stats.vblankMissCount += count;
+   pthread_mutex_unlock( &ctx->mutexStats );
+}
+
+static void wstCommitSchedAddSample( WstCommitSched *sched, long long duration )
+{
+   long long sorted[COMMIT_SAMPLE_COUNT];
+   long long t;
+   int i, j, n;
+
+   sched->samples[sched->sampleNext]= duration;
+   sched->sampleNext= (sched->sampleNext+1) % COMMIT_SAMPLE_COUNT;
+   if ( sched->sampleCount < COMMIT_SAMPLE_COUNT )
+   {
+      ++sched->sampleCount;
+   }
+
+   n= sched->sampleCount;
+   for( i= 0; i < n; ++i )
+   {
+      t= sched->samples[i];
+      for( j= i; (j > 0) && (sorted[j-1] > t); --j )
+      {
+         sorted[j]= sorted[j-1];
+      }
+      sorted[j]= t;
+   }
+   sched->estimate= sorted[((n-1)*COMMIT_PERCENTILE)/100];
+}
+
+/*
+ * Sleep until the predicted start time for the commit targeting the vblank
+ * after the one at vblankTime.  Until enough commits have been timed the
+ * thread proceeds immediately, as it does without a deadline.
+ */
+static void wstCommitSchedWait( WstGLCtx *ctx, long long vblankTime, long long refreshInterval )
+{
+   WstCommitSched *sched= &ctx->commitSched;
+   long long lead, wakeTime, now;
+
+   if ( sched->sampleCount < COMMIT_SAMPLE_COUNT/4 )
+   {
+      return;
+   }
+
+   lead= sched->estimate + sched->margin;
+   if ( lead >= refreshInterval )
+   {
+      return;
+   }
+
+   wakeTime= vblankTime + refreshInterval - lead;
+   now= getMonotonicTimeMicros();
+   if ( wakeTime > now )
+   {
+      FRAME("refresh: commit deadline: sleep %lld us (estimate %lld margin %lld)", wakeTime-now, sched->estimate, sched->margin);
+      usleep( wakeTime-now );
+   }
+}
+
 static void *wstRefreshThread( void *arg )
 {
    WstGLCtx *ctx= (WstGLCtx*)arg;
@@ -5545,6 +7456,7 @@ static void *wstRefreshThread( void *arg )
    long long delay;
    long long refreshInterval= 0LL;
    long long vblankTime= 0LL;
+   unsigned int vblankSeq= 0;
    const char *env, *policyName;
    int policy= SCHED_FIFO;
    int priority= 1;
@@ -5612,6 +7524,12 @@ static void *wstRefreshThread( void *arg )
       ERROR("failed to set refresh thread policy and priority: %d errno %d", rc, errno);
    }
 
+   if ( ctx->commitSched.enabled && !(ctx->useVBlank && ctx->vblankMonotonic) )
+   {
+      INFO("commit deadline needs monotonic vblank timestamps: disabled");
+      ctx->commitSched.enabled= false;
+   }
+
    while( !ctx->refreshThreadStopRequested )
    {
       delay= 16667LL;
@@ -5631,17 +7549,40 @@ static void *wstRefreshThread( void *arg )
 
       if ( ctx->conn && ctx->modeInfo )
       {
+         long long wakeTime, commitStart, commitTime= -1LL;
+
+         wakeTime= getMonotonicTimeMicros();
          pthread_mutex_lock( &gMutex );
          if ( ctx->modeInfo->vrefresh )
          {
             refreshInterval= (1000000LL+(ctx->modeInfo->vrefresh/2))/ctx->modeInfo->vrefresh;
          }
-         wstReleasePreviousBuffers( ctx );
-         if ( wstCheckPlanes( ctx, vblankTime, refreshInterval ) )
+         #ifdef DRM_USE_OUT_FENCE
+         /*
+          * Commits are non-blocking: only retire the previous buffers and
+          * queue the next commit once the last one has reached the display
+          */
+         if ( !wstSwapCheckFence( ctx, (refreshInterval >= 8000LL) ? (int)(refreshInterval/4000LL) : 1 ) )
+         {
+            FRAME("refresh: previous commit still pending");
+         }
+         else
+         #endif
          {
-            TRACE3("refresh thread calling wstSwapDRMBuffers");
-            wstSwapDRMBuffers( ctx );
-            delay= 3LL*refreshInterval/4LL;
+            wstReleasePreviousBuffers( ctx );
+            /* Time only plane setup and the commit, not waits for the lock or the previous flip */
+            commitStart= getMonotonicTimeMicros();
+            if ( wstCheckPlanes( ctx, vblankTime, refreshInterval ) )
+            {
+               TRACE3("refresh thread calling wstSwapDRMBuffers");
+               wstSwapDRMBuffers( ctx );
+               delay= 3LL*refreshInterval/4LL;
+               commitTime= getMonotonicTimeMicros()-commitStart;
+               if ( ctx->commitSched.enabled )
+               {
+                  wstCommitSchedAddSample( &ctx->commitSched, commitTime );
+               }
+            }
          }
          #ifdef USE_REFRESH_LOCK
          if ( g_useRefreshLock )
@@ -5651,16 +7592,18 @@ static void *wstRefreshThread( void *arg )
          }
          #endif
          pthread_mutex_unlock( &gMutex );
+
+         wstStatsUpdate( ctx, wakeTime, commitTime );
       }
 
       if (
-            (ctx->offloadMsgQ.writeIdx != ctx->offloadMsgQ.readIdx && ctx->offloadThreadStarted)
+            (wstOffloadMsgPending( &ctx->offloadMsgQ ) && ctx->offloadThreadStarted)
             #ifdef USE_UEVENT_HOTPLUG
             || ctx->ueventFd >= 0
             #endif
          )
       {
-         TRACE3("have offload work w_idx %d r_idx %d", ctx->offloadMsgQ.writeIdx, ctx->offloadMsgQ.readIdx);
+         TRACE3("have offload work w_idx %u r_idx %u", ctx->offloadMsgQ.writeIdx, ctx->offloadMsgQ.readIdx);
          sem_post(&ctx->offloadMsgQ.sem);
       }
 
@@ -5673,9 +7616,33 @@ static void *wstRefreshThread( void *arg )
          if ( !rc )
          {
             vblankTime= vbl.reply.tval_sec*1000000LL + vbl.reply.tval_usec;
+            if ( ctx->vblankMonotonic )
+            {
+               pthread_mutex_lock( &ctx->mutexVBlank );
+               ctx->vblankInfo.vblankTime= vblankTime;
+               ctx->vblankInfo.vblankInterval= refreshInterval;
+               ctx->vblankInfo.vblankCount= vbl.reply.sequence;
+               ctx->haveVBlankInfo= true;
+               pthread_mutex_unlock( &ctx->mutexVBlank );
+            }
+            if ( vblankSeq && (vbl.reply.sequence-vblankSeq > 1) )
+            {
+               wstStatsVBlankMissed( ctx, vbl.reply.sequence-vblankSeq-1 );
+               if ( ctx->commitSched.enabled )
+               {
+                  ++ctx->commitSched.missCount;
+                  FRAME("refresh: commit deadline: missed %u vblank(s)", vbl.reply.sequence-vblankSeq-1);
+               }
+            }
+            vblankSeq= vbl.reply.sequence;
+            if ( ctx->commitSched.enabled && refreshInterval )
+            {
+               wstCommitSchedWait( ctx, vblankTime, refreshInterval );
+            }
          }
          else
          {
+            vblankSeq= 0;
             TRACE3("drmWaitVBlank failed: rc %d errno %d", rc, errno);
             if ( errno == 16 )
             {
@@ -5685,198 +7652,396 @@ static void *wstRefreshThread( void *arg )
       }
       else
       {
+         vblankSeq= 0;
          if ( delay )
          {
             usleep( delay );
          }
       }
    }
-   ctx->refreshThreadStarted= false;
-
-   DEBUG("refresh thread exit");
-   return NULL;
-}
+   ctx->refreshThreadStarted= false;
+
+   DEBUG("refresh thread exit");
+   return NULL;
+}
+
+static void wstStartRefreshThread( WstGLCtx *ctx )
+{
+   int rc;
+   rc= pthread_create( &ctx->refreshThreadId, NULL, wstRefreshThread, ctx );
+   if ( rc )
+   {
+      ERROR("unable to start refresh thread: rc %d errno %d", rc, errno);
+   }
+}
+
+static void *wstOffloadThread( void *arg )
+{
+   WstGLCtx *ctx= (WstGLCtx*)arg;
+   WstOffloadMsgQ *pMsgQ;
+   WstOffloadMsg cur;
+   int rc;
+
+   pMsgQ= &ctx->offloadMsgQ;
+   DEBUG("offload thread started");
+
+   ctx->offloadThreadStarted= true;
+   while ( !ctx->offloadThreadStopRequested )
+   {
+      rc= sem_wait(&pMsgQ->sem);
+      if (rc)
+      {
+         ERROR("Offload thread semaphore wait failed: rc %d errno %d", rc, errno);
+      }
+
+      for ( ; ; )
+      {
+         if (ctx->offloadThreadStopRequested)
+         {
+            break;
+         }
+         pthread_mutex_lock( &pMsgQ->mutex);
+         if ( !wstOffloadMsgPop( pMsgQ, &cur ) )
+         {
+            TRACE1("Empty queue now index %u", pMsgQ->readIdx);
+            pthread_mutex_unlock( &pMsgQ->mutex);
+            break;
+         }
+         pMsgQ->busyConn= wstOffloadMsgConn( &cur );
+         pthread_mutex_unlock( &pMsgQ->mutex);
+
+         wstOffloadMsgExecute( cur.msgType, cur.param_pvoid, cur.param_long_long, cur.param_int, cur.param_pvoid2 );
+
+         pthread_mutex_lock( &pMsgQ->mutex);
+         pMsgQ->busyConn= 0;
+         pthread_cond_broadcast( &pMsgQ->idle );
+         pthread_mutex_unlock( &pMsgQ->mutex);
+
+         TRACE1("OLM: process msg %d, lpar %lld, par %d", cur.msgType, cur.param_long_long, cur.param_int);
+      }
+      #ifdef USE_UEVENT_HOTPLUG
+      wstProcessUEvent( ctx );
+      #endif
+   }
+   ctx->offloadThreadStarted= false;
+   DEBUG("offload thread exit");
+   return NULL;
+}
+
+static void wstOffloadMsgExecute(uint32_t msgType, void *param_pv, long long param_ll, int param_int, void *param_pv2)
+{
+   VideoServerConnection *conn;
+   switch (msgType)
+   {
+      case WST_OLM_NONE:
+         /* Nothing to do */
+         break;
+      case WST_OLM_BUFF_RELEASE:
+         {
+            WstOffloadVideoFrameResources *f= (WstOffloadVideoFrameResources *)param_pv2;
+            if ( f )
+            {
+               wstOffloadFreeVideoFrameResources(f);
+               free(f);
+            }
+            conn= (VideoServerConnection*)param_pv;
+            wstVideoServerSendBufferRelease(conn, param_int);
+            break;
+         }
+      case WST_OLM_STATUS_UPDATE:
+         conn= (VideoServerConnection*)param_pv;
+         wstVideoServerSendStatus(conn, param_ll, param_int);
+         break;
+      case WST_OLM_SENT_UNDERFLOW:
+         conn= (VideoServerConnection*)param_pv;
+         wstVideoServerSendUnderflow(conn, param_ll);
+         break;
+      case WST_OLM_FD_HANDLE_CLOSE:
+         close(param_int);
+         break;
+      case WST_OLM_FREE_VF_BUFF:
+         free(param_pv);
+         break;
+      default:
+         ERROR("unknown msg type %d", msgType);
+         break;
+   }
+}
+
+static bool wstOffloadMsgPending( WstOffloadMsgQ *pMsgQ )
+{
+   return (__atomic_load_n( &pMsgQ->pushCount, __ATOMIC_ACQUIRE ) !=
+           __atomic_load_n( &pMsgQ->popCount, __ATOMIC_ACQUIRE ));
+}
+
+/*
+ * Get the connection a message is for, if any.
+ */
+static VideoServerConnection* wstOffloadMsgConn( WstOffloadMsg *msg )
+{
+   VideoServerConnection *conn= 0;
+
+   switch( msg->msgType )
+   {
+      case WST_OLM_BUFF_RELEASE:
+      case WST_OLM_STATUS_UPDATE:
+      case WST_OLM_SENT_UNDERFLOW:
+         conn= (VideoServerConnection*)msg->param_pvoid;
+         break;
+      default:
+         break;
+   }
+
+   return conn;
+}
+
+/*
+ * Take the oldest message from the held list or the queue.  Caller must hold
+ * pMsgQ->mutex.
+ */
+static bool wstOffloadMsgPop( WstOffloadMsgQ *pMsgQ, WstOffloadMsg *msg )
+{
+   bool result= false;
+   WstOffloadMsg *pCur;
+
+   pCur= pMsgQ->held;
+   if ( pCur )
+   {
+      pMsgQ->held= pCur->next;
+      if ( !pMsgQ->held )
+      {
+         pMsgQ->heldTail= 0;
+      }
+      *msg= *pCur;
+      free( pCur );
+      result= true;
+   }
+   else
+   {
+      result= wstOffloadMsgTake( pMsgQ, msg );
+   }
+
+   if ( result )
+   {
+      __atomic_add_fetch( &pMsgQ->popCount, 1, __ATOMIC_RELEASE );
+   }
+   return result;
+}
+
+/*
+ * Take the oldest message from the ring or overflow.  Caller must hold
+ * pMsgQ->mutex and account for the message in popCount.  Producers use the
+ * overflow list whenever it is not empty, so the ring is drained before the
+ * overflow is taken.  While taken messages are processed overflowMark is left
+ * on the list to keep producers off the ring; it is only cleared once nothing
+ * more has been added.
+ */
+static bool wstOffloadMsgTake( WstOffloadMsgQ *pMsgQ, WstOffloadMsg *msg )
+{
+   bool result= false;
+   WstOffloadMsg *pCur, *next;
+   unsigned int seq;
+   int spinCount= 0;
+
+   for( ; ; )
+   {
+      pCur= &pMsgQ->msg[pMsgQ->readIdx & (OFFLOAD_QUEUE_CAPACITY-1)];
+      seq= __atomic_load_n( &pCur->seq, __ATOMIC_ACQUIRE );
+      if ( seq == pMsgQ->readIdx+1 )
+      {
+         *msg= *pCur;
+         __atomic_store_n( &pCur->seq, pMsgQ->readIdx+OFFLOAD_QUEUE_CAPACITY, __ATOMIC_RELEASE );
+         ++pMsgQ->readIdx;
+         result= true;
+         break;
+      }
+      if ( __atomic_load_n( &pMsgQ->writeIdx, __ATOMIC_ACQUIRE ) != pMsgQ->readIdx )
+      {
+         /* A producer has claimed the next slot but not yet filled it: it will shortly */
+         if ( ++spinCount > OFFLOAD_POP_SPIN_LIMIT )
+         {
+            TRACE1("OLM: slot %u claimed but not filled", pMsgQ->readIdx);
+            break;
+         }
+         sched_yield();
+         continue;
+      }
+
+      pCur= pMsgQ->overflowPending;
+      if ( pCur )
+      {
+         pMsgQ->overflowPending= pCur->next;
+         *msg= *pCur;
+         free( pCur );
+         result= true;
+         break;
+      }
+
+      pCur= __atomic_load_n( &pMsgQ->overflow, __ATOMIC_ACQUIRE );
+      if ( !pCur )
+      {
+         break;
+      }
+      if ( pCur == &pMsgQ->overflowMark )
+      {
+         if ( __atomic_compare_exchange_n( &pMsgQ->overflow, &pCur, NULL, false, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE ) )
+         {
+            break;
+         }
+      }
+      pCur= __atomic_exchange_n( &pMsgQ->overflow, &pMsgQ->overflowMark, __ATOMIC_ACQUIRE );
+      while( pCur && (pCur != &pMsgQ->overflowMark) )
+      {
+         /* Overflow list is LIFO: reverse it */
+         next= pCur->next;
+         pCur->next= pMsgQ->overflowPending;
+         pMsgQ->overflowPending= pCur;
+         pCur= next;
+      }
+      /* Ring slots claimed before the exchange are older: check again */
+   }
 
-static void wstStartRefreshThread( WstGLCtx *ctx )
-{
-   int rc;
-   rc= pthread_create( &ctx->refreshThreadId, NULL, wstRefreshThread, ctx );
-   if ( rc )
-   {
-      ERROR("unable to start refresh thread: rc %d errno %d", rc, errno);
-   }
+   return result;
 }
 
-static void *wstOffloadThread( void *arg )
+/*
+ * Remove every message queued so far for the connection and return them as a
+ * list in queue order.  Messages for other connections stay queued, in order,
+ * on the held list.  The list must be passed to wstOffloadRunConn, which may
+ * wait on video fences, once locks such as gMutex have been released.
+ */
+static WstOffloadMsg* wstOffloadTakeConn( VideoServerConnection *conn )
 {
-   WstGLCtx *ctx= (WstGLCtx*)arg;
    WstOffloadMsgQ *pMsgQ;
-   WstOffloadMsg *pCur;
-   int msgType;
-   VideoServerConnection *conn;
-   long long param_long_long;
-   int param_int;
-   void *param_pvoid, *param_pvoid2;
-   int rc;
-   int fullness;
+   WstOffloadMsg cur;
+   WstOffloadMsg *pMsg, *prev, *next;
+   WstOffloadMsg *head= 0, *tail= 0;
 
-   pMsgQ= &ctx->offloadMsgQ;
-   DEBUG("offload thread started");
+   pMsgQ= &gCtx->offloadMsgQ;
+   pthread_mutex_lock( &pMsgQ->mutex);
 
-   ctx->offloadThreadStarted= true;
-   while ( !ctx->offloadThreadStopRequested )
+   prev= 0;
+   pMsg= pMsgQ->held;
+   while( pMsg )
    {
-      rc= sem_wait(&pMsgQ->sem);
-      if (rc)
-      {
-         ERROR("Offload thread semaphore wait failed: rc %d errno %d", rc, errno);
-      }
-
-      for ( ; ; )
+      next= pMsg->next;
+      if ( wstOffloadMsgConn( pMsg ) == conn )
       {
-         if (ctx->offloadThreadStopRequested)
+         if ( prev )
          {
-            break;
+            prev->next= next;
          }
-         pthread_mutex_lock( &pMsgQ->mutex);
-         fullness= pMsgQ->writeIdx - pMsgQ->readIdx;
-         if (fullness < 0)
+         else
          {
-            fullness += OFFLOAD_QUEUE_CAPACITY;
+            pMsgQ->held= next;
          }
-         if (fullness == 0)
+         pMsg->next= 0;
+         if ( tail )
          {
-            TRACE1("Empty queue now index %d", pMsgQ->writeIdx);
-            pthread_mutex_unlock( &pMsgQ->mutex);
-            break;
+            tail->next= pMsg;
          }
-         pCur= &pMsgQ->msg[pMsgQ->readIdx];
-         msgType= pCur->msgType;
-         param_pvoid= pCur->param_pvoid;
-         param_long_long= pCur->param_long_long;
-         param_int= pCur->param_int;
-         param_pvoid2= pCur->param_pvoid2;
-
-         pMsgQ->readIdx++;
-         if (pMsgQ->readIdx >= OFFLOAD_QUEUE_CAPACITY)
+         else
          {
-            pMsgQ->readIdx= 0;
+            head= pMsg;
          }
-         pthread_mutex_unlock( &pMsgQ->mutex);
-
-         wstOffloadMsgExecute( msgType, param_pvoid, param_long_long, param_int, param_pvoid2 );
-
-         TRACE1("OLM: process msg %d, lpar %lld, par %d", msgType, param_long_long, param_int);
+         tail= pMsg;
+         __atomic_add_fetch( &pMsgQ->popCount, 1, __ATOMIC_RELEASE );
       }
-      #ifdef USE_UEVENT_HOTPLUG
-      wstProcessUEvent( ctx );
-      #endif
+      else
+      {
+         prev= pMsg;
+      }
+      pMsg= next;
    }
-   ctx->offloadThreadStarted= false;
-   DEBUG("offload thread exit");
-   return NULL;
-}
+   pMsgQ->heldTail= prev;
 
-static void wstOffloadMsgExecute(uint32_t msgType, void *param_pv, long long param_ll, int param_int, void *param_pv2)
-{
-   VideoServerConnection *conn;
-   switch (msgType)
+   while( wstOffloadMsgTake( pMsgQ, &cur ) )
    {
-      case WST_OLM_NONE:
-         /* Nothing to do */
-         break;
-      case WST_OLM_BUFF_RELEASE:
+      pMsg= (WstOffloadMsg*)malloc( sizeof(WstOffloadMsg) );
+      if ( !pMsg )
+      {
+         ERROR("no memory to hold offload msg %d: executing inline", cur.msgType);
+         __atomic_add_fetch( &pMsgQ->popCount, 1, __ATOMIC_RELEASE );
+         wstOffloadMsgExecute( cur.msgType, cur.param_pvoid, cur.param_long_long, cur.param_int, cur.param_pvoid2 );
+         continue;
+      }
+      *pMsg= cur;
+      pMsg->next= 0;
+      if ( wstOffloadMsgConn( pMsg ) == conn )
+      {
+         if ( tail )
          {
-            WstOffloadVideoFrameResources *f= (WstOffloadVideoFrameResources *)param_pv2;
-            if ( f )
-            {
-               wstOffloadFreeVideoFrameResources(f);
-               free(f);
-            }
-            conn= (VideoServerConnection*)param_pv;
-            wstVideoServerSendBufferRelease(conn, param_int);
-            break;
+            tail->next= pMsg;
          }
-      case WST_OLM_STATUS_UPDATE:
-         conn= (VideoServerConnection*)param_pv;
-         wstVideoServerSendStatus(conn, param_ll, param_int);
-         break;
-      case WST_OLM_SENT_UNDERFLOW:
-         conn= (VideoServerConnection*)param_pv;
-         wstVideoServerSendUnderflow(conn, param_ll);
-         break;
-      case WST_OLM_FD_HANDLE_CLOSE:
-         close(param_int);
-         break;
-      case WST_OLM_FREE_VF_BUFF:
-         free(param_pv);
-         break;
-      default:
-         ERROR("unknown msg type %d", msgType);
-         break;
+         else
+         {
+            head= pMsg;
+         }
+         tail= pMsg;
+         __atomic_add_fetch( &pMsgQ->popCount, 1, __ATOMIC_RELEASE );
+      }
+      else
+      {
+         if ( pMsgQ->heldTail )
+         {
+            pMsgQ->heldTail->next= pMsg;
+         }
+         else
+         {
+            pMsgQ->held= pMsg;
+         }
+         pMsgQ->heldTail= pMsg;
+      }
    }
+
+   pthread_mutex_unlock( &pMsgQ->mutex);
+
+   return head;
 }
 
-static void wstOffloadFlushConn( VideoServerConnection *conn )
+/*
+ * Run messages taken with wstOffloadTakeConn once the offload thread is not
+ * running one for the same connection.
+ */
+static void wstOffloadRunConn( VideoServerConnection *conn, WstOffloadMsg *list )
 {
    WstOffloadMsgQ *pMsgQ;
-   WstOffloadMsg *pCur;
-   int readIdx, fullness;
-   int msgType;
-   long long param_long_long;
-   int param_int;
-   void *param_pvoid, *param_pvoid2;
+   WstOffloadMsg *next;
 
-   DEBUG("wstOffloadFlushConn: begin: conn %p",conn);
    pMsgQ= &gCtx->offloadMsgQ;
    pthread_mutex_lock( &pMsgQ->mutex);
-   readIdx= pMsgQ->readIdx;
-   for( ; ; )
+   while( pMsgQ->busyConn == conn )
    {
-      fullness= pMsgQ->writeIdx - readIdx;
-      if (fullness < 0)
-      {
-         fullness += OFFLOAD_QUEUE_CAPACITY;
-      }
-      if (fullness == 0)
-      {
-         break;
-      }
-      pCur= &pMsgQ->msg[readIdx];
-      msgType= pCur->msgType;
-      param_pvoid= pCur->param_pvoid;
-      param_long_long= pCur->param_long_long;
-      param_int= pCur->param_int;
-      param_pvoid2= pCur->param_pvoid2;
-      switch (msgType)
-      {
-         case WST_OLM_BUFF_RELEASE:
-         case WST_OLM_STATUS_UPDATE:
-         case WST_OLM_SENT_UNDERFLOW:
-            if ( conn == (VideoServerConnection *)param_pvoid )
-            {
-               wstOffloadMsgExecute( msgType, param_pvoid, param_long_long, param_int, param_pvoid2 );
-               pCur->msgType= WST_OLM_NONE;
-            }
-            break;
-         default:
-            break;
-      }
-      readIdx++;
-      if (readIdx >= OFFLOAD_QUEUE_CAPACITY)
-      {
-         readIdx= 0;
-      }
+      pthread_cond_wait( &pMsgQ->idle, &pMsgQ->mutex );
    }
    pthread_mutex_unlock( &pMsgQ->mutex);
+
+   while( list )
+   {
+      next= list->next;
+      wstOffloadMsgExecute( list->msgType, list->param_pvoid, list->param_long_long, list->param_int, list->param_pvoid2 );
+      free( list );
+      list= next;
+   }
+}
+
+/*
+ * Execute every message queued so far for the connection on the calling
+ * thread so none is left or in progress once it returns.  The caller must
+ * not hold gMutex.
+ */
+static void wstOffloadFlushConn( VideoServerConnection *conn )
+{
+   DEBUG("wstOffloadFlushConn: begin: conn %p",conn);
+   wstOffloadRunConn( conn, wstOffloadTakeConn( conn ) );
    DEBUG("wstOffloadFlushConn: end: conn %p",conn);
 }
 
 static void wstOffloadMsgPush(uint32_t type, void *param_pv, long long param_ll, int param_int, void *param_pv2)
 {
    WstOffloadMsgQ *pMsgQ;
-   WstOffloadMsg *pCur;
-   int fullness;
+   WstOffloadMsg *pCur= 0;
+   unsigned int pos, seq, depth, highWater;
    if (!gCtx)
    {
        ERROR("context not initialized");
@@ -5888,47 +8053,88 @@ static void wstOffloadMsgPush(uint32_t type, void *param_pv, long long param_ll,
        return;
    }
    pMsgQ= &gCtx->offloadMsgQ;
-   pthread_mutex_lock( &pMsgQ->mutex);
-   fullness= pMsgQ->writeIdx - pMsgQ->readIdx;
-   if (fullness < 0)
-   {
-      fullness += OFFLOAD_QUEUE_CAPACITY;
-   }
-   if (fullness >= OFFLOAD_QUEUE_CAPACITY - 1)
+   pos= __atomic_load_n( &pMsgQ->writeIdx, __ATOMIC_RELAXED );
+   for( ; ; )
    {
-      static int fullCount= 0;
-      if ( (fullCount++ % 10) == 0 )
+      if ( __atomic_load_n( &pMsgQ->overflow, __ATOMIC_ACQUIRE ) )
       {
-         ERROR("offload Message queue nospace please enlarge OFFLOAD_QUEUE_CAPACITY %d fullness %d count %d", OFFLOAD_QUEUE_CAPACITY, fullness, fullCount);
+         /* Keep order: nothing goes in the ring until the overflow is taken */
+         pCur= 0;
+         break;
+      }
+      pCur= &pMsgQ->msg[pos & (OFFLOAD_QUEUE_CAPACITY-1)];
+      seq= __atomic_load_n( &pCur->seq, __ATOMIC_ACQUIRE );
+      if ( seq == pos )
+      {
+         if ( __atomic_compare_exchange_n( &pMsgQ->writeIdx, &pos, pos+1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+         {
+            break;
+         }
+      }
+      else if ( (int)(seq - pos) < 0 )
+      {
+         pCur= 0;
+         break;
+      }
+      else
+      {
+         pos= __atomic_load_n( &pMsgQ->writeIdx, __ATOMIC_RELAXED );
       }
-      pthread_mutex_unlock( &pMsgQ->mutex);
-      wstOffloadMsgExecute( type, param_pv, param_ll, param_int, param_pv2 );
-      return;
    }
-   pCur= &pMsgQ->msg[pMsgQ->writeIdx];
-   pCur->msgType= type;
-   pCur->param_pvoid= param_pv;
-   pCur->param_long_long= param_ll;
-   pCur->param_int= param_int;
-   pCur->param_pvoid2= param_pv2;
-   pMsgQ->writeIdx++;
-   if (pMsgQ->writeIdx >= OFFLOAD_QUEUE_CAPACITY)
+   if ( pCur )
    {
-      pMsgQ->writeIdx= 0;
+      pCur->msgType= type;
+      pCur->param_pvoid= param_pv;
+      pCur->param_long_long= param_ll;
+      pCur->param_int= param_int;
+      pCur->param_pvoid2= param_pv2;
+      __atomic_store_n( &pCur->seq, pos+1, __ATOMIC_RELEASE );
    }
-   pthread_mutex_unlock( &pMsgQ->mutex);
+   else
+   {
+      pCur= (WstOffloadMsg*)malloc( sizeof(WstOffloadMsg) );
+      if ( !pCur )
+      {
+         ERROR("offload message queue full and no memory for overflow: executing msg %d inline", type);
+         wstOffloadMsgExecute( type, param_pv, param_ll, param_int, param_pv2 );
+         return;
+      }
+      pCur->msgType= type;
+      pCur->param_pvoid= param_pv;
+      pCur->param_long_long= param_ll;
+      pCur->param_int= param_int;
+      pCur->param_pvoid2= param_pv2;
+      pCur->next= __atomic_load_n( &pMsgQ->overflow, __ATOMIC_RELAXED );
+      while( !__atomic_compare_exchange_n( &pMsgQ->overflow, &pCur->next, pCur, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED ) );
+      if ( (__atomic_add_fetch( &pMsgQ->overflowCount, 1, __ATOMIC_RELAXED ) % 100) == 1 )
+      {
+         WARNING("offload message queue full: capacity %d overflow count %u", OFFLOAD_QUEUE_CAPACITY, pMsgQ->overflowCount);
+      }
+   }
+   depth= __atomic_add_fetch( &pMsgQ->pushCount, 1, __ATOMIC_RELEASE ) - __atomic_load_n( &pMsgQ->popCount, __ATOMIC_RELAXED );
+   highWater= __atomic_load_n( &pMsgQ->highWater, __ATOMIC_RELAXED );
+   while( ((int)depth > (int)highWater) &&
+          !__atomic_compare_exchange_n( &pMsgQ->highWater, &highWater, depth, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) );
    TRACE3("OLM: add: type %d, par_pv %p par_ll %lld, par_int %d par_pv2 %p", type, param_pv, param_ll, param_int, param_pv2);
 }
 
 static void wstStartOffloadMsgThread( WstGLCtx *ctx )
 {
-   int rc;
+   int rc, i;
    WstOffloadMsgQ *pMsgQ;
 
    pMsgQ= &ctx->offloadMsgQ;
    pMsgQ->readIdx= 0;
    pMsgQ->writeIdx= 0;
+   for( i= 0; i < OFFLOAD_QUEUE_CAPACITY; ++i )
+   {
+      pMsgQ->msg[i].seq= i;
+   }
+   pMsgQ->held= 0;
+   pMsgQ->heldTail= 0;
+   pMsgQ->busyConn= 0;
    pthread_mutex_init( &pMsgQ->mutex, 0);
+   pthread_cond_init( &pMsgQ->idle, 0);
    rc= sem_init(&pMsgQ->sem, 0, 0);
    if (rc)
    {
@@ -5987,6 +8193,116 @@ static void pageFlipEventHandler(int fd, unsigned int frame,
    }
 }
 
+static void wstGraphicsFbDestroy( struct gbm_bo *bo, void *data )
+{
+   WstGraphicsFb *gfb= (WstGraphicsFb*)data;
+   if ( gfb )
+   {
+      TRACE3("wstGraphicsFbDestroy: bo %p fbId %u", bo, gfb->fbId);
+      wstUpdateResources( WSTRES_FB_GRAPHICS, false, gfb->fbId, __LINE__);
+      drmModeRmFB( gfb->drmFd, gfb->fbId );
+      free( gfb );
+   }
+}
+
+static int wstGraphicsFbGet( WstGLCtx *ctx, struct gbm_bo *bo, int width, int height, uint32_t *fbId )
+{
+   int rc= -1;
+   WstGraphicsFb *gfb;
+   uint32_t handle, stride;
+
+   gfb= (WstGraphicsFb*)gbm_bo_get_user_data( bo );
+   if ( gfb )
+   {
+      if ( (gfb->width == width) && (gfb->height == height) )
+      {
+         *fbId= gfb->fbId;
+         rc= 0;
+         goto exit;
+      }
+      /* Surface has been resized: replace the fb */
+      gbm_bo_set_user_data( bo, NULL, NULL );
+      wstGraphicsFbDestroy( bo, gfb );
+   }
+
+   gfb= (WstGraphicsFb*)calloc( 1, sizeof(WstGraphicsFb) );
+   if ( !gfb )
+   {
+      ERROR("wstGraphicsFbGet: no memory for fb info");
+      goto exit;
+   }
+
+   handle= gbm_bo_get_handle(bo).u32;
+   stride= gbm_bo_get_stride(bo);
+
+   #ifdef USE_GBM_MODIFIERS
+   if ( ctx->useGBMModifiers )
+   {
+      uint32_t handles[4]= { handle,
+                             0,
+                             0,
+                             0 };
+      uint32_t strides[4]= { stride,
+                             0,
+                             0,
+                             0 };
+      uint32_t offsets[4]= { gbm_bo_get_offset(bo, 0),
+                             0,
+                             0,
+                             0};
+      uint64_t modifiers[4]= { gbm_bo_get_modifier(bo),
+                               0,
+                               0,
+                               0 };
+      rc= drmModeAddFB2WithModifiers( ctx->drmFd,
+                                      width,
+                                      height,
+                                      gbm_bo_get_format(bo),
+                                      handles,
+                                      strides,
+                                      offsets,
+                                      modifiers,
+                                      &gfb->fbId,
+                                      DRM_MODE_FB_MODIFIERS );
+      if ( rc )
+      {
+         ERROR("wstGraphicsFbGet: drmModeAddFB2WithModifiers rc %d errno %d", rc, errno);
+      }
+   }
+   else
+   #endif
+   {
+      rc= drmModeAddFB( ctx->drmFd,
+                        width,
+                        height,
+                        32,
+                        32,
+                        stride,
+                        handle,
+                        &gfb->fbId );
+      if ( rc )
+      {
+         ERROR("wstGraphicsFbGet: drmModeAddFB rc %d errno %d", rc, errno);
+      }
+   }
+   if ( rc )
+   {
+      free( gfb );
+      goto exit;
+   }
+
+   wstUpdateResources( WSTRES_FB_GRAPHICS, true, gfb->fbId, __LINE__);
+   gfb->drmFd= ctx->drmFd;
+   gfb->width= width;
+   gfb->height= height;
+   gbm_bo_set_user_data( bo, gfb, wstGraphicsFbDestroy );
+   TRACE3("wstGraphicsFbGet: bo %p new fbId %u (%dx%d)", bo, gfb->fbId, width, height);
+   *fbId= gfb->fbId;
+
+exit:
+   return rc;
+}
+
 #ifdef DRM_USE_OUT_FENCE
 static void wstSwapWaitFence( WstGLCtx *ctx )
 {
@@ -6018,6 +8334,44 @@ static void wstSwapWaitFence( WstGLCtx *ctx )
       ctx->nativeOutputFenceFd= -1;
    }
 }
+
+static bool wstSwapCheckFence( WstGLCtx *ctx, int timeoutMs )
+{
+   bool signalled= true;
+
+   if ( ctx->nativeOutputFenceFd >= 0 )
+   {
+      int rc;
+      struct pollfd pfd;
+
+      pfd.fd= ctx->nativeOutputFenceFd;
+      pfd.events= POLLIN;
+      pfd.revents= 0;
+
+      do
+      {
+         rc= poll( &pfd, 1, timeoutMs );
+      }
+      while ( (rc == -1) && ((errno == EINTR) || (errno == EAGAIN)) );
+
+      if ( rc == 0 )
+      {
+         TRACE3("out fence fd %d still pending", ctx->nativeOutputFenceFd);
+         signalled= false;
+      }
+      else
+      {
+         if ( rc < 0 )
+         {
+            ERROR("wstSwapCheckFence: poll out fence failed: fd %d errno %d", ctx->nativeOutputFenceFd, errno);
+         }
+         close( ctx->nativeOutputFenceFd );
+         ctx->nativeOutputFenceFd= -1;
+      }
+   }
+
+   return signalled;
+}
 #endif
 
 static void wstSwapDRMBuffersAtomic( WstGLCtx *ctx )
@@ -6028,7 +8382,6 @@ static void wstSwapDRMBuffersAtomic( WstGLCtx *ctx )
    uint32_t blobId= 0;
    struct gbm_surface* gs;
    struct gbm_bo *bo;
-   uint32_t handle, stride;
    NativeWindowItem *nw;
 
    TRACE3("wstSwapDRMBuffersAtomic: atomic start");
@@ -6144,68 +8497,26 @@ static void wstSwapDRMBuffersAtomic( WstGLCtx *ctx )
                   uint32_t fbId;
                   wstUpdateResources( WSTRES_BO_GRAPHICS, true, (long long)bo, __LINE__);
 
-                  handle= gbm_bo_get_handle(bo).u32;
-                  stride= gbm_bo_get_stride(bo);
-
-                  #ifdef USE_GBM_MODIFIERS
-                  if ( gCtx->useGBMModifiers )
+                  rc= wstGraphicsFbGet( ctx, bo, nw->width, nw->height, &fbId );
+                  if ( rc )
                   {
-                     uint32_t handles[4]= { handle,
-                                            0,
-                                            0,
-                                            0 };
-                     uint32_t strides[4]= { stride,
-                                            0,
-                                            0,
-                                            0 };
-                     uint32_t offsets[4]= { gbm_bo_get_offset(bo, 0),
-                                            0,
-                                            0,
-                                            0};
-                     uint64_t modifiers[4]= { gbm_bo_get_modifier(bo),
-                                              0,
-                                              0,
-                                              0 };
-                     rc= drmModeAddFB2WithModifiers( ctx->drmFd,
-                                                     nw->width,
-                                                     nw->height,
-                                                     gbm_bo_get_format(bo),
-                                                     handles,
-                                                     strides,
-                                                     offsets,
-                                                     modifiers,
-                                                     &fbId,
-                                                     DRM_MODE_FB_MODIFIERS );
-                     if ( rc )
-                     {
-                        ERROR("wstSwapDRMBuffersAtomic: drmModeAddFB2WithModifiers rc %d errno %d", rc, errno);
-                        gbm_surface_release_buffer(gs, bo);
-                     }
+                     ERROR("wstSwapDRMBuffersAtomic: unable to get fb for bo %p", bo);
+                     wstUpdateResources( WSTRES_BO_GRAPHICS, false, (long long)bo, __LINE__);
+                     gbm_surface_release_buffer(gs, bo);
                   }
                   else
-                  #endif
-                  {
-                     rc= drmModeAddFB( ctx->drmFd,
-                                       nw->width,
-                                       nw->height,
-                                       32,
-                                       32,
-                                       stride,
-                                       handle,
-                                       &fbId );
-                     if ( rc )
-                     {
-                        ERROR("wstSwapDRMBuffersAtomic: drmModeAddFB rc %d errno %d", rc, errno);
-                        gbm_surface_release_buffer(gs, bo);
-                     }
-                  }
-                  if ( !rc )
                   {
                      nw->prevBo= nw->bo;
-                     nw->prevFbId= nw->fbId;
                      nw->fbId= fbId;
-                     wstUpdateResources( WSTRES_FB_GRAPHICS, true, nw->fbId, __LINE__);
                      nw->bo= bo;
+                     #ifdef DRM_USE_NATIVE_FENCE
+                     if ( nw->commitFenceFd >= 0 )
+                     {
+                        close( nw->commitFenceFd );
+                     }
+                     nw->commitFenceFd= nw->renderFenceFd;
+                     nw->renderFenceFd= -1;
+                     #endif
                   }
                }
             }
@@ -6282,9 +8593,15 @@ static void wstSwapDRMBuffersAtomic( WstGLCtx *ctx )
                                         nw->windowPlane->planeProps->count_props, nw->windowPlane->planePropRes,
                                         "CRTC_H", ctx->modeInfo->vdisplay );
 
+                  #ifdef DRM_USE_NATIVE_FENCE
+                  wstAtomicAddProperty( ctx, req, nw->windowPlane->plane->plane_id,
+                                        nw->windowPlane->planeProps->count_props, nw->windowPlane->planePropRes,
+                                        "IN_FENCE_FD", nw->commitFenceFd );
+                  #else
                   wstAtomicAddProperty( ctx, req, nw->windowPlane->plane->plane_id,
                                         nw->windowPlane->planeProps->count_props, nw->windowPlane->planePropRes,
                                         "IN_FENCE_FD", -1 );
+                  #endif
                   if ( ctx->useZPos )
                   {
                      wstAtomicAddProperty( ctx, req, nw->windowPlane->plane->plane_id,
@@ -6306,6 +8623,35 @@ static void wstSwapDRMBuffersAtomic( WstGLCtx *ctx )
       {
          if ( iter->dirty && iter->readyToFlip && iter->inUse )
          {
+            if ( iter->scanout && iter->hide )
+            {
+               /* Take the scanout plane off the display until it is given another buffer */
+               if ( ctx->outputEnable )
+               {
+                  wstAtomicAddProperty( ctx, req, iter->plane->plane_id,
+                                        iter->planeProps->count_props, iter->planePropRes,
+                                        "FB_ID", 0 );
+
+                  wstAtomicAddProperty( ctx, req, iter->plane->plane_id,
+                                        iter->planeProps->count_props, iter->planePropRes,
+                                        "CRTC_ID", 0 );
+               }
+
+               iter->videoFrame[FRAME_FREE]= iter->videoFrame[FRAME_PREV];
+               iter->videoFrame[FRAME_PREV]= iter->videoFrame[FRAME_CURR];
+
+               iter->videoFrame[FRAME_CURR].fbId= 0;
+               iter->videoFrame[FRAME_CURR].handle0= 0;
+               iter->videoFrame[FRAME_CURR].handle1= 0;
+               iter->videoFrame[FRAME_CURR].fd0= -1;
+               iter->videoFrame[FRAME_CURR].fd1= -1;
+               iter->videoFrame[FRAME_CURR].fd2= -1;
+               iter->videoFrame[FRAME_CURR].fenceFd= -1;
+               iter->videoFrame[FRAME_CURR].bufferId= -1;
+               iter->videoFrame[FRAME_CURR].frameNumber= 0;
+               iter->dirty= false;
+            }
+            else
             if ( iter->videoFrame[FRAME_NEXT].fbId ||
                  (iter->videoFrame[FRAME_CURR].fbId > 0) )
             {
@@ -6336,6 +8682,7 @@ static void wstSwapDRMBuffersAtomic( WstGLCtx *ctx )
                   iter->videoFrame[FRAME_NEXT].fd0= -1;
                   iter->videoFrame[FRAME_NEXT].fd1= -1;
                   iter->videoFrame[FRAME_NEXT].fd2= -1;
+                  iter->videoFrame[FRAME_NEXT].fenceFd= -1;
                   iter->videoFrame[FRAME_NEXT].hide= false;
                   iter->videoFrame[FRAME_NEXT].hidden= false;
                   iter->videoFrame[FRAME_NEXT].vf= 0;
@@ -6420,7 +8767,7 @@ static void wstSwapDRMBuffersAtomic( WstGLCtx *ctx )
                           dx, dy, dw, dh );
                }
 
-               if ( ctx->outputEnable && ctx->videoEnable )
+               if ( ctx->outputEnable && (ctx->videoEnable || iter->scanout) )
                {
                   wstAtomicAddProperty( ctx, req, iter->plane->plane_id,
                                         iter->planeProps->count_props, iter->planePropRes,
@@ -6477,7 +8824,7 @@ static void wstSwapDRMBuffersAtomic( WstGLCtx *ctx )
 
                   wstAtomicAddProperty( ctx, req, iter->plane->plane_id,
                                         iter->planeProps->count_props, iter->planePropRes,
-                                        "IN_FENCE_FD", -1 );
+                                        "IN_FENCE_FD", iter->videoFrame[FRAME_CURR].fenceFd );
                   if ( ctx->useZPos )
                   {
                      wstAtomicAddProperty( ctx, req, iter->plane->plane_id,
@@ -6502,15 +8849,41 @@ static void wstSwapDRMBuffersAtomic( WstGLCtx *ctx )
       ERROR("drmModeAtomicCommit failed: rc %d errno %d", rc, errno );
    }
 
-   #ifdef DRM_USE_OUT_FENCE
-   #ifdef USE_REFRESH_LOCK
-   if ( !ctx->modeSet || !g_useRefreshLock )
+   /* The kernel holds its own references to the in fences once the commit is queued */
+   pthread_mutex_lock( &ctx->mutex );
+   if ( ctx->overlayPlanes.usedCount )
    {
-   #endif
-   wstSwapWaitFence( ctx );
-   #ifdef USE_REFRESH_LOCK
+      WstOverlayPlane *iter= ctx->overlayPlanes.usedHead;
+      while( iter )
+      {
+         if ( iter->videoFrame[FRAME_CURR].fenceFd >= 0 )
+         {
+            close( iter->videoFrame[FRAME_CURR].fenceFd );
+            iter->videoFrame[FRAME_CURR].fenceFd= -1;
+         }
+         iter= iter->next;
+      }
+   }
+   pthread_mutex_unlock( &ctx->mutex );
+   #ifdef DRM_USE_NATIVE_FENCE
+   nw= gCtx->nwFirst;
+   while( nw )
+   {
+      if ( nw->commitFenceFd >= 0 )
+      {
+         close( nw->commitFenceFd );
+         nw->commitFenceFd= -1;
+      }
+      nw= nw->next;
    }
    #endif
+
+   #ifdef DRM_USE_OUT_FENCE
+   if ( flags & DRM_MODE_ATOMIC_ALLOW_MODESET )
+   {
+      /* Mode sets complete synchronously, page flips are retired by the refresh thread */
+      wstSwapWaitFence( ctx );
+   }
    #endif
 
    if ( (flags & DRM_MODE_ATOMIC_ALLOW_MODESET) && !rc )
@@ -6521,6 +8894,7 @@ static void wstSwapDRMBuffersAtomic( WstGLCtx *ctx )
       {
          ctx->defaultRate= ctx->modeInfo->vrefresh;
       }
+      wstVideoServerWake();
    }
 
 exit:
@@ -6542,11 +8916,37 @@ exit:
    return;
 }
 
+static void wstVideoFrameWaitFence( VideoFrame *f )
+{
+   if ( f->fenceFd >= 0 )
+   {
+      int rc;
+      struct pollfd pfd;
+
+      pfd.fd= f->fenceFd;
+      pfd.events= POLLIN;
+      pfd.revents= 0;
+
+      do
+      {
+         rc= poll( &pfd, 1, 100 );
+      }
+      while ( (rc == -1) && ((errno == EINTR) || (errno == EAGAIN)) );
+
+      if ( rc <= 0 )
+      {
+         if ( rc == 0 ) errno= ETIME;
+         ERROR("wstVideoFrameWaitFence: wait acquire fence failed: buffer %d fd %d errno %d", f->bufferId, f->fenceFd, errno);
+      }
+      close( f->fenceFd );
+      f->fenceFd= -1;
+   }
+}
+
 static void wstSwapDRMBuffers( WstGLCtx *ctx )
 {
    struct gbm_surface* gs;
    struct gbm_bo *bo;
-   uint32_t handle, stride;
    fd_set fds;
    drmEventContext ev;
    drmModePlane *plane= 0;
@@ -6570,6 +8970,7 @@ static void wstSwapDRMBuffers( WstGLCtx *ctx )
       ctx->notifySizeChange= true;
       ctx->modeCurrent= ctx->modeNext;
       ctx->modeSetPending= false;
+      wstVideoServerWake();
       #ifdef DRM_USE_OUT_FENCE
       #ifdef USE_REFRESH_LOCK
       if ( ctx->modeSet && g_useRefreshLock )
@@ -6598,30 +8999,18 @@ static void wstSwapDRMBuffers( WstGLCtx *ctx )
          {
             TRACE3("nw %p dirty", nw);
             nw->prevBo= nw->bo;
-            nw->prevFbId= nw->fbId;
             gs= (struct gbm_surface*)nw->nativeWindow;
             if ( gs )
             {
                bo= gbm_surface_lock_front_buffer(gs);
                wstUpdateResources( WSTRES_BO_GRAPHICS, true, (long long)bo, __LINE__);
 
-               handle= gbm_bo_get_handle(bo).u32;
-               stride= gbm_bo_get_stride(bo);
-
-               rc= drmModeAddFB( ctx->drmFd,
-                                 ctx->modeInfo->hdisplay,
-                                 ctx->modeInfo->vdisplay,
-                                 32,
-                                 32,
-                                 stride,
-                                 handle,
-                                 &nw->fbId );
+               rc= wstGraphicsFbGet( ctx, bo, ctx->modeInfo->hdisplay, ctx->modeInfo->vdisplay, &nw->fbId );
                 if ( rc )
                 {
-                   ERROR("wstSwapDRMBuffers: drmModeAddFB rc %d errno %d", rc, errno);
+                   ERROR("wstSwapDRMBuffers: unable to get fb for bo %p", bo);
                    goto exit;
                 }
-                wstUpdateResources( WSTRES_FB_GRAPHICS, true, nw->fbId, __LINE__);
                 nw->bo= bo;
 
                if ( !ctx->modeSet )
@@ -6640,6 +9029,7 @@ static void wstSwapDRMBuffers( WstGLCtx *ctx )
                       goto exit;
                    }
                    ctx->modeSet= true;
+                   wstVideoServerWake();
                }
                else if ( nw->windowPlane )
                {
@@ -6736,9 +9126,13 @@ static void wstSwapDRMBuffers( WstGLCtx *ctx )
                   iter->videoFrame[FRAME_NEXT].fd0= -1;
                   iter->videoFrame[FRAME_NEXT].fd1= -1;
                   iter->videoFrame[FRAME_NEXT].fd2= -1;
+                  iter->videoFrame[FRAME_NEXT].fenceFd= -1;
                   iter->videoFrame[FRAME_NEXT].hide= false;
                   iter->videoFrame[FRAME_NEXT].hidden= false;
 
+                  /* No IN_FENCE_FD with legacy set plane: the frame must be complete before it is shown */
+                  wstVideoFrameWaitFence( &iter->videoFrame[FRAME_CURR] );
+
                   sw= frameWidth;
                   sh= frameHeight;
                   dw= rectW;
@@ -6814,9 +9208,7 @@ static void wstSwapDRMBuffers( WstGLCtx *ctx )
                   }
                   else
                   {
-                     wstUpdateResources( WSTRES_FB_VIDEO, false, fbId, __LINE__);
-                     drmModeRmFB( gCtx->drmFd, fbId );
-                     wstClosePrimeFDHandles( ctx, handle0, handle1, __LINE__ );
+                     wstReleaseVideoFb( fbId, handle0, handle1, __LINE__ );
                      if ( fd0 >= 0 )
                      {
                         wstUpdateResources( WSTRES_FD_VIDEO, false, fd0, __LINE__);
@@ -6864,6 +9256,7 @@ static void wstSwapDRMBuffers( WstGLCtx *ctx )
                   iter->videoFrame[FRAME_CURR].fd0= -1;
                   iter->videoFrame[FRAME_CURR].fd1= -1;
                   iter->videoFrame[FRAME_CURR].fd2= -1;
+                  iter->videoFrame[FRAME_CURR].fenceFd= -1;
                   iter->videoFrame[FRAME_CURR].bufferId= -1;
                   iter->videoFrame[FRAME_NEXT].hide= true;
                   iter->videoFrame[FRAME_NEXT].hidden= true;
@@ -7197,26 +9590,56 @@ EGLAPI EGLBoolean eglSwapBuffers( EGLDisplay dpy, EGLSurface surface )
 {
    EGLBoolean result= EGL_FALSE;
    NativeWindowItem *nwIter;
+   #ifdef DRM_USE_NATIVE_FENCE
+   EGLSyncKHR renderSync= EGL_NO_SYNC_KHR;
+   #endif
 
    if ( gRealEGLSwapBuffers )
    {
       #ifdef DRM_USE_NATIVE_FENCE
-      if ( gCtx->nativeOutputFenceFd >= 0 )
+      if ( gCtx->haveNativeFence && gRealEGLDupNativeFenceFDANDROID )
+      {
+         /* Fence the rendering of this frame so the commit can pass it as IN_FENCE_FD */
+         renderSync= gRealEGLCreateSyncKHR( dpy, EGL_SYNC_NATIVE_FENCE_ANDROID, NULL );
+      }
       {
-         EGLint attrib[3];
-         attrib[0]= EGL_SYNC_NATIVE_FENCE_FD_ANDROID;
-         attrib[1]= gCtx->nativeOutputFenceFd;
-         attrib[2]= EGL_NONE;
-         gCtx->fenceSync= gRealEGLCreateSyncKHR( dpy, EGL_SYNC_NATIVE_FENCE_ANDROID, attrib );
-         if ( gCtx->fenceSync )
+         int outFenceFd= -1;
+
+         /*
+          * The refresh thread owns nativeOutputFenceFd and closes it once the
+          * commit completes, so wait on a copy taken under the lock
+          */
+         pthread_mutex_lock( &gMutex );
+         if ( gCtx->nativeOutputFenceFd >= 0 )
          {
-            TRACE2("fenceSync %p created for nativeOutputFenceFd %d", gCtx->fenceSync, gCtx->nativeOutputFenceFd);
-            gCtx->nativeOutputFenceFd= -1;
-            gRealEGLWaitSyncKHR( dpy, gCtx->fenceSync, 0);
+            outFenceFd= dup( gCtx->nativeOutputFenceFd );
          }
-         else
-         {
-            ERROR("failed to create fenceSync for nativeOutputFenceFd %d", gCtx->nativeOutputFenceFd);
+         pthread_mutex_unlock( &gMutex );
+         if ( outFenceFd >= 0 )
+         {
+            EGLSyncKHR fenceSync;
+            EGLint attrib[3];
+            attrib[0]= EGL_SYNC_NATIVE_FENCE_FD_ANDROID;
+            attrib[1]= outFenceFd;
+            attrib[2]= EGL_NONE;
+            fenceSync= gRealEGLCreateSyncKHR( dpy, EGL_SYNC_NATIVE_FENCE_ANDROID, attrib );
+            if ( fenceSync )
+            {
+               TRACE2("fenceSync %p created for out fence fd %d", fenceSync, outFenceFd);
+               gRealEGLWaitSyncKHR( dpy, fenceSync, 0);
+               pthread_mutex_lock( &gMutex );
+               if ( gCtx->fenceSync )
+               {
+                  gRealEGLDestroySyncKHR( dpy, gCtx->fenceSync );
+               }
+               gCtx->fenceSync= fenceSync;
+               pthread_mutex_unlock( &gMutex );
+            }
+            else
+            {
+               ERROR("failed to create fenceSync for out fence fd %d", outFenceFd);
+               close( outFenceFd );
+            }
          }
       }
       #endif
@@ -7265,6 +9688,13 @@ EGLAPI EGLBoolean eglSwapBuffers( EGLDisplay dpy, EGLSurface surface )
          result= gRealEGLSwapBuffers( dpy, surface );
          if ( EGL_TRUE == result )
          {
+            #ifdef DRM_USE_NATIVE_FENCE
+            int fenceFd= -1;
+            if ( renderSync != EGL_NO_SYNC_KHR )
+            {
+               fenceFd= gRealEGLDupNativeFenceFDANDROID( dpy, renderSync );
+            }
+            #endif
             if ( gCtx )
             {
                #ifdef EGL_SWAP_LOCK_2
@@ -7275,6 +9705,18 @@ EGLAPI EGLBoolean eglSwapBuffers( EGLDisplay dpy, EGLSurface surface )
                {
                   if ( nwIter->surface == surface )
                   {
+                     #ifdef DRM_USE_NATIVE_FENCE
+                     /* Publish the render fence with the dirty flag so a commit never takes the frame without it */
+                     if ( fenceFd >= 0 )
+                     {
+                        if ( nwIter->renderFenceFd >= 0 )
+                        {
+                           close( nwIter->renderFenceFd );
+                        }
+                        nwIter->renderFenceFd= fenceFd;
+                        fenceFd= -1;
+                     }
+                     #endif
                      gCtx->dirty= true;
                      nwIter->dirty= true;
                      TRACE3("mark nw %p dirty", nwIter);
@@ -7286,6 +9728,12 @@ EGLAPI EGLBoolean eglSwapBuffers( EGLDisplay dpy, EGLSurface surface )
                pthread_mutex_unlock( &gMutex );
                #endif
             }
+            #ifdef DRM_USE_NATIVE_FENCE
+            if ( fenceFd >= 0 )
+            {
+               close( fenceFd );
+            }
+            #endif
          }
          #ifndef EGL_SWAP_LOCK_2
          pthread_mutex_unlock( &gMutex );
@@ -7293,6 +9741,12 @@ EGLAPI EGLBoolean eglSwapBuffers( EGLDisplay dpy, EGLSurface surface )
       #ifdef USE_REFRESH_LOCK
       }
       #endif
+      #ifdef DRM_USE_NATIVE_FENCE
+      if ( renderSync != EGL_NO_SYNC_KHR )
+      {
+         gRealEGLDestroySyncKHR( dpy, renderSync );
+      }
+      #endif
    }
 
 exit:
@@ -7386,6 +9840,11 @@ WstGLCtx* WstGLInit()
       gRealEGLWaitSyncKHR= (PREALEGLWAITSYNCKHR)eglGetProcAddress( "eglWaitSyncKHR" );
       DEBUG("westeros-gl: wstGLInit: eglWaitSyncKHR=%p", (void*)gRealEGLWaitSyncKHR );
    }
+   if ( !gRealEGLDupNativeFenceFDANDROID )
+   {
+      gRealEGLDupNativeFenceFDANDROID= (PREALEGLDUPNATIVEFENCEFDANDROID)eglGetProcAddress( "eglDupNativeFenceFDANDROID" );
+      DEBUG("westeros-gl: wstGLInit: eglDupNativeFenceFDANDROID=%p", (void*)gRealEGLDupNativeFenceFDANDROID );
+   }
    #endif
 
    pthread_mutex_lock( &gMutex );
@@ -7810,6 +10269,29 @@ bool WstGLRemoveDisplaySizeListener( WstGLCtx *ctx, WstGLDisplaySizeCallback lis
    return result;
 }
 
+/*
+ * Obtain the time, in CLOCK_MONOTONIC microseconds, of the most recent vblank
+ * observed by the refresh thread along with the refresh interval and the
+ * vblank sequence number.
+ */
+bool WstGLGetVBlankInfo( WstGLCtx *ctx, WstGLVBlankInfo *vblankInfo )
+{
+   bool result= false;
+
+   if ( ctx && vblankInfo )
+   {
+      pthread_mutex_lock( &ctx->mutexVBlank );
+      if ( ctx->haveVBlankInfo )
+      {
+         *vblankInfo= ctx->vblankInfo;
+         result= true;
+      }
+      pthread_mutex_unlock( &ctx->mutexVBlank );
+   }
+
+   return result;
+}
+
 void* WstGLCreateNativeWindow( WstGLCtx *ctx, int x, int y, int width, int height )
 {
    void *nativeWindow= 0;
@@ -7831,6 +10313,10 @@ void* WstGLCreateNativeWindow( WstGLCtx *ctx, int x, int y, int width, int heigh
       nwItem= (NativeWindowItem*)calloc( 1, sizeof(NativeWindowItem) );
       if ( nwItem )
       {
+         #ifdef DRM_USE_NATIVE_FENCE
+         nwItem->renderFenceFd= -1;
+         nwItem->commitFenceFd= -1;
+         #endif
          #ifdef USE_REFRESH_LOCK
          pthread_mutex_init( &nwItem->mutexRefresh, 0 );
          pthread_cond_init( &nwItem->condRefresh, 0);
@@ -7959,9 +10445,7 @@ void WstGLDestroyNativeWindow( WstGLCtx *ctx, void *nativeWindow )
                if ( nwIter->prevBo )
                {
                   gbm_surface_release_buffer(gs, nwIter->prevBo);
-                  drmModeRmFB( ctx->drmFd, nwIter->prevFbId );
                   nwIter->prevBo= 0;
-                  nwIter->prevFbId= 0;
                }
                nwIter->nativeWindow= 0;
                if ( nwIter->windowPlane )
@@ -7980,6 +10464,16 @@ void WstGLDestroyNativeWindow( WstGLCtx *ctx, void *nativeWindow )
                {
                   ctx->nwLast= nwPrev;
                }
+               #ifdef DRM_USE_NATIVE_FENCE
+               if ( nwIter->renderFenceFd >= 0 )
+               {
+                  close( nwIter->renderFenceFd );
+               }
+               if ( nwIter->commitFenceFd >= 0 )
+               {
+                  close( nwIter->commitFenceFd );
+               }
+               #endif
                #ifdef USE_REFRESH_LOCK
                pthread_mutex_destroy( &nwIter->mutexRefresh );
                pthread_cond_destroy( &nwIter->condRefresh );
@@ -8043,3 +10537,306 @@ void* WstGLGetEGLNativePixmap( WstGLCtx *ctx, void *nativePixmap )
 
    return eglPixmap;
 }
+
+void* WstGLCreateScanout( WstGLCtx *ctx, WstGLScanoutRetireCallback retireCB, void *userData )
+{
+   WstGLScanout *scanout= 0;
+
+   if ( ctx && ctx->usePlanes && ctx->haveAtomic )
+   {
+      scanout= (WstGLScanout*)calloc( 1, sizeof(WstGLScanout) );
+      if ( scanout )
+      {
+         pthread_mutex_lock( &gMutex );
+         scanout->plane= wstOverlayAlloc( &ctx->overlayPlanes, false, false );
+         if ( scanout->plane )
+         {
+            scanout->plane->scanout= true;
+            scanout->plane->scanoutRetired= 0;
+            scanout->plane->scanoutHideFrame= 0;
+            scanout->plane->scanoutRetireCB= retireCB;
+            scanout->plane->scanoutUserData= userData;
+            scanout->plane->hide= true;
+         }
+         pthread_mutex_unlock( &gMutex );
+
+         if ( !scanout->plane )
+         {
+            DEBUG("WstGLCreateScanout: no plane available");
+            free( scanout );
+            scanout= 0;
+         }
+         else
+         {
+            INFO("scanout plane %p : zorder: %d", scanout->plane, scanout->plane->zOrder);
+         }
+      }
+   }
+
+   return scanout;
+}
+
+void WstGLDestroyScanout( WstGLCtx *ctx, void *scanout )
+{
+   WstGLScanout *so= (WstGLScanout*)scanout;
+
+   if ( ctx && so )
+   {
+      int i, rc;
+      drmModePlane *plane= so->plane->plane;
+
+      pthread_mutex_lock( &gMutex );
+      pthread_mutex_lock( &ctx->mutex );
+
+      so->plane->inUse= false;
+      so->plane->scanoutRetireCB= 0;
+      if ( ctx->enc && ctx->modeInfo )
+      {
+         long long delay= 16667*2LL;
+
+         plane->crtc_id= ctx->enc->crtc_id;
+         rc= drmModeSetPlane( ctx->drmFd,
+                              plane->plane_id,
+                              plane->crtc_id,
+                              0, // fbid
+                              0, // flags
+                              0, // plane x
+                              0, // plane y
+                              ctx->modeInfo->hdisplay,
+                              ctx->modeInfo->vdisplay,
+                              0, // fb rect x
+                              0, // fb rect y
+                              ctx->modeInfo->hdisplay<<16,
+                              ctx->modeInfo->vdisplay<<16 );
+         if ( rc )
+         {
+            ERROR("WstGLDestroyScanout: drmModeSetPlane rc %d errno %d", rc, errno );
+         }
+
+         /* Let the plane go idle before its fbs are removed */
+         if ( ctx->modeInfo->vrefresh )
+         {
+            delay= (1000000LL+(ctx->modeInfo->vrefresh/2))/ctx->modeInfo->vrefresh;
+         }
+         DEBUG("WstGLDestroyScanout: delay for %lld us", delay);
+         pthread_mutex_unlock( &ctx->mutex );
+         pthread_mutex_unlock( &gMutex );
+         usleep( delay );
+         pthread_mutex_lock( &gMutex );
+         pthread_mutex_lock( &ctx->mutex );
+      }
+
+      for( i= 0; i < ACTIVE_FRAMES; ++i )
+      {
+         wstFreeVideoFrameResources( &so->plane->videoFrame[i] );
+      }
+
+      pthread_mutex_unlock( &ctx->mutex );
+
+      wstOverlayFree( &ctx->overlayPlanes, so->plane );
+
+      pthread_mutex_unlock( &gMutex );
+
+      free( so );
+   }
+}
+
+/*
+ * Show a client buffer on a scanout plane at the given rectangle, in
+ * graphics coordinates.  Returns false if the plane can't display the
+ * buffer, in which case the caller should compose it instead.  This does
+ * not wait for the flip: the buffer stays in use until the retire callback
+ * reports a frame number at or beyond the one returned in frameNumber.
+ */
+bool WstGLSetScanoutBuffer( WstGLCtx *ctx, void *scanout, WstGLScanoutBuffer *buffer, int x, int y, int width, int height,
+                            int *frameNumber )
+{
+   bool result= false;
+   WstGLScanout *so= (WstGLScanout*)scanout;
+   uint32_t handles[4]= { 0, 0, 0, 0 };
+   uint32_t pitches[4]= { 0, 0, 0, 0 };
+   uint32_t offsets[4]= { 0, 0, 0, 0 };
+   #ifdef USE_GBM_MODIFIERS
+   uint64_t modifiers[4]= { 0, 0, 0, 0 };
+   #endif
+   uint32_t handle0= 0, handle1= 0;
+   uint32_t fbId= 0;
+   int i, rc;
+
+   if ( !ctx || !so || !buffer || !frameNumber )
+   {
+      goto exit;
+   }
+
+   if ( !ctx->haveAtomic || !ctx->modeSet || !ctx->modeInfo ||
+        (buffer->planeCount < 1) || (buffer->planeCount > 4) ||
+        (width <= 0) || (height <= 0) )
+   {
+      goto exit;
+   }
+
+   for( i= 0; i < so->plane->plane->count_formats; ++i )
+   {
+      if ( so->plane->plane->formats[i] == buffer->format )
+      {
+         break;
+      }
+   }
+   if ( i >= so->plane->plane->count_formats )
+   {
+      TRACE1("WstGLSetScanoutBuffer: format %X not supported by plane %d", buffer->format, so->plane->plane->plane_id);
+      goto exit;
+   }
+
+   for( i= 0; i < buffer->planeCount; ++i )
+   {
+      rc= drmPrimeFDToHandle( ctx->drmFd, buffer->fd[i], &handles[i] );
+      if ( rc )
+      {
+         ERROR("WstGLSetScanoutBuffer: drmPrimeFDToHandle failed: fd %d rc %d errno %d", buffer->fd[i], rc, errno);
+         goto exit;
+      }
+      /* Frames track at most two distinct gem handles */
+      if ( !handle0 || (handles[i] == handle0) )
+      {
+         if ( !handle0 ) wstUpdateResources( WSTRES_HD_VIDEO, true, handles[i], __LINE__);
+         handle0= handles[i];
+      }
+      else if ( !handle1 || (handles[i] == handle1) )
+      {
+         if ( !handle1 ) wstUpdateResources( WSTRES_HD_VIDEO, true, handles[i], __LINE__);
+         handle1= handles[i];
+      }
+      else
+      {
+         DEBUG("WstGLSetScanoutBuffer: too many buffer objects");
+         wstUpdateResources( WSTRES_HD_VIDEO, true, handles[i], __LINE__);
+         wstClosePrimeFDHandles( ctx, handles[i], 0, __LINE__ );
+         goto exit;
+      }
+      pitches[i]= buffer->stride[i];
+      offsets[i]= buffer->offset[i];
+      #ifdef USE_GBM_MODIFIERS
+      modifiers[i]= buffer->modifier;
+      #endif
+   }
+
+   #ifdef USE_GBM_MODIFIERS
+   if ( buffer->modifier && (buffer->modifier != DRM_FORMAT_MOD_INVALID) )
+   {
+      rc= drmModeAddFB2WithModifiers( ctx->drmFd,
+                                      buffer->width,
+                                      buffer->height,
+                                      buffer->format,
+                                      handles,
+                                      pitches,
+                                      offsets,
+                                      modifiers,
+                                      &fbId,
+                                      DRM_MODE_FB_MODIFIERS );
+   }
+   else
+   #else
+   if ( buffer->modifier && (buffer->modifier != DRM_FORMAT_MOD_INVALID) )
+   {
+      DEBUG("WstGLSetScanoutBuffer: buffer modifiers not supported");
+      goto exit;
+   }
+   else
+   #endif
+   {
+      rc= drmModeAddFB2( ctx->drmFd,
+                         buffer->width,
+                         buffer->height,
+                         buffer->format,
+                         handles,
+                         pitches,
+                         offsets,
+                         &fbId,
+                         0 // flags
+                       );
+   }
+   if ( rc )
+   {
+      ERROR("WstGLSetScanoutBuffer: drmModeAddFB2 failed: rc %d errno %d", rc, errno);
+      goto exit;
+   }
+   wstUpdateResources( WSTRES_FB_VIDEO, true, fbId, __LINE__);
+
+   pthread_mutex_lock( &gMutex );
+   if ( so->plane->videoFrame[FRAME_NEXT].fbId )
+   {
+      /* Replace a buffer that was never displayed */
+      wstFreeVideoFrameResources( &so->plane->videoFrame[FRAME_NEXT] );
+   }
+   *frameNumber= ++so->frameNumber;
+   so->plane->videoFrame[FRAME_NEXT].plane= so->plane;
+   so->plane->videoFrame[FRAME_NEXT].hide= false;
+   so->plane->videoFrame[FRAME_NEXT].hidden= false;
+   so->plane->videoFrame[FRAME_NEXT].canExpire= false;
+   so->plane->videoFrame[FRAME_NEXT].dropped= false;
+   so->plane->videoFrame[FRAME_NEXT].fbId= fbId;
+   so->plane->videoFrame[FRAME_NEXT].handle0= handle0;
+   so->plane->videoFrame[FRAME_NEXT].handle1= handle1;
+   so->plane->videoFrame[FRAME_NEXT].fd0= -1;
+   so->plane->videoFrame[FRAME_NEXT].fd1= -1;
+   so->plane->videoFrame[FRAME_NEXT].fd2= -1;
+   so->plane->videoFrame[FRAME_NEXT].fenceFd= -1;
+   so->plane->videoFrame[FRAME_NEXT].frameFormat= buffer->format;
+   so->plane->videoFrame[FRAME_NEXT].frameWidth= buffer->width;
+   so->plane->videoFrame[FRAME_NEXT].frameHeight= buffer->height;
+   so->plane->videoFrame[FRAME_NEXT].frameWidthVisible= buffer->width;
+   so->plane->videoFrame[FRAME_NEXT].frameHeightVisible= buffer->height;
+   so->plane->videoFrame[FRAME_NEXT].rectX= x;
+   so->plane->videoFrame[FRAME_NEXT].rectY= y;
+   so->plane->videoFrame[FRAME_NEXT].rectW= width;
+   so->plane->videoFrame[FRAME_NEXT].rectH= height;
+   so->plane->videoFrame[FRAME_NEXT].frameNumber= *frameNumber;
+   so->plane->videoFrame[FRAME_NEXT].bufferId= -1;
+   so->plane->videoFrame[FRAME_NEXT].frameTime= 0;
+   so->plane->videoFrame[FRAME_NEXT].vf= 0;
+   so->plane->hide= false;
+   so->plane->dirty= true;
+   so->plane->readyToFlip= true;
+   ctx->dirty= true;
+   ctx->forceDirty= true;
+   pthread_mutex_unlock( &gMutex );
+
+   FRAME("scanout frame %d fb %u (%d,%d,%d,%d)", *frameNumber, fbId, x, y, width, height);
+
+   handle0= handle1= 0;
+   result= true;
+
+exit:
+   if ( !result )
+   {
+      wstClosePrimeFDHandles( ctx, handle0, handle1, __LINE__ );
+   }
+
+   return result;
+}
+
+void WstGLHideScanout( WstGLCtx *ctx, void *scanout )
+{
+   WstGLScanout *so= (WstGLScanout*)scanout;
+
+   if ( ctx && so )
+   {
+      pthread_mutex_lock( &gMutex );
+      if ( !so->plane->hide )
+      {
+         if ( so->plane->videoFrame[FRAME_NEXT].fbId )
+         {
+            wstFreeVideoFrameResources( &so->plane->videoFrame[FRAME_NEXT] );
+         }
+         so->plane->hide= true;
+         so->plane->scanoutHideFrame= so->frameNumber;
+         so->plane->dirty= true;
+         so->plane->readyToFlip= true;
+         ctx->dirty= true;
+         ctx->forceDirty= true;
+      }
+      pthread_mutex_unlock( &gMutex );
+   }
+}
+
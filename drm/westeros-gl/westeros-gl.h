@@ -59,6 +59,40 @@ typedef struct _WstGLDisplayInfo
 
 typedef void (*WstGLDisplaySizeCallback)( void *userData, int width, int height );
 
+#define WESTEROS_GL_VBLANK_INFO
+
+typedef struct _WstGLVBlankInfo
+{
+   long long vblankTime;
+   long long vblankInterval;
+   unsigned int vblankCount;
+} WstGLVBlankInfo;
+
+#define WESTEROS_GL_SCANOUT
+
+/*
+ * A client dmabuf to be displayed directly on an overlay plane.  The fds
+ * only need to remain valid for the duration of WstGLSetScanoutBuffer but
+ * the buffer contents are read until the frame is retired.
+ */
+typedef struct _WstGLScanoutBuffer
+{
+   unsigned int format;
+   int width;
+   int height;
+   int planeCount;
+   int fd[4];
+   unsigned int offset[4];
+   unsigned int stride[4];
+   unsigned long long modifier;
+} WstGLScanoutBuffer;
+
+/*
+ * Called from the display refresh thread once every scanout frame up to and
+ * including frameNumber is off screen.  It must not call back into WstGL.
+ */
+typedef void (*WstGLScanoutRetireCallback)( void *userData, int frameNumber );
+
 WstGLCtx* WstGLInit();
 void WstGLTerm( WstGLCtx *ctx );
 bool WstGLGetDisplayCaps( WstGLCtx *ctx, unsigned int *caps );
@@ -67,12 +101,18 @@ bool WstGLGetDisplayInfo( WstGLCtx *ctx, WstGLDisplayInfo *displayInfo );
 bool WstGLGetDisplaySafeArea( WstGLCtx *ctx, int *x, int *y, int *w, int *h );
 bool WstGLAddDisplaySizeListener( WstGLCtx *ctx, void *userData, WstGLDisplaySizeCallback listener );
 bool WstGLRemoveDisplaySizeListener( WstGLCtx *ctx, WstGLDisplaySizeCallback listener );
+bool WstGLGetVBlankInfo( WstGLCtx *ctx, WstGLVBlankInfo *vblankInfo );
 void* WstGLCreateNativeWindow( WstGLCtx *ctx, int x, int y, int width, int height );
 void WstGLDestroyNativeWindow( WstGLCtx *ctx, void *nativeWindow );
 bool WstGLGetNativePixmap( WstGLCtx *ctx, void *nativeBuffer, void **nativePixmap );
 void WstGLGetNativePixmapDimensions( WstGLCtx *ctx, void *nativePixmap, int *width, int *height );
 void WstGLReleaseNativePixmap( WstGLCtx *ctx, void *nativePixmap );
 void* WstGLGetEGLNativePixmap( WstGLCtx *ctx, void *nativePixmap );
+void* WstGLCreateScanout( WstGLCtx *ctx, WstGLScanoutRetireCallback retireCB, void *userData );
+void WstGLDestroyScanout( WstGLCtx *ctx, void *scanout );
+bool WstGLSetScanoutBuffer( WstGLCtx *ctx, void *scanout, WstGLScanoutBuffer *buffer, int x, int y, int width, int height,
+                            int *frameNumber );
+void WstGLHideScanout( WstGLCtx *ctx, void *scanout );
 
 #if defined(__cplusplus)
 } //extern "C"
@@ -0,0 +1,137 @@
+/*
+ * If not stated otherwise in this file or this component's Licenses.txt file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2018 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "westeros-pixel.h"
+
+#define FRAME_WIDTH (1920)
+#define FRAME_HEIGHT (1080)
+#define FRAME_COUNT (100)
+
+static const char *gKernelNames[]= { "scalar", "sse2", "avx2", "neon" };
+static const char *gOpNames[WstPixelOp_count]= { "fillAlpha", "swapRB", "swapRBFillAlpha", "rotate", "rotateFillAlpha" };
+
+static long long getCurrentTimeMicros()
+{
+   struct timespec tm;
+   clock_gettime( CLOCK_MONOTONIC, &tm );
+   return tm.tv_sec*1000000LL+tm.tv_nsec/1000LL;
+}
+
+static void convertFrame( WstPixelRowFunc convert, unsigned char *dst, const unsigned char *src, int width )
+{
+   int y;
+   int stride= FRAME_WIDTH*4;
+
+   for( y= 0; y < FRAME_HEIGHT; ++y )
+   {
+      convert( dst+y*stride, src+y*stride, width );
+   }
+}
+
+int main()
+{
+   int result= -1;
+   int i, k, op, frame;
+   int size= FRAME_WIDTH*FRAME_HEIGHT*4;
+   unsigned char *src= 0;
+   unsigned char *dst= 0;
+   unsigned char *ref= 0;
+   const WstPixelKernels *scalar, *kernels;
+   long long start, end;
+   double msPerFrame, scalarMs[WstPixelOp_count];
+
+   src= (unsigned char*)malloc( size+4 );
+   dst= (unsigned char*)malloc( size+4 );
+   ref= (unsigned char*)malloc( size+4 );
+   if ( !src || !dst || !ref )
+   {
+      printf("Error: no memory for frame buffers\n");
+      goto exit;
+   }
+
+   srand( 1 );
+   for( i= 0; i < size+4; ++i )
+   {
+      src[i]= rand();
+   }
+
+   printf("Westeros pixel kernels: default %s\n", WstPixelGetKernels(0)->name);
+   printf("%dx%d frames, %d iterations\n", FRAME_WIDTH, FRAME_HEIGHT, FRAME_COUNT);
+
+   scalar= WstPixelGetKernels( "scalar" );
+   result= 0;
+   for( k= 0; k < (int)(sizeof(gKernelNames)/sizeof(gKernelNames[0])); ++k )
+   {
+      kernels= WstPixelGetKernels( gKernelNames[k] );
+      if ( !kernels )
+      {
+         printf("%-8s not available\n", gKernelNames[k]);
+         continue;
+      }
+      for( op= 0; op < WstPixelOp_count; ++op )
+      {
+         // Use an odd row width and source offset so tails and unaligned access are verified
+         convertFrame( scalar->row[op], ref, src+1, FRAME_WIDTH-3 );
+         convertFrame( kernels->row[op], dst, src+1, FRAME_WIDTH-3 );
+         for( i= 0; i < FRAME_HEIGHT; ++i )
+         {
+            if ( memcmp( dst+i*FRAME_WIDTH*4, ref+i*FRAME_WIDTH*4, (FRAME_WIDTH-3)*4 ) )
+            {
+               printf("Error: %s %s output does not match scalar at row %d\n", kernels->name, gOpNames[op], i);
+               result= -1;
+               break;
+            }
+         }
+
+         start= getCurrentTimeMicros();
+         for( frame= 0; frame < FRAME_COUNT; ++frame )
+         {
+            convertFrame( kernels->row[op], dst, src, FRAME_WIDTH );
+         }
+         end= getCurrentTimeMicros();
+         msPerFrame= (end-start)/(1000.0*FRAME_COUNT);
+         if ( kernels == scalar )
+         {
+            scalarMs[op]= msPerFrame;
+         }
+         printf("%-8s %-16s %7.3f ms/frame  %5.2fx\n", kernels->name, gOpNames[op], msPerFrame, scalarMs[op]/msPerFrame);
+      }
+   }
+
+exit:
+   if ( src )
+   {
+      free( src );
+   }
+   if ( dst )
+   {
+      free( dst );
+   }
+   if ( ref )
+   {
+      free( ref );
+   }
+
+   return result;
+}
+
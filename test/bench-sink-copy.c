@@ -0,0 +1,227 @@
+/*
+ * If not stated otherwise in this file or this component's Licenses.txt file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2018 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <drm/drm.h>
+
+#include "westeros-sink-copy.h"
+
+/*
+ * Measure the cost of the sinks' I420 to NV12 frame copy into a real DRM
+ * dumb buffer when the buffer is mapped for every frame, as the sinks used
+ * to do, and when it is kept mapped.  A copy into cached memory is timed
+ * for reference.
+ */
+
+#define FRAME_WIDTH (1920)
+#define FRAME_HEIGHT (1080)
+#define FRAME_COUNT (100)
+
+static long long getCurrentTimeMicros()
+{
+   struct timespec tm;
+   clock_gettime( CLOCK_MONOTONIC, &tm );
+   return tm.tv_sec*1000000LL+tm.tv_nsec/1000LL;
+}
+
+/*
+ * Copy an I420 frame into NV12 planes the way the sinks fill a DRM buffer.
+ */
+static void copyFrame( unsigned char *dstY, unsigned char *dstUV, int pitch, const unsigned char *src )
+{
+   const unsigned char *srcU= src+FRAME_WIDTH*FRAME_HEIGHT;
+   const unsigned char *srcV= srcU+(FRAME_WIDTH/2)*(FRAME_HEIGHT/2);
+
+   wstCopyPlane( dstY, pitch, src, FRAME_WIDTH, FRAME_WIDTH, FRAME_HEIGHT );
+   wstInterleaveUV( dstUV, pitch, srcU, FRAME_WIDTH/2, srcV, FRAME_WIDTH/2, FRAME_WIDTH/2, FRAME_HEIGHT/2 );
+}
+
+static bool checkFrame( const unsigned char *dst, int pitch, const unsigned char *src )
+{
+   const unsigned char *srcU= src+FRAME_WIDTH*FRAME_HEIGHT;
+   const unsigned char *srcV= srcU+(FRAME_WIDTH/2)*(FRAME_HEIGHT/2);
+   const unsigned char *dstUV= dst+pitch*FRAME_HEIGHT;
+   int i, j;
+
+   for( i= 0; i < FRAME_HEIGHT; ++i )
+   {
+      if ( memcmp( dst+i*pitch, src+i*FRAME_WIDTH, FRAME_WIDTH ) )
+      {
+         printf("Error: luma mismatch at row %d\n", i);
+         return false;
+      }
+   }
+   for( i= 0; i < FRAME_HEIGHT/2; ++i )
+   {
+      for( j= 0; j < FRAME_WIDTH/2; ++j )
+      {
+         if ( (dstUV[i*pitch+j*2] != srcU[i*(FRAME_WIDTH/2)+j]) ||
+              (dstUV[i*pitch+j*2+1] != srcV[i*(FRAME_WIDTH/2)+j]) )
+         {
+            printf("Error: chroma mismatch at row %d\n", i);
+            return false;
+         }
+      }
+   }
+
+   return true;
+}
+
+int main( int argc, const char **argv )
+{
+   int result= -1;
+   int i, frame, drmFd= -1;
+   int srcSize= FRAME_WIDTH*FRAME_HEIGHT*3/2;
+   const char *deviceName= "/dev/dri/card0";
+   unsigned char *src= 0;
+   unsigned char *dst= 0;
+   unsigned char *map;
+   struct drm_mode_create_dumb createDumb;
+   struct drm_mode_map_dumb mapDumb;
+   struct drm_mode_destroy_dumb destroyDumb;
+   long long start, end;
+   double cachedMs, mapMs, msPerFrame;
+
+   memset( &createDumb, 0, sizeof(createDumb) );
+
+   if ( argc > 1 )
+   {
+      deviceName= argv[1];
+   }
+
+   src= (unsigned char*)malloc( srcSize );
+   dst= (unsigned char*)malloc( FRAME_WIDTH*FRAME_HEIGHT*3/2 );
+   if ( !src || !dst )
+   {
+      printf("Error: no memory for frame buffers\n");
+      goto exit;
+   }
+
+   srand( 1 );
+   for( i= 0; i < srcSize; ++i )
+   {
+      src[i]= rand();
+   }
+
+   printf("%dx%d I420 to NV12 frames, %d iterations\n", FRAME_WIDTH, FRAME_HEIGHT, FRAME_COUNT);
+
+   start= getCurrentTimeMicros();
+   for( frame= 0; frame < FRAME_COUNT; ++frame )
+   {
+      copyFrame( dst, dst+FRAME_WIDTH*FRAME_HEIGHT, FRAME_WIDTH, src );
+   }
+   end= getCurrentTimeMicros();
+   if ( !checkFrame( dst, FRAME_WIDTH, src ) )
+   {
+      goto exit;
+   }
+   cachedMs= (end-start)/(1000.0*FRAME_COUNT);
+   printf("%-16s %7.3f ms/frame\n", "cached", cachedMs);
+
+   drmFd= open( deviceName, O_RDWR | O_CLOEXEC );
+   if ( drmFd < 0 )
+   {
+      printf("Error: unable to open %s: errno %d\n", deviceName, errno);
+      goto exit;
+   }
+
+   // An 8 bpp dumb buffer with 3/2 the frame height holds both NV12 planes
+   createDumb.width= FRAME_WIDTH;
+   createDumb.height= FRAME_HEIGHT*3/2;
+   createDumb.bpp= 8;
+   if ( ioctl( drmFd, DRM_IOCTL_MODE_CREATE_DUMB, &createDumb ) )
+   {
+      printf("Error: DRM_IOCTL_MODE_CREATE_DUMB failed: errno %d\n", errno);
+      createDumb.handle= 0;
+      goto exit;
+   }
+   memset( &mapDumb, 0, sizeof(mapDumb) );
+   mapDumb.handle= createDumb.handle;
+   if ( ioctl( drmFd, DRM_IOCTL_MODE_MAP_DUMB, &mapDumb ) )
+   {
+      printf("Error: DRM_IOCTL_MODE_MAP_DUMB failed: errno %d\n", errno);
+      goto exit;
+   }
+
+   start= getCurrentTimeMicros();
+   for( frame= 0; frame < FRAME_COUNT; ++frame )
+   {
+      map= (unsigned char*)mmap( NULL, createDumb.size, PROT_READ | PROT_WRITE, MAP_SHARED, drmFd, mapDumb.offset );
+      if ( map == MAP_FAILED )
+      {
+         printf("Error: mmap of dumb buffer failed: errno %d\n", errno);
+         goto exit;
+      }
+      copyFrame( map, map+createDumb.pitch*FRAME_HEIGHT, createDumb.pitch, src );
+      munmap( map, createDumb.size );
+   }
+   end= getCurrentTimeMicros();
+   mapMs= (end-start)/(1000.0*FRAME_COUNT);
+   printf("%-16s %7.3f ms/frame  %5.2fx cached\n", "mapPerFrame", mapMs, mapMs/cachedMs);
+
+   map= (unsigned char*)mmap( NULL, createDumb.size, PROT_READ | PROT_WRITE, MAP_SHARED, drmFd, mapDumb.offset );
+   if ( map == MAP_FAILED )
+   {
+      printf("Error: mmap of dumb buffer failed: errno %d\n", errno);
+      goto exit;
+   }
+   start= getCurrentTimeMicros();
+   for( frame= 0; frame < FRAME_COUNT; ++frame )
+   {
+      copyFrame( map, map+createDumb.pitch*FRAME_HEIGHT, createDumb.pitch, src );
+   }
+   end= getCurrentTimeMicros();
+   munmap( map, createDumb.size );
+   msPerFrame= (end-start)/(1000.0*FRAME_COUNT);
+   printf("%-16s %7.3f ms/frame  %5.2fx cached  %5.2fx faster than mapPerFrame\n",
+          "mapPersistent", msPerFrame, msPerFrame/cachedMs, mapMs/msPerFrame);
+
+   result= 0;
+
+exit:
+   if ( drmFd >= 0 )
+   {
+      if ( createDumb.handle )
+      {
+         memset( &destroyDumb, 0, sizeof(destroyDumb) );
+         destroyDumb.handle= createDumb.handle;
+         ioctl( drmFd, DRM_IOCTL_MODE_DESTROY_DUMB, &destroyDumb );
+      }
+      close( drmFd );
+   }
+   if ( src )
+   {
+      free( src );
+   }
+   if ( dst )
+   {
+      free( dst );
+   }
+
+   return result;
+}
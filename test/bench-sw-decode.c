@@ -0,0 +1,475 @@
+/*
+ * If not stated otherwise in this file or this component's Licenses.txt file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2018 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <drm/drm.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
+
+/*
+ * Compare the two ways the sink's software decode path can fill DRM dumb
+ * buffers with an H.264 stream: decoding into cached memory and copying the
+ * frame into a dumb buffer, or decoding the luma plane straight into dumb
+ * buffers.  Dumb buffers are write-combined on most drivers, so the second
+ * way makes motion compensation and deblocking read uncached memory.
+ */
+
+#define MAX_DUMB_BUFFERS (48)
+#define PLANE_ALIGN (64)
+#define PLANE_PAD (128)
+#define ALIGN( n, a ) (((n)+(a)-1) & ~((a)-1))
+
+typedef struct _DumbBuffer
+{
+   pthread_mutex_t *mutex;
+   bool inUse;
+   int width;
+   int height;
+   uint32_t handle;
+   int pitch;
+   int size;
+   uint8_t *map;
+} DumbBuffer;
+
+typedef struct _BenchCtx
+{
+   int drmFd;
+   pthread_mutex_t mutex;
+   DumbBuffer buffer[MAX_DUMB_BUFFERS];
+   AVBufferPool *chromaPool;
+   int chromaPoolSize;
+   DumbBuffer *out;
+} BenchCtx;
+
+static long long getCurrentTimeMicros()
+{
+   struct timespec tm;
+   clock_gettime( CLOCK_MONOTONIC, &tm );
+   return tm.tv_sec*1000000LL+tm.tv_nsec/1000LL;
+}
+
+static void freeDumb( BenchCtx *ctx, DumbBuffer *buff )
+{
+   if ( buff->map )
+   {
+      munmap( buff->map, buff->size );
+      buff->map= 0;
+   }
+   if ( buff->handle )
+   {
+      struct drm_mode_destroy_dumb destroyDumb;
+      memset( &destroyDumb, 0, sizeof(destroyDumb) );
+      destroyDumb.handle= buff->handle;
+      ioctl( ctx->drmFd, DRM_IOCTL_MODE_DESTROY_DUMB, &destroyDumb );
+      buff->handle= 0;
+   }
+}
+
+static bool allocDumb( BenchCtx *ctx, DumbBuffer *buff, int width, int height )
+{
+   bool result= false;
+   struct drm_mode_create_dumb createDumb;
+   struct drm_mode_map_dumb mapDumb;
+
+   memset( &createDumb, 0, sizeof(createDumb) );
+   createDumb.width= width;
+   createDumb.height= height;
+   createDumb.bpp= 8;
+   if ( ioctl( ctx->drmFd, DRM_IOCTL_MODE_CREATE_DUMB, &createDumb ) )
+   {
+      printf("Error: DRM_IOCTL_MODE_CREATE_DUMB failed: errno %d\n", errno);
+      goto exit;
+   }
+   buff->handle= createDumb.handle;
+   buff->pitch= createDumb.pitch;
+   buff->size= createDumb.size;
+
+   memset( &mapDumb, 0, sizeof(mapDumb) );
+   mapDumb.handle= buff->handle;
+   if ( ioctl( ctx->drmFd, DRM_IOCTL_MODE_MAP_DUMB, &mapDumb ) )
+   {
+      printf("Error: DRM_IOCTL_MODE_MAP_DUMB failed: errno %d\n", errno);
+      goto exit;
+   }
+   buff->map= (uint8_t*)mmap( NULL, buff->size, PROT_READ | PROT_WRITE, MAP_SHARED, ctx->drmFd, mapDumb.offset );
+   if ( buff->map == MAP_FAILED )
+   {
+      printf("Error: mmap of dumb buffer failed: errno %d\n", errno);
+      buff->map= 0;
+      goto exit;
+   }
+   buff->width= width;
+   buff->height= height;
+
+   result= true;
+
+exit:
+   if ( !result )
+   {
+      freeDumb( ctx, buff );
+   }
+   return result;
+}
+
+static void freeDumbLuma( void *opaque, uint8_t *data )
+{
+   DumbBuffer *buff= (DumbBuffer*)opaque;
+
+   (void)data;
+   pthread_mutex_lock( buff->mutex );
+   buff->inUse= false;
+   pthread_mutex_unlock( buff->mutex );
+}
+
+/*
+ * Decode luma into dumb buffers the same way the sink's swGetBuffer2 does.
+ */
+static int getBufferDumb( AVCodecContext *avctx, AVFrame *frame, int flags )
+{
+   BenchCtx *ctx= (BenchCtx*)avctx->opaque;
+   DumbBuffer *buff= 0;
+   AVBufferRef *chroma= 0;
+   int linesizeAlign[AV_NUM_DATA_POINTERS];
+   int width, height, chromaStride, chromaPlaneSize, i;
+
+   if ( frame->format != AV_PIX_FMT_YUV420P )
+   {
+      return avcodec_default_get_buffer2( avctx, frame, flags );
+   }
+
+   width= frame->width;
+   height= frame->height;
+   avcodec_align_dimensions2( avctx, &width, &height, linesizeAlign );
+   width= ALIGN( width, PLANE_ALIGN );
+   height= ALIGN( height, 2 );
+   chromaStride= ALIGN( width/2, PLANE_ALIGN );
+   chromaPlaneSize= ALIGN( chromaStride*(height/2)+PLANE_PAD, PLANE_ALIGN );
+
+   pthread_mutex_lock( &ctx->mutex );
+   for( i= 0; i < MAX_DUMB_BUFFERS; ++i )
+   {
+      if ( !ctx->buffer[i].inUse )
+      {
+         buff= &ctx->buffer[i];
+         if ( (buff->width != width) || (buff->height != height+2) )
+         {
+            freeDumb( ctx, buff );
+            if ( !allocDumb( ctx, buff, width, height+2 ) )
+            {
+               buff= 0;
+            }
+         }
+         break;
+      }
+   }
+   if ( buff )
+   {
+      buff->inUse= true;
+      if ( ctx->chromaPoolSize != 2*chromaPlaneSize )
+      {
+         if ( ctx->chromaPool )
+         {
+            av_buffer_pool_uninit( &ctx->chromaPool );
+         }
+         ctx->chromaPoolSize= 2*chromaPlaneSize;
+         ctx->chromaPool= av_buffer_pool_init( ctx->chromaPoolSize, NULL );
+      }
+      chroma= ctx->chromaPool ? av_buffer_pool_get( ctx->chromaPool ) : 0;
+      if ( !chroma )
+      {
+         buff->inUse= false;
+         buff= 0;
+      }
+   }
+   pthread_mutex_unlock( &ctx->mutex );
+
+   if ( !buff )
+   {
+      return AVERROR(ENOMEM);
+   }
+
+   frame->buf[0]= av_buffer_create( buff->map, buff->size, freeDumbLuma, buff, 0 );
+   if ( !frame->buf[0] )
+   {
+      freeDumbLuma( buff, buff->map );
+      av_buffer_unref( &chroma );
+      return AVERROR(ENOMEM);
+   }
+   frame->buf[1]= chroma;
+   frame->data[0]= buff->map;
+   frame->linesize[0]= buff->pitch;
+   frame->data[1]= chroma->data;
+   frame->linesize[1]= chromaStride;
+   frame->data[2]= chroma->data+chromaPlaneSize;
+   frame->linesize[2]= chromaStride;
+   frame->extended_data= frame->data;
+
+   return 0;
+}
+
+/*
+ * Fill the display's NV12 dumb buffer: the luma copy is skipped when it
+ * was decoded in place.
+ */
+static void outputFrame( BenchCtx *ctx, AVFrame *frame, bool copyLuma )
+{
+   DumbBuffer *out= ctx->out;
+   uint8_t *dst, *srcU, *srcV;
+   int x, y;
+
+   if ( !out->map || (out->width != frame->width) || (out->height != frame->height*3/2) )
+   {
+      freeDumb( ctx, out );
+      if ( !allocDumb( ctx, out, frame->width, frame->height*3/2 ) )
+      {
+         return;
+      }
+   }
+   if ( copyLuma )
+   {
+      for( y= 0; y < frame->height; ++y )
+      {
+         memcpy( out->map+y*out->pitch, frame->data[0]+y*frame->linesize[0], frame->width );
+      }
+   }
+   for( y= 0; y < frame->height/2; ++y )
+   {
+      dst= out->map+(frame->height+y)*out->pitch;
+      srcU= frame->data[1]+y*frame->linesize[1];
+      srcV= frame->data[2]+y*frame->linesize[2];
+      for( x= 0; x < frame->width/2; ++x )
+      {
+         dst[2*x]= srcU[x];
+         dst[2*x+1]= srcV[x];
+      }
+   }
+}
+
+static int decodeStream( BenchCtx *ctx, const uint8_t *data, int size, bool direct, int threads,
+                         double *msPerFrame )
+{
+   int result= -1;
+   const AVCodec *codec;
+   AVCodecContext *avctx= 0;
+   AVCodecParserContext *parser= 0;
+   AVPacket *packet= 0;
+   AVFrame *frame= 0;
+   int frameCount= 0, consumed, rc;
+   long long start, end;
+
+   codec= avcodec_find_decoder( AV_CODEC_ID_H264 );
+   avctx= codec ? avcodec_alloc_context3( codec ) : 0;
+   parser= av_parser_init( AV_CODEC_ID_H264 );
+   packet= av_packet_alloc();
+   frame= av_frame_alloc();
+   if ( !avctx || !parser || !packet || !frame )
+   {
+      printf("Error: unable to create h264 decoder\n");
+      goto exit;
+   }
+   avctx->thread_count= threads;
+   avctx->thread_type= FF_THREAD_FRAME | FF_THREAD_SLICE;
+   if ( direct )
+   {
+      avctx->opaque= ctx;
+      avctx->get_buffer2= getBufferDumb;
+   }
+   if ( avcodec_open2( avctx, codec, NULL ) )
+   {
+      printf("Error: avcodec_open2 failed\n");
+      goto exit;
+   }
+
+   start= getCurrentTimeMicros();
+   while( size >= 0 )
+   {
+      consumed= av_parser_parse2( parser, avctx, &packet->data, &packet->size,
+                                  data, size, AV_NOPTS_VALUE, AV_NOPTS_VALUE, 0 );
+      if ( consumed < 0 )
+      {
+         break;
+      }
+      data += consumed;
+      size -= consumed;
+      if ( packet->size || (size == 0) )
+      {
+         avcodec_send_packet( avctx, packet->size ? packet : NULL );
+         for( ; ; )
+         {
+            rc= avcodec_receive_frame( avctx, frame );
+            if ( rc )
+            {
+               break;
+            }
+            outputFrame( ctx, frame, !direct );
+            av_frame_unref( frame );
+            ++frameCount;
+         }
+         if ( !packet->size )
+         {
+            break;
+         }
+      }
+   }
+   end= getCurrentTimeMicros();
+
+   if ( frameCount )
+   {
+      *msPerFrame= (end-start)/(1000.0*frameCount);
+      printf("%-8s %5d frames %7.3f ms/frame\n", direct ? "direct" : "copy", frameCount, *msPerFrame);
+      result= 0;
+   }
+   else
+   {
+      printf("Error: no frames decoded\n");
+   }
+
+exit:
+   if ( frame )
+   {
+      av_frame_free( &frame );
+   }
+   if ( packet )
+   {
+      av_packet_free( &packet );
+   }
+   if ( parser )
+   {
+      av_parser_close( parser );
+   }
+   if ( avctx )
+   {
+      avcodec_free_context( &avctx );
+   }
+   return result;
+}
+
+int main( int argc, const char **argv )
+{
+   int result= -1;
+   const char *fileName;
+   const char *deviceName= "/dev/dri/card0";
+   int threads= 4;
+   FILE *file= 0;
+   uint8_t *data= 0;
+   long size;
+   BenchCtx ctx;
+   double copyMs= 0.0, directMs= 0.0;
+   int i;
+
+   memset( &ctx, 0, sizeof(ctx) );
+   ctx.drmFd= -1;
+   pthread_mutex_init( &ctx.mutex, 0 );
+   for( i= 0; i < MAX_DUMB_BUFFERS; ++i )
+   {
+      ctx.buffer[i].mutex= &ctx.mutex;
+   }
+
+   if ( argc < 2 )
+   {
+      printf("usage: bench-sw-decode <file.h264> [threads] [drm-device]\n");
+      goto exit;
+   }
+   fileName= argv[1];
+   if ( argc > 2 )
+   {
+      threads= atoi( argv[2] );
+   }
+   if ( argc > 3 )
+   {
+      deviceName= argv[3];
+   }
+
+   file= fopen( fileName, "rb" );
+   if ( !file || fseek( file, 0, SEEK_END ) || ((size= ftell( file )) <= 0) || fseek( file, 0, SEEK_SET ) )
+   {
+      printf("Error: unable to read %s\n", fileName);
+      goto exit;
+   }
+   data= (uint8_t*)calloc( 1, size+AV_INPUT_BUFFER_PADDING_SIZE );
+   if ( !data || (fread( data, 1, size, file ) != (size_t)size) )
+   {
+      printf("Error: unable to read %s\n", fileName);
+      goto exit;
+   }
+
+   ctx.drmFd= open( deviceName, O_RDWR | O_CLOEXEC );
+   if ( ctx.drmFd < 0 )
+   {
+      printf("Error: unable to open %s: errno %d\n", deviceName, errno);
+      goto exit;
+   }
+   ctx.out= (DumbBuffer*)calloc( 1, sizeof(DumbBuffer) );
+   if ( !ctx.out )
+   {
+      goto exit;
+   }
+
+   printf("Westeros sw decode into %s dumb buffers: %s, %d threads\n", deviceName, fileName, threads);
+   if ( decodeStream( &ctx, data, size, false, threads, &copyMs ) ||
+        decodeStream( &ctx, data, size, true, threads, &directMs ) )
+   {
+      goto exit;
+   }
+   printf("direct/copy time ratio %5.2f\n", directMs/copyMs);
+   result= 0;
+
+exit:
+   if ( ctx.drmFd >= 0 )
+   {
+      for( i= 0; i < MAX_DUMB_BUFFERS; ++i )
+      {
+         freeDumb( &ctx, &ctx.buffer[i] );
+      }
+      if ( ctx.out )
+      {
+         freeDumb( &ctx, ctx.out );
+      }
+      close( ctx.drmFd );
+   }
+   if ( ctx.out )
+   {
+      free( ctx.out );
+   }
+   if ( ctx.chromaPool )
+   {
+      av_buffer_pool_uninit( &ctx.chromaPool );
+   }
+   pthread_mutex_destroy( &ctx.mutex );
+   if ( data )
+   {
+      free( data );
+   }
+   if ( file )
+   {
+      fclose( file );
+   }
+   return result;
+}
@@ -359,6 +359,8 @@ struct gbm_bo
    bool locked;
    union gbm_bo_handle handle;
    uint32_t fbId;
+   void *userData;
+   void (*destroyUserData)(struct gbm_bo *bo, void *data);
 };
 
 struct gbm_surface
@@ -4243,6 +4245,8 @@ struct gbm_surface *gbm_surface_create( struct gbm_device *gbm,
                surface->buffers[i].locked= false;
                surface->buffers[i].handle.u32= ++gbm->dev->ctx->nextGbmBuffHandle;
                surface->buffers[i].fbId= ++gbm->dev->dev.drm.nextId;
+               surface->buffers[i].userData= 0;
+               surface->buffers[i].destroyUserData= 0;
                gbm->dev->ctx->gbmBuffs.push_back( &surface->buffers[i] );
             }
          }
@@ -4286,6 +4290,10 @@ void gbm_surface_destroy( struct gbm_surface *surface )
       TRACE1("gbm_surface_destroy: gbm_surface %p gbm %p dev %p", surface, surface->gbm), surface->gbm->dev;
       for( int i= 0; i < 3; ++i )
       {
+         if ( surface->buffers[i].destroyUserData )
+         {
+            surface->buffers[i].destroyUserData( &surface->buffers[i], surface->buffers[i].userData );
+         }
          for( std::vector<struct gbm_bo*>::iterator it= surface->gbm->dev->ctx->gbmBuffs.begin();
               it != surface->gbm->dev->ctx->gbmBuffs.end();
               ++it )
@@ -4434,6 +4442,36 @@ uint64_t gbm_bo_get_modifier(struct gbm_bo *bo)
    return modifier;
 }
 
+void gbm_bo_set_user_data(struct gbm_bo *bo, void *data,
+                          void (*destroy_user_data)(struct gbm_bo *, void *))
+{
+   if ( bo->surface->nw.magic == EM_WINDOW_MAGIC )
+   {
+      bo->userData= data;
+      bo->destroyUserData= destroy_user_data;
+   }
+   else
+   {
+      ERROR("gbm_bo_set_user_data: bad gbm_bo %p", bo);
+   }
+}
+
+void *gbm_bo_get_user_data(struct gbm_bo *bo)
+{
+   void *data= 0;
+
+   if ( bo->surface->nw.magic == EM_WINDOW_MAGIC )
+   {
+      data= bo->userData;
+   }
+   else
+   {
+      ERROR("gbm_bo_get_user_data: bad gbm_bo %p", bo);
+   }
+
+   return data;
+}
+
 } //extern "C"
 
 
@@ -0,0 +1,22 @@
+#!/bin/bash
+unset LD_PRELOAD
+export LD_LIBRARY_PATH=../lib
+case $1 in
+  brcm)
+  pushd brcm/external/install/bin ;;
+  drm)
+  pushd drm/external/install/bin
+  export LD_PRELOAD=../lib/libwesteros_gl.so.0.0.0 ;;
+  *)
+  echo "bad platform"
+  exit ;;
+esac
+shift
+killall westeros-unittest
+export LD_PRELOAD=$LD_PRELOAD:../lib/libwesteros-ut-em.so
+export XDG_RUNTIME_DIR=/tmp
+unset WAYLAND_DISPLAY
+./westeros-unittest -w -s -x benchmark $@
+popd
+unset LD_PRELOAD
+unset LD_LIBRARY_PATH
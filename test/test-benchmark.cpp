@@ -0,0 +1,897 @@
+/*
+ * If not stated otherwise in this file or this component's Licenses.txt file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2018 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include <vector>
+#include <algorithm>
+
+#include "test-benchmark.h"
+#include "test-egl.h"
+
+#include "westeros-compositor.h"
+#include "wayland-client.h"
+#include "wayland-egl.h"
+#include "simplebuffer-client-protocol.h"
+
+/*
+ * Compositor throughput benchmark
+ *
+ * Runs a compositor on the emulated platform with a number of synthetic
+ * clients, each on its own thread and connection, committing new content at
+ * a fixed rate.  After a warm up period the compositor frame rate, compositor
+ * thread CPU time per frame, client commit to frame callback latency and
+ * process memory high water mark are measured and reported.
+ */
+
+#define BENCH_WARMUP_MILLIS (1000)
+#define BENCH_DISPATCH_TIMEOUT_MILLIS (100)
+
+typedef enum _BenchClientType
+{
+   BenchClient_shm,
+   BenchClient_dmabuf,
+   BenchClient_egl,
+   BenchClient_count
+} BenchClientType;
+
+static const char *gClientTypeNames[BenchClient_count]= { "shm", "dmabuf", "egl" };
+
+typedef struct _BenchCtx BenchCtx;
+
+typedef struct _BenchClient
+{
+   BenchCtx *bench;
+   int index;
+   BenchClientType type;
+   pthread_t threadId;
+   bool threadStarted;
+   bool error;
+   struct wl_display *display;
+   struct wl_registry *registry;
+   struct wl_compositor *compositor;
+   struct wl_shm *shm;
+   struct wl_sb *sb;
+   struct wl_surface *surface;
+   struct wl_callback *frameCallback;
+   TestEGLCtx eglCtx;
+   struct wl_egl_window *wlEglWindow;
+   char filename[32];
+   int fd;
+   unsigned char *data;
+   int frameSize;
+   struct wl_shm_pool *shmPool;
+   struct wl_buffer *buffer[2];
+   int bufferIndex;
+   long long commitTime;
+   int commitCount;
+   int frameCount;
+   std::vector<long long> latency;
+} BenchClient;
+
+typedef struct _BenchCtx
+{
+   int clientCount[BenchClient_count];
+   int rate;
+   int width;
+   int height;
+   int seconds;
+   bool measuring;
+   bool stopRequested;
+   int frameCount;
+   long long firstFrameTime;
+   long long lastFrameTime;
+   long long firstCpuTime;
+   long long lastCpuTime;
+   long long sceneTime;
+   long long bytesUploaded;
+} BenchCtx;
+
+static long long getThreadCpuTimeMicros( void )
+{
+   struct timespec tm;
+   clock_gettime( CLOCK_THREAD_CPUTIME_ID, &tm );
+   return tm.tv_sec*1000000LL+tm.tv_nsec/1000LL;
+}
+
+static long long getProcessCpuTimeMicros( void )
+{
+   struct rusage usage;
+   getrusage( RUSAGE_SELF, &usage );
+   return (usage.ru_utime.tv_sec+usage.ru_stime.tv_sec)*1000000LL+usage.ru_utime.tv_usec+usage.ru_stime.tv_usec;
+}
+
+static void registryHandleGlobal(void *data,
+                                 struct wl_registry *registry, uint32_t id,
+                                 const char *interface, uint32_t version)
+{
+   BenchClient *client= (BenchClient*)data;
+   int len;
+
+   len= strlen(interface);
+
+   if ( (len==13) && !strncmp(interface, "wl_compositor", len) ) {
+      client->compositor= (struct wl_compositor*)wl_registry_bind(registry, id, &wl_compositor_interface, 1);
+   }
+   else if ( (len==6) && !strncmp(interface, "wl_shm", len)) {
+      client->shm= (struct wl_shm*)wl_registry_bind(registry, id, &wl_shm_interface, 1);
+   }
+   else if ( (len==5) && !strncmp(interface, "wl_sb", len) && (version >= 2) ) {
+      client->sb= (struct wl_sb*)wl_registry_bind(registry, id, &wl_sb_interface, 2);
+   }
+}
+
+static void registryHandleGlobalRemove(void *data,
+                                      struct wl_registry *registry,
+                                      uint32_t name)
+{
+}
+
+static const struct wl_registry_listener registryListener =
+{
+   registryHandleGlobal,
+   registryHandleGlobalRemove
+};
+
+static void frameDone( void *data, struct wl_callback *callback, uint32_t time )
+{
+   BenchClient *client= (BenchClient*)data;
+   long long now= EMGetCurrentTimeMicro();
+
+   wl_callback_destroy( callback );
+   client->frameCallback= 0;
+   ++client->frameCount;
+   if ( client->bench->measuring )
+   {
+      client->latency.push_back( now-client->commitTime );
+   }
+}
+
+static const struct wl_callback_listener frameListener=
+{
+   frameDone
+};
+
+static void frameStats( WstCompositor *wctx, const WstFrameStats *stats, void *userData )
+{
+   BenchCtx *bench= (BenchCtx*)userData;
+   long long cpuTime;
+
+   if ( bench->measuring )
+   {
+      // Runs on the compositor thread so thread CPU time is that of the compositor
+      cpuTime= getThreadCpuTimeMicros();
+      if ( bench->frameCount == 0 )
+      {
+         bench->firstFrameTime= stats->frameTime;
+         bench->firstCpuTime= cpuTime;
+      }
+      else
+      {
+         bench->sceneTime += stats->sceneTime;
+         if ( stats->bytesUploaded > 0 )
+         {
+            bench->bytesUploaded += stats->bytesUploaded;
+         }
+      }
+      bench->lastFrameTime= stats->frameTime;
+      bench->lastCpuTime= cpuTime;
+      ++bench->frameCount;
+   }
+}
+
+static int dispatchEvents( struct wl_display *display, int timeoutMillis )
+{
+   struct pollfd pfd;
+   int rc;
+
+   while ( wl_display_prepare_read( display ) != 0 )
+   {
+      wl_display_dispatch_pending( display );
+   }
+   wl_display_flush( display );
+
+   pfd.fd= wl_display_get_fd( display );
+   pfd.events= POLLIN;
+   pfd.revents= 0;
+   rc= poll( &pfd, 1, timeoutMillis );
+   if ( rc > 0 )
+   {
+      rc= wl_display_read_events( display );
+   }
+   else
+   {
+      wl_display_cancel_read( display );
+      rc= 0;
+   }
+   if ( rc >= 0 )
+   {
+      rc= wl_display_dispatch_pending( display );
+   }
+
+   return rc;
+}
+
+static bool setupClient( BenchClient *client, const char *displayName )
+{
+   bool result= false;
+   BenchCtx *bench= client->bench;
+   int poolSize;
+
+   client->display= wl_display_connect( displayName );
+   if ( !client->display )
+   {
+      printf("Error: client %d: wl_display_connect failed\n", client->index);
+      goto exit;
+   }
+
+   client->registry= wl_display_get_registry( client->display );
+   if ( !client->registry )
+   {
+      printf("Error: client %d: wl_display_get_registry failed\n", client->index);
+      goto exit;
+   }
+
+   wl_registry_add_listener( client->registry, &registryListener, client );
+
+   wl_display_roundtrip( client->display );
+
+   if ( !client->compositor )
+   {
+      printf("Error: client %d: failed to acquire compositor\n", client->index);
+      goto exit;
+   }
+
+   client->surface= wl_compositor_create_surface( client->compositor );
+   if ( !client->surface )
+   {
+      printf("Error: client %d: unable to create wayland surface\n", client->index);
+      goto exit;
+   }
+
+   switch( client->type )
+   {
+      case BenchClient_shm:
+      case BenchClient_dmabuf:
+         if ( (client->type == BenchClient_shm) && !client->shm )
+         {
+            printf("Error: client %d: wl_shm not available\n", client->index);
+            goto exit;
+         }
+         if ( (client->type == BenchClient_dmabuf) && !client->sb )
+         {
+            printf("Error: client %d: wl_sb not available\n", client->index);
+            goto exit;
+         }
+
+         if ( client->type == BenchClient_shm )
+         {
+            client->frameSize= bench->width*bench->height*4;
+         }
+         else
+         {
+            // NV12: full size luma plane followed by half size interleaved chroma plane
+            client->frameSize= bench->width*bench->height*3/2;
+         }
+         poolSize= 2*client->frameSize;
+
+         strcpy( client->filename, "/tmp/westeros-bench-XXXXXX" );
+         client->fd= mkostemp( client->filename, O_CLOEXEC );
+         if ( client->fd < 0 )
+         {
+            printf("Error: client %d: unable to create temp file\n", client->index);
+            goto exit;
+         }
+         if ( ftruncate( client->fd, poolSize ) < 0 )
+         {
+            printf("Error: client %d: unable to size temp file\n", client->index);
+            goto exit;
+         }
+
+         client->data= (unsigned char*)mmap( NULL, poolSize, PROT_READ | PROT_WRITE, MAP_SHARED, client->fd, 0 );
+         if ( client->data == MAP_FAILED )
+         {
+            client->data= 0;
+            printf("Error: client %d: unable to mmap buffer data\n", client->index);
+            goto exit;
+         }
+
+         if ( client->type == BenchClient_shm )
+         {
+            client->shmPool= wl_shm_create_pool( client->shm, client->fd, poolSize );
+            if ( !client->shmPool )
+            {
+               printf("Error: client %d: unable to create shm pool\n", client->index);
+               goto exit;
+            }
+         }
+
+         for( int i= 0; i < 2; ++i )
+         {
+            int offset= i*client->frameSize;
+            if ( client->type == BenchClient_shm )
+            {
+               client->buffer[i]= wl_shm_pool_create_buffer( client->shmPool,
+                                                             offset,
+                                                             bench->width,
+                                                             bench->height,
+                                                             bench->width*4,
+                                                             WL_SHM_FORMAT_ARGB8888 );
+            }
+            else
+            {
+               client->buffer[i]= wl_sb_create_planar_buffer_fd( client->sb,
+                                                                 client->fd,
+                                                                 bench->width,
+                                                                 bench->height,
+                                                                 WL_SB_FORMAT_NV12,
+                                                                 offset,
+                                                                 bench->width,
+                                                                 offset+bench->width*bench->height,
+                                                                 bench->width,
+                                                                 0,
+                                                                 0 );
+            }
+            if ( !client->buffer[i] )
+            {
+               printf("Error: client %d: unable to create buffer\n", client->index);
+               goto exit;
+            }
+         }
+         break;
+      case BenchClient_egl:
+         if ( !testSetupEGL( &client->eglCtx, client->display ) )
+         {
+            printf("Error: client %d: testSetupEGL failed\n", client->index);
+            goto exit;
+         }
+
+         client->wlEglWindow= wl_egl_window_create( client->surface, bench->width, bench->height );
+         if ( !client->wlEglWindow )
+         {
+            printf("Error: client %d: unable to create wl_egl_window\n", client->index);
+            goto exit;
+         }
+
+         client->eglCtx.eglSurfaceWindow= eglCreateWindowSurface( client->eglCtx.eglDisplay,
+                                                                  client->eglCtx.eglConfig,
+                                                                  (EGLNativeWindowType)client->wlEglWindow,
+                                                                  NULL );
+         if ( client->eglCtx.eglSurfaceWindow == EGL_NO_SURFACE )
+         {
+            printf("Error: client %d: eglCreateWindowSurface failed: %X\n", client->index, eglGetError());
+            goto exit;
+         }
+
+         if ( !eglMakeCurrent( client->eglCtx.eglDisplay, client->eglCtx.eglSurfaceWindow, client->eglCtx.eglSurfaceWindow, client->eglCtx.eglContext ) )
+         {
+            printf("Error: client %d: eglMakeCurrent failed: %X\n", client->index, eglGetError());
+            goto exit;
+         }
+
+         // Pace with frame callbacks rather than inside eglSwapBuffers
+         eglSwapInterval( client->eglCtx.eglDisplay, 0 );
+         break;
+      default:
+         goto exit;
+   }
+
+   wl_display_roundtrip( client->display );
+
+   result= true;
+
+exit:
+   return result;
+}
+
+static void termClient( BenchClient *client )
+{
+   if ( client->frameCallback )
+   {
+      wl_callback_destroy( client->frameCallback );
+      client->frameCallback= 0;
+   }
+
+   if ( client->eglCtx.eglSurfaceWindow )
+   {
+      eglMakeCurrent( client->eglCtx.eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT );
+      eglDestroySurface( client->eglCtx.eglDisplay, client->eglCtx.eglSurfaceWindow );
+      client->eglCtx.eglSurfaceWindow= EGL_NO_SURFACE;
+   }
+
+   if ( client->wlEglWindow )
+   {
+      wl_egl_window_destroy( client->wlEglWindow );
+      client->wlEglWindow= 0;
+   }
+
+   testTermEGL( &client->eglCtx );
+
+   for( int i= 0; i < 2; ++i )
+   {
+      if ( client->buffer[i] )
+      {
+         wl_buffer_destroy( client->buffer[i] );
+         client->buffer[i]= 0;
+      }
+   }
+
+   if ( client->surface )
+   {
+      wl_surface_destroy( client->surface );
+      client->surface= 0;
+   }
+
+   if ( client->shmPool )
+   {
+      wl_shm_pool_destroy( client->shmPool );
+      client->shmPool= 0;
+   }
+
+   if ( client->shm )
+   {
+      wl_shm_destroy( client->shm );
+      client->shm= 0;
+   }
+
+   if ( client->sb )
+   {
+      wl_sb_destroy( client->sb );
+      client->sb= 0;
+   }
+
+   if ( client->compositor )
+   {
+      wl_compositor_destroy( client->compositor );
+      client->compositor= 0;
+   }
+
+   if ( client->registry )
+   {
+      wl_registry_destroy( client->registry );
+      client->registry= 0;
+   }
+
+   if ( client->display )
+   {
+      wl_display_roundtrip( client->display );
+      wl_display_disconnect( client->display );
+      client->display= 0;
+   }
+
+   if ( client->data )
+   {
+      munmap( client->data, 2*client->frameSize );
+      client->data= 0;
+   }
+
+   if ( client->fd >= 0 )
+   {
+      close( client->fd );
+      client->fd= -1;
+      remove( client->filename );
+   }
+}
+
+static void commitFrame( BenchClient *client )
+{
+   BenchCtx *bench= client->bench;
+
+   client->frameCallback= wl_surface_frame( client->surface );
+   wl_callback_add_listener( client->frameCallback, &frameListener, client );
+
+   if ( client->type == BenchClient_egl )
+   {
+      client->commitTime= EMGetCurrentTimeMicro();
+      eglSwapBuffers( client->eglCtx.eglDisplay, client->eglCtx.eglSurfaceWindow );
+   }
+   else
+   {
+      // Touch every byte of the frame as a producer would
+      memset( client->data+client->bufferIndex*client->frameSize, client->commitCount, client->frameSize );
+
+      client->commitTime= EMGetCurrentTimeMicro();
+      wl_surface_attach( client->surface, client->buffer[client->bufferIndex], 0, 0 );
+      wl_surface_damage( client->surface, 0, 0, bench->width, bench->height );
+      wl_surface_commit( client->surface );
+      client->bufferIndex ^= 1;
+   }
+   wl_display_flush( client->display );
+
+   ++client->commitCount;
+}
+
+static void* clientThread( void *arg )
+{
+   BenchClient *client= (BenchClient*)arg;
+   BenchCtx *bench= client->bench;
+   long long period, nextCommit, now;
+
+   if ( !setupClient( client, "bench0" ) )
+   {
+      client->error= true;
+      goto exit;
+   }
+
+   period= (bench->rate > 0) ? 1000000LL/bench->rate : 0;
+   nextCommit= EMGetCurrentTimeMicro();
+   while( !bench->stopRequested )
+   {
+      now= EMGetCurrentTimeMicro();
+      if ( now < nextCommit )
+      {
+         usleep( nextCommit-now );
+      }
+      else
+      {
+         // Behind schedule: don't try to catch up with a burst of commits
+         nextCommit= now;
+      }
+      nextCommit += period;
+
+      commitFrame( client );
+
+      while( client->frameCallback && !bench->stopRequested )
+      {
+         if ( dispatchEvents( client->display, BENCH_DISPATCH_TIMEOUT_MILLIS ) < 0 )
+         {
+            printf("Error: client %d: lost connection to compositor\n", client->index);
+            client->error= true;
+            goto exit;
+         }
+      }
+   }
+
+exit:
+   termClient( client );
+
+   return NULL;
+}
+
+static long long percentile( std::vector<long long> &sorted, int percent )
+{
+   if ( sorted.size() == 0 )
+   {
+      return 0;
+   }
+   return sorted[((sorted.size()-1)*percent)/100];
+}
+
+static void reportLatency( const char *name, int clientCount, std::vector<long long> &latency )
+{
+   std::sort( latency.begin(), latency.end() );
+   printf("%-8s %3d %8d  %8.3f %8.3f %8.3f %8.3f\n",
+          name,
+          clientCount,
+          (int)latency.size(),
+          percentile( latency, 50 )/1000.0,
+          percentile( latency, 90 )/1000.0,
+          percentile( latency, 99 )/1000.0,
+          percentile( latency, 100 )/1000.0 );
+}
+
+static void showBenchmarkUsage( void )
+{
+   printf("Usage:\n");
+   printf(" westeros-unittest -w -x benchmark <options>\n");
+   printf("where: options are:\n");
+   printf(" -shm <n> : number of SHM clients (default 1)\n" );
+   printf(" -dmabuf <n> : number of dmabuf (wl_sb fd) clients (default 0)\n" );
+   printf(" -egl <n> : number of EGL clients (default 1)\n" );
+   printf(" -rate <fps> : commit rate of each client, 0 for as fast as frame callbacks allow (default 60)\n" );
+   printf(" -size <w>x<h> : client surface size (default 640x480)\n" );
+   printf(" -time <seconds> : measurement duration (default 10)\n" );
+   printf("\n");
+}
+
+void runBenchmark(int argc, const char **argv)
+{
+   EMCTX *emctx= 0;
+   WstCompositor *wctx= 0;
+   BenchCtx bench;
+   std::vector<BenchClient*> clients;
+   WstFrameHistogram histogram;
+   long long startTime, endTime, startCpu, endCpu;
+   struct rusage usage;
+   int argidx, i, t;
+   bool error= true;
+
+   memset( &bench, 0, sizeof(BenchCtx) );
+   bench.clientCount[BenchClient_shm]= 1;
+   bench.clientCount[BenchClient_egl]= 1;
+   bench.rate= 60;
+   bench.width= 640;
+   bench.height= 480;
+   bench.seconds= 10;
+
+   argidx= 1;
+   while( argidx < argc )
+   {
+      const char *arg= argv[argidx];
+      const char *value= (argidx+1 < argc) ? argv[argidx+1] : 0;
+
+      if ( !value )
+      {
+         showBenchmarkUsage();
+         goto exit;
+      }
+      if ( !strcmp( arg, "-shm" ) )
+      {
+         bench.clientCount[BenchClient_shm]= atoi( value );
+      }
+      else if ( !strcmp( arg, "-dmabuf" ) )
+      {
+         bench.clientCount[BenchClient_dmabuf]= atoi( value );
+      }
+      else if ( !strcmp( arg, "-egl" ) )
+      {
+         bench.clientCount[BenchClient_egl]= atoi( value );
+      }
+      else if ( !strcmp( arg, "-rate" ) )
+      {
+         bench.rate= atoi( value );
+      }
+      else if ( !strcmp( arg, "-size" ) )
+      {
+         if ( sscanf( value, "%dx%d", &bench.width, &bench.height ) != 2 )
+         {
+            showBenchmarkUsage();
+            goto exit;
+         }
+      }
+      else if ( !strcmp( arg, "-time" ) )
+      {
+         bench.seconds= atoi( value );
+      }
+      else
+      {
+         showBenchmarkUsage();
+         goto exit;
+      }
+      argidx += 2;
+   }
+
+   if ( (bench.width <= 0) || (bench.height <= 0) || (bench.seconds <= 0) || (bench.rate < 0) )
+   {
+      showBenchmarkUsage();
+      goto exit;
+   }
+
+   printf("Westeros compositor benchmark: shm %d dmabuf %d egl %d rate %d size %dx%d time %d s\n",
+          bench.clientCount[BenchClient_shm],
+          bench.clientCount[BenchClient_dmabuf],
+          bench.clientCount[BenchClient_egl],
+          bench.rate,
+          bench.width,
+          bench.height,
+          bench.seconds );
+
+   emctx= EMCreateContext();
+   if ( !emctx )
+   {
+      printf("Error: EMCreateContext failed\n");
+      goto exit;
+   }
+
+   EMStart( emctx );
+
+   wctx= WstCompositorCreate();
+   if ( !wctx )
+   {
+      EMERROR( "WstCompositorCreate failed" );
+      goto exit;
+   }
+
+   if ( !WstCompositorSetDisplayName( wctx, "bench0" ) )
+   {
+      EMERROR( "WstCompositorSetDisplayName failed" );
+      goto exit;
+   }
+
+   if ( !WstCompositorSetRendererModule( wctx, "libwesteros_render_gl.so.0.0.0" ) )
+   {
+      EMERROR( "WstCompositorSetRendererModule failed" );
+      goto exit;
+   }
+
+   if ( !WstCompositorSetFrameStatsCallback( wctx, frameStats, &bench ) )
+   {
+      EMERROR( "WstCompositorSetFrameStatsCallback failed" );
+      goto exit;
+   }
+
+   if ( !WstCompositorStart( wctx ) )
+   {
+      EMERROR( "WstCompositorStart failed" );
+      goto exit;
+   }
+
+   for( t= 0; t < BenchClient_count; ++t )
+   {
+      for( i= 0; i < bench.clientCount[t]; ++i )
+      {
+         BenchClient *client= (BenchClient*)calloc( 1, sizeof(BenchClient) );
+         if ( !client )
+         {
+            EMERROR( "No memory for client" );
+            goto exit;
+         }
+         client->bench= &bench;
+         client->index= clients.size();
+         client->type= (BenchClientType)t;
+         client->fd= -1;
+         clients.push_back( client );
+         if ( pthread_create( &client->threadId, NULL, clientThread, client ) )
+         {
+            EMERROR( "Unable to start client thread" );
+            goto exit;
+         }
+         client->threadStarted= true;
+      }
+   }
+
+   usleep( BENCH_WARMUP_MILLIS*1000 );
+
+   WstCompositorResetFrameHistogram( wctx );
+   startTime= EMGetCurrentTimeMicro();
+   startCpu= getProcessCpuTimeMicros();
+   bench.measuring= true;
+
+   usleep( bench.seconds*1000000LL );
+
+   bench.measuring= false;
+   endTime= EMGetCurrentTimeMicro();
+   endCpu= getProcessCpuTimeMicros();
+   WstCompositorGetFrameHistogram( wctx, &histogram );
+
+   bench.stopRequested= true;
+   for( i= 0; i < (int)clients.size(); ++i )
+   {
+      if ( clients[i]->threadStarted )
+      {
+         pthread_join( clients[i]->threadId, NULL );
+         clients[i]->threadStarted= false;
+      }
+   }
+
+   getrusage( RUSAGE_SELF, &usage );
+
+   printf("=============================================================================\n");
+   if ( bench.frameCount > 1 )
+   {
+      int intervals= bench.frameCount-1;
+      printf("frames                 %d\n", bench.frameCount );
+      printf("frames/sec             %.2f\n", intervals*1000000.0/(bench.lastFrameTime-bench.firstFrameTime) );
+      printf("compositor cpu/frame   %.3f ms\n", (bench.lastCpuTime-bench.firstCpuTime)/(1000.0*intervals) );
+      printf("process cpu/frame      %.3f ms\n", (endCpu-startCpu)/(1000.0*intervals) );
+      printf("scene update/frame     %.3f ms\n", bench.sceneTime/(1000.0*intervals) );
+      printf("bytes uploaded/frame   %lld\n", bench.bytesUploaded/intervals );
+   }
+   else
+   {
+      printf("frames                 %d in %lld us: no throughput measured\n", bench.frameCount, endTime-startTime );
+   }
+   printf("peak rss               %ld KB\n", usage.ru_maxrss );
+   printf("\n");
+   printf("commit to frame callback latency (ms)\n");
+   printf("%-8s %3s %8s  %8s %8s %8s %8s\n", "client", "n", "frames", "p50", "p90", "p99", "max" );
+   {
+      std::vector<long long> all;
+      for( t= 0; t < BenchClient_count; ++t )
+      {
+         std::vector<long long> latency;
+         if ( !bench.clientCount[t] ) continue;
+         for( i= 0; i < (int)clients.size(); ++i )
+         {
+            BenchClient *client= clients[i];
+            if ( client->type == t )
+            {
+               latency.insert( latency.end(), client->latency.begin(), client->latency.end() );
+            }
+         }
+         all.insert( all.end(), latency.begin(), latency.end() );
+         reportLatency( gClientTypeNames[t], bench.clientCount[t], latency );
+      }
+      reportLatency( "all", clients.size(), all );
+   }
+   printf("\n");
+   printf("compositor histograms (frames per bucket, bucket 0 < 250 us, doubling)\n");
+   printf("%-14s", "bucket limit" );
+   for( i= 0; i < WST_FRAME_STATS_HISTOGRAM_BUCKETS; ++i )
+   {
+      if ( i < WST_FRAME_STATS_HISTOGRAM_BUCKETS-1 )
+      {
+         printf(" %7lldu", 250LL<<i );
+      }
+      else
+      {
+         printf(" %8s", "more" );
+      }
+   }
+   printf("\n");
+   {
+      const char *names[]= { "frame interval", "events", "scene", "swap", "commit latency" };
+      unsigned int *buckets[]= { histogram.frameInterval, histogram.eventTime, histogram.sceneTime, histogram.swapTime, histogram.commitLatency };
+      for( t= 0; t < 5; ++t )
+      {
+         printf("%-14s", names[t] );
+         for( i= 0; i < WST_FRAME_STATS_HISTOGRAM_BUCKETS; ++i )
+         {
+            printf(" %8u", buckets[t][i] );
+         }
+         printf("\n");
+      }
+   }
+   printf("=============================================================================\n");
+
+   error= false;
+   for( i= 0; i < (int)clients.size(); ++i )
+   {
+      if ( clients[i]->error )
+      {
+         error= true;
+      }
+   }
+
+exit:
+   bench.measuring= false;
+   bench.stopRequested= true;
+   for( i= 0; i < (int)clients.size(); ++i )
+   {
+      BenchClient *client= clients[i];
+      if ( client->threadStarted )
+      {
+         pthread_join( client->threadId, NULL );
+      }
+      std::vector<long long>().swap( client->latency );
+      free( client );
+   }
+   std::vector<BenchClient*>().swap( clients );
+
+   if ( wctx )
+   {
+      WstCompositorDestroy( wctx );
+   }
+
+   if ( error )
+   {
+      const char *detail= "see above";
+      if ( emctx && EMGetError( emctx ) && EMGetError( emctx )[0] )
+      {
+         detail= EMGetError( emctx );
+      }
+      printf("runBenchmark error: %s\n", detail );
+   }
+   if ( emctx )
+   {
+      EMDestroyContext( emctx );
+   }
+   return;
+}
+
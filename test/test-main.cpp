@@ -46,6 +46,7 @@
 #include "test-essos-erm.h"
 #include "test-clientapp.h"
 #include "test-repeaterapp.h"
+#include "test-benchmark.h"
 
 static bool invokeTestCase( TESTCASE testCase, std::string &detail );
 static bool testCaseAPIDisplayName( EMCTX *ctx );
@@ -561,6 +562,10 @@ void executeCommand( const char *cmd, int argc, const char **argv )
    {
       runRepeaterApp( argc, argv );
    }
+   else if ( strcmp( cmd, "benchmark" ) == 0 )
+   {
+      runBenchmark( argc, argv );
+   }
 }
 
 static void showUsage( void )
@@ -571,7 +576,8 @@ static void showUsage( void )
    printf("where: options are:\n");
    printf(" -w : no watchdog\n" );
    printf(" -s : no signal handling\n" );
-   printf(" -x <cmd> : execute command <cmd>\n" );
+   printf(" -x <cmd> [<args>] : execute command <cmd>, remaining arguments are passed to <cmd>\n" );
+   printf("    commands: clientApp, repeaterApp, benchmark (use -x benchmark -? for options)\n" );
    printf(" -? : show usage\n");
    printf("\n");
 }
@@ -612,6 +618,8 @@ int main( int argc, const char **argv )
                   cmdIdx= ++argidx;
                   cmd= argv[cmdIdx];
                   executeCmd= true;
+                  // Remaining arguments belong to the command
+                  argidx= argc;
                }
                break;
             case '?':
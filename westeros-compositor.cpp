@@ -30,6 +30,8 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
 #include <sys/wait.h>
 #include <dirent.h>
 #include <dlfcn.h>
@@ -65,6 +67,7 @@
 #include "xdg-shell-server-protocol.h"
 #include "vpc-client-protocol.h"
 #include "vpc-server-protocol.h"
+#include "presentation-time-server-protocol.h"
 
 #include "westeros-version.h"
 
@@ -113,7 +116,14 @@
 #define TRACE2(...)                 INT_TRACE2(__VA_ARGS__, "")
 #define TRACE3(...)                 INT_TRACE3(__VA_ARGS__, "")
 
-#define WST_EVENT_QUEUE_SIZE (64)
+#define WST_MAX_DAMAGE_RECTS (16)
+
+#if ((WAYLAND_VERSION_MAJOR > 1) || (WAYLAND_VERSION_MINOR >= 10))
+#define WST_HAVE_DAMAGE_BUFFER
+#define WST_COMPOSITOR_VERSION (4)
+#else
+#define WST_COMPOSITOR_VERSION (3)
+#endif
 
 #define VPCBRIDGE_SIGNAL (INT_MIN)
 
@@ -159,6 +169,44 @@ typedef struct _WstEvent
    unsigned int v4;
 } WstEvent;
 
+typedef struct _WstEventNode
+{
+   struct _WstEventNode *next;
+   WstEvent event;
+} WstEventNode;
+
+/*
+ * Unbounded multiple producer, single consumer queue of input events.  Any
+ * thread may push without taking a lock; only the compositor thread pops.
+ */
+typedef struct _WstEventQueue
+{
+   WstEventNode *head;
+   WstEventNode *tail;
+   WstEventNode stub;
+} WstEventQueue;
+
+#define WST_FRAME_STATS_RING_SIZE (128)
+
+/*
+ * Frame statistics are written only by the compositor thread.  Each slot is
+ * guarded by a sequence count which is odd while the slot is being written so
+ * readers on other threads can copy the stats without taking a lock and
+ * discard any copy that raced with the writer.
+ */
+typedef struct _WstFrameStatsSlot
+{
+   unsigned int seq;
+   WstFrameStats stats;
+} WstFrameStatsSlot;
+
+typedef struct _WstFrameStatsRing
+{
+   unsigned long long head;
+   WstFrameStatsSlot slots[WST_FRAME_STATS_RING_SIZE];
+   WstFrameHistogram histogram;
+} WstFrameStatsRing;
+
 typedef struct _WstContext WstContext;
 typedef struct _WstSurface WstSurface;
 typedef struct _WstSeat WstSeat;
@@ -291,6 +339,8 @@ typedef struct _WstRegion
    struct wl_resource *resource;
 
    WstCompositor *compositor;
+
+   std::vector<WstRect> rects;
 } WstRegion;
 
 typedef struct _WstSurfaceFrameCallback
@@ -299,6 +349,14 @@ typedef struct _WstSurfaceFrameCallback
    struct wl_list link;
 } WstSurfaceFrameCallback;
 
+typedef struct _WstPresentationFeedback
+{
+   struct wl_resource *resource;
+   WstSurface *surface;
+   long long composeTime;
+   struct wl_list link;
+} WstPresentationFeedback;
+
 typedef struct _WstSurface
 {
    struct wl_resource *resource;
@@ -332,10 +390,21 @@ typedef struct _WstSurface
    struct wl_resource *detachedBufferResource;
    int attachedX;
    int attachedY;
+   bool attachedSinceCommit;
    bool vpcBridgeSignal;
    int commitCount;
+   long long commitTime;
+
+   std::vector<WstRect> damage;
+   std::vector<WstRect> bufferDamage;
+   std::vector<WstRect> commitDamage;
+
+   bool opaqueRegionPending;
+   std::vector<WstRect> opaqueRegion;
    
    struct wl_list frameCallbackList;
+   struct wl_list feedbackPendingList;
+   struct wl_list feedbackList;
    struct wl_listener attachedBufferDestroyListener;
    struct wl_listener detachedBufferDestroyListener;
    
@@ -388,6 +457,7 @@ typedef struct _WstContext
    const char *displayName;
    unsigned int frameRate;
    int framePeriodMillis;
+   int vblankDeadlineMicros;
    const char *rendererModule;
    bool isNested;
    bool isRepeater;
@@ -454,6 +524,16 @@ typedef struct _WstContext
    #endif
    struct wl_simple_shell *simpleShell;
    struct wl_event_source *displayTimer;
+   int frameTimerFd;
+   struct wl_event_source *frameTimer;
+   struct wl_list presentedFeedbackList;
+   int eventFd;
+   bool eventSignalled;
+   struct wl_event_source *eventSource;
+
+   long long frameEventTime;
+   long long lastFrameTime;
+   WstFrameStatsRing frameStats;
 
    #if defined (WESTEROS_HAVE_WAYLAND_EGL)
    EGLDisplay eglDisplay;
@@ -518,6 +598,8 @@ typedef struct _WstCompositor
    WstHidePointerCallback hidePointerCB;
    void *clientStatusUserData;
    WstClientStatus clientStatusCB;
+   void *frameStatsUserData;
+   WstFrameStatsCallback frameStatsCB;
 
    bool outputSizeChanged;
    int outputWidth;
@@ -529,8 +611,7 @@ typedef struct _WstCompositor
 
    bool destroyed;
 
-   int eventIndex;
-   WstEvent eventQueue[WST_EVENT_QUEUE_SIZE];
+   WstEventQueue eventQueue;
 } WstCompositor;
 
 static void wstLog( int level, const char *fmt, ... );
@@ -539,17 +620,32 @@ static bool wstCompositorCreateRenderer( WstContext *ctx );
 static void wstCompositorReleaseResources( WstContext *ctx );
 static void* wstCompositorThread( void *arg );
 static long long wstGetCurrentTimeMillis(void);
+static long long wstGetCurrentTimeMicros(void);
 static bool wstCompositorCheckForRepeaterSupport( WstContext *ctx );
 static void wstCompositorDestroyVirtual( WstCompositor *wctx );
 static void wstCompositorProcessEvents( WstCompositor *wctx );
+static void wstEventQueueInit( WstEventQueue *queue );
+static void wstEventQueueTerm( WstEventQueue *queue );
+static void wstEventQueuePush( WstEventQueue *queue, WstEventNode *first, WstEventNode *last );
+static WstEventNode* wstEventQueuePop( WstEventQueue *queue );
+static void wstCompositorQueueEvents( WstCompositor *wctx, WstEvent *events, int count );
+static int wstCompositorEventReady( int fd, uint32_t mask, void *data );
 static void wstContextProcessEvents( WstContext *ctx );
 static void wstCompositorComposeFrame( WstContext *ctx, uint32_t frameTime );
 static void wstContextInvokeDispatchCB( WstContext *ctx );
 static void wstContextInvokeInvalidateCB( WstContext *ctx );
 static void wstContextInvokeHidePointerCB( WstContext *ctx, bool hidePointer );
+static void wstContextInvokeFrameStatsCB( WstContext *ctx, WstFrameStats *stats );
+static void wstFrameHistogramAdd( unsigned int *buckets, long long value );
+static void wstFrameStatsRecord( WstContext *ctx, WstFrameStats *stats );
+static bool wstFrameStatsRead( WstFrameStatsRing *ring, unsigned long long index, WstFrameStats *stats );
+static void wstCompositorRunFrame( WstContext *ctx, long long frameTime );
 static int wstCompositorDisplayTimeOut( void *data );
+static int wstCompositorFrameTimerReady( int fd, uint32_t mask, void *data );
+static void wstCompositorScheduleFrameTimer( WstContext *ctx, long long frameStart );
 static void wstCompositorScheduleRepaint( WstContext *ctx );
 static void wstCompositorReleaseDetachedBuffers( WstContext *ctx );
+static void wstCompositorReleaseBuffer( WstSurface *surface, struct wl_resource *resource );
 static void wstShmBind( struct wl_client *client, void *data, uint32_t version, uint32_t id);
 static bool wstShmInit( WstContext *ctx );
 static void wstShmTerm( WstContext *ctx );
@@ -588,6 +684,13 @@ static void wstISurfaceAttach(struct wl_client *client,
 static void wstISurfaceDamage(struct wl_client *client,
                               struct wl_resource *resource,
                               int32_t x, int32_t y, int32_t width, int32_t height);
+#ifdef WST_HAVE_DAMAGE_BUFFER
+static void wstISurfaceDamageBuffer(struct wl_client *client,
+                                    struct wl_resource *resource,
+                                    int32_t x, int32_t y, int32_t width, int32_t height);
+#endif
+static void wstSurfaceAddDamage( std::vector<WstRect> &damage, int32_t x, int32_t y, int32_t width, int32_t height );
+static void wstSurfaceGetCommitDamage( WstSurface *surface );
 static void wstISurfaceFrame(struct wl_client *client,
                              struct wl_resource *resource, uint32_t callback);
 static void wstISurfaceSetOpaqueRegion(struct wl_client *client,
@@ -612,6 +715,7 @@ static void wstIRegionAdd( struct wl_client *client,
 static void wstIRegionSubtract( struct wl_client *client,
                                 struct wl_resource *resource,
                                 int32_t x, int32_t y, int32_t width, int32_t height );
+static void wstRegionSubtractRect( std::vector<WstRect> &rects, WstRect *r );
 static bool wstOutputInit( WstContext *ctx );
 static void wstOutputTerm( WstContext *ctx );
 static void wstOutputBind( struct wl_client *client, void *data, uint32_t version, uint32_t id);                                
@@ -822,6 +926,15 @@ static void wstIVpcSurfaceSetGeometryWithCrop( struct wl_client *client, struct
                                        int32_t x, int32_t y, int32_t width, int32_t height,
                                        int32_t cropX, int32_t cropY, int32_t cropW, int32_t cropH );
 static void wstUpdateVPCSurfaces( WstCompositor *wctx, std::vector<WstRect> &rects );
+static void wstPresentationBind( struct wl_client *client, void *data, uint32_t version, uint32_t id);
+static void wstIPresentationDestroy( struct wl_client *client, struct wl_resource *resource );
+static void wstIPresentationFeedback( struct wl_client *client, struct wl_resource *resource,
+                                      struct wl_resource *surfaceResource, uint32_t id );
+static void wstDestroyPresentationFeedbackCallback( struct wl_resource *resource );
+static void wstPresentationFeedbackDiscardList( struct wl_list *list );
+static void wstPresentationFeedbackCommit( WstSurface *surface );
+static void wstPresentationFeedbackCompose( WstContext *ctx, long long composeTime );
+static void wstPresentationFeedbackDeliver( WstContext *ctx );
 static bool wstInitializeKeymap( WstCompositor *wctx );
 static void wstTerminateKeymap( WstCompositor *wctx );
 static void wstProcessKeyEvent( WstKeyboard *keyboard, uint32_t keyCode, uint32_t keyState, uint32_t modifiers );
@@ -894,6 +1007,8 @@ WstCompositor* WstCompositorCreate()
       wctx->outputWidth= DEFAULT_OUTPUT_WIDTH;
       wctx->outputHeight= DEFAULT_OUTPUT_HEIGHT;
 
+      wstEventQueueInit( &wctx->eventQueue );
+
       ctx= (WstContext*)calloc( 1, sizeof(WstContext) );
       if ( ctx )
       {
@@ -901,6 +1016,13 @@ WstCompositor* WstCompositorCreate()
 
          ctx->frameRate= DEFAULT_FRAME_RATE;
          ctx->framePeriodMillis= (1000/ctx->frameRate);
+         ctx->frameTimerFd= -1;
+         wl_list_init( &ctx->presentedFeedbackList );
+         ctx->eventFd= eventfd( 0, EFD_NONBLOCK|EFD_CLOEXEC );
+         if ( ctx->eventFd < 0 )
+         {
+            WARNING("unable to create input event fd: errno %d: input will be processed per frame", errno);
+         }
 
          ctx->nestedWidth= DEFAULT_NESTED_WIDTH;
          ctx->nestedHeight= DEFAULT_NESTED_HEIGHT;
@@ -1041,10 +1163,18 @@ void WstCompositorDestroy( WstCompositor *wctx )
          }
       }
 
+      if ( ctx->eventFd >= 0 )
+      {
+         close( ctx->eventFd );
+         ctx->eventFd= -1;
+      }
+
       pthread_mutex_destroy( &ctx->mutex );
       
       free( ctx );
 
+      wstEventQueueTerm( &wctx->eventQueue );
+
       free( wctx );
    }
 }
@@ -1128,6 +1258,7 @@ WstCompositor* WstCompositorCreateVirtualEmbedded( WstCompositor *wctx )
 
       virt->isVirtual= true;
       virt->ctx= ctx;
+      wstEventQueueInit( &virt->eventQueue );
       ctx->virt.push_back( virt );
 
       pthread_mutex_unlock( &ctx->mutex );
@@ -1233,6 +1364,49 @@ exit:
    return result;
 }
 
+bool WstCompositorSetVBlankDeadline( WstCompositor *wctx, int deadlineMicros )
+{
+   bool result= false;
+
+   if ( wctx && wctx->ctx )
+   {
+      WstContext *ctx= wctx->ctx;
+
+      if ( wctx->isVirtual )
+      {
+         sprintf( wctx->lastErrorDetail,
+                  "Invalid argument.  Cannot set vblank deadline of virtual embedded compositor" );
+         goto exit;
+      }
+
+      if ( deadlineMicros < 0 )
+      {
+         sprintf( wctx->lastErrorDetail,
+                  "Invalid argument.  The deadline (%d) must not be negative", deadlineMicros );
+         goto exit;
+      }
+
+      if ( ctx->running )
+      {
+         sprintf( wctx->lastErrorDetail,
+                  "Bad state.  Cannot set vblank deadline while compositor is running" );
+         goto exit;
+      }
+
+      pthread_mutex_lock( &ctx->mutex );
+
+      ctx->vblankDeadlineMicros= deadlineMicros;
+
+      pthread_mutex_unlock( &ctx->mutex );
+
+      result= true;
+   }
+
+exit:
+
+   return result;
+}
+
 bool WstCompositorSetNativeWindow( WstCompositor *wctx, void *nativeWindow )
 {
    bool result= false;
@@ -1887,11 +2061,12 @@ void WstCompositorResolutionChangeBegin( WstCompositor *wctx )
 
       if ( !ctx->isNested && !ctx->isEmbedded )
       {
-         int eventIndex= wctx->eventIndex;
-         wctx->eventQueue[eventIndex].type= WstEventType_resolutionChangeBegin;
+         WstEvent event;
 
-         ++wctx->eventIndex;
-         assert( wctx->eventIndex < WST_EVENT_QUEUE_SIZE );
+         memset( &event, 0, sizeof(event) );
+         event.type= WstEventType_resolutionChangeBegin;
+
+         wstCompositorQueueEvents( wctx, &event, 1 );
 
          ctx->allowImmediateRepaint= true;
          wstCompositorScheduleRepaint( ctx );
@@ -1916,13 +2091,14 @@ void WstCompositorResolutionChangeEnd( WstCompositor *wctx, int width, int heigh
 
       if ( !ctx->isNested && !ctx->isEmbedded )
       {
-         int eventIndex= wctx->eventIndex;
-         wctx->eventQueue[eventIndex].type= WstEventType_resolutionChangeEnd;
-         wctx->eventQueue[eventIndex].v1= width;
-         wctx->eventQueue[eventIndex].v2= height;
+         WstEvent event;
+
+         memset( &event, 0, sizeof(event) );
+         event.type= WstEventType_resolutionChangeEnd;
+         event.v1= width;
+         event.v2= height;
 
-         ++wctx->eventIndex;
-         assert( wctx->eventIndex < WST_EVENT_QUEUE_SIZE );
+         wstCompositorQueueEvents( wctx, &event, 1 );
 
          ctx->allowImmediateRepaint= true;
          wstCompositorScheduleRepaint( ctx );
@@ -2182,6 +2358,92 @@ bool WstCompositorGetAllowCursorModification( WstCompositor *wctx )
    return allow;
 }
 
+bool WstCompositorGetFrameStats( WstCompositor *wctx, WstFrameStats *stats, int maxCount, int *count )
+{
+   bool result= false;
+   int n= 0;
+
+   if ( wctx && wctx->ctx && stats && (maxCount >= 0) )
+   {
+      WstContext *ctx= wctx->ctx;
+      unsigned long long head;
+
+      if ( maxCount > WST_FRAME_STATS_RING_SIZE )
+      {
+         maxCount= WST_FRAME_STATS_RING_SIZE;
+      }
+
+      head= __atomic_load_n( &ctx->frameStats.head, __ATOMIC_ACQUIRE );
+      while ( (n < maxCount) && (head > 0) )
+      {
+         --head;
+         if ( !wstFrameStatsRead( &ctx->frameStats, head, &stats[n] ) )
+         {
+            // Older slots are being overwritten by the compositor thread
+            break;
+         }
+         ++n;
+      }
+
+      result= true;
+   }
+
+   if ( count )
+   {
+      *count= n;
+   }
+
+   return result;
+}
+
+bool WstCompositorGetFrameHistogram( WstCompositor *wctx, WstFrameHistogram *histogram )
+{
+   bool result= false;
+
+   if ( wctx && wctx->ctx && histogram )
+   {
+      WstFrameHistogram *src= &wctx->ctx->frameStats.histogram;
+
+      histogram->frameCount= __atomic_load_n( &src->frameCount, __ATOMIC_RELAXED );
+      for( int i= 0; i < WST_FRAME_STATS_HISTOGRAM_BUCKETS; ++i )
+      {
+         histogram->frameInterval[i]= __atomic_load_n( &src->frameInterval[i], __ATOMIC_RELAXED );
+         histogram->eventTime[i]= __atomic_load_n( &src->eventTime[i], __ATOMIC_RELAXED );
+         histogram->sceneTime[i]= __atomic_load_n( &src->sceneTime[i], __ATOMIC_RELAXED );
+         histogram->swapTime[i]= __atomic_load_n( &src->swapTime[i], __ATOMIC_RELAXED );
+         histogram->commitLatency[i]= __atomic_load_n( &src->commitLatency[i], __ATOMIC_RELAXED );
+      }
+
+      result= true;
+   }
+
+   return result;
+}
+
+bool WstCompositorResetFrameHistogram( WstCompositor *wctx )
+{
+   bool result= false;
+
+   if ( wctx && wctx->ctx )
+   {
+      WstFrameHistogram *hist= &wctx->ctx->frameStats.histogram;
+
+      __atomic_store_n( &hist->frameCount, 0, __ATOMIC_RELAXED );
+      for( int i= 0; i < WST_FRAME_STATS_HISTOGRAM_BUCKETS; ++i )
+      {
+         __atomic_store_n( &hist->frameInterval[i], 0, __ATOMIC_RELAXED );
+         __atomic_store_n( &hist->eventTime[i], 0, __ATOMIC_RELAXED );
+         __atomic_store_n( &hist->sceneTime[i], 0, __ATOMIC_RELAXED );
+         __atomic_store_n( &hist->swapTime[i], 0, __ATOMIC_RELAXED );
+         __atomic_store_n( &hist->commitLatency[i], 0, __ATOMIC_RELAXED );
+      }
+
+      result= true;
+   }
+
+   return result;
+}
+
 bool WstCompositorSetTerminatedCallback( WstCompositor *wctx, WstTerminatedCallback cb, void *userData )
 {
    bool result= false;
@@ -2320,6 +2582,27 @@ exit:
    return result;   
 }
 
+bool WstCompositorSetFrameStatsCallback( WstCompositor *wctx, WstFrameStatsCallback cb, void *userData )
+{
+   bool result= false;
+
+   if ( wctx && wctx->ctx )
+   {
+      WstContext *ctx= wctx->ctx;
+
+      pthread_mutex_lock( &ctx->mutex );
+
+      wctx->frameStatsUserData= userData;
+      wctx->frameStatsCB= cb;
+
+      pthread_mutex_unlock( &ctx->mutex );
+
+      result= true;
+   }
+
+   return result;
+}
+
 bool WstCompositorSetOutputNestedListener( WstCompositor *wctx, WstOutputNestedListener *listener, void *userData )
 {
   bool result= false;
@@ -2849,21 +3132,18 @@ void WstCompositorKeyEvent( WstCompositor *wctx, int keyCode, unsigned int keySt
    {
       WstContext *ctx= wctx->ctx;
 
-      pthread_mutex_lock( &ctx->mutex );
-
       if ( ctx->seat && !ctx->isNested )
       {
-         int eventIndex= wctx->eventIndex;
-         wctx->eventQueue[eventIndex].type= WstEventType_key;
-         wctx->eventQueue[eventIndex].v1= keyCode;
-         wctx->eventQueue[eventIndex].v2= keyState;
-         wctx->eventQueue[eventIndex].v3= modifiers;
+         WstEvent event;
+
+         memset( &event, 0, sizeof(event) );
+         event.type= WstEventType_key;
+         event.v1= keyCode;
+         event.v2= keyState;
+         event.v3= modifiers;
          
-         ++wctx->eventIndex;
-         assert( wctx->eventIndex < WST_EVENT_QUEUE_SIZE );
+         wstCompositorQueueEvents( wctx, &event, 1 );
       }
-
-      pthread_mutex_unlock( &ctx->mutex );
    }
 }
 
@@ -2873,21 +3153,18 @@ void WstCompositorPointerEnter( WstCompositor *wctx )
    {
       WstContext *ctx= wctx->ctx;
 
-      pthread_mutex_lock( &ctx->mutex );
-
       if ( ctx->seat && !ctx->isNested )
       {
-         int eventIndex= wctx->eventIndex;
-         wctx->eventQueue[eventIndex].type= WstEventType_pointerEnter;
-         wctx->eventQueue[eventIndex].v1= 0;
-         wctx->eventQueue[eventIndex].v2= 0;
-         wctx->eventQueue[eventIndex].p1= 0;
+         WstEvent event;
+
+         memset( &event, 0, sizeof(event) );
+         event.type= WstEventType_pointerEnter;
+         event.v1= 0;
+         event.v2= 0;
+         event.p1= 0;
          
-         ++wctx->eventIndex;
-         assert( wctx->eventIndex < WST_EVENT_QUEUE_SIZE );
+         wstCompositorQueueEvents( wctx, &event, 1 );
       }
-
-      pthread_mutex_unlock( &ctx->mutex );
    }
 }
 
@@ -2897,19 +3174,16 @@ void WstCompositorPointerLeave( WstCompositor *wctx )
    {
       WstContext *ctx= wctx->ctx;
 
-      pthread_mutex_lock( &ctx->mutex );
-
       if ( ctx->seat && !ctx->isNested )
       {
-         int eventIndex= wctx->eventIndex;
-         wctx->eventQueue[eventIndex].type= WstEventType_pointerLeave;
-         wctx->eventQueue[eventIndex].p1= 0;
+         WstEvent event;
+
+         memset( &event, 0, sizeof(event) );
+         event.type= WstEventType_pointerLeave;
+         event.p1= 0;
          
-         ++wctx->eventIndex;
-         assert( wctx->eventIndex < WST_EVENT_QUEUE_SIZE );
+         wstCompositorQueueEvents( wctx, &event, 1 );
       }
-
-      pthread_mutex_unlock( &ctx->mutex );
    }
 }
 
@@ -2919,20 +3193,17 @@ void WstCompositorPointerMoveEvent( WstCompositor *wctx, int x, int y )
    {
       WstContext *ctx= wctx->ctx;
 
-      pthread_mutex_lock( &ctx->mutex );
-
       if ( ctx->seat && !ctx->isNested )
       {
-         int eventIndex= wctx->eventIndex;
-         wctx->eventQueue[eventIndex].type= WstEventType_pointerMove;
-         wctx->eventQueue[eventIndex].v1= x;
-         wctx->eventQueue[eventIndex].v2= y;
+         WstEvent event;
+
+         memset( &event, 0, sizeof(event) );
+         event.type= WstEventType_pointerMove;
+         event.v1= x;
+         event.v2= y;
          
-         ++wctx->eventIndex;
-         assert( wctx->eventIndex < WST_EVENT_QUEUE_SIZE );
+         wstCompositorQueueEvents( wctx, &event, 1 );
       }
-
-      pthread_mutex_unlock( &ctx->mutex );
    }
 }
 
@@ -2942,21 +3213,18 @@ void WstCompositorPointerButtonEvent( WstCompositor *wctx, unsigned int button,
    {
       WstContext *ctx= wctx->ctx;
 
-      pthread_mutex_lock( &ctx->mutex );
-
       if ( ctx->seat && !ctx->isNested )
       {
-         int eventIndex= wctx->eventIndex;
-         wctx->eventQueue[eventIndex].type= WstEventType_pointerButton;
-         wctx->eventQueue[eventIndex].v1= button;
-         wctx->eventQueue[eventIndex].v2= buttonState;
-         wctx->eventQueue[eventIndex].v3= 0; //no time
+         WstEvent event;
+
+         memset( &event, 0, sizeof(event) );
+         event.type= WstEventType_pointerButton;
+         event.v1= button;
+         event.v2= buttonState;
+         event.v3= 0; //no time
          
-         ++wctx->eventIndex;
-         assert( wctx->eventIndex < WST_EVENT_QUEUE_SIZE );
+         wstCompositorQueueEvents( wctx, &event, 1 );
       }
-
-      pthread_mutex_unlock( &ctx->mutex );
    }
 }
 
@@ -2965,12 +3233,11 @@ void WstCompositorTouchEvent( WstCompositor *wctx, WstTouchSet *touchSet )
    if ( wctx && wctx->ctx )
    {
       WstContext *ctx= wctx->ctx;
-      bool queuedEvents= false;
+      WstEvent events[WST_MAX_TOUCH+1];
+      int count= 0;
       uint32_t time= (uint32_t)wstGetCurrentTimeMillis();
 
-      pthread_mutex_lock( &ctx->mutex );
-
-      int eventIndex= wctx->eventIndex;
+      memset( events, 0, sizeof(events) );
 
       for( int i= 0; i < WST_MAX_TOUCH; ++i )
       {
@@ -2978,49 +3245,41 @@ void WstCompositorTouchEvent( WstCompositor *wctx, WstTouchSet *touchSet )
          {
             if ( touchSet->touch[i].starting )
             {
-               wctx->eventQueue[eventIndex].type= WstEventType_touchDown;
-               wctx->eventQueue[eventIndex].v1= time;
-               wctx->eventQueue[eventIndex].v2= touchSet->touch[i].id;
-               wctx->eventQueue[eventIndex].v3= touchSet->touch[i].x;
-               wctx->eventQueue[eventIndex].v4= touchSet->touch[i].y;
-               wctx->eventQueue[eventIndex].p1= 0;
-               ++eventIndex;
-               assert( eventIndex < WST_EVENT_QUEUE_SIZE );
-               queuedEvents= true;
+               events[count].type= WstEventType_touchDown;
+               events[count].v1= time;
+               events[count].v2= touchSet->touch[i].id;
+               events[count].v3= touchSet->touch[i].x;
+               events[count].v4= touchSet->touch[i].y;
+               events[count].p1= 0;
+               ++count;
             }
             else if ( touchSet->touch[i].stopping )
             {
-               wctx->eventQueue[eventIndex].type= WstEventType_touchUp;
-               wctx->eventQueue[eventIndex].v1= time;
-               wctx->eventQueue[eventIndex].v2= touchSet->touch[i].id;
-               ++eventIndex;
-               assert( eventIndex < WST_EVENT_QUEUE_SIZE );
-               queuedEvents= true;
+               events[count].type= WstEventType_touchUp;
+               events[count].v1= time;
+               events[count].v2= touchSet->touch[i].id;
+               ++count;
             }
             else if ( touchSet->touch[i].moved )
             {
-               wctx->eventQueue[eventIndex].type= WstEventType_touchMotion;
-               wctx->eventQueue[eventIndex].v1= time;
-               wctx->eventQueue[eventIndex].v2= touchSet->touch[i].id;
-               wctx->eventQueue[eventIndex].v3= touchSet->touch[i].x;
-               wctx->eventQueue[eventIndex].v4= touchSet->touch[i].y;
-               ++eventIndex;
-               assert( eventIndex < WST_EVENT_QUEUE_SIZE );
-               queuedEvents= true;
+               events[count].type= WstEventType_touchMotion;
+               events[count].v1= time;
+               events[count].v2= touchSet->touch[i].id;
+               events[count].v3= touchSet->touch[i].x;
+               events[count].v4= touchSet->touch[i].y;
+               ++count;
             }
          }
       }
 
-      if ( queuedEvents )
+      if ( count )
       {
-         wctx->eventQueue[eventIndex].type= WstEventType_touchFrame;
-         ++eventIndex;
-         assert( eventIndex < WST_EVENT_QUEUE_SIZE );
-      }
-
-      wctx->eventIndex= eventIndex;
+         events[count].type= WstEventType_touchFrame;
+         ++count;
 
-      pthread_mutex_unlock( &ctx->mutex );
+         // Queue the whole set so its frame can't be split by another producer
+         wstCompositorQueueEvents( wctx, events, count );
+      }
    }
 }
 
@@ -3738,7 +3997,7 @@ static void* wstCompositorThread( void *arg )
       goto exit;
    }
 
-   if (!wl_global_create(ctx->display, &wl_compositor_interface, 3, ctx, wstCompositorBind))
+   if (!wl_global_create(ctx->display, &wl_compositor_interface, WST_COMPOSITOR_VERSION, ctx, wstCompositorBind))
    {
       ERROR("unable to create wl_compositor interface");
       goto exit;
@@ -3767,6 +4026,12 @@ static void* wstCompositorThread( void *arg )
       ERROR("unable to create wl_vpc interface");
       goto exit;
    }
+
+   if (!wl_global_create(ctx->display, &wp_presentation_interface, 1, ctx, wstPresentationBind ))
+   {
+      ERROR("unable to create wp_presentation interface");
+      goto exit;
+   }
    
    if ( !wstOutputInit(ctx) )
    {
@@ -3919,10 +4184,45 @@ static void* wstCompositorThread( void *arg )
       goto exit;
    }
 
-   ctx->displayTimer= wl_event_loop_add_timer( loop, wstCompositorDisplayTimeOut, ctx );
-   pthread_mutex_lock( &ctx->mutex );
-   wl_event_source_timer_update( ctx->displayTimer, ctx->framePeriodMillis );
-   pthread_mutex_unlock( &ctx->mutex );
+   if ( (ctx->vblankDeadlineMicros > 0) && !ctx->isEmbedded && !ctx->isRepeater )
+   {
+      ctx->frameTimerFd= timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC );
+      if ( ctx->frameTimerFd >= 0 )
+      {
+         ctx->frameTimer= wl_event_loop_add_fd( loop, ctx->frameTimerFd, WL_EVENT_READABLE, wstCompositorFrameTimerReady, ctx );
+      }
+      if ( ctx->frameTimer )
+      {
+         INFO("using vblank scheduling with deadline %d us", ctx->vblankDeadlineMicros);
+         wstCompositorScheduleFrameTimer( ctx, wstGetCurrentTimeMicros() );
+      }
+      else
+      {
+         ERROR("unable to create frame timer: errno %d: using fixed frame period", errno);
+         if ( ctx->frameTimerFd >= 0 )
+         {
+            close( ctx->frameTimerFd );
+            ctx->frameTimerFd= -1;
+         }
+      }
+   }
+
+   if ( ctx->eventFd >= 0 )
+   {
+      ctx->eventSource= wl_event_loop_add_fd( loop, ctx->eventFd, WL_EVENT_READABLE, wstCompositorEventReady, ctx );
+      if ( !ctx->eventSource )
+      {
+         ERROR("unable to add input event fd to event loop: input will be processed per frame");
+      }
+   }
+
+   if ( !ctx->frameTimer )
+   {
+      ctx->displayTimer= wl_event_loop_add_timer( loop, wstCompositorDisplayTimeOut, ctx );
+      pthread_mutex_lock( &ctx->mutex );
+      wl_event_source_timer_update( ctx->displayTimer, ctx->framePeriodMillis );
+      pthread_mutex_unlock( &ctx->mutex );
+   }
 
    for ( std::vector<WstModule*>::iterator it= ctx->modules.begin();
          it != ctx->modules.end();
@@ -4021,6 +4321,22 @@ exit:
       wl_event_source_remove( ctx->displayTimer );
       ctx->displayTimer= 0;
    }
+
+   if ( ctx->frameTimer )
+   {
+      wl_event_source_remove( ctx->frameTimer );
+      ctx->frameTimer= 0;
+   }
+   if ( ctx->eventSource )
+   {
+      wl_event_source_remove( ctx->eventSource );
+      ctx->eventSource= 0;
+   }
+   if ( ctx->frameTimerFd >= 0 )
+   {
+      close( ctx->frameTimerFd );
+      ctx->frameTimerFd= -1;
+   }
       
    return NULL;
 }
@@ -4248,6 +4564,17 @@ static long long wstGetCurrentTimeMillis(void)
    return utcCurrentTimeMillis;
 }
 
+static long long wstGetCurrentTimeMicros(void)
+{
+   struct timespec tm;
+   long long currentTimeMicros;
+
+   clock_gettime( CLOCK_MONOTONIC, &tm );
+   currentTimeMicros= tm.tv_sec*1000000LL+(tm.tv_nsec/1000LL);
+
+   return currentTimeMicros;
+}
+
 static void wstCompositorDestroyVirtual( WstCompositor *wctx )
 {
    WstContext *ctx= wctx->ctx;
@@ -4309,54 +4636,200 @@ static void wstCompositorDestroyVirtual( WstCompositor *wctx )
    }
    pthread_mutex_lock( &ctx->mutex );
 
+   wstEventQueueTerm( &wctx->eventQueue );
+
    free( wctx );
 }
 
-static void wstCompositorProcessEvents( WstCompositor *wctx )
+static void wstEventQueueInit( WstEventQueue *queue )
 {
-   int i;
-   WstContext *ctx= wctx->ctx;
+   queue->stub.next= 0;
+   queue->head= &queue->stub;
+   queue->tail= &queue->stub;
+}
 
-   if ( wctx->outputSizeChanged )
+static void wstEventQueueTerm( WstEventQueue *queue )
+{
+   WstEventNode *node;
+
+   while( (node= wstEventQueuePop( queue )) )
    {
-      wstOutputChangeSize( wctx );
+      free( node );
    }
-   
-   for( i= 0; i < wctx->eventIndex; ++i )
+}
+
+static void wstEventQueuePush( WstEventQueue *queue, WstEventNode *first, WstEventNode *last )
+{
+   WstEventNode *prev;
+
+   __atomic_store_n( &last->next, (WstEventNode*)0, __ATOMIC_RELAXED );
+   prev= __atomic_exchange_n( &queue->head, last, __ATOMIC_ACQ_REL );
+   // Until this store completes the consumer sees the queue end at prev
+   __atomic_store_n( &prev->next, first, __ATOMIC_RELEASE );
+}
+
+static WstEventNode* wstEventQueuePop( WstEventQueue *queue )
+{
+   WstEventNode *node= 0;
+   WstEventNode *tail, *next;
+
+   tail= queue->tail;
+   next= __atomic_load_n( &tail->next, __ATOMIC_ACQUIRE );
+   if ( tail == &queue->stub )
    {
-      switch( wctx->eventQueue[i].type )
+      if ( !next )
       {
-         case WstEventType_key:
-            {
-               WstKeyboard *keyboard= wctx->keyboard;
+         goto exit;
+      }
+      queue->tail= next;
+      tail= next;
+      next= __atomic_load_n( &tail->next, __ATOMIC_ACQUIRE );
+   }
 
-               if ( keyboard )
-               {
-                  wstProcessKeyEvent( keyboard,
-                                      wctx->eventQueue[i].v1, //keyCode
-                                      wctx->eventQueue[i].v2, //keyState
-                                      wctx->eventQueue[i].v3  //modifiers
-                                    );
-               }
-            }
-            break;
-         case WstEventType_keyCode:
-            {
-               WstKeyboard *keyboard= wctx->keyboard;
+   if ( !next )
+   {
+      if ( tail != __atomic_load_n( &queue->head, __ATOMIC_ACQUIRE ) )
+      {
+         // A producer is part way through a push.  It will signal
+         // the event fd once done so the rest is picked up then.
+         goto exit;
+      }
+      // Re-insert the stub so the last node can be removed
+      wstEventQueuePush( queue, &queue->stub, &queue->stub );
+      next= __atomic_load_n( &tail->next, __ATOMIC_ACQUIRE );
+   }
 
-               if ( keyboard )
-               {
-                  uint32_t serial;
-                  struct wl_resource *resource;
+   if ( next )
+   {
+      queue->tail= next;
+      node= tail;
+   }
+
+exit:
+   return node;
+}
+
+static void wstCompositorQueueEvents( WstCompositor *wctx, WstEvent *events, int count )
+{
+   WstContext *ctx= wctx->ctx;
+   WstEventNode *first= 0;
+   WstEventNode *last= 0;
+   WstEventNode *node;
+   int i;
+
+   for( i= 0; i < count; ++i )
+   {
+      node= (WstEventNode*)malloc( sizeof(WstEventNode) );
+      if ( !node )
+      {
+         ERROR("no memory to queue input events: dropping %d events", count);
+         while( first )
+         {
+            node= first;
+            first= first->next;
+            free( node );
+         }
+         goto exit;
+      }
+      node->next= 0;
+      node->event= events[i];
+      if ( last )
+      {
+         last->next= node;
+      }
+      else
+      {
+         first= node;
+      }
+      last= node;
+   }
+
+   if ( first )
+   {
+      wstEventQueuePush( &wctx->eventQueue, first, last );
+
+      // Wake the compositor thread unless a wakeup is already pending
+      if ( (ctx->eventFd >= 0) && !__atomic_exchange_n( &ctx->eventSignalled, true, __ATOMIC_SEQ_CST ) )
+      {
+         uint64_t value= 1;
+         if ( write( ctx->eventFd, &value, sizeof(value) ) < 0 )
+         {
+            ERROR("failed to signal input event fd: errno %d", errno);
+         }
+      }
+   }
+
+exit:
+   return;
+}
+
+static int wstCompositorEventReady( int fd, uint32_t mask, void *data )
+{
+   WstContext *ctx= (WstContext*)data;
+   uint64_t value;
+   WESTEROS_UNUSED(mask);
+
+   if ( read( fd, &value, sizeof(value) ) < 0 )
+   {
+      if ( errno == EAGAIN )
+      {
+         return 0;
+      }
+   }
+   __atomic_store_n( &ctx->eventSignalled, false, __ATOMIC_SEQ_CST );
+
+   wstContextProcessEvents( ctx );
+
+   return 0;
+}
+
+static void wstCompositorProcessEvents( WstCompositor *wctx )
+{
+   WstContext *ctx= wctx->ctx;
+   WstEventNode *node;
+   WstEvent *event;
+
+   if ( wctx->outputSizeChanged )
+   {
+      wstOutputChangeSize( wctx );
+   }
+   
+   while( (node= wstEventQueuePop( &wctx->eventQueue )) )
+   {
+      event= &node->event;
+      switch( event->type )
+      {
+         case WstEventType_key:
+            {
+               WstKeyboard *keyboard= wctx->keyboard;
+
+               if ( keyboard )
+               {
+                  wstProcessKeyEvent( keyboard,
+                                      event->v1, //keyCode
+                                      event->v2, //keyState
+                                      event->v3  //modifiers
+                                    );
+               }
+            }
+            break;
+         case WstEventType_keyCode:
+            {
+               WstKeyboard *keyboard= wctx->keyboard;
+
+               if ( keyboard )
+               {
+                  uint32_t serial;
+                  struct wl_resource *resource;
 
                   serial= wl_display_next_serial( ctx->display );
                   wl_resource_for_each( resource, &keyboard->focusResourceList )
                   {
                      wl_keyboard_send_key( resource,
                                            serial,
-                                           wctx->eventQueue[i].v1,  //time
-                                           wctx->eventQueue[i].v2,  //key
-                                           wctx->eventQueue[i].v3   //state
+                                           event->v1,  //time
+                                           event->v2,  //key
+                                           event->v3   //state
                                          );
                   }
                }
@@ -4376,10 +4849,10 @@ static void wstCompositorProcessEvents( WstCompositor *wctx )
                   {
                      wl_keyboard_send_modifiers( resource,
                                                  serial,
-                                                 wctx->eventQueue[i].v1, // mod depressed
-                                                 wctx->eventQueue[i].v2, // mod latched
-                                                 wctx->eventQueue[i].v3, // mod locked
-                                                 wctx->eventQueue[i].v4  // mod group
+                                                 event->v1, // mod depressed
+                                                 event->v2, // mod latched
+                                                 event->v3, // mod locked
+                                                 event->v4  // mod group
                                                );
                   }
                }
@@ -4392,9 +4865,9 @@ static void wstCompositorProcessEvents( WstCompositor *wctx )
                if ( pointer )
                {
                   wstProcessPointerEnter( pointer,
-                                          wctx->eventQueue[i].v1, //x
-                                          wctx->eventQueue[i].v2, //y
-                                          (struct wl_surface*)wctx->eventQueue[i].p1  //surfaceNested
+                                          event->v1, //x
+                                          event->v2, //y
+                                          (struct wl_surface*)event->p1  //surfaceNested
                                         );
                }
             }
@@ -4406,7 +4879,7 @@ static void wstCompositorProcessEvents( WstCompositor *wctx )
                if ( pointer )
                {
                   wstProcessPointerLeave( pointer,
-                                          (struct wl_surface*)wctx->eventQueue[i].p1  //surfaceNested
+                                          (struct wl_surface*)event->p1  //surfaceNested
                                         );
                }
             }
@@ -4418,8 +4891,8 @@ static void wstCompositorProcessEvents( WstCompositor *wctx )
                if ( pointer )
                {
                   wstProcessPointerMoveEvent( pointer, 
-                                              wctx->eventQueue[i].v1, //x
-                                              wctx->eventQueue[i].v2  //y
+                                              event->v1, //x
+                                              event->v2  //y
                                             );
                }
             }
@@ -4430,9 +4903,9 @@ static void wstCompositorProcessEvents( WstCompositor *wctx )
                
                uint32_t time;
                
-               if ( wctx->eventQueue[i].v3 )
+               if ( event->v3 )
                {
-                  time= wctx->eventQueue[i].v4;
+                  time= event->v4;
                }
                else
                {
@@ -4442,8 +4915,8 @@ static void wstCompositorProcessEvents( WstCompositor *wctx )
                if ( pointer )
                {
                   wstProcessPointerButtonEvent( pointer, 
-                                                wctx->eventQueue[i].v1, //button
-                                                wctx->eventQueue[i].v2, //buttonState
+                                                event->v1, //button
+                                                event->v2, //buttonState
                                                 time
                                                );
                }
@@ -4455,11 +4928,11 @@ static void wstCompositorProcessEvents( WstCompositor *wctx )
                if ( touch )
                {
                   wstProcessTouchDownEvent( touch,
-                                            wctx->eventQueue[i].v1, //time
-                                            wctx->eventQueue[i].v2, //id
-                                            wctx->eventQueue[i].v3, //x
-                                            wctx->eventQueue[i].v4, //y
-                                            (struct wl_surface*)wctx->eventQueue[i].p1  //surfaceNested
+                                            event->v1, //time
+                                            event->v2, //id
+                                            event->v3, //x
+                                            event->v4, //y
+                                            (struct wl_surface*)event->p1  //surfaceNested
                                           );
                }
             }
@@ -4470,8 +4943,8 @@ static void wstCompositorProcessEvents( WstCompositor *wctx )
                if ( touch )
                {
                   wstProcessTouchUpEvent( touch,
-                                          wctx->eventQueue[i].v1, //time
-                                          wctx->eventQueue[i].v2  //id
+                                          event->v1, //time
+                                          event->v2  //id
                                           );
                }
             }
@@ -4482,10 +4955,10 @@ static void wstCompositorProcessEvents( WstCompositor *wctx )
                if ( touch )
                {
                   wstProcessTouchMotionEvent( touch,
-                                              wctx->eventQueue[i].v1, //time
-                                              wctx->eventQueue[i].v2, //id
-                                              wctx->eventQueue[i].v3, //x
-                                              wctx->eventQueue[i].v4  //y
+                                              event->v1, //time
+                                              event->v2, //id
+                                              event->v3, //x
+                                              event->v4  //y
                                             );
                }
             }
@@ -4511,8 +4984,8 @@ static void wstCompositorProcessEvents( WstCompositor *wctx )
             {
                int width, height;
 
-               width= wctx->eventQueue[i].v1;
-               height= wctx->eventQueue[i].v2;
+               width= event->v1;
+               height= event->v2;
 
                if ( !ctx->isNested && !ctx->isEmbedded )
                {
@@ -4524,17 +4997,21 @@ static void wstCompositorProcessEvents( WstCompositor *wctx )
             }
             break;
          default:
-            WARNING("wstCompositorProcessEvents: unknown event type %d", wctx->eventQueue[i].type );
+            WARNING("wstCompositorProcessEvents: unknown event type %d", event->type );
             break;
       }
+      free( node );
    }
-   wctx->eventIndex= 0;
 }
 
 static void wstContextProcessEvents( WstContext *ctx )
 {
+   long long start;
+
    pthread_mutex_lock( &ctx->mutex );
 
+   start= wstGetCurrentTimeMicros();
+
    if ( ctx->nc )
    {
       WstNestedConnectionReleaseRemoteBuffers( ctx->nc );
@@ -4558,20 +5035,46 @@ static void wstContextProcessEvents( WstContext *ctx )
 
    wstCompositorProcessEvents( ctx->wctx );
 
+   ctx->frameEventTime += (wstGetCurrentTimeMicros()-start);
+
    pthread_mutex_unlock( &ctx->mutex );
 }
 
 static void wstCompositorComposeFrame( WstContext *ctx, uint32_t frameTime )
 {
+   WstFrameStats stats;
+   long long composeStart, now;
+
+   composeStart= wstGetCurrentTimeMicros();
+
    pthread_mutex_lock( &ctx->mutex );
 
+   memset( &stats, 0, sizeof(stats) );
+   stats.frameTime= composeStart;
+   stats.eventTime= ctx->frameEventTime;
+   stats.swapTime= -1;
+   stats.surfaceCount= -1;
+   stats.bytesUploaded= -1;
+   ctx->frameEventTime= 0;
+
    ctx->needRepaint= false;
 
    if ( !ctx->isEmbedded && !ctx->isRepeater )
    {
+      WstRenderStats renderStats;
+
       WstRendererUpdateScene( ctx->renderer );
+      stats.sceneTime= wstGetCurrentTimeMicros()-composeStart;
+      if ( WstRendererGetRenderStats( ctx->renderer, &renderStats ) )
+      {
+         stats.swapTime= renderStats.swapTime;
+         stats.surfaceCount= renderStats.surfaceCount;
+         stats.bytesUploaded= renderStats.bytesUploaded;
+      }
       wstCompositorReleaseDetachedBuffers( ctx );
    }
+
+   now= wstGetCurrentTimeMicros();
    
    for( std::map<struct wl_resource*, WstSurfaceInfo*>::iterator it= ctx->surfaceInfoMap.begin(); it != ctx->surfaceInfoMap.end(); ++it )
    {
@@ -4580,6 +5083,18 @@ static void wstCompositorComposeFrame( WstContext *ctx, uint32_t frameTime )
       WstSurfaceInfo *surfaceInfo= it->second;
       
       surface= surfaceInfo->surface;
+      if ( surface->commitTime )
+      {
+         long long latency= now-surface->commitTime;
+         if ( stats.latencyCount < WST_FRAME_STATS_MAX_SURFACES )
+         {
+            stats.latency[stats.latencyCount].surfaceId= surface->surfaceId;
+            stats.latency[stats.latencyCount].latency= latency;
+            ++stats.latencyCount;
+         }
+         wstFrameHistogramAdd( ctx->frameStats.histogram.commitLatency, latency );
+         surface->commitTime= 0;
+      }
       while( !wl_list_empty( &surface->frameCallbackList ) )
       {
          fcb= wl_container_of( surface->frameCallbackList.next, fcb, link);
@@ -4587,10 +5102,17 @@ static void wstCompositorComposeFrame( WstContext *ctx, uint32_t frameTime )
          wl_callback_send_done( fcb->resource, frameTime );
          wl_resource_destroy( fcb->resource );
          free(fcb);
+         ++stats.frameCallbackCount;
       }
    }
+
+   wstPresentationFeedbackCompose( ctx, now );
+
+   wstFrameStatsRecord( ctx, &stats );
    
    pthread_mutex_unlock( &ctx->mutex );
+
+   wstContextInvokeFrameStatsCB( ctx, &stats );
 }
 
 static void wstContextInvokeDispatchCB( WstContext *ctx )
@@ -4633,6 +5155,89 @@ static void wstContextInvokeInvalidateCB( WstContext *ctx )
    }
 }
 
+static void wstContextInvokeFrameStatsCB( WstContext *ctx, WstFrameStats *stats )
+{
+   WstCompositor *wctx;
+   for ( std::vector<WstCompositor*>::iterator it= ctx->virt.begin();
+         it != ctx->virt.end();
+         ++it )
+   {
+      wctx= (*it);
+      if ( wctx->frameStatsCB )
+      {
+         wctx->frameStatsCB( wctx, stats, wctx->frameStatsUserData );
+      }
+   }
+   wctx= ctx->wctx;
+   if ( wctx->frameStatsCB )
+   {
+      wctx->frameStatsCB( wctx, stats, wctx->frameStatsUserData );
+   }
+}
+
+static void wstFrameHistogramAdd( unsigned int *buckets, long long value )
+{
+   long long limit= 250;
+   int i;
+
+   for( i= 0; i < WST_FRAME_STATS_HISTOGRAM_BUCKETS-1; ++i )
+   {
+      if ( value < limit )
+      {
+         break;
+      }
+      limit *= 2;
+   }
+   __atomic_fetch_add( &buckets[i], 1, __ATOMIC_RELAXED );
+}
+
+static void wstFrameStatsRecord( WstContext *ctx, WstFrameStats *stats )
+{
+   WstFrameStatsRing *ring= &ctx->frameStats;
+   WstFrameStatsSlot *slot;
+   unsigned long long head;
+   unsigned int seq;
+
+   if ( ctx->lastFrameTime )
+   {
+      wstFrameHistogramAdd( ring->histogram.frameInterval, stats->frameTime-ctx->lastFrameTime );
+   }
+   ctx->lastFrameTime= stats->frameTime;
+   wstFrameHistogramAdd( ring->histogram.eventTime, stats->eventTime );
+   wstFrameHistogramAdd( ring->histogram.sceneTime, stats->sceneTime );
+   if ( stats->swapTime >= 0 )
+   {
+      wstFrameHistogramAdd( ring->histogram.swapTime, stats->swapTime );
+   }
+   __atomic_fetch_add( &ring->histogram.frameCount, 1, __ATOMIC_RELAXED );
+
+   head= __atomic_load_n( &ring->head, __ATOMIC_RELAXED );
+   stats->frameNumber= head;
+
+   slot= &ring->slots[head % WST_FRAME_STATS_RING_SIZE];
+   seq= __atomic_load_n( &slot->seq, __ATOMIC_RELAXED );
+   __atomic_store_n( &slot->seq, seq+1, __ATOMIC_RELAXED );
+   __atomic_thread_fence( __ATOMIC_RELEASE );
+   slot->stats= *stats;
+   __atomic_store_n( &slot->seq, seq+2, __ATOMIC_RELEASE );
+
+   __atomic_store_n( &ring->head, head+1, __ATOMIC_RELEASE );
+}
+
+static bool wstFrameStatsRead( WstFrameStatsRing *ring, unsigned long long index, WstFrameStats *stats )
+{
+   WstFrameStatsSlot *slot= &ring->slots[index % WST_FRAME_STATS_RING_SIZE];
+   unsigned int seq1, seq2;
+
+   seq1= __atomic_load_n( &slot->seq, __ATOMIC_ACQUIRE );
+   memcpy( stats, &slot->stats, sizeof(WstFrameStats) );
+   __atomic_thread_fence( __ATOMIC_ACQUIRE );
+   seq2= __atomic_load_n( &slot->seq, __ATOMIC_RELAXED );
+
+   // Reject a copy that raced with the writer or a slot already reused for a later frame
+   return ( !(seq1 & 1) && (seq1 == seq2) && (stats->frameNumber == index) );
+}
+
 static void wstContextInvokeHidePointerCB( WstContext *ctx, bool hidePointer )
 {
    WstCompositor *wctx;
@@ -4653,24 +5258,22 @@ static void wstContextInvokeHidePointerCB( WstContext *ctx, bool hidePointer )
    }
 }
 
-static int wstCompositorDisplayTimeOut( void *data )
+/*
+ * Work done once per frame period whichever timer drives it: dispatch,
+ * compose if anything changed, and deliver presentation feedback.
+ */
+static void wstCompositorRunFrame( WstContext *ctx, long long frameTime )
 {
-   WstContext *ctx= (WstContext*)data;
-   long long frameTime, now;
-   long long nextFrameDelay;
-   
-   frameTime= wstGetCurrentTimeMillis();   
-   
    wstContextProcessEvents( ctx );
 
    wstContextInvokeDispatchCB( ctx );
-   
+
    if ( ctx->needRepaint )
    {
       ctx->allowImmediateRepaint= false;
 
       wstCompositorComposeFrame( ctx, (uint32_t)frameTime );
-      
+
       wstContextInvokeInvalidateCB( ctx );
    }
    else
@@ -4678,6 +5281,19 @@ static int wstCompositorDisplayTimeOut( void *data )
       ctx->allowImmediateRepaint= true;
    }
 
+   wstPresentationFeedbackDeliver( ctx );
+}
+
+static int wstCompositorDisplayTimeOut( void *data )
+{
+   WstContext *ctx= (WstContext*)data;
+   long long frameTime, now;
+   long long nextFrameDelay;
+   
+   frameTime= wstGetCurrentTimeMillis();   
+   
+   wstCompositorRunFrame( ctx, frameTime );
+
    now= wstGetCurrentTimeMillis();
    nextFrameDelay= (ctx->framePeriodMillis-(now-frameTime));
    if ( nextFrameDelay < 1 ) nextFrameDelay= 1;
@@ -4690,6 +5306,93 @@ static int wstCompositorDisplayTimeOut( void *data )
    return 0;
 }
 
+static int wstCompositorFrameTimerReady( int fd, uint32_t mask, void *data )
+{
+   WstContext *ctx= (WstContext*)data;
+   uint64_t expirations;
+   long long frameStart, frameTime;
+   WESTEROS_UNUSED(mask);
+
+   if ( read( fd, &expirations, sizeof(expirations) ) < 0 )
+   {
+      // Spurious wakeup: the timer has not yet expired
+      if ( errno == EAGAIN )
+      {
+         return 0;
+      }
+   }
+
+   frameStart= wstGetCurrentTimeMicros();
+   frameTime= wstGetCurrentTimeMillis();
+
+   wstCompositorRunFrame( ctx, frameTime );
+
+   wstCompositorScheduleFrameTimer( ctx, frameStart );
+
+   return 0;
+}
+
+/*
+ * Arm the frame timer so that the next frame is composed a deadline ahead of
+ * the next vblank, as predicted from the most recent vblank reported by the
+ * renderer.  Without vblank information from the renderer this falls back
+ * to a fixed frame period.
+ */
+static void wstCompositorScheduleFrameTimer( WstContext *ctx, long long frameStart )
+{
+   WstPresentationInfo info;
+   struct itimerspec ts;
+   long long now, period, deadline, target;
+
+   pthread_mutex_lock( &ctx->mutex );
+   period= 1000000LL/ctx->frameRate;
+   deadline= ctx->vblankDeadlineMicros;
+   pthread_mutex_unlock( &ctx->mutex );
+
+   now= wstGetCurrentTimeMicros();
+
+   memset( &info, 0, sizeof(info) );
+   if ( ctx->renderer && WstRendererGetPresentationInfo( ctx->renderer, &info ) && info.vblankTime )
+   {
+      long long interval, nextVBlank, n;
+
+      interval= (info.vblankInterval > 0 ? info.vblankInterval : period);
+      if ( deadline >= interval )
+      {
+         deadline= interval-1;
+      }
+
+      // First vblank far enough ahead to meet the deadline
+      n= (now+deadline-info.vblankTime)/interval+1;
+      if ( n < 1 ) n= 1;
+      nextVBlank= info.vblankTime+n*interval;
+      target= nextVBlank-deadline;
+
+      // Don't compose faster than the configured frame rate
+      while ( target < frameStart+period-(interval/2) )
+      {
+         target += interval;
+      }
+   }
+   else
+   {
+      target= frameStart+period;
+      if ( target <= now )
+      {
+         target= now+1000LL;
+      }
+   }
+
+   ts.it_interval.tv_sec= 0;
+   ts.it_interval.tv_nsec= 0;
+   ts.it_value.tv_sec= target/1000000LL;
+   ts.it_value.tv_nsec= (target%1000000LL)*1000LL;
+   if ( timerfd_settime( ctx->frameTimerFd, TFD_TIMER_ABSTIME, &ts, NULL ) < 0 )
+   {
+      ERROR("timerfd_settime failed: errno %d", errno);
+   }
+}
+
 static void wstCompositorScheduleRepaint( WstContext *ctx )
 {
    if ( !ctx->needRepaint )
@@ -4715,12 +5418,21 @@ static void wstCompositorReleaseDetachedBuffers( WstContext *ctx )
       if ( surface->detachedBufferResource )
       {
          wl_list_remove(&surface->detachedBufferDestroyListener.link);
-         wl_buffer_send_release( surface->detachedBufferResource );
+         wstCompositorReleaseBuffer( surface, surface->detachedBufferResource );
          surface->detachedBufferResource= 0;
       }
    }
 }
 
+static void wstCompositorReleaseBuffer( WstSurface *surface, struct wl_resource *resource )
+{
+   // A buffer on a scanout plane is released by the renderer once it is off screen
+   if ( !surface->renderer || !WstRendererRetainBuffer( surface->renderer, resource ) )
+   {
+      wl_buffer_send_release( resource );
+   }
+}
+
 static const struct wl_shm_interface shm_interface=
 {
    wstIShmCreatePool
@@ -4753,6 +5465,10 @@ static const struct wl_surface_interface surface_interface=
    wstISurfaceCommit,
    wstISurfaceSetBufferTransform,
    wstISurfaceSetBufferScale
+   #ifdef WST_HAVE_DAMAGE_BUFFER
+   ,
+   wstISurfaceDamageBuffer
+   #endif
 };
 
 static const struct wl_region_interface region_interface=
@@ -4873,6 +5589,12 @@ static const struct wl_vpc_surface_interface vpc_surface_interface=
    wstIVpcSurfaceSetGeometryWithCrop
 };
 
+static const struct wp_presentation_interface presentation_interface_impl=
+{
+   wstIPresentationDestroy,
+   wstIPresentationFeedback
+};
+
 static void wstShmBind( struct wl_client *client, void *data, uint32_t version, uint32_t id)
 {
    WstShm *shm= (WstShm*)data;
@@ -5387,8 +6109,6 @@ static void wstICompositorCreateRegion(struct wl_client *client, struct wl_resou
    WstCompositor *wctx= 0;
    WstRegion *region;
 
-   WARNING("wstICompositorCreateRegion: wl_region is currently a stub impl");
-
    wctx= wstGetCompositorFromClient( ctx, client );
    if ( !wctx )
    {
@@ -5476,6 +6196,8 @@ static WstSurface* wstSurfaceCreate( WstCompositor *wctx)
       ctx->surfaceMap.insert( std::pair<int32_t,WstSurface*>( surface->surfaceId, surface ) );
 
       wl_list_init(&surface->frameCallbackList);
+      wl_list_init(&surface->feedbackPendingList);
+      wl_list_init(&surface->feedbackList);
 
       surface->attachedBufferDestroyListener.notify= wstAttachedBufferDestroyCallback;
       surface->detachedBufferDestroyListener.notify= wstDetachedBufferDestroyCallback;
@@ -5535,12 +6257,12 @@ static void wstSurfaceDestroy( WstSurface *surface )
       if ( surface->detachedBufferResource )
       {
          wl_list_remove(&surface->detachedBufferDestroyListener.link);
-         wl_buffer_send_release( surface->detachedBufferResource );
+         wstCompositorReleaseBuffer( surface, surface->detachedBufferResource );
       }
       if ( surface->attachedBufferResource )
       {
          wl_list_remove(&surface->attachedBufferDestroyListener.link);
-         wl_buffer_send_release( surface->attachedBufferResource );
+         wstCompositorReleaseBuffer( surface, surface->attachedBufferResource );
       }
       surface->attachedBufferResource= 0;
       surface->detachedBufferResource= 0;
@@ -5661,7 +6383,16 @@ static void wstSurfaceDestroy( WstSurface *surface )
       free(fcb);      
    }
 
+   // Content updates of a destroyed surface will never be presented
+   wstPresentationFeedbackDiscardList( &surface->feedbackPendingList );
+   wstPresentationFeedbackDiscardList( &surface->feedbackList );
+
    assert(surface->resource == NULL);
+
+   std::vector<WstRect>().swap( surface->damage );
+   std::vector<WstRect>().swap( surface->bufferDamage );
+   std::vector<WstRect>().swap( surface->commitDamage );
+   std::vector<WstRect>().swap( surface->opaqueRegion );
    
    pthread_mutex_destroy( &surface->renderMutex );
    free(surface);
@@ -5931,7 +6662,7 @@ static void wstISurfaceAttach(struct wl_client *client,
       if ( surface->detachedBufferResource )
       {
          wl_list_remove(&surface->detachedBufferDestroyListener.link);
-         wl_buffer_send_release( surface->detachedBufferResource );
+         wstCompositorReleaseBuffer( surface, surface->detachedBufferResource );
       }
       if ( surface->attachedBufferResource )
       {
@@ -5953,6 +6684,7 @@ static void wstISurfaceAttach(struct wl_client *client,
       }
       surface->attachedX= sx;
       surface->attachedY= sy;
+      surface->attachedSinceCommit= true;
    }
    else
    {
@@ -5966,12 +6698,89 @@ static void wstISurfaceDamage(struct wl_client *client,
                               int32_t x, int32_t y, int32_t width, int32_t height)
 {
    WstSurface *surface= (WstSurface*)wl_resource_get_user_data(resource);
-   WESTEROS_UNUSED(x);
-   WESTEROS_UNUSED(y);
-   WESTEROS_UNUSED(width);
-   WESTEROS_UNUSED(height);
+   WstContext *ctx= surface->compositor->ctx;
 
-   // Ignored for now - assume damage includes entire surface
+   pthread_mutex_lock( &ctx->mutex );
+   wstSurfaceAddDamage( surface->damage, x, y, width, height );
+   pthread_mutex_unlock( &ctx->mutex );
+}
+
+#ifdef WST_HAVE_DAMAGE_BUFFER
+static void wstISurfaceDamageBuffer(struct wl_client *client,
+                                    struct wl_resource *resource,
+                                    int32_t x, int32_t y, int32_t width, int32_t height)
+{
+   WstSurface *surface= (WstSurface*)wl_resource_get_user_data(resource);
+   WstContext *ctx= surface->compositor->ctx;
+
+   pthread_mutex_lock( &ctx->mutex );
+   wstSurfaceAddDamage( surface->bufferDamage, x, y, width, height );
+   pthread_mutex_unlock( &ctx->mutex );
+}
+#endif
+
+static void wstSurfaceAddDamage( std::vector<WstRect> &damage, int32_t x, int32_t y, int32_t width, int32_t height )
+{
+   WstRect r;
+   long long x1, y1, x2, y2;
+
+   if ( (width <= 0) || (height <= 0) )
+   {
+      return;
+   }
+
+   x1= x;
+   y1= y;
+   x2= (long long)x+width;
+   y2= (long long)y+height;
+
+   if ( damage.size() >= WST_MAX_DAMAGE_RECTS )
+   {
+      // Too many rectangles: collapse to a single bounding rectangle
+      for( int i= 0; i < damage.size(); ++i )
+      {
+         if ( damage[i].x < x1 ) x1= damage[i].x;
+         if ( damage[i].y < y1 ) y1= damage[i].y;
+         if ( (long long)damage[i].x+damage[i].width > x2 ) x2= (long long)damage[i].x+damage[i].width;
+         if ( (long long)damage[i].y+damage[i].height > y2 ) y2= (long long)damage[i].y+damage[i].height;
+      }
+      damage.clear();
+   }
+
+   if ( x2-x1 > INT_MAX ) x2= x1+INT_MAX;
+   if ( y2-y1 > INT_MAX ) y2= y1+INT_MAX;
+
+   r.x= (int)x1;
+   r.y= (int)y1;
+   r.width= (int)(x2-x1);
+   r.height= (int)(y2-y1);
+   damage.push_back( r );
+}
+
+static void wstSurfaceGetCommitDamage( WstSurface *surface )
+{
+   // Buffer scale and transform are not supported so surface and buffer
+   // coordinates are the same and the pending damage lists can be merged
+   surface->commitDamage.clear();
+   for( int i= 0; i < surface->damage.size(); ++i )
+   {
+      WstRect r= surface->damage[i];
+      wstSurfaceAddDamage( surface->commitDamage, r.x, r.y, r.width, r.height );
+   }
+   for( int i= 0; i < surface->bufferDamage.size(); ++i )
+   {
+      WstRect r= surface->bufferDamage[i];
+      wstSurfaceAddDamage( surface->commitDamage, r.x, r.y, r.width, r.height );
+   }
+   surface->damage.clear();
+   surface->bufferDamage.clear();
+
+   if ( surface->attachedSinceCommit && surface->commitDamage.empty() )
+   {
+      // A new buffer with no damage: treat as full surface damage
+      wstSurfaceAddDamage( surface->commitDamage, 0, 0, INT_MAX, INT_MAX );
+   }
+   surface->attachedSinceCommit= false;
 }
 
 static void wstISurfaceFrame(struct wl_client *client,
@@ -6002,10 +6811,23 @@ static void wstISurfaceSetOpaqueRegion(struct wl_client *client,
                                        struct wl_resource *resource,
                                        struct wl_resource *regionResource)
 {
+   WstSurface *surface= (WstSurface*)wl_resource_get_user_data(resource);
+   WstContext *ctx= surface->compositor->ctx;
    WESTEROS_UNUSED(client);
-   WESTEROS_UNUSED(resource);
-   WESTEROS_UNUSED(regionResource);
-   TRACE1("wstISurfaceSetOpaqueRegion: not supported");
+
+   // The opaque region is double buffered and takes effect on the next commit
+   pthread_mutex_lock( &ctx->mutex );
+   surface->opaqueRegion.clear();
+   if ( regionResource )
+   {
+      WstRegion *region= (WstRegion*)wl_resource_get_user_data(regionResource);
+      if ( region )
+      {
+         surface->opaqueRegion= region->rects;
+      }
+   }
+   surface->opaqueRegionPending= true;
+   pthread_mutex_unlock( &ctx->mutex );
 }
 
 static void wstISurfaceSetInputRegion(struct wl_client *client,
@@ -6026,9 +6848,26 @@ static void wstISurfaceCommit(struct wl_client *client, struct wl_resource *reso
 
    pthread_mutex_lock( &ctx->mutex );
 
+   wstSurfaceGetCommitDamage( surface );
+
+   if ( surface->opaqueRegionPending )
+   {
+      surface->opaqueRegionPending= false;
+      if ( surface->renderer && surface->surface )
+      {
+         WstRendererSurfaceSetOpaqueRegion( surface->renderer, surface->surface, surface->opaqueRegion );
+      }
+   }
+
+   wstPresentationFeedbackCommit( surface );
+
    committedBufferResource= surface->attachedBufferResource;
    if ( surface->attachedBufferResource )
    {
+      if ( !surface->commitTime )
+      {
+         surface->commitTime= wstGetCurrentTimeMicros();
+      }
       if ( !surface->compositor->clientCommit )
       {
          struct wl_client *client= wl_resource_get_client( surface->resource );
@@ -6214,7 +7053,7 @@ static void wstISurfaceCommit(struct wl_client *client, struct wl_resource *reso
       }
       else
       {
-         WstRendererSurfaceCommit( surface->renderer, surface->surface, surface->attachedBufferResource );
+         WstRendererSurfaceCommitDamage( surface->renderer, surface->surface, surface->attachedBufferResource, surface->commitDamage );
          if ( ctx->hasVpcBridge && surface->vpcSurface && surface->surfaceNested )
          {
             WstNestedConnectionAttachAndCommit( ctx->nc,
@@ -6320,6 +7159,7 @@ static WstRegion *wstRegionCreate( WstCompositor *wctx )
 static void wstRegionDestroy( WstRegion *region )
 {
    assert(region->resource == NULL);
+   std::vector<WstRect>().swap( region->rects );
    free( region );
 }
 
@@ -6342,24 +7182,111 @@ static void wstIRegionAdd( struct wl_client *client,
                            struct wl_resource *resource,
                            int32_t x, int32_t y, int32_t width, int32_t height )
 {
+   WstRegion *region= (WstRegion*)wl_resource_get_user_data(resource);
+   WstRect r;
    WESTEROS_UNUSED(client);
-   WESTEROS_UNUSED(resource);
-   WESTEROS_UNUSED(x);
-   WESTEROS_UNUSED(y);
-   WESTEROS_UNUSED(width);
-   WESTEROS_UNUSED(height);
+
+   if ( (width <= 0) || (height <= 0) )
+   {
+      return;
+   }
+
+   r.x= x;
+   r.y= y;
+   r.width= width;
+   r.height= height;
+
+   // Keep the rectangles disjoint so the region is a simple list
+   wstRegionSubtractRect( region->rects, &r );
+   region->rects.push_back( r );
 }
                            
 static void wstIRegionSubtract( struct wl_client *client,
                                 struct wl_resource *resource,
                                 int32_t x, int32_t y, int32_t width, int32_t height )
 {
+   WstRegion *region= (WstRegion*)wl_resource_get_user_data(resource);
+   WstRect r;
    WESTEROS_UNUSED(client);
-   WESTEROS_UNUSED(resource);
-   WESTEROS_UNUSED(x);
-   WESTEROS_UNUSED(y);
-   WESTEROS_UNUSED(width);
-   WESTEROS_UNUSED(height);
+
+   if ( (width <= 0) || (height <= 0) )
+   {
+      return;
+   }
+
+   r.x= x;
+   r.y= y;
+   r.width= width;
+   r.height= height;
+
+   wstRegionSubtractRect( region->rects, &r );
+}
+
+static void wstRegionSubtractRect( std::vector<WstRect> &rects, WstRect *r )
+{
+   std::vector<WstRect> result;
+   long long rx1, ry1, rx2, ry2;
+
+   rx1= r->x;
+   ry1= r->y;
+   rx2= (long long)r->x+r->width;
+   ry2= (long long)r->y+r->height;
+
+   for( int i= 0; i < rects.size(); ++i )
+   {
+      WstRect a= rects[i];
+      WstRect piece;
+      long long ax1, ay1, ax2, ay2, y1, y2;
+
+      ax1= a.x;
+      ay1= a.y;
+      ax2= (long long)a.x+a.width;
+      ay2= (long long)a.y+a.height;
+
+      if ( (rx1 >= ax2) || (rx2 <= ax1) || (ry1 >= ay2) || (ry2 <= ay1) )
+      {
+         result.push_back( a );
+         continue;
+      }
+
+      // Split the remainder into bands above, below, left and right of r
+      if ( ry1 > ay1 )
+      {
+         piece.x= a.x;
+         piece.y= a.y;
+         piece.width= a.width;
+         piece.height= (int)(ry1-ay1);
+         result.push_back( piece );
+      }
+      if ( ry2 < ay2 )
+      {
+         piece.x= a.x;
+         piece.y= (int)ry2;
+         piece.width= a.width;
+         piece.height= (int)(ay2-ry2);
+         result.push_back( piece );
+      }
+      y1= (ry1 > ay1 ? ry1 : ay1);
+      y2= (ry2 < ay2 ? ry2 : ay2);
+      if ( rx1 > ax1 )
+      {
+         piece.x= a.x;
+         piece.y= (int)y1;
+         piece.width= (int)(rx1-ax1);
+         piece.height= (int)(y2-y1);
+         result.push_back( piece );
+      }
+      if ( rx2 < ax2 )
+      {
+         piece.x= (int)rx2;
+         piece.y= (int)y1;
+         piece.width= (int)(ax2-rx2);
+         piece.height= (int)(y2-y1);
+         result.push_back( piece );
+      }
+   }
+
+   rects.swap( result );
 }
 
 static bool wstOutputInit( WstContext *ctx )
@@ -7388,16 +8315,15 @@ static void wstDefaultNestedKeyboardHandleKey( void *userData, uint32_t time, ui
       else
       {
          WstCompositor *wctx= ctx->wctx;
-         int eventIndex= wctx->eventIndex;
-         pthread_mutex_lock( &ctx->mutex );
-         wctx->eventQueue[eventIndex].type= WstEventType_keyCode;
-         wctx->eventQueue[eventIndex].v1= time;
-         wctx->eventQueue[eventIndex].v2= key;
-         wctx->eventQueue[eventIndex].v3= state;
+         WstEvent event;
+
+         memset( &event, 0, sizeof(event) );
+         event.type= WstEventType_keyCode;
+         event.v1= time;
+         event.v2= key;
+         event.v3= state;
          
-         ++wctx->eventIndex;
-         assert( wctx->eventIndex < WST_EVENT_QUEUE_SIZE );
-         pthread_mutex_unlock( &ctx->mutex );         
+         wstCompositorQueueEvents( wctx, &event, 1 );
       }
    }   
 }
@@ -7417,17 +8343,16 @@ static void wstDefaultNestedKeyboardHandleModifiers( void *userData, uint32_t mo
       else
       {
          WstCompositor *wctx= ctx->wctx;
-         int eventIndex= wctx->eventIndex;
-         pthread_mutex_lock( &ctx->mutex );
-         wctx->eventQueue[eventIndex].type= WstEventType_keyModifiers;
-         wctx->eventQueue[eventIndex].v1= mods_depressed;
-         wctx->eventQueue[eventIndex].v2= mods_latched;
-         wctx->eventQueue[eventIndex].v3= mods_locked;
-         wctx->eventQueue[eventIndex].v4= group;
+         WstEvent event;
+
+         memset( &event, 0, sizeof(event) );
+         event.type= WstEventType_keyModifiers;
+         event.v1= mods_depressed;
+         event.v2= mods_latched;
+         event.v3= mods_locked;
+         event.v4= group;
          
-         ++wctx->eventIndex;
-         assert( wctx->eventIndex < WST_EVENT_QUEUE_SIZE );
-         pthread_mutex_unlock( &ctx->mutex );
+         wstCompositorQueueEvents( wctx, &event, 1 );
       }
    }
 }
@@ -7471,20 +8396,18 @@ static void wstDefaultNestedPointerHandleEnter( void *userData, struct wl_surfac
       {
          int x, y;
          WstCompositor *wctx= ctx->wctx;
-         int eventIndex= wctx->eventIndex;
+         WstEvent event;
          
          x= wl_fixed_to_int( sx );
          y= wl_fixed_to_int( sy );
 
-         pthread_mutex_lock( &ctx->mutex );
-         wctx->eventQueue[eventIndex].type= WstEventType_pointerEnter;
-         wctx->eventQueue[eventIndex].v1= x;
-         wctx->eventQueue[eventIndex].v2= y;
-         wctx->eventQueue[eventIndex].p1= surfaceNested;
+         memset( &event, 0, sizeof(event) );
+         event.type= WstEventType_pointerEnter;
+         event.v1= x;
+         event.v2= y;
+         event.p1= surfaceNested;
          
-         ++wctx->eventIndex;
-         assert( wctx->eventIndex < WST_EVENT_QUEUE_SIZE );
-         pthread_mutex_unlock( &ctx->mutex );
+         wstCompositorQueueEvents( wctx, &event, 1 );
       }
    }
 }
@@ -7502,13 +8425,12 @@ static void wstDefaultNestedPointerHandleLeave( void *userData, struct wl_surfac
       else
       {
          WstCompositor *wctx= ctx->wctx;
-         int eventIndex= wctx->eventIndex;
-         pthread_mutex_lock( &ctx->mutex );
-         wctx->eventQueue[eventIndex].type= WstEventType_pointerLeave;
+         WstEvent event;
+
+         memset( &event, 0, sizeof(event) );
+         event.type= WstEventType_pointerLeave;
          
-         ++wctx->eventIndex;
-         assert( wctx->eventIndex < WST_EVENT_QUEUE_SIZE );
-         pthread_mutex_unlock( &ctx->mutex );
+         wstCompositorQueueEvents( wctx, &event, 1 );
       }
    }
 }
@@ -7528,19 +8450,17 @@ static void wstDefaultNestedPointerHandleMotion( void *userData, uint32_t time,
       {
          int x, y;
          WstCompositor *wctx= ctx->wctx;
-         int eventIndex= wctx->eventIndex;
+         WstEvent event;
          
          x= wl_fixed_to_int( sx );
          y= wl_fixed_to_int( sy );
 
-         pthread_mutex_lock( &ctx->mutex );
-         wctx->eventQueue[eventIndex].type= WstEventType_pointerMove;
-         wctx->eventQueue[eventIndex].v1= x;
-         wctx->eventQueue[eventIndex].v2= y;
+         memset( &event, 0, sizeof(event) );
+         event.type= WstEventType_pointerMove;
+         event.v1= x;
+         event.v2= y;
          
-         ++wctx->eventIndex;
-         assert( wctx->eventIndex < WST_EVENT_QUEUE_SIZE );
-         pthread_mutex_unlock( &ctx->mutex );
+         wstCompositorQueueEvents( wctx, &event, 1 );
       }
    }
 }
@@ -7559,17 +8479,16 @@ static void wstDefaultNestedPointerHandleButton( void *userData, uint32_t time,
       else
       {
          WstCompositor *wctx= ctx->wctx;
-         int eventIndex= wctx->eventIndex;
-         pthread_mutex_lock( &ctx->mutex );
-         wctx->eventQueue[eventIndex].type= WstEventType_pointerButton;
-         wctx->eventQueue[eventIndex].v1= button;
-         wctx->eventQueue[eventIndex].v2= state;
-         wctx->eventQueue[eventIndex].v3= 1; // have time
-         wctx->eventQueue[eventIndex].v4= time;
+         WstEvent event;
+
+         memset( &event, 0, sizeof(event) );
+         event.type= WstEventType_pointerButton;
+         event.v1= button;
+         event.v2= state;
+         event.v3= 1; // have time
+         event.v4= time;
          
-         ++wctx->eventIndex;
-         assert( wctx->eventIndex < WST_EVENT_QUEUE_SIZE );
-         pthread_mutex_unlock( &ctx->mutex );
+         wstCompositorQueueEvents( wctx, &event, 1 );
       }
    }
 }
@@ -7610,19 +8529,18 @@ static void wstDefaultNestedTouchHandleDown( void *userData, struct wl_surface *
          x= wl_fixed_to_int( sx );
          y= wl_fixed_to_int( sy );
 
-         pthread_mutex_lock( &ctx->mutex );
          WstCompositor *wctx= ctx->wctx;
-         int eventIndex= wctx->eventIndex;
-         wctx->eventQueue[eventIndex].type= WstEventType_touchDown;
-         wctx->eventQueue[eventIndex].v1= time;
-         wctx->eventQueue[eventIndex].v2= id;
-         wctx->eventQueue[eventIndex].v3= x;
-         wctx->eventQueue[eventIndex].v4= y;
-         wctx->eventQueue[eventIndex].p1= surfaceNested;
-
-         ++wctx->eventIndex;
-         assert( wctx->eventIndex < WST_EVENT_QUEUE_SIZE );
-         pthread_mutex_unlock( &ctx->mutex );
+         WstEvent event;
+
+         memset( &event, 0, sizeof(event) );
+         event.type= WstEventType_touchDown;
+         event.v1= time;
+         event.v2= id;
+         event.v3= x;
+         event.v4= y;
+         event.p1= surfaceNested;
+
+         wstCompositorQueueEvents( wctx, &event, 1 );
       }
    }
 }
@@ -7640,16 +8558,15 @@ static void wstDefaultNestedTouchHandleUp( void *userData, uint32_t time, int32_
       }
       else
       {
-         pthread_mutex_lock( &ctx->mutex );
          WstCompositor *wctx= ctx->wctx;
-         int eventIndex= wctx->eventIndex;
-         wctx->eventQueue[eventIndex].type= WstEventType_touchUp;
-         wctx->eventQueue[eventIndex].v1= time;
-         wctx->eventQueue[eventIndex].v2= id;
+         WstEvent event;
 
-         ++wctx->eventIndex;
-         assert( wctx->eventIndex < WST_EVENT_QUEUE_SIZE );
-         pthread_mutex_unlock( &ctx->mutex );
+         memset( &event, 0, sizeof(event) );
+         event.type= WstEventType_touchUp;
+         event.v1= time;
+         event.v2= id;
+
+         wstCompositorQueueEvents( wctx, &event, 1 );
       }
    }
 }
@@ -7672,18 +8589,17 @@ static void wstDefaultNestedTouchHandleMotion( void *userData, uint32_t time, in
          x= wl_fixed_to_int( sx );
          y= wl_fixed_to_int( sy );
 
-         pthread_mutex_lock( &ctx->mutex );
          WstCompositor *wctx= ctx->wctx;
-         int eventIndex= wctx->eventIndex;
-         wctx->eventQueue[eventIndex].type= WstEventType_touchMotion;
-         wctx->eventQueue[eventIndex].v1= time;
-         wctx->eventQueue[eventIndex].v2= id;
-         wctx->eventQueue[eventIndex].v3= x;
-         wctx->eventQueue[eventIndex].v4= y;
-
-         ++wctx->eventIndex;
-         assert( wctx->eventIndex < WST_EVENT_QUEUE_SIZE );
-         pthread_mutex_unlock( &ctx->mutex );
+         WstEvent event;
+
+         memset( &event, 0, sizeof(event) );
+         event.type= WstEventType_touchMotion;
+         event.v1= time;
+         event.v2= id;
+         event.v3= x;
+         event.v4= y;
+
+         wstCompositorQueueEvents( wctx, &event, 1 );
       }
    }
 }
@@ -7700,14 +8616,13 @@ static void wstDefaultNestedTouchHandleFrame( void *userData )
       }
       else
       {
-         pthread_mutex_lock( &ctx->mutex );
          WstCompositor *wctx= ctx->wctx;
-         int eventIndex= wctx->eventIndex;
-         wctx->eventQueue[eventIndex].type= WstEventType_touchFrame;
+         WstEvent event;
 
-         ++wctx->eventIndex;
-         assert( wctx->eventIndex < WST_EVENT_QUEUE_SIZE );
-         pthread_mutex_unlock( &ctx->mutex );
+         memset( &event, 0, sizeof(event) );
+         event.type= WstEventType_touchFrame;
+
+         wstCompositorQueueEvents( wctx, &event, 1 );
       }
    }
 }
@@ -8866,6 +9781,213 @@ static void wstUpdateVPCSurfaces( WstCompositor *wctx, std::vector<WstRect> &rec
    }
 }
 
+static void wstPresentationBind( struct wl_client *client, void *data, uint32_t version, uint32_t id)
+{
+   WstContext *ctx= (WstContext*)data;
+   struct wl_resource *resource;
+
+   resource= wl_resource_create(client, 
+                                &wp_presentation_interface,
+                                MIN(version, 1), 
+                                id);
+   if (!resource)
+   {
+      wl_client_post_no_memory(client);
+      return;
+   }
+
+   wl_resource_set_implementation(resource, &presentation_interface_impl, ctx, NULL);
+
+   wp_presentation_send_clock_id( resource, CLOCK_MONOTONIC );
+}
+
+static void wstIPresentationDestroy( struct wl_client *client, struct wl_resource *resource )
+{
+   WESTEROS_UNUSED(client);
+
+   wl_resource_destroy(resource);
+}
+
+static void wstIPresentationFeedback( struct wl_client *client, struct wl_resource *resource,
+                                      struct wl_resource *surfaceResource, uint32_t id )
+{
+   WstSurface *surface= (WstSurface*)wl_resource_get_user_data(surfaceResource);
+   WstPresentationFeedback *feedback= 0;
+
+   feedback= (WstPresentationFeedback*)calloc( 1, sizeof(WstPresentationFeedback) );
+   if ( !feedback )
+   {
+      wl_resource_post_no_memory(resource);
+      return;
+   }
+
+   feedback->resource= wl_resource_create( client, &wp_presentation_feedback_interface, 1, id );
+   if ( !feedback->resource )
+   {
+      wl_resource_post_no_memory(resource);
+      free(feedback);
+      return;
+   }
+
+   wl_resource_set_implementation(feedback->resource, NULL, feedback, wstDestroyPresentationFeedbackCallback);
+
+   feedback->surface= surface;
+   wl_list_insert( surface->feedbackPendingList.prev, &feedback->link );
+}
+
+static void wstDestroyPresentationFeedbackCallback( struct wl_resource *resource )
+{
+   WstPresentationFeedback *feedback= (WstPresentationFeedback*)wl_resource_get_user_data(resource);
+
+   wl_list_remove( &feedback->link );
+   free(feedback);
+}
+
+static void wstPresentationFeedbackDiscardList( struct wl_list *list )
+{
+   WstPresentationFeedback *feedback;
+
+   while( !wl_list_empty( list ) )
+   {
+      feedback= wl_container_of( list->next, feedback, link);
+      wp_presentation_feedback_send_discarded( feedback->resource );
+      // Destroying the resource removes the feedback from the list
+      wl_resource_destroy( feedback->resource );
+   }
+}
+
+static void wstPresentationFeedbackCommit( WstSurface *surface )
+{
+   // Any previous content update not yet composed has been superseded
+   wstPresentationFeedbackDiscardList( &surface->feedbackList );
+
+   wl_list_insert_list( &surface->feedbackList, &surface->feedbackPendingList );
+   wl_list_init( &surface->feedbackPendingList );
+}
+
+static void wstPresentationFeedbackCompose( WstContext *ctx, long long composeTime )
+{
+   WstPresentationFeedback *feedback;
+
+   for( std::map<struct wl_resource*, WstSurfaceInfo*>::iterator it= ctx->surfaceInfoMap.begin(); it != ctx->surfaceInfoMap.end(); ++it )
+   {
+      WstSurface *surface= it->second->surface;
+
+      if ( !surface->visible )
+      {
+         wstPresentationFeedbackDiscardList( &surface->feedbackList );
+         continue;
+      }
+
+      while( !wl_list_empty( &surface->feedbackList ) )
+      {
+         feedback= wl_container_of( surface->feedbackList.next, feedback, link);
+         wl_list_remove( &feedback->link );
+         feedback->surface= 0;
+         feedback->composeTime= composeTime;
+         wl_list_insert( ctx->presentedFeedbackList.prev, &feedback->link );
+      }
+   }
+}
+
+/*
+ * Send presented events for composed content updates once the renderer
+ * reports the vblank at which they reached the screen.  When the renderer
+ * has no vblank information, or stops reporting vblanks, the time of
+ * composition is used instead.
+ */
+static void wstPresentationFeedbackDeliver( WstContext *ctx )
+{
+   WstPresentationFeedback *feedback;
+   WstPresentationInfo info;
+   struct wl_list *link;
+   bool haveVBlank= false;
+   long long now;
+
+   pthread_mutex_lock( &ctx->mutex );
+
+   if ( wl_list_empty( &ctx->presentedFeedbackList ) )
+   {
+      goto exit;
+   }
+
+   now= wstGetCurrentTimeMicros();
+
+   memset( &info, 0, sizeof(info) );
+   if ( ctx->renderer && WstRendererGetPresentationInfo( ctx->renderer, &info ) )
+   {
+      haveVBlank= (info.vblankTime && (info.vblankInterval > 0));
+   }
+
+   link= ctx->presentedFeedbackList.next;
+   while ( link != &ctx->presentedFeedbackList )
+   {
+      struct wl_resource *outputResource= 0;
+      long long presentTime, refresh, sec, nsec, intervals;
+      unsigned long long seq;
+      uint32_t flags;
+
+      feedback= wl_container_of( link, feedback, link);
+      link= link->next;
+
+      presentTime= feedback->composeTime;
+      refresh= 0;
+      seq= 0;
+      flags= 0;
+
+      if ( haveVBlank )
+      {
+         // Number of refresh intervals from the first vblank after composition to the latest vblank
+         intervals= -1;
+         if ( info.vblankTime > feedback->composeTime )
+         {
+            intervals= (info.vblankTime-feedback->composeTime-1)/info.vblankInterval;
+         }
+         if ( intervals >= info.presentLatency )
+         {
+            presentTime= info.vblankTime-(intervals-info.presentLatency)*info.vblankInterval;
+            seq= info.vblankCount-(intervals-info.presentLatency);
+            refresh= info.vblankInterval;
+            flags= WP_PRESENTATION_FEEDBACK_KIND_VSYNC;
+            if ( info.hwClock )
+            {
+               flags |= WP_PRESENTATION_FEEDBACK_KIND_HW_CLOCK;
+            }
+         }
+         else if ( now < feedback->composeTime+(info.presentLatency+4)*info.vblankInterval )
+         {
+            // Not yet on screen
+            continue;
+         }
+      }
+
+      if ( ctx->output )
+      {
+         outputResource= wl_resource_find_for_client( &ctx->output->resourceList,
+                                                      wl_resource_get_client( feedback->resource ) );
+         if ( outputResource )
+         {
+            wp_presentation_feedback_send_sync_output( feedback->resource, outputResource );
+         }
+      }
+
+      sec= presentTime/1000000LL;
+      nsec= (presentTime%1000000LL)*1000LL;
+      wp_presentation_feedback_send_presented( feedback->resource,
+                                               (uint32_t)(sec >> 32),
+                                               (uint32_t)(sec & 0xFFFFFFFF),
+                                               (uint32_t)nsec,
+                                               (uint32_t)(refresh*1000LL),
+                                               (uint32_t)(seq >> 32),
+                                               (uint32_t)(seq & 0xFFFFFFFF),
+                                               flags );
+      wl_resource_destroy( feedback->resource );
+   }
+
+exit:
+   pthread_mutex_unlock( &ctx->mutex );
+}
+
 #define TEMPFILE_PREFIX "westeros-"
 #define TEMPFILE_TEMPLATE "/tmp/" TEMPFILE_PREFIX "%d-XXXXXX"
 
@@ -72,12 +72,52 @@ typedef enum _WstClient_status
    WstClient_firstFrame
 } WstClient_status;
 
+#define WST_FRAME_STATS_MAX_SURFACES (8)
+#define WST_FRAME_STATS_HISTOGRAM_BUCKETS (16)
+
+typedef struct _WstSurfaceLatency
+{
+   int surfaceId;                   // compositor surface id
+   long long latency;               // microseconds from the first commit of new content to its composition
+} WstSurfaceLatency;
+
+typedef struct _WstFrameStats
+{
+   unsigned long long frameNumber;  // sequence number of the composed frame
+   long long frameTime;             // CLOCK_MONOTONIC time in microseconds when composition started
+   long long eventTime;             // microseconds spent processing compositor events since the previous frame
+   long long sceneTime;             // microseconds spent updating the scene, including the swap
+   long long swapTime;              // microseconds spent presenting the frame, -1 if not reported by the renderer
+   int surfaceCount;                // surfaces drawn, -1 if not reported by the renderer
+   long long bytesUploaded;         // bytes of pixel data uploaded for the frame, -1 if not reported by the renderer
+   int frameCallbackCount;          // wl_surface frame callbacks sent
+   int latencyCount;                // number of valid entries in latency
+   WstSurfaceLatency latency[WST_FRAME_STATS_MAX_SURFACES];
+} WstFrameStats;
+
+/*
+ * Each histogram has WST_FRAME_STATS_HISTOGRAM_BUCKETS buckets of microsecond
+ * durations.  Bucket 0 counts durations below 250us and each following bucket
+ * doubles the upper limit (500us, 1ms, 2ms, ...) with the final bucket
+ * counting all larger durations.
+ */
+typedef struct _WstFrameHistogram
+{
+   unsigned long long frameCount;
+   unsigned int frameInterval[WST_FRAME_STATS_HISTOGRAM_BUCKETS];
+   unsigned int eventTime[WST_FRAME_STATS_HISTOGRAM_BUCKETS];
+   unsigned int sceneTime[WST_FRAME_STATS_HISTOGRAM_BUCKETS];
+   unsigned int swapTime[WST_FRAME_STATS_HISTOGRAM_BUCKETS];
+   unsigned int commitLatency[WST_FRAME_STATS_HISTOGRAM_BUCKETS];
+} WstFrameHistogram;
+
 typedef void (*WstTerminatedCallback)( WstCompositor *wctx, void *userData );
 typedef void (*WstDispatchCallback)( WstCompositor *wctx, void *userData );
 typedef void (*WstInvalidateSceneCallback)( WstCompositor *wctx, void *userData );
 typedef void (*WstHidePointerCallback)( WstCompositor *wctx, bool hidePointer, void *userData );
 typedef void (*WstClientStatus)( WstCompositor *wctx, int status, int clientPID, int detail, void *userData );
 typedef void (*WstVirtEmbUnBoundClient)( WstCompositor *wctx, int clientPID, void *userData );
+typedef void (*WstFrameStatsCallback)( WstCompositor *wctx, const WstFrameStats *stats, void *userData );
 
 typedef void (*WstOutputHandleGeometryCallback)( void *userData, int32_t x, int32_t y, int32_t mmWidth, int32_t mmHeight,
                                                  int32_t subPixel, const char *make, const char *model, int32_t transform );
@@ -203,6 +243,18 @@ bool WstCompositorSetDisplayName( WstCompositor *wctx, const char *displayName )
  */
 bool WstCompositorSetFrameRate( WstCompositor *wctx, unsigned int frameRate );
 
+/**
+ * WstCompositorSetVBlankDeadline
+ *
+ * Compose each output frame a deadline, in microseconds, ahead of the next
+ * vblank as reported by the renderer module rather than on a fixed period
+ * timer.  The frame rate set with WstCompositorSetFrameRate remains an upper
+ * limit.  A deadline of 0 selects the fixed period timer, which is the
+ * default.  This must be called prior to WstCompositorStart.  It has no
+ * effect on embedded or repeating compositors.
+ */
+bool WstCompositorSetVBlankDeadline( WstCompositor *wctx, int deadlineMicros );
+
 /**
  * WstCompositorSetNativeWindow
  *
@@ -448,6 +500,33 @@ void WstCompositorGetNestedSize( WstCompositor *wctx, unsigned int *width, unsig
  */
 bool WstCompositorGetAllowCursorModification( WstCompositor *wctx );
 
+/**
+ * WstCompositorGetFrameStats
+ *
+ * Obtain statistics for the most recently composed frames, most recent
+ * first.  Up to maxCount entries are copied to stats and the number copied
+ * is returned in count.  The compositor retains the statistics of a fixed
+ * number of recent frames.  This may be called at any time from any thread
+ * and does not block composition.
+ */
+bool WstCompositorGetFrameStats( WstCompositor *wctx, WstFrameStats *stats, int maxCount, int *count );
+
+/**
+ * WstCompositorGetFrameHistogram
+ *
+ * Obtain histograms of frame timing accumulated since the compositor
+ * started or since the last call to WstCompositorResetFrameHistogram.
+ * This may be called at any time from any thread.
+ */
+bool WstCompositorGetFrameHistogram( WstCompositor *wctx, WstFrameHistogram *histogram );
+
+/**
+ * WstCompositorResetFrameHistogram
+ *
+ * Clear the frame timing histograms.  This may be called at any time.
+ */
+bool WstCompositorResetFrameHistogram( WstCompositor *wctx );
+
 /**
  * WstCompositorSetTerminatedCallback
  *
@@ -492,6 +571,16 @@ bool WstCompositorSetHidePointerCallback( WstCompositor *wctx, WstHidePointerCal
  */
 bool WstCompositorSetClientStatusCallback( WstCompositor *wctx, WstClientStatus cb, void *userData );
 
+/**
+ * WstCompositorSetFrameStatsCallback
+ *
+ * Specifies a callback the compositor will invoke from its thread with the
+ * statistics of each frame it composes.  This allows modules loaded with
+ * WstCompositorAddModule to monitor frame timing.  The callback must not
+ * block and must not call back into the compositor.
+ */
+bool WstCompositorSetFrameStatsCallback( WstCompositor *wctx, WstFrameStatsCallback cb, void *userData );
+
 /**
  * WstCompositorSetOutputNestedListener
  *
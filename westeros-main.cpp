@@ -143,6 +143,7 @@ static void showUsage()
    printf("where [options] are:\n" );
    printf("  --renderer <module> : renderer module to use\n" );
    printf("  --framerate <rate> : frame rate in fps\n" );
+   printf("  --vblankDeadline <usec> : compose frames this many microseconds before vblank\n" );
    printf("  --display <name> : name of wayland display created by compositor\n" );
    printf("  --embedded : operate as an embedded compositor\n" );
    printf("  --repeater : operate as a repeating nested compositor\n" );
@@ -2139,6 +2140,22 @@ int main( int argc, char** argv)
          }
       }
       else
+      if ( (len == 16) && !strncmp( (const char*)argv[i], "--vblankDeadline", len) )
+      {
+         if ( i < argc-1 )
+         {
+            int deadline;
+
+            ++i;
+            deadline= atoi(argv[i]);
+            if ( !WstCompositorSetVBlankDeadline( wctx, deadline ) )
+            {
+               error= true;
+               break;
+            }
+         }
+      }
+      else
       if ( (len == 9) && !strncmp( (const char*)argv[i], "--display", len) )
       {
          if ( i < argc-1)
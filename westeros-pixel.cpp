@@ -0,0 +1,402 @@
+/*
+ * If not stated otherwise in this file or this component's Licenses.txt file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2016 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "westeros-pixel.h"
+
+// The vector kernels operate on pixels as little endian 32 bit values
+#if !defined (BIG_ENDIAN_CPU) && defined (__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#define WST_PIXEL_SSE2
+#define WST_PIXEL_AVX2
+#include <immintrin.h>
+#endif
+#if defined (__ARM_NEON) || defined (__ARM_NEON__)
+#define WST_PIXEL_NEON
+#include <arm_neon.h>
+#endif
+#endif
+
+static const WstPixelKernels *gDefaultKernels= 0;
+
+static inline uint32_t wstPixelLoad( const unsigned char *p )
+{
+   uint32_t pixel;
+   memcpy( &pixel, p, sizeof(pixel) );
+   return pixel;
+}
+
+static inline void wstPixelStore( unsigned char *p, uint32_t pixel )
+{
+   memcpy( p, &pixel, sizeof(pixel) );
+}
+
+static bool wstPixelScalarIsSupported( void )
+{
+   return true;
+}
+
+static void wstPixelScalarFillAlpha( unsigned char *dst, const unsigned char *src, int count )
+{
+   int i;
+
+   if ( dst != src )
+   {
+      memcpy( dst, src, count*4 );
+   }
+   for( i= 0; i < count; ++i )
+   {
+      dst[i*4+3]= 0xFF;
+   }
+}
+
+static void wstPixelScalarSwapRB( unsigned char *dst, const unsigned char *src, int count )
+{
+   int i;
+   unsigned char b0, b2;
+
+   for( i= 0; i < count; ++i )
+   {
+      b0= src[i*4+0];
+      b2= src[i*4+2];
+      dst[i*4+0]= b2;
+      dst[i*4+1]= src[i*4+1];
+      dst[i*4+2]= b0;
+      dst[i*4+3]= src[i*4+3];
+   }
+}
+
+static void wstPixelScalarSwapRBFillAlpha( unsigned char *dst, const unsigned char *src, int count )
+{
+   int i;
+   unsigned char b0, b2;
+
+   for( i= 0; i < count; ++i )
+   {
+      b0= src[i*4+0];
+      b2= src[i*4+2];
+      dst[i*4+0]= b2;
+      dst[i*4+1]= src[i*4+1];
+      dst[i*4+2]= b0;
+      dst[i*4+3]= 0xFF;
+   }
+}
+
+static void wstPixelScalarRotate( unsigned char *dst, const unsigned char *src, int count )
+{
+   int i;
+   uint32_t pixel;
+
+   for( i= 0; i < count; ++i )
+   {
+      pixel= wstPixelLoad( src+i*4 );
+      wstPixelStore( dst+i*4, (pixel<<8)|(pixel>>24) );
+   }
+}
+
+static void wstPixelScalarRotateFillAlpha( unsigned char *dst, const unsigned char *src, int count )
+{
+   int i;
+   uint32_t pixel;
+
+   for( i= 0; i < count; ++i )
+   {
+      pixel= wstPixelLoad( src+i*4 );
+      wstPixelStore( dst+i*4, (pixel<<8)|0xFF );
+   }
+}
+
+#ifdef WST_PIXEL_SSE2
+static bool wstPixelSSE2IsSupported( void )
+{
+   __builtin_cpu_init();
+   return __builtin_cpu_supports("sse2");
+}
+
+#define WST_PIXEL_SSE2_ROW( name, expr, scalar ) \
+__attribute__((target("sse2"))) \
+static void name( unsigned char *dst, const unsigned char *src, int count ) \
+{ \
+   const __m128i maskAlpha= _mm_set1_epi32( (int)0xFF000000 ); \
+   const __m128i maskLow= _mm_set1_epi32( 0xFF ); \
+   const __m128i maskGA= _mm_set1_epi32( (int)0xFF00FF00 ); \
+   const __m128i maskB2= _mm_set1_epi32( 0x00FF0000 ); \
+   __m128i p; \
+   int i= 0; \
+   (void)maskAlpha; (void)maskLow; (void)maskGA; (void)maskB2; \
+   for( ; i+4 <= count; i += 4 ) \
+   { \
+      p= _mm_loadu_si128( (const __m128i*)(src+i*4) ); \
+      p= (expr); \
+      _mm_storeu_si128( (__m128i*)(dst+i*4), p ); \
+   } \
+   if ( i < count ) \
+   { \
+      scalar( dst+i*4, src+i*4, count-i ); \
+   } \
+}
+
+WST_PIXEL_SSE2_ROW( wstPixelSSE2FillAlpha,
+                    _mm_or_si128( p, maskAlpha ),
+                    wstPixelScalarFillAlpha )
+WST_PIXEL_SSE2_ROW( wstPixelSSE2SwapRB,
+                    _mm_or_si128( _mm_and_si128( p, maskGA ),
+                                  _mm_or_si128( _mm_and_si128( _mm_srli_epi32( p, 16 ), maskLow ),
+                                                _mm_and_si128( _mm_slli_epi32( p, 16 ), maskB2 ) ) ),
+                    wstPixelScalarSwapRB )
+WST_PIXEL_SSE2_ROW( wstPixelSSE2SwapRBFillAlpha,
+                    _mm_or_si128( _mm_or_si128( _mm_and_si128( p, maskGA ), maskAlpha ),
+                                  _mm_or_si128( _mm_and_si128( _mm_srli_epi32( p, 16 ), maskLow ),
+                                                _mm_and_si128( _mm_slli_epi32( p, 16 ), maskB2 ) ) ),
+                    wstPixelScalarSwapRBFillAlpha )
+WST_PIXEL_SSE2_ROW( wstPixelSSE2Rotate,
+                    _mm_or_si128( _mm_slli_epi32( p, 8 ), _mm_srli_epi32( p, 24 ) ),
+                    wstPixelScalarRotate )
+WST_PIXEL_SSE2_ROW( wstPixelSSE2RotateFillAlpha,
+                    _mm_or_si128( _mm_slli_epi32( p, 8 ), maskLow ),
+                    wstPixelScalarRotateFillAlpha )
+#endif
+
+#ifdef WST_PIXEL_AVX2
+static bool wstPixelAVX2IsSupported( void )
+{
+   __builtin_cpu_init();
+   return __builtin_cpu_supports("avx2");
+}
+
+#define WST_PIXEL_AVX2_ROW( name, expr, tail ) \
+__attribute__((target("avx2"))) \
+static void name( unsigned char *dst, const unsigned char *src, int count ) \
+{ \
+   const __m256i maskAlpha= _mm256_set1_epi32( (int)0xFF000000 ); \
+   const __m256i maskLow= _mm256_set1_epi32( 0xFF ); \
+   const __m256i maskRB= _mm256_setr_epi8( 2,1,0,3, 6,5,4,7, 10,9,8,11, 14,13,12,15, \
+                                           2,1,0,3, 6,5,4,7, 10,9,8,11, 14,13,12,15 ); \
+   __m256i p; \
+   int i= 0; \
+   (void)maskAlpha; (void)maskLow; (void)maskRB; \
+   for( ; i+8 <= count; i += 8 ) \
+   { \
+      p= _mm256_loadu_si256( (const __m256i*)(src+i*4) ); \
+      p= (expr); \
+      _mm256_storeu_si256( (__m256i*)(dst+i*4), p ); \
+   } \
+   if ( i < count ) \
+   { \
+      tail( dst+i*4, src+i*4, count-i ); \
+   } \
+}
+
+WST_PIXEL_AVX2_ROW( wstPixelAVX2FillAlpha,
+                    _mm256_or_si256( p, maskAlpha ),
+                    wstPixelSSE2FillAlpha )
+WST_PIXEL_AVX2_ROW( wstPixelAVX2SwapRB,
+                    _mm256_shuffle_epi8( p, maskRB ),
+                    wstPixelSSE2SwapRB )
+WST_PIXEL_AVX2_ROW( wstPixelAVX2SwapRBFillAlpha,
+                    _mm256_or_si256( _mm256_shuffle_epi8( p, maskRB ), maskAlpha ),
+                    wstPixelSSE2SwapRBFillAlpha )
+WST_PIXEL_AVX2_ROW( wstPixelAVX2Rotate,
+                    _mm256_or_si256( _mm256_slli_epi32( p, 8 ), _mm256_srli_epi32( p, 24 ) ),
+                    wstPixelSSE2Rotate )
+WST_PIXEL_AVX2_ROW( wstPixelAVX2RotateFillAlpha,
+                    _mm256_or_si256( _mm256_slli_epi32( p, 8 ), maskLow ),
+                    wstPixelSSE2RotateFillAlpha )
+#endif
+
+#ifdef WST_PIXEL_NEON
+static bool wstPixelNEONIsSupported( void )
+{
+   return true;
+}
+
+// NEON de-interleaves 16 pixels into one register per byte lane so every
+// operation is a lane permutation, with an optional constant alpha lane.
+#define WST_PIXEL_NEON_ROW( name, l0, l1, l2, l3, scalar ) \
+static void name( unsigned char *dst, const unsigned char *src, int count ) \
+{ \
+   const uint8x16_t alpha= vdupq_n_u8( 0xFF ); \
+   uint8x16x4_t in, out; \
+   int i= 0; \
+   (void)alpha; \
+   for( ; i+16 <= count; i += 16 ) \
+   { \
+      in= vld4q_u8( src+i*4 ); \
+      out.val[0]= (l0); \
+      out.val[1]= (l1); \
+      out.val[2]= (l2); \
+      out.val[3]= (l3); \
+      vst4q_u8( dst+i*4, out ); \
+   } \
+   if ( i < count ) \
+   { \
+      scalar( dst+i*4, src+i*4, count-i ); \
+   } \
+}
+
+WST_PIXEL_NEON_ROW( wstPixelNEONFillAlpha,
+                    in.val[0], in.val[1], in.val[2], alpha,
+                    wstPixelScalarFillAlpha )
+WST_PIXEL_NEON_ROW( wstPixelNEONSwapRB,
+                    in.val[2], in.val[1], in.val[0], in.val[3],
+                    wstPixelScalarSwapRB )
+WST_PIXEL_NEON_ROW( wstPixelNEONSwapRBFillAlpha,
+                    in.val[2], in.val[1], in.val[0], alpha,
+                    wstPixelScalarSwapRBFillAlpha )
+WST_PIXEL_NEON_ROW( wstPixelNEONRotate,
+                    in.val[3], in.val[0], in.val[1], in.val[2],
+                    wstPixelScalarRotate )
+WST_PIXEL_NEON_ROW( wstPixelNEONRotateFillAlpha,
+                    alpha, in.val[0], in.val[1], in.val[2],
+                    wstPixelScalarRotateFillAlpha )
+#endif
+
+// Ordered from most to least preferred
+static const WstPixelKernels gKernels[]=
+{
+   #ifdef WST_PIXEL_NEON
+   {
+      "neon",
+      wstPixelNEONIsSupported,
+      {
+         wstPixelNEONFillAlpha,
+         wstPixelNEONSwapRB,
+         wstPixelNEONSwapRBFillAlpha,
+         wstPixelNEONRotate,
+         wstPixelNEONRotateFillAlpha
+      }
+   },
+   #endif
+   #ifdef WST_PIXEL_AVX2
+   {
+      "avx2",
+      wstPixelAVX2IsSupported,
+      {
+         wstPixelAVX2FillAlpha,
+         wstPixelAVX2SwapRB,
+         wstPixelAVX2SwapRBFillAlpha,
+         wstPixelAVX2Rotate,
+         wstPixelAVX2RotateFillAlpha
+      }
+   },
+   #endif
+   #ifdef WST_PIXEL_SSE2
+   {
+      "sse2",
+      wstPixelSSE2IsSupported,
+      {
+         wstPixelSSE2FillAlpha,
+         wstPixelSSE2SwapRB,
+         wstPixelSSE2SwapRBFillAlpha,
+         wstPixelSSE2Rotate,
+         wstPixelSSE2RotateFillAlpha
+      }
+   },
+   #endif
+   {
+      "scalar",
+      wstPixelScalarIsSupported,
+      {
+         wstPixelScalarFillAlpha,
+         wstPixelScalarSwapRB,
+         wstPixelScalarSwapRBFillAlpha,
+         wstPixelScalarRotate,
+         wstPixelScalarRotateFillAlpha
+      }
+   }
+};
+
+static const WstPixelKernels* wstPixelFindKernels( const char *name )
+{
+   const WstPixelKernels *kernels= 0;
+   int i;
+
+   for( i= 0; i < (int)(sizeof(gKernels)/sizeof(gKernels[0])); ++i )
+   {
+      if ( name && strcmp( name, gKernels[i].name ) )
+      {
+         continue;
+      }
+      if ( gKernels[i].isSupported() )
+      {
+         kernels= &gKernels[i];
+         break;
+      }
+   }
+
+   return kernels;
+}
+
+const WstPixelKernels* WstPixelGetKernels( const char *name )
+{
+   const WstPixelKernels *kernels= 0;
+
+   if ( name )
+   {
+      kernels= wstPixelFindKernels( name );
+   }
+   else
+   {
+      kernels= gDefaultKernels;
+      if ( !kernels )
+      {
+         const char *env= getenv("WESTEROS_PIXEL_KERNELS");
+         if ( env )
+         {
+            kernels= wstPixelFindKernels( env );
+            if ( !kernels )
+            {
+               printf("westeros-pixel: kernels (%s) not available\n", env);
+            }
+         }
+         if ( !kernels )
+         {
+            kernels= wstPixelFindKernels( 0 );
+         }
+         printf("westeros-pixel: using %s kernels\n", kernels->name);
+         gDefaultKernels= kernels;
+      }
+   }
+
+   return kernels;
+}
+
+WstPixelOp WstPixelGetOp( bool transformPixelsA, bool transformPixelsB, bool fillAlpha )
+{
+   WstPixelOp op= WstPixelOp_count;
+
+   if ( transformPixelsA )
+   {
+      op= (fillAlpha ? WstPixelOp_rotateFillAlpha : WstPixelOp_rotate);
+   }
+   else if ( transformPixelsB )
+   {
+      op= (fillAlpha ? WstPixelOp_swapRBFillAlpha : WstPixelOp_swapRB);
+   }
+   else if ( fillAlpha )
+   {
+      op= WstPixelOp_fillAlpha;
+   }
+
+   return op;
+}
+
@@ -0,0 +1,73 @@
+/*
+ * If not stated otherwise in this file or this component's Licenses.txt file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2016 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _WESTEROS_PIXEL_H
+#define _WESTEROS_PIXEL_H
+
+/*
+ * Westeros Pixel Conversion Kernels
+ *
+ * Row kernels used by the renderers to copy 32 bit SHM pixel data
+ * while converting it to a layout the GL implementation accepts.
+ * Each kernel converts count pixels from src to dst.  The rows may
+ * be unaligned and src may equal dst for an in place conversion.
+ *
+ * Several implementations (NEON, SSE2, AVX2 and portable scalar code)
+ * are built depending on the target and the best one supported by the
+ * running CPU is selected at runtime.  Setting the environment variable
+ * WESTEROS_PIXEL_KERNELS to the name of an implementation forces its use.
+ */
+
+typedef enum _WstPixelOp
+{
+   WstPixelOp_fillAlpha,           // set byte 3 of each pixel to 0xFF
+   WstPixelOp_swapRB,              // swap bytes 0 and 2 of each pixel
+   WstPixelOp_swapRBFillAlpha,     // swap bytes 0 and 2 and set byte 3 to 0xFF
+   WstPixelOp_rotate,              // rotate the 32 bit pixel value left by 8 bits
+   WstPixelOp_rotateFillAlpha,     // shift the 32 bit pixel value left by 8 bits and set the low 8 bits to 0xFF
+   WstPixelOp_count
+} WstPixelOp;
+
+typedef void (*WstPixelRowFunc)( unsigned char *dst, const unsigned char *src, int count );
+
+typedef struct _WstPixelKernels
+{
+   const char *name;
+   bool (*isSupported)( void );
+   WstPixelRowFunc row[WstPixelOp_count];
+} WstPixelKernels;
+
+/**
+ * WstPixelGetKernels
+ *
+ * Get the named kernel implementation, or the best implementation supported
+ * by the CPU if name is NULL.  Returns NULL if the named implementation is
+ * not built or not supported by the CPU.
+ */
+const WstPixelKernels* WstPixelGetKernels( const char *name );
+
+/**
+ * WstPixelGetOp
+ *
+ * Map the renderer's conversion flags to a kernel operation.  Returns
+ * WstPixelOp_count if no conversion is needed.
+ */
+WstPixelOp WstPixelGetOp( bool transformPixelsA, bool transformPixelsB, bool fillAlpha );
+
+#endif
+
@@ -46,6 +46,7 @@
 #endif
 
 #include "westeros-render.h"
+#include "westeros-pixel.h"
 #include "wayland-server.h"
 #include "wayland-client.h"
 #include "wayland-egl.h"
@@ -224,6 +225,8 @@ static bool emitFPS= false;
 
 #define MAX_TEXTURES (2)
 
+#define MAX_OCCLUDERS (16)
+
 struct _WstRenderSurface
 {
    int textureCount;
@@ -242,8 +245,10 @@ struct _WstRenderSurface
    bool memDirty;
    int memWidth;
    int memHeight;
+   int memStride;
    GLint memFormatGL;
    GLenum memType;
+   WstRect memDirtyRect;
    
    int x;
    int y;
@@ -261,6 +266,12 @@ struct _WstRenderSurface
    bool haveCrop;
    float cropTextureCoord[4][2];
 
+   bool opaqueFormat;
+   std::vector<WstRect> opaqueRegion;
+
+   bool occluded;
+   bool drawOpaque;
+
    WstRenderSurface *surfaceFast;
 };
 
@@ -320,7 +331,15 @@ static WstRenderSurface *wstRendererEMBCreateSurface(WstRendererEMB *renderer);
 static void wstRendererEMBDestroySurface( WstRendererEMB *renderer, WstRenderSurface *surface );
 static void wstRendererEMBFlushSurface( WstRendererEMB *renderer, WstRenderSurface *surface );
 static void wstRendererEMBPrepareResource( WstRendererEMB *renderer, WstRenderSurface *surface, struct wl_resource *resource);
-static void wstRendererEMBCommitShm( WstRendererEMB *renderer, WstRenderSurface *surface, struct wl_resource *resource );
+static void wstRendererEMBCommitShm( WstRendererEMB *renderer, WstRenderSurface *surface, struct wl_resource *resource,
+                                     std::vector<WstRect> *damage );
+static void wstRendererEMBCopyShmRect( WstRenderSurface *surface, unsigned char *data, int stride, int bpp, WstRect *r,
+                                       bool transformPixelsA, bool transformPixelsB, bool fillAlpha );
+static void wstRectUnion( WstRect *r, int x, int y, int width, int height );
+static bool wstRendererEMBSurfaceHasContent( WstRenderSurface *surface );
+static int wstRendererEMBGetOpaqueRects( WstRenderSurface *surface, WstRect *rects, int maxRects, bool *fullyOpaque );
+static void wstRendererEMBCullSurfaces( WstRendererEMB *renderer );
+static void wstRectTrim( WstRect *r, WstRect *occluder );
 #if defined (WESTEROS_HAVE_WAYLAND_EGL)
 static void wstRendererEMBCommitWaylandEGL( WstRendererEMB *renderer, WstRenderSurface *surface, 
                                            struct wl_resource *resource, EGLint format );
@@ -575,6 +594,7 @@ static void wstRendererEMBDestroySurface( WstRendererEMB *renderer, WstRenderSur
                surface->surfaceFast= 0;
             }
         }
+        std::vector<WstRect>().swap( surface->opaqueRegion );
         free( surface );
     }
 }
@@ -611,6 +631,7 @@ static void wstRendererEMBFlushSurface( WstRendererEMB *renderer, WstRenderSurfa
            free( surface->mem );
            surface->mem= 0;
         }
+        surface->memDirty= false;
     }
 }
 
@@ -810,7 +831,8 @@ static void wstRendererEMBPrepareResource( WstRendererEMB *renderer, WstRenderSu
    }
 }
 
-static void wstRendererEMBCommitShm( WstRendererEMB *renderer, WstRenderSurface *surface, struct wl_resource *resource )
+static void wstRendererEMBCommitShm( WstRendererEMB *renderer, WstRenderSurface *surface, struct wl_resource *resource,
+                                     std::vector<WstRect> *damage )
 {
    struct wl_shm_buffer *shmBuffer;
    int width, height, stride;
@@ -819,6 +841,7 @@ static void wstRendererEMBCommitShm( WstRendererEMB *renderer, WstRenderSurface
    bool transformPixelsA= false;
    bool transformPixelsB= false;
    bool fillAlpha= false;
+   bool fullCopy= false;
    void *data;
 
    shmBuffer= wl_shm_buffer_get( resource );
@@ -956,7 +979,8 @@ static void wstRendererEMBCommitShm( WstRendererEMB *renderer, WstRenderSurface
                 (surface->memWidth != width) ||
                 (surface->memHeight != height) ||
                 (surface->memFormatGL != formatGL) ||
-                (surface->memType != type)
+                (surface->memType != type) ||
+                (surface->memStride != stride)
               )
             )
          {
@@ -966,67 +990,73 @@ static void wstRendererEMBCommitShm( WstRendererEMB *renderer, WstRenderSurface
          if ( !surface->mem )
          {
             surface->mem= (unsigned char*)malloc( stride*height );
+            surface->memDirty= false;
+            fullCopy= true;
          }
          if ( surface->mem )
          {
-            memcpy( surface->mem, data, stride*height );
-            
-            if ( transformPixelsA )
+            int bpp= ((type == GL_UNSIGNED_BYTE) ? 4 : 2);
+            WstRect r;
+
+            if ( !surface->memDirty )
             {
-               // transform ARGB to RGBA
-               unsigned int pixel, alpha;
-               unsigned int *pixdata= (unsigned int*)surface->mem;
-               for( int y= 0; y < height; ++y )
-               {
-                  for( int x= 0; x < width; ++x )
-                  {
-                     pixel= pixdata[y*width+x];
-                     alpha= (fillAlpha ? 0xFF : (pixel>>24));
-                     pixel= (pixel<<8)|alpha;
-                     pixdata[y*width+x]= pixel;
-                  }
-               }
+               surface->memDirtyRect.x= 0;
+               surface->memDirtyRect.y= 0;
+               surface->memDirtyRect.width= 0;
+               surface->memDirtyRect.height= 0;
             }
-            else if ( transformPixelsB )
+
+            if ( fullCopy || !damage )
             {
-               // transform BGRA to RGBA
-               unsigned char *pixdata= (unsigned char*)surface->mem;
-               for( int y= 0; y < height; ++y )
-               {
-                  for( int x= 0; x < width; ++x )
-                  {
-                     if ( fillAlpha )
-                     {
-                        pixdata[y*width*4 + x*4 +3]= 0xFF;
-                     }
-                     unsigned char temp= pixdata[y*width*4 + x*4 +2];
-                     pixdata[y*width*4 + x*4 +2]= pixdata[y*width*4 + x*4 +0];
-                     pixdata[y*width*4 + x*4 +0]= temp;
-                  }
-               }
+               r.x= 0;
+               r.y= 0;
+               r.width= width;
+               r.height= height;
+               wstRendererEMBCopyShmRect( surface, (unsigned char*)data, stride, bpp, &r,
+                                          transformPixelsA, transformPixelsB, fillAlpha );
+               wstRectUnion( &surface->memDirtyRect, r.x, r.y, r.width, r.height );
             }
-            else if ( fillAlpha )
+            else
             {
-               if ( fillAlpha )
+               for( int i= 0; i < damage->size(); ++i )
                {
-                  unsigned char *pixdata= (unsigned char*)surface->mem;
-                  for( int y= 0; y < height; ++y )
+                  long long x1, y1, x2, y2;
+
+                  x1= (*damage)[i].x;
+                  y1= (*damage)[i].y;
+                  x2= x1+(*damage)[i].width;
+                  y2= y1+(*damage)[i].height;
+                  if ( x1 < 0 ) x1= 0;
+                  if ( y1 < 0 ) y1= 0;
+                  if ( x2 > width ) x2= width;
+                  if ( y2 > height ) y2= height;
+                  if ( (x2 <= x1) || (y2 <= y1) )
                   {
-                     for( int x= 0; x < width; ++x )
-                     {
-                        pixdata[y*width*4 + x*4 +3]= 0xFF;
-                     }
+                     continue;
                   }
+                  r.x= (int)x1;
+                  r.y= (int)y1;
+                  r.width= (int)(x2-x1);
+                  r.height= (int)(y2-y1);
+
+                  wstRendererEMBCopyShmRect( surface, (unsigned char*)data, stride, bpp, &r,
+                                             transformPixelsA, transformPixelsB, fillAlpha );
+                  wstRectUnion( &surface->memDirtyRect, r.x, r.y, r.width, r.height );
                }
             }
-            
+
             surface->bufferWidth= width;
             surface->bufferHeight= height;
             surface->memWidth= width;
             surface->memHeight= height;
+            surface->memStride= stride;
             surface->memFormatGL= formatGL;
             surface->memType= type;
-            surface->memDirty= true;
+            surface->opaqueFormat= (fillAlpha || (type == GL_UNSIGNED_SHORT_5_6_5));
+            if ( (surface->memDirtyRect.width > 0) && (surface->memDirtyRect.height > 0) )
+            {
+               surface->memDirty= true;
+            }
          }      
          
          wl_shm_buffer_end_access(shmBuffer);
@@ -1034,6 +1064,265 @@ static void wstRendererEMBCommitShm( WstRendererEMB *renderer, WstRenderSurface
    }
 }
 
+static void wstRendererEMBCopyShmRect( WstRenderSurface *surface, unsigned char *data, int stride, int bpp, WstRect *r,
+                                       bool transformPixelsA, bool transformPixelsB, bool fillAlpha )
+{
+   int y;
+   WstPixelOp op;
+
+   op= WstPixelGetOp( transformPixelsA, transformPixelsB, fillAlpha );
+   if ( op == WstPixelOp_count )
+   {
+      if ( (r->x == 0) && (r->width*bpp == stride) )
+      {
+         memcpy( surface->mem+r->y*stride, data+r->y*stride, r->height*stride );
+      }
+      else
+      {
+         for( y= r->y; y < r->y+r->height; ++y )
+         {
+            memcpy( surface->mem+y*stride+r->x*bpp, data+y*stride+r->x*bpp, r->width*bpp );
+         }
+      }
+   }
+   else
+   {
+      // Copy and convert each row in a single pass
+      WstPixelRowFunc convert= WstPixelGetKernels(0)->row[op];
+      for( y= r->y; y < r->y+r->height; ++y )
+      {
+         convert( surface->mem+y*stride+r->x*4, data+y*stride+r->x*4, r->width );
+      }
+   }
+}
+
+static void wstRectUnion( WstRect *r, int x, int y, int width, int height )
+{
+   if ( (width <= 0) || (height <= 0) )
+   {
+      return;
+   }
+   if ( (r->width <= 0) || (r->height <= 0) )
+   {
+      r->x= x;
+      r->y= y;
+      r->width= width;
+      r->height= height;
+   }
+   else
+   {
+      int x2= ((r->x+r->width > x+width) ? r->x+r->width : x+width);
+      int y2= ((r->y+r->height > y+height) ? r->y+r->height : y+height);
+      r->x= ((x < r->x) ? x : r->x);
+      r->y= ((y < r->y) ? y : r->y);
+      r->width= x2-r->x;
+      r->height= y2-r->y;
+   }
+}
+
+static bool wstRendererEMBSurfaceHasContent( WstRenderSurface *surface )
+{
+   return (
+            #if defined (WESTEROS_PLATFORM_EMBEDDED) || defined (WESTEROS_HAVE_WAYLAND_EGL)
+            surface->eglImage[0] ||
+            #endif
+            surface->memDirty ||
+            (surface->textureId[0] != GL_NONE)
+          );
+}
+
+/*
+ * Get the opaque areas of a surface in compositor coordinates.  Cropped surfaces
+ * are only treated as opaque when their content has no alpha.
+ */
+static int wstRendererEMBGetOpaqueRects( WstRenderSurface *surface, WstRect *rects, int maxRects, bool *fullyOpaque )
+{
+   int count= 0;
+   WstRect sr;
+
+   *fullyOpaque= false;
+
+   if ( (surface->opacity < 1.0) || (surface->bufferWidth <= 0) || (surface->bufferHeight <= 0) )
+   {
+      return 0;
+   }
+
+   sr.x= surface->x;
+   sr.y= surface->y;
+   sr.width= (surface->sizeOverride ? surface->width : surface->bufferWidth);
+   sr.height= (surface->sizeOverride ? surface->height : surface->bufferHeight);
+   if ( (sr.width <= 0) || (sr.height <= 0) )
+   {
+      return 0;
+   }
+
+   // RGBX, RGB565 and YUV content has no alpha
+   if ( surface->opaqueFormat || (surface->textureCount == 2) )
+   {
+      *fullyOpaque= true;
+      rects[count++]= sr;
+      return count;
+   }
+
+   if ( surface->haveCrop )
+   {
+      return 0;
+   }
+
+   for( int i= 0; (i < surface->opaqueRegion.size()) && (count < maxRects); ++i )
+   {
+      WstRect *o= &surface->opaqueRegion[i];
+      long long x1, y1, x2, y2;
+
+      x1= o->x;
+      y1= o->y;
+      x2= (long long)o->x+o->width;
+      y2= (long long)o->y+o->height;
+      if ( x1 < 0 ) x1= 0;
+      if ( y1 < 0 ) y1= 0;
+      if ( x2 > surface->bufferWidth ) x2= surface->bufferWidth;
+      if ( y2 > surface->bufferHeight ) y2= surface->bufferHeight;
+      if ( (x2 <= x1) || (y2 <= y1) )
+      {
+         continue;
+      }
+
+      if ( (x1 == 0) && (y1 == 0) && (x2 == surface->bufferWidth) && (y2 == surface->bufferHeight) )
+      {
+         *fullyOpaque= true;
+      }
+
+      if ( (sr.width != surface->bufferWidth) || (sr.height != surface->bufferHeight) )
+      {
+         // Map onto the surface geometry rounding inwards and allow for filtering at the edges
+         x1= (x1*sr.width+surface->bufferWidth-1)/surface->bufferWidth+1;
+         y1= (y1*sr.height+surface->bufferHeight-1)/surface->bufferHeight+1;
+         x2= (x2*sr.width)/surface->bufferWidth-1;
+         y2= (y2*sr.height)/surface->bufferHeight-1;
+         if ( (x2 <= x1) || (y2 <= y1) )
+         {
+            continue;
+         }
+      }
+
+      rects[count].x= sr.x+(int)x1;
+      rects[count].y= sr.y+(int)y1;
+      rects[count].width= (int)(x2-x1);
+      rects[count].height= (int)(y2-y1);
+      ++count;
+   }
+
+   return count;
+}
+
+/*
+ * Remove the part of r hidden by an occluder when what remains is still a
+ * rectangle: either r is fully covered or the occluder spans a full edge.
+ */
+static void wstRectTrim( WstRect *r, WstRect *occluder )
+{
+   int rx2, ry2, ox2, oy2;
+
+   if ( (r->width <= 0) || (r->height <= 0) )
+   {
+      return;
+   }
+
+   rx2= r->x+r->width;
+   ry2= r->y+r->height;
+   ox2= occluder->x+occluder->width;
+   oy2= occluder->y+occluder->height;
+
+   if ( (occluder->x >= rx2) || (ox2 <= r->x) || (occluder->y >= ry2) || (oy2 <= r->y) )
+   {
+      return;
+   }
+
+   if ( (occluder->x <= r->x) && (ox2 >= rx2) )
+   {
+      if ( (occluder->y <= r->y) && (oy2 >= ry2) )
+      {
+         r->width= 0;
+         r->height= 0;
+      }
+      else if ( occluder->y <= r->y )
+      {
+         r->y= oy2;
+         r->height= ry2-oy2;
+      }
+      else if ( oy2 >= ry2 )
+      {
+         r->height= occluder->y-r->y;
+      }
+   }
+   else if ( (occluder->y <= r->y) && (oy2 >= ry2) )
+   {
+      if ( occluder->x <= r->x )
+      {
+         r->x= ox2;
+         r->width= rx2-ox2;
+      }
+      else if ( ox2 >= rx2 )
+      {
+         r->width= occluder->x-r->x;
+      }
+   }
+}
+
+/*
+ * Walk the surfaces from top to bottom culling surfaces hidden by opaque
+ * surfaces above them.  Since the host transform is applied to every surface
+ * alike this can be done in compositor coordinates.  When the host applies an
+ * alpha below 1.0 nothing is opaque.
+ */
+static void wstRendererEMBCullSurfaces( WstRendererEMB *renderer )
+{
+   WstRect occluders[MAX_OCCLUDERS];
+   int occluderCount= 0;
+   bool allowOpaque;
+
+   allowOpaque= !((renderer->renderer->hints & WstHints_applyTransform) && (renderer->renderer->alpha < 1.0));
+
+   for( int i= renderer->surfaces.size()-1; i >= 0; --i )
+   {
+      WstRenderSurface *surface= renderer->surfaces[i];
+      WstRect opaque[MAX_OCCLUDERS];
+      WstRect r;
+      int opaqueCount;
+
+      surface->occluded= true;
+      surface->drawOpaque= false;
+
+      if ( !surface->visible || !wstRendererEMBSurfaceHasContent( surface ) )
+      {
+         continue;
+      }
+
+      r.x= surface->x;
+      r.y= surface->y;
+      r.width= (surface->sizeOverride ? surface->width : surface->bufferWidth);
+      r.height= (surface->sizeOverride ? surface->height : surface->bufferHeight);
+      for( int j= 0; j < occluderCount; ++j )
+      {
+         wstRectTrim( &r, &occluders[j] );
+      }
+      if ( (r.width <= 0) || (r.height <= 0) )
+      {
+         continue;
+      }
+      surface->occluded= false;
+
+      if ( allowOpaque )
+      {
+         opaqueCount= wstRendererEMBGetOpaqueRects( surface, opaque, MAX_OCCLUDERS, &surface->drawOpaque );
+         for( int j= 0; (j < opaqueCount) && (occluderCount < MAX_OCCLUDERS); ++j )
+         {
+            occluders[occluderCount++]= opaque[j];
+         }
+      }
+   }
+}
+
 #if defined (WESTEROS_HAVE_WAYLAND_EGL)
 static void wstRendererEMBCommitWaylandEGL( WstRendererEMB *renderer, WstRenderSurface *surface, 
                                            struct wl_resource *resource, EGLint format )
@@ -1502,7 +1791,8 @@ static void wstRendererEMBCommitDispmanx( WstRendererEMB *renderer, WstRenderSur
                       (surface->memWidth != bufferWidth) ||
                       (surface->memHeight != bufferHeight) ||
                       (surface->memFormatGL != formatGL) ||
-                      (surface->memType != type)
+                      (surface->memType != type) ||
+                      (surface->memStride != stride)
                     )
                   )
                {
@@ -1533,8 +1823,13 @@ static void wstRendererEMBCommitDispmanx( WstRendererEMB *renderer, WstRenderSur
                      surface->bufferHeight= bufferHeight;
                      surface->memWidth= bufferWidth;
                      surface->memHeight= bufferHeight;
+                     surface->memStride= stride;
                      surface->memFormatGL= formatGL;
                      surface->memType= type;
+                     surface->memDirtyRect.x= 0;
+                     surface->memDirtyRect.y= 0;
+                     surface->memDirtyRect.width= bufferWidth;
+                     surface->memDirtyRect.height= bufferHeight;
                      surface->memDirty= true;
                   }
                }            
@@ -1567,9 +1862,11 @@ static void wstRendererEMBRenderSurface( WstRendererEMB *renderer, WstRenderSurf
    {
       for ( int i= 0; i < surface->textureCount; ++i )
       {
+         bool newTexture= false;
          if ( surface->textureId[i] == GL_NONE )
          {
             glGenTextures(1, &surface->textureId[i] );
+            newTexture= true;
          }
        
          /* Bind the egl image as a texture */
@@ -1597,15 +1894,33 @@ static void wstRendererEMBRenderSurface( WstRendererEMB *renderer, WstRenderSurf
          {
             if ( surface->mem )
             {
-               glTexImage2D( GL_TEXTURE_2D,
-                             0, //level
-                             surface->memFormatGL, //internalFormat
-                             surface->memWidth,
-                             surface->memHeight,
-                             0, // border
-                             surface->memFormatGL, //format
-                             surface->memType,
-                             surface->mem );
+               if ( newTexture ||
+                    ((surface->memDirtyRect.width == surface->memWidth) &&
+                     (surface->memDirtyRect.height == surface->memHeight)) )
+               {
+                  glTexImage2D( GL_TEXTURE_2D,
+                                0, //level
+                                surface->memFormatGL, //internalFormat
+                                surface->memWidth,
+                                surface->memHeight,
+                                0, // border
+                                surface->memFormatGL, //format
+                                surface->memType,
+                                surface->mem );
+               }
+               else if ( surface->memDirty )
+               {
+                  // Only upload the rows covered by the damage
+                  glTexSubImage2D( GL_TEXTURE_2D,
+                                   0, //level
+                                   0,
+                                   surface->memDirtyRect.y,
+                                   surface->memWidth,
+                                   surface->memDirtyRect.height,
+                                   surface->memFormatGL, //format
+                                   surface->memType,
+                                   surface->mem+surface->memDirtyRect.y*surface->memStride );
+               }
                surface->memDirty= false;
             }
          }
@@ -1941,6 +2256,7 @@ static void wstRendererUpdateScene( WstRenderer *renderer )
 {
    WstRendererEMB *rendererEMB= (WstRendererEMB*)renderer->renderer;
    GLuint program;
+   GLboolean blendEnabled;
 
    if ( emitFPS )
    {
@@ -2037,6 +2353,10 @@ static void wstRendererUpdateScene( WstRenderer *renderer )
       rendererEMB->eglContext= eglGetCurrentContext();
    }
 
+   wstRendererEMBCullSurfaces( rendererEMB );
+
+   blendEnabled= glIsEnabled( GL_BLEND );
+
    /*
     * Render surfaces from bottom to top
     */   
@@ -2045,17 +2365,17 @@ static void wstRendererUpdateScene( WstRenderer *renderer )
    {
       WstRenderSurface *surface= rendererEMB->surfaces[i];
 
-      if ( surface->visible && 
-          (
-            #if defined (WESTEROS_PLATFORM_EMBEDDED) || defined (WESTEROS_HAVE_WAYLAND_EGL)
-            surface->eglImage[0] ||
-            #endif
-            surface->memDirty ||
-            (surface->textureId[0] != GL_NONE)
-          )
-        )
+      if ( !surface->occluded )
       {
+         if ( surface->drawOpaque && blendEnabled )
+         {
+            glDisable( GL_BLEND );
+         }
          wstRendererEMBRenderSurface( rendererEMB, surface );
+         if ( surface->drawOpaque && blendEnabled )
+         {
+            glEnable( GL_BLEND );
+         }
       }
    }
 
@@ -2115,7 +2435,8 @@ static void wstRendererSurfaceDestroy( WstRenderer *renderer, WstRenderSurface *
    wstRendererEMBDestroySurface( rendererEMB, surface );
 }
 
-static void wstRendererSurfaceCommit( WstRenderer *renderer, WstRenderSurface *surface, struct wl_resource *resource )
+static void wstRendererEMBSurfaceCommit( WstRenderer *renderer, WstRenderSurface *surface, struct wl_resource *resource,
+                                         std::vector<WstRect> *damage )
 {
    WstRendererEMB *rendererEMB= (WstRendererEMB*)renderer->renderer;
    EGLint value;
@@ -2139,9 +2460,10 @@ static void wstRendererSurfaceCommit( WstRenderer *renderer, WstRenderSurface *s
 
    if ( resource )
    {
+      surface->opaqueFormat= false;
       if ( wl_shm_buffer_get( resource ) )
       {
-         wstRendererEMBCommitShm( rendererEMB, surface, resource );
+         wstRendererEMBCommitShm( rendererEMB, surface, resource, damage );
       }
       #if defined (WESTEROS_HAVE_WAYLAND_EGL)
       else if ( rendererEMB->haveWaylandEGL && 
@@ -2176,6 +2498,34 @@ static void wstRendererSurfaceCommit( WstRenderer *renderer, WstRenderSurface *s
    }
 }
 
+static void wstRendererSurfaceCommit( WstRenderer *renderer, WstRenderSurface *surface, struct wl_resource *resource )
+{
+   wstRendererEMBSurfaceCommit( renderer, surface, resource, 0 );
+}
+
+static void wstRendererSurfaceCommitDamage( WstRenderer *renderer, WstRenderSurface *surface, struct wl_resource *resource,
+                                            std::vector<WstRect> &damage )
+{
+   wstRendererEMBSurfaceCommit( renderer, surface, resource, &damage );
+}
+
+static void wstRendererSurfaceSetOpaqueRegion( WstRenderer *renderer, WstRenderSurface *surface, std::vector<WstRect> &rects )
+{
+   WstRendererEMB *rendererEMB= (WstRendererEMB*)renderer->renderer;
+
+   if ( surface )
+   {
+      surface->opaqueRegion= rects;
+
+      if ( surface->surfaceFast && rendererEMB->rendererFast->surfaceSetOpaqueRegion )
+      {
+         rendererEMB->rendererFast->surfaceSetOpaqueRegion( rendererEMB->rendererFast,
+                                                            surface->surfaceFast,
+                                                            rects );
+      }
+   }
+}
+
 static void wstRendererSurfaceSetVisible( WstRenderer *renderer, WstRenderSurface *surface, bool visible )
 {
    WstRendererEMB *rendererEMB= (WstRendererEMB*)renderer->renderer;
@@ -2711,6 +3061,8 @@ int renderer_init( WstRenderer *renderer, int argc, char **argv )
       renderer->surfaceCreate= wstRendererSurfaceCreate;
       renderer->surfaceDestroy= wstRendererSurfaceDestroy;
       renderer->surfaceCommit= wstRendererSurfaceCommit;
+      renderer->surfaceCommitDamage= wstRendererSurfaceCommitDamage;
+      renderer->surfaceSetOpaqueRegion= wstRendererSurfaceSetOpaqueRegion;
       renderer->surfaceSetVisible= wstRendererSurfaceSetVisible;
       renderer->surfaceGetVisible= wstRendererSurfaceGetVisible;
       renderer->surfaceSetGeometry= wstRendererSurfaceSetGeometry;
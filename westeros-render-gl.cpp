@@ -21,6 +21,11 @@
 #include <memory.h>
 #include <assert.h>
 #include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <errno.h>
 
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
@@ -45,6 +50,7 @@
 #endif
 
 #include "westeros-render.h"
+#include "westeros-pixel.h"
 #include "wayland-server.h"
 #include "wayland-client.h"
 #include "wayland-egl.h"
@@ -59,6 +65,10 @@
 
 #include <vector>
 
+#if defined (WESTEROS_PLATFORM_EMBEDDED) && defined (WESTEROS_GL_SCANOUT) && defined (ENABLE_LDBPROTOCOL)
+#define WST_RENDER_SCANOUT
+#endif
+
 //#define WST_DEBUG
 
 #ifdef WST_DEBUG
@@ -99,7 +109,7 @@ static const char *fShaderText =
   "precision mediump float;\n"
   "#endif\n"
   "uniform sampler2D texture;\n"
-  "uniform float alpha;\n"
+  "varying float alpha;\n"
   "varying vec2 txv;\n"
   "void main()\n"
   "{\n"
@@ -111,7 +121,9 @@ static const char *vShaderText =
   "uniform mat4 matrix;\n"
   "attribute vec2 pos;\n"
   "attribute vec2 texcoord;\n"
+  "attribute float opacity;\n"
   "varying vec2 txv;\n"
+  "varying float alpha;\n"
   "void main()\n"
   "{\n"
   "  vec4 p= matrix * vec4(pos, 0, 1);\n"
@@ -121,6 +133,7 @@ static const char *vShaderText =
   "  clipSpace.w= 1.0+clipSpace.z;\n"
   "  gl_Position=  clipSpace * vec4(1, -1, 1, 1);\n"
   "  txv= texcoord;\n"
+  "  alpha= opacity;\n"
   "}\n";
 
 static const char *fShaderTextYUV =
@@ -132,7 +145,7 @@ static const char *fShaderTextYUV =
   "const vec3 cc_r = vec3(1.0, -0.8604, 1.59580);\n"
   "const vec4 cc_g = vec4(1.0, 0.539815, -0.39173, -0.81290);\n"
   "const vec3 cc_b = vec3(1.0, -1.071, 2.01700);\n"
-  "uniform float alpha;\n"
+  "varying float alpha;\n"
   "varying vec2 txv;\n"
   "varying vec2 txvuv;\n"
   "void main()\n"
@@ -149,8 +162,10 @@ static const char *vShaderTextYUV =
   "attribute vec2 pos;\n"
   "attribute vec2 texcoord;\n"
   "attribute vec2 texcoorduv;\n"
+  "attribute float opacity;\n"
   "varying vec2 txv;\n"
   "varying vec2 txvuv;\n"
+  "varying float alpha;\n"
   "void main()\n"
   "{\n"
   "  vec4 p= matrix * vec4(pos, 0, 1);\n"
@@ -161,6 +176,7 @@ static const char *vShaderTextYUV =
   "  gl_Position=  clipSpace * vec4(1, -1, 1, 1);\n"
   "  txv= texcoord;\n"
   "  txvuv= texcoorduv;\n"
+  "  alpha= opacity;\n"
   "}\n";
 
 static const char *fShaderText_Y_UV =
@@ -210,9 +226,9 @@ typedef struct _WstShader
    GLuint attrPos;
    GLuint attrTexcoord;
    GLuint attrTexcoorduv;
+   GLuint attrOpacity;
    GLint uniRes;
    GLint uniMatrix;
-   GLint uniAlpha;
    GLint uniTexture;
    GLint uniTextureuv;
 } WstShader;
@@ -221,6 +237,54 @@ static char message[1024];
 
 #define MAX_TEXTURES (2)
 
+#define MAX_DAMAGE_HISTORY (4)
+
+#define MAX_OCCLUDERS (16)
+
+#define ATLAS_SIZE (1024)
+#define ATLAS_MAX_SURFACE_SIZE (256)
+
+#if defined (GL_UNPACK_ROW_LENGTH_EXT)
+#define WST_UNPACK_ROW_LENGTH GL_UNPACK_ROW_LENGTH_EXT
+#elif defined (GL_UNPACK_ROW_LENGTH)
+#define WST_UNPACK_ROW_LENGTH GL_UNPACK_ROW_LENGTH
+#endif
+
+typedef struct _WstBatchVertex
+{
+   float x;
+   float y;
+   float u;
+   float v;
+   float opacity;
+} WstBatchVertex;
+
+typedef struct _WstBatchQuad
+{
+   int batch;
+   WstBatchVertex v[6];
+} WstBatchQuad;
+
+typedef struct _WstDrawBatch
+{
+   WstShader *shader;
+   GLuint textureId;
+   GLuint textureUVId;
+   bool blend;
+   WstRect bounds;
+   int quadCount;
+   int first;
+   int count;
+} WstDrawBatch;
+
+typedef struct _WstAtlasShelf
+{
+   int y;
+   int height;
+   int x;
+   int count;
+} WstAtlasShelf;
+
 struct _WstRenderSurface
 {
    void *nativePixmap;
@@ -236,8 +300,19 @@ struct _WstRenderSurface
    bool memDirty;
    int memWidth;
    int memHeight;
+   int memStride;
    GLint memFormatGL;
    GLenum memType;
+   WstRect memDirtyRect;
+
+   int texWidth;
+   int texHeight;
+   GLint texFormatGL;
+   GLenum texType;
+
+   bool inAtlas;
+   int atlasShelf;
+   WstRect atlasRect;
 
    int x;
    int y;
@@ -250,8 +325,39 @@ struct _WstRenderSurface
 
    bool sizeOverride;
    bool invertedY;
+
+   bool opaqueFormat;
+   std::vector<WstRect> opaqueRegion;
+
+   bool occluded;
+   bool drawOpaque;
+   WstRect drawRect;
+
+   #ifdef WST_RENDER_SCANOUT
+   bool scanoutCapable;
+   bool scanoutPending;
+   WstGLScanoutBuffer scanoutBuffer;
+   struct wl_resource *scanoutResource;
+   struct wl_listener scanoutResourceDestroyListener;
+   #endif
 };
 
+#ifdef WST_RENDER_SCANOUT
+/*
+ * A buffer given to the scanout plane.  It stays in use until frameNumber
+ * is retired: if the compositor retains it before then, its release is sent
+ * from here once the frame that replaces it is on screen.
+ */
+typedef struct _WstScanoutHold
+{
+   struct wl_listener destroyListener;
+   struct _WstRendererGL *renderer;
+   struct wl_resource *resource;
+   int frameNumber;
+   bool releaseOwed;
+} WstScanoutHold;
+#endif
+
 typedef struct _WstRendererGL
 {
    WstRenderer *renderer;
@@ -284,6 +390,11 @@ typedef struct _WstRendererGL
    bool haveDmaBufImport;
    bool haveDmaBufImportModifiers;
    bool haveExternalImage;
+   bool haveBufferAge;
+   bool haveUnpackSubimage;
+   #if defined (EGL_EXT_swap_buffers_with_damage)
+   PFNEGLSWAPBUFFERSWITHDAMAGEEXTPROC eglSwapBuffersWithDamage;
+   #endif
 
    #if defined (WESTEROS_HAVE_WAYLAND_EGL)
    bool haveWaylandEGL;
@@ -296,6 +407,41 @@ typedef struct _WstRendererGL
    PFNEGLQUERYDMABUFMODIFIERSEXTPROC eglQueryDmaBufModifiersEXT;
    #endif
 
+   long long swapTime;
+   unsigned long long swapCount;
+
+   long long bytesUploaded;
+   WstRenderStats frameStats;
+
+   bool useAtlas;
+   GLuint atlasTextureId;
+   GLint atlasFormatGL;
+   GLenum atlasType;
+   int atlasSurfaceCount;
+   std::vector<WstAtlasShelf> atlasShelves;
+
+   GLuint batchBuffer;
+   std::vector<WstDrawBatch> batches;
+   std::vector<WstBatchQuad> batchQuads;
+   std::vector<WstBatchVertex> batchVertices;
+
+   bool fullDamage;
+   WstRect frameDamage;
+   int damageHistoryCount;
+   WstRect damageHistory[MAX_DAMAGE_HISTORY];
+
+   #ifdef WST_RENDER_SCANOUT
+   bool useScanout;
+   void *scanout;
+   bool scanoutActive;
+   bool scanoutHidePending;
+   WstRenderSurface *scanoutSurface;
+   WstRect scanoutRect;
+   int scanoutRetirePipe[2];
+   struct wl_event_source *scanoutRetireSource;
+   std::vector<WstScanoutHold*> scanoutHolds;
+   #endif
+
    std::vector<WstRenderSurface*> surfaces;
 } WstRendererGL;
 
@@ -305,7 +451,16 @@ static WstRenderSurface *wstRendererGLCreateSurface(WstRendererGL *renderer);
 static void wstRendererGLDestroySurface( WstRendererGL *renderer, WstRenderSurface *surface );
 static void wstRendererGLFlushSurface( WstRendererGL *renderer, WstRenderSurface *surface );
 static void wstRendererGLPrepareResource( WstRendererGL *renderer, WstRenderSurface *surface, struct wl_resource *resource);
-static void wstRendererGLCommitShm( WstRendererGL *rendererGL, WstRenderSurface *surface, struct wl_resource *resource );
+static void wstRendererGLCommitShm( WstRendererGL *rendererGL, WstRenderSurface *surface, struct wl_resource *resource,
+                                    std::vector<WstRect> *damage );
+static void wstRendererGLCopyShmRect( WstRenderSurface *surface, unsigned char *data, int stride, int bpp, WstRect *r,
+                                      bool transformPixelsA, bool transformPixelsB, bool fillAlpha );
+static bool wstRendererGLAllocTextureStorage( WstRenderSurface *surface, int width, int height, GLint formatGL, GLenum type );
+static void wstRendererGLUploadTexture( WstRendererGL *renderer, unsigned char *data, int stride, int width,
+                                        GLint formatGL, GLenum type, WstRect *r, int dstX, int dstY );
+static bool wstRendererGLAtlasPlace( WstRendererGL *renderer, WstRenderSurface *surface,
+                                     int width, int height, GLint formatGL, GLenum type );
+static void wstRendererGLAtlasRelease( WstRendererGL *renderer, WstRenderSurface *surface );
 #if defined (WESTEROS_HAVE_WAYLAND_EGL)
 static void wstRendererGLCommitWaylandEGL( WstRendererGL *rendererGL, WstRenderSurface *surface, 
                                            struct wl_resource *resource, EGLint format );
@@ -316,22 +471,47 @@ static void wstRendererGLCommitSB( WstRendererGL *rendererGL, WstRenderSurface *
 #ifdef ENABLE_LDBPROTOCOL
 static void wstRendererGLCommitLDB( WstRendererGL *rendererGL, WstRenderSurface *surface, struct wl_resource *resource );
 #endif
+#ifdef WST_RENDER_SCANOUT
+static bool wstRendererGLScanoutFormat( uint32_t format );
+static void wstRendererGLSetScanoutResource( WstRenderSurface *surface, struct wl_resource *resource );
+static void wstRendererGLScanoutResourceDestroyed( struct wl_listener *listener, void *data );
+static bool wstRendererGLScanoutRetireInit( WstRendererGL *renderer );
+static void wstRendererGLScanoutRetireTerm( WstRendererGL *renderer );
+static void wstRendererGLScanoutRetired( void *userData, int frameNumber );
+static int wstRendererGLScanoutRetireEvent( int fd, uint32_t mask, void *data );
+static void wstRendererGLHoldScanoutBuffer( WstRendererGL *renderer, struct wl_resource *resource, int frameNumber );
+static void wstRendererGLReleaseScanoutHolds( WstRendererGL *renderer, int retired );
+static void wstRendererGLScanoutHoldDestroyed( struct wl_listener *listener, void *data );
+static bool wstRendererGLUpdateScanout( WstRendererGL *renderer );
+#endif
 #if defined (WESTEROS_PLATFORM_RPI)
 static void wstRendererGLCommitDispmanx( WstRendererGL *rendererGL, WstRenderSurface *surface, 
                                          DISPMANX_RESOURCE_HANDLE_T dispResource,
                                          EGLint format, int bufferWidth, int bufferHeight );
 #endif                                         
-static void wstRendererGLRenderSurface( WstRendererGL *renderer, WstRenderSurface *surface );
+static void wstRendererGLPrepareSurface( WstRendererGL *renderer, WstRenderSurface *surface );
+static void wstRendererGLBatchSurface( WstRendererGL *renderer, WstRenderSurface *surface );
+static void wstRendererGLDrawBatches( WstRendererGL *renderer );
+static void wstRectUnion( WstRect *r, int x, int y, int width, int height );
+static void wstRendererGLAddDamage( WstRendererGL *renderer, int x, int y, int width, int height );
+static void wstRendererGLAddSurfaceDamage( WstRendererGL *renderer, WstRenderSurface *surface );
+static void wstRendererGLAddBufferDamage( WstRendererGL *renderer, WstRenderSurface *surface, WstRect *r );
+static bool wstRendererGLGetRepaintRect( WstRendererGL *renderer, WstRect *rect );
+static long long wstRendererGLUpdateFrameTiming( WstRendererGL *renderer );
+static bool wstRendererGLSurfaceHasContent( WstRenderSurface *surface );
+static void wstRendererGLGetSurfaceRect( WstRenderSurface *surface, WstRect *r );
+static int wstRendererGLGetOpaqueRects( WstRenderSurface *surface, WstRect *rects, int maxRects, bool *fullyOpaque );
+static void wstRendererGLCullSurfaces( WstRendererGL *renderer, WstRect *clip );
+static void wstRectIntersect( WstRect *r, WstRect *clip );
+static void wstRectTrim( WstRect *r, WstRect *occluder );
 
 static bool wstRendererGLSetupEGL( WstRendererGL *renderer );
 static void wstRendererGLDestroyShader( WstShader *shader );
 static WstShader* wstRendererGLCreateShader( WstRendererGL *renderer, int shaderType );
-static void wstRendererGLShaderDraw( WstShader *shader,
-                                      int width, int height, float* matrix, float alpha,
-                                      GLuint textureId, GLuint textureUVId,
-                                      int count, const float* vc, const float* txc );
+static void wstRendererGLShaderUse( WstShader *shader, int width, int height, float* matrix );
 
 static bool emitFPS= false;
+static bool forceFullRepaint= false;
 
 static WstRendererGL* wstRendererGLCreate( WstRenderer *renderer )
 {
@@ -344,6 +524,20 @@ static WstRendererGL* wstRendererGLCreate( WstRenderer *renderer )
       {
          emitFPS= true;
       }
+      if ( getenv("WESTEROS_RENDER_GL_FULL_REPAINT" ) )
+      {
+         forceFullRepaint= true;
+      }
+      if ( getenv("WESTEROS_RENDER_GL_ATLAS" ) )
+      {
+         rendererGL->useAtlas= true;
+      }
+      #ifdef WST_RENDER_SCANOUT
+      if ( getenv("WESTEROS_RENDER_GL_SCANOUT" ) )
+      {
+         rendererGL->useScanout= true;
+      }
+      #endif
 
       rendererGL->outputWidth= renderer->outputWidth;
       rendererGL->outputHeight= renderer->outputHeight;
@@ -361,6 +555,47 @@ static WstRendererGL* wstRendererGLCreate( WstRenderer *renderer )
       rendererGL->eglDestroyImageKHR= (PFNEGLDESTROYIMAGEKHRPROC)eglGetProcAddress("eglDestroyImageKHR");
       printf( "eglDestroyImageKHR %p\n", rendererGL->eglDestroyImageKHR);
 
+      rendererGL->fullDamage= true;
+      {
+         const char *extensions= eglQueryString( rendererGL->eglDisplay, EGL_EXTENSIONS );
+         if ( extensions )
+         {
+            #if defined (EGL_BUFFER_AGE_EXT)
+            if ( strstr( extensions, "EGL_EXT_buffer_age" ) )
+            {
+               rendererGL->haveBufferAge= true;
+            }
+            #endif
+            #if defined (EGL_EXT_swap_buffers_with_damage)
+            if ( strstr( extensions, "EGL_EXT_swap_buffers_with_damage" ) )
+            {
+               rendererGL->eglSwapBuffersWithDamage= (PFNEGLSWAPBUFFERSWITHDAMAGEEXTPROC)eglGetProcAddress("eglSwapBuffersWithDamageEXT");
+            }
+            else if ( strstr( extensions, "EGL_KHR_swap_buffers_with_damage" ) )
+            {
+               rendererGL->eglSwapBuffersWithDamage= (PFNEGLSWAPBUFFERSWITHDAMAGEEXTPROC)eglGetProcAddress("eglSwapBuffersWithDamageKHR");
+            }
+            printf( "eglSwapBuffersWithDamage %p\n", rendererGL->eglSwapBuffersWithDamage);
+            #endif
+         }
+         printf("have buffer age: %d\n", rendererGL->haveBufferAge );
+      }
+
+      #if defined (WST_UNPACK_ROW_LENGTH)
+      #if defined (WESTEROS_PLATFORM_EMBEDDED) || defined (WESTEROS_HAVE_WAYLAND_EGL)
+      {
+         const char *extensions= (const char *)glGetString(GL_EXTENSIONS);
+         if ( extensions && strstr( extensions, "GL_EXT_unpack_subimage" ) )
+         {
+            rendererGL->haveUnpackSubimage= true;
+         }
+      }
+      #else
+      rendererGL->haveUnpackSubimage= true;
+      #endif
+      #endif
+      printf("have unpack subimage: %d\n", rendererGL->haveUnpackSubimage );
+
       #if defined (WESTEROS_PLATFORM_EMBEDDED) || defined (WESTEROS_HAVE_WAYLAND_EGL)
       rendererGL->glEGLImageTargetTexture2DOES= (PFNGLEGLIMAGETARGETTEXTURE2DOESPROC)eglGetProcAddress("glEGLImageTargetTexture2DOES");
       printf( "glEGLImageTargetTexture2DOES %p\n", rendererGL->glEGLImageTargetTexture2DOES);
@@ -464,6 +699,22 @@ static void wstRendererGLDestroy( WstRendererGL *renderer )
          wstRendererGLDestroyShader( renderer->textureShaderYUV );
          renderer->textureShaderYUV= 0;
       }
+
+      if ( renderer->atlasTextureId )
+      {
+         glDeleteTextures( 1, &renderer->atlasTextureId );
+         renderer->atlasTextureId= GL_NONE;
+      }
+      std::vector<WstAtlasShelf>().swap( renderer->atlasShelves );
+
+      if ( renderer->batchBuffer )
+      {
+         glDeleteBuffers( 1, &renderer->batchBuffer );
+         renderer->batchBuffer= GL_NONE;
+      }
+      std::vector<WstDrawBatch>().swap( renderer->batches );
+      std::vector<WstBatchQuad>().swap( renderer->batchQuads );
+      std::vector<WstBatchVertex>().swap( renderer->batchVertices );
       
       if ( renderer->eglSurface )
       {
@@ -492,6 +743,17 @@ static void wstRendererGLDestroy( WstRendererGL *renderer )
          #endif
       }
 
+      #ifdef WST_RENDER_SCANOUT
+      if ( renderer->scanout )
+      {
+         WstGLDestroyScanout( renderer->glCtx, renderer->scanout );
+         renderer->scanout= 0;
+      }
+      // The plane is idle so every buffer it showed can go back to its client
+      wstRendererGLReleaseScanoutHolds( renderer, INT_MAX );
+      wstRendererGLScanoutRetireTerm( renderer );
+      #endif
+
       #if defined (WESTEROS_PLATFORM_EMBEDDED)
       if ( renderer->glCtx )
       {
@@ -532,7 +794,14 @@ static void wstRendererGLDestroySurface( WstRendererGL *renderer, WstRenderSurfa
     WST_UNUSED(renderer);    
     if ( surface )
     {
+        #ifdef WST_RENDER_SCANOUT
+        if ( renderer->scanoutSurface == surface )
+        {
+           renderer->scanoutSurface= 0;
+        }
+        #endif
         wstRendererGLFlushSurface( renderer, surface );
+        std::vector<WstRect>().swap( surface->opaqueRegion );
         free( surface );
     }
 }
@@ -555,6 +824,11 @@ static void wstRendererGLFlushSurface( WstRendererGL *renderer, WstRenderSurface
                surface->eglImage[i]= 0;
            }
         }
+        #ifdef WST_RENDER_SCANOUT
+        surface->scanoutCapable= false;
+        surface->scanoutPending= false;
+        wstRendererGLSetScanoutResource( surface, 0 );
+        #endif
         #if defined (WESTEROS_PLATFORM_EMBEDDED)
         if ( surface->nativePixmap )
         {
@@ -565,7 +839,11 @@ static void wstRendererGLFlushSurface( WstRendererGL *renderer, WstRenderSurface
         if ( surface->mem )
         {
            free( surface->mem );
+           surface->mem= 0;
         }
+        surface->memDirty= false;
+        surface->texWidth= 0;
+        wstRendererGLAtlasRelease( renderer, surface );
     }
 }
 
@@ -765,7 +1043,8 @@ static void wstRendererGLPrepareResource( WstRendererGL *renderer, WstRenderSurf
    }
 }
 
-static void wstRendererGLCommitShm( WstRendererGL *rendererGL, WstRenderSurface *surface, struct wl_resource *resource )
+static void wstRendererGLCommitShm( WstRendererGL *rendererGL, WstRenderSurface *surface, struct wl_resource *resource,
+                                    std::vector<WstRect> *damage )
 {
    struct wl_shm_buffer *shmBuffer;
    int width, height, stride;
@@ -774,6 +1053,7 @@ static void wstRendererGLCommitShm( WstRendererGL *rendererGL, WstRenderSurface
    bool transformPixelsA= false;
    bool transformPixelsB= false;
    bool fillAlpha= false;
+   bool fullCopy= false;
    void *data;
 
    shmBuffer= wl_shm_buffer_get( resource );
@@ -903,92 +1183,466 @@ static void wstRendererGLCommitShm( WstRendererGL *rendererGL, WstRenderSurface
 
       if ( formatGL != GL_NONE )
       {
+         int bpp= ((type == GL_UNSIGNED_BYTE) ? 4 : 2);
+         bool glReady, directUpload;
+
          wl_shm_buffer_begin_access(shmBuffer);
          data= wl_shm_buffer_get_data(shmBuffer);
-         
-         if ( surface->mem &&
-              (
-                (surface->memWidth != width) ||
-                (surface->memHeight != height) ||
-                (surface->memFormatGL != formatGL) ||
-                (surface->memType != type)
-              )
-            )
+
+         // The context is only made current for drawing and there is no surface during
+         // a resolution change, in which case all GL work is left to the prepare path
+         glReady= (rendererGL->eglSurface != EGL_NO_SURFACE) &&
+                  eglMakeCurrent( rendererGL->eglDisplay,
+                                  rendererGL->eglSurface,
+                                  rendererGL->eglSurface,
+                                  rendererGL->eglContext );
+
+         // When no pixel conversion is needed upload straight from the shm buffer
+         // into persistent texture storage and skip the intermediate copy
+         directUpload= glReady && !transformPixelsA && !transformPixelsB && !fillAlpha && ((stride % bpp) == 0);
+
+         // Small surfaces may share a texture atlas so they can be drawn in a single batch
+         if ( glReady )
          {
-            free( surface->mem );
-            surface->mem= 0;
+            if ( wstRendererGLAtlasPlace( rendererGL, surface, width, height, formatGL, type ) )
+            {
+               fullCopy= true;
+            }
          }
-         if ( !surface->mem )
+         else if ( surface->inAtlas )
          {
-            surface->mem= (unsigned char*)malloc( stride*height );
+            wstRendererGLAtlasRelease( rendererGL, surface );
+            fullCopy= true;
          }
-         if ( surface->mem )
+
+         if ( directUpload )
          {
-            memcpy( surface->mem, data, stride*height );
-            
-            if ( transformPixelsA )
+            if ( surface->mem )
+            {
+               free( surface->mem );
+               surface->mem= 0;
+            }
+            surface->memDirty= false;
+
+            glActiveTexture( GL_TEXTURE1 );
+            if ( surface->inAtlas )
+            {
+               glBindTexture( GL_TEXTURE_2D, rendererGL->atlasTextureId );
+            }
+            else
             {
-               // transform ARGB to RGBA
-               unsigned int pixel, alpha;
-               unsigned int *pixdata= (unsigned int*)surface->mem;
-               for( int y= 0; y < height; ++y )
+               if ( surface->textureId[0] == GL_NONE )
                {
-                  for( int x= 0; x < width; ++x )
-                  {
-                     pixel= pixdata[y*width+x];
-                     alpha= (fillAlpha ? 0xFF : (pixel>>24));
-                     pixel= (pixel<<8)|alpha;
-                     pixdata[y*width+x]= pixel;
-                  }
+                  glGenTextures( 1, &surface->textureId[0] );
+                  surface->texWidth= 0;
+               }
+               glBindTexture( GL_TEXTURE_2D, surface->textureId[0] );
+               if ( wstRendererGLAllocTextureStorage( surface, width, height, formatGL, type ) )
+               {
+                  fullCopy= true;
                }
             }
-            else if ( transformPixelsB )
+         }
+         else
+         {
+            if ( surface->mem &&
+                 (
+                   (surface->memWidth != width) ||
+                   (surface->memHeight != height) ||
+                   (surface->memFormatGL != formatGL) ||
+                   (surface->memType != type) ||
+                   (surface->memStride != stride)
+                 )
+               )
+            {
+               free( surface->mem );
+               surface->mem= 0;
+            }
+            if ( !surface->mem )
+            {
+               surface->mem= (unsigned char*)malloc( stride*height );
+               surface->memDirty= false;
+               fullCopy= true;
+            }
+         }
+         if ( surface->mem || directUpload )
+         {
+            WstRect r;
+
+            if ( !surface->memDirty )
+            {
+               surface->memDirtyRect.x= 0;
+               surface->memDirtyRect.y= 0;
+               surface->memDirtyRect.width= 0;
+               surface->memDirtyRect.height= 0;
+            }
+
+            if ( (surface->bufferWidth != width) || (surface->bufferHeight != height) )
+            {
+               wstRendererGLAddSurfaceDamage( rendererGL, surface );
+               surface->bufferWidth= width;
+               surface->bufferHeight= height;
+            }
+
+            if ( fullCopy || !damage )
             {
-               // transform BGRA to RGBA
-               unsigned char *pixdata= (unsigned char*)surface->mem;
-               for( int y= 0; y < height; ++y )
+               r.x= 0;
+               r.y= 0;
+               r.width= width;
+               r.height= height;
+               if ( directUpload )
                {
-                  for( int x= 0; x < width; ++x )
-                  {
-                     if ( fillAlpha )
-                     {
-                        pixdata[y*width*4 + x*4 +3]= 0xFF;
-                     }
-                     unsigned char temp= pixdata[y*width*4 + x*4 +2];
-                     pixdata[y*width*4 + x*4 +2]= pixdata[y*width*4 + x*4 +0];
-                     pixdata[y*width*4 + x*4 +0]= temp;
-                  }
+                  wstRendererGLUploadTexture( rendererGL, (unsigned char*)data, stride, width, formatGL, type, &r,
+                                              surface->atlasRect.x, surface->atlasRect.y );
+               }
+               else
+               {
+                  wstRendererGLCopyShmRect( surface, (unsigned char*)data, stride, bpp, &r,
+                                            transformPixelsA, transformPixelsB, fillAlpha );
+                  wstRectUnion( &surface->memDirtyRect, r.x, r.y, r.width, r.height );
                }
+               wstRendererGLAddSurfaceDamage( rendererGL, surface );
             }
-            else if ( fillAlpha )
+            else
             {
-               if ( fillAlpha )
+               for( int i= 0; i < damage->size(); ++i )
                {
-                  unsigned char *pixdata= (unsigned char*)surface->mem;
-                  for( int y= 0; y < height; ++y )
+                  long long x1, y1, x2, y2;
+
+                  x1= (*damage)[i].x;
+                  y1= (*damage)[i].y;
+                  x2= x1+(*damage)[i].width;
+                  y2= y1+(*damage)[i].height;
+                  if ( x1 < 0 ) x1= 0;
+                  if ( y1 < 0 ) y1= 0;
+                  if ( x2 > width ) x2= width;
+                  if ( y2 > height ) y2= height;
+                  if ( (x2 <= x1) || (y2 <= y1) )
                   {
-                     for( int x= 0; x < width; ++x )
-                     {
-                        pixdata[y*width*4 + x*4 +3]= 0xFF;
-                     }
+                     continue;
+                  }
+                  r.x= (int)x1;
+                  r.y= (int)y1;
+                  r.width= (int)(x2-x1);
+                  r.height= (int)(y2-y1);
+
+                  if ( directUpload )
+                  {
+                     wstRendererGLUploadTexture( rendererGL, (unsigned char*)data, stride, width, formatGL, type, &r,
+                                                 surface->atlasRect.x, surface->atlasRect.y );
+                  }
+                  else
+                  {
+                     wstRendererGLCopyShmRect( surface, (unsigned char*)data, stride, bpp, &r,
+                                               transformPixelsA, transformPixelsB, fillAlpha );
+                     wstRectUnion( &surface->memDirtyRect, r.x, r.y, r.width, r.height );
                   }
+
+                  wstRendererGLAddBufferDamage( rendererGL, surface, &r );
                }
             }
-            
-            surface->bufferWidth= width;
-            surface->bufferHeight= height;
+
             surface->memWidth= width;
             surface->memHeight= height;
+            surface->memStride= stride;
             surface->memFormatGL= formatGL;
             surface->memType= type;
-            surface->memDirty= true;
-         }      
-         
+            surface->opaqueFormat= (fillAlpha || (type == GL_UNSIGNED_SHORT_5_6_5));
+            if ( (surface->memDirtyRect.width > 0) && (surface->memDirtyRect.height > 0) )
+            {
+               surface->memDirty= true;
+            }
+         }
+
          wl_shm_buffer_end_access(shmBuffer);
       }
    }
 }
 
+static void wstRendererGLCopyShmRect( WstRenderSurface *surface, unsigned char *data, int stride, int bpp, WstRect *r,
+                                      bool transformPixelsA, bool transformPixelsB, bool fillAlpha )
+{
+   int y;
+   WstPixelOp op;
+
+   op= WstPixelGetOp( transformPixelsA, transformPixelsB, fillAlpha );
+   if ( op == WstPixelOp_count )
+   {
+      if ( (r->x == 0) && (r->width*bpp == stride) )
+      {
+         memcpy( surface->mem+r->y*stride, data+r->y*stride, r->height*stride );
+      }
+      else
+      {
+         for( y= r->y; y < r->y+r->height; ++y )
+         {
+            memcpy( surface->mem+y*stride+r->x*bpp, data+y*stride+r->x*bpp, r->width*bpp );
+         }
+      }
+   }
+   else
+   {
+      // Copy and convert each row in a single pass
+      WstPixelRowFunc convert= WstPixelGetKernels(0)->row[op];
+      for( y= r->y; y < r->y+r->height; ++y )
+      {
+         convert( surface->mem+y*stride+r->x*4, data+y*stride+r->x*4, r->width );
+      }
+   }
+}
+
+static bool wstRendererGLAllocTextureStorage( WstRenderSurface *surface, int width, int height, GLint formatGL, GLenum type )
+{
+   bool allocated= false;
+
+   // Texture storage is allocated once per size and format and then updated in place
+   if ( (surface->texWidth != width) ||
+        (surface->texHeight != height) ||
+        (surface->texFormatGL != formatGL) ||
+        (surface->texType != type) )
+   {
+      glTexImage2D( GL_TEXTURE_2D,
+                    0, //level
+                    formatGL, //internalFormat
+                    width,
+                    height,
+                    0, // border
+                    formatGL, //format
+                    type,
+                    NULL );
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+      surface->texWidth= width;
+      surface->texHeight= height;
+      surface->texFormatGL= formatGL;
+      surface->texType= type;
+      allocated= true;
+   }
+
+   return allocated;
+}
+
+static void wstRendererGLUploadTexture( WstRendererGL *renderer, unsigned char *data, int stride, int width,
+                                        GLint formatGL, GLenum type, WstRect *r, int dstX, int dstY )
+{
+   int bpp= ((type == GL_UNSIGNED_BYTE) ? 4 : 2);
+
+   if ( (stride % 4) != 0 )
+   {
+      glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+   }
+
+   renderer->bytesUploaded += (long long)r->width*r->height*bpp;
+
+   #if defined (WST_UNPACK_ROW_LENGTH)
+   if ( renderer->haveUnpackSubimage )
+   {
+      // Upload just the damaged rectangle using the source stride
+      glPixelStorei( WST_UNPACK_ROW_LENGTH, stride/bpp );
+      glTexSubImage2D( GL_TEXTURE_2D,
+                       0, //level
+                       dstX+r->x,
+                       dstY+r->y,
+                       r->width,
+                       r->height,
+                       formatGL, //format
+                       type,
+                       data+r->y*stride+r->x*bpp );
+      glPixelStorei( WST_UNPACK_ROW_LENGTH, 0 );
+   }
+   else
+   #endif
+   if ( stride == width*bpp )
+   {
+      // Only upload the rows covered by the damage
+      renderer->bytesUploaded += (long long)(width-r->width)*r->height*bpp;
+      glTexSubImage2D( GL_TEXTURE_2D,
+                       0, //level
+                       dstX,
+                       dstY+r->y,
+                       width,
+                       r->height,
+                       formatGL, //format
+                       type,
+                       data+r->y*stride );
+   }
+   else
+   {
+      for( int y= r->y; y < r->y+r->height; ++y )
+      {
+         glTexSubImage2D( GL_TEXTURE_2D,
+                          0, //level
+                          dstX+r->x,
+                          dstY+y,
+                          r->width,
+                          1,
+                          formatGL, //format
+                          type,
+                          data+y*stride+r->x*bpp );
+      }
+   }
+
+   if ( (stride % 4) != 0 )
+   {
+      glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+   }
+}
+
+/*
+ * Place a small shm surface in the shared texture atlas.  Space is handed out
+ * on shelves and a shelf is reused once all surfaces on it are released.
+ * Returns true if the surface was given a new location and so needs a full
+ * upload of its content.
+ */
+static bool wstRendererGLAtlasPlace( WstRendererGL *renderer, WstRenderSurface *surface,
+                                     int width, int height, GLint formatGL, GLenum type )
+{
+   bool placed= false;
+   bool eligible;
+   int shelf= -1;
+
+   eligible= renderer->useAtlas &&
+             (surface->textureCount == 1) &&
+             (width <= ATLAS_MAX_SURFACE_SIZE) &&
+             (height <= ATLAS_MAX_SURFACE_SIZE);
+
+   if ( surface->inAtlas )
+   {
+      if ( eligible &&
+           (surface->atlasRect.width == width) &&
+           (surface->atlasRect.height == height) &&
+           (renderer->atlasFormatGL == formatGL) &&
+           (renderer->atlasType == type) )
+      {
+         goto exit;
+      }
+      wstRendererGLAtlasRelease( renderer, surface );
+   }
+
+   if ( !eligible )
+   {
+      goto exit;
+   }
+
+   if ( renderer->atlasSurfaceCount == 0 )
+   {
+      renderer->atlasShelves.clear();
+      if ( renderer->atlasTextureId &&
+           ((renderer->atlasFormatGL != formatGL) || (renderer->atlasType != type)) )
+      {
+         glDeleteTextures( 1, &renderer->atlasTextureId );
+         renderer->atlasTextureId= GL_NONE;
+      }
+      renderer->atlasFormatGL= formatGL;
+      renderer->atlasType= type;
+   }
+   else if ( (renderer->atlasFormatGL != formatGL) || (renderer->atlasType != type) )
+   {
+      goto exit;
+   }
+
+   for( int i= 0; i < renderer->atlasShelves.size(); ++i )
+   {
+      WstAtlasShelf *s= &renderer->atlasShelves[i];
+      if ( (s->height >= height) &&
+           (s->x+width <= ATLAS_SIZE) &&
+           ((shelf < 0) || (s->height < renderer->atlasShelves[shelf].height)) )
+      {
+         shelf= i;
+      }
+   }
+   if ( shelf < 0 )
+   {
+      WstAtlasShelf s;
+
+      s.y= 0;
+      if ( renderer->atlasShelves.size() )
+      {
+         WstAtlasShelf *last= &renderer->atlasShelves.back();
+         s.y= last->y+last->height;
+      }
+      if ( s.y+height > ATLAS_SIZE )
+      {
+         goto exit;
+      }
+      s.height= height;
+      s.x= 0;
+      s.count= 0;
+      renderer->atlasShelves.push_back( s );
+      shelf= renderer->atlasShelves.size()-1;
+   }
+
+   if ( renderer->atlasTextureId == GL_NONE )
+   {
+      glGenTextures( 1, &renderer->atlasTextureId );
+      glActiveTexture( GL_TEXTURE1 );
+      glBindTexture( GL_TEXTURE_2D, renderer->atlasTextureId );
+      glTexImage2D( GL_TEXTURE_2D,
+                    0, //level
+                    formatGL, //internalFormat
+                    ATLAS_SIZE,
+                    ATLAS_SIZE,
+                    0, // border
+                    formatGL, //format
+                    type,
+                    NULL );
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+   }
+
+   surface->inAtlas= true;
+   surface->atlasShelf= shelf;
+   surface->atlasRect.x= renderer->atlasShelves[shelf].x;
+   surface->atlasRect.y= renderer->atlasShelves[shelf].y;
+   surface->atlasRect.width= width;
+   surface->atlasRect.height= height;
+   renderer->atlasShelves[shelf].x += width;
+   renderer->atlasShelves[shelf].count += 1;
+   ++renderer->atlasSurfaceCount;
+
+   // The surface no longer needs a texture of its own
+   if ( surface->textureId[0] != GL_NONE )
+   {
+      glDeleteTextures( 1, &surface->textureId[0] );
+      surface->textureId[0]= GL_NONE;
+   }
+   surface->texWidth= 0;
+
+   placed= true;
+
+exit:
+   return placed;
+}
+
+static void wstRendererGLAtlasRelease( WstRendererGL *renderer, WstRenderSurface *surface )
+{
+   if ( surface->inAtlas )
+   {
+      WstAtlasShelf *s= &renderer->atlasShelves[surface->atlasShelf];
+
+      if ( --s->count == 0 )
+      {
+         s->x= 0;
+      }
+      while ( renderer->atlasShelves.size() && (renderer->atlasShelves.back().count == 0) )
+      {
+         renderer->atlasShelves.pop_back();
+      }
+      --renderer->atlasSurfaceCount;
+
+      surface->inAtlas= false;
+      surface->atlasShelf= 0;
+      surface->atlasRect.x= 0;
+      surface->atlasRect.y= 0;
+      surface->atlasRect.width= 0;
+      surface->atlasRect.height= 0;
+   }
+}
+
 #if defined (WESTEROS_HAVE_WAYLAND_EGL)
 static void wstRendererGLCommitWaylandEGL( WstRendererGL *rendererGL, WstRenderSurface *surface, 
                                            struct wl_resource *resource, EGLint format )
@@ -1420,6 +2074,35 @@ static void wstRendererGLCommitLDB( WstRendererGL *rendererGL, WstRenderSurface
          }
       }
       #endif
+
+      #ifdef WST_RENDER_SCANOUT
+      if ( rendererGL->useScanout &&
+           wstRendererGLScanoutFormat( ldbBuffer->info.format ) &&
+           (ldbBuffer->info.flags == 0) &&
+           (ldbBuffer->info.planeCount > 0) &&
+           (WstLDBBufferGetFd( ldbBuffer ) >= 0) )
+      {
+         // Remember the buffer so the scene update can put it on a plane.  The
+         // fds belong to the buffer and stay valid while it is attached
+         WstGLScanoutBuffer *sb= &surface->scanoutBuffer;
+         sb->format= ldbBuffer->info.format;
+         sb->width= ldbBuffer->info.width;
+         sb->height= ldbBuffer->info.height;
+         sb->planeCount= ldbBuffer->info.planeCount;
+         for( int i= 0; i < WST_LDB_MAX_PLANES; ++i )
+         {
+            sb->fd[i]= ldbBuffer->info.fd[i];
+            sb->offset[i]= ldbBuffer->info.offset[i];
+            sb->stride[i]= ldbBuffer->info.stride[i];
+         }
+         sb->modifier= ldbBuffer->info.modifier[0];
+         surface->bufferWidth= sb->width;
+         surface->bufferHeight= sb->height;
+         surface->scanoutCapable= true;
+         surface->scanoutPending= true;
+         wstRendererGLSetScanoutResource( surface, resource );
+      }
+      #endif
    }
 
    #if WESTEROS_INVERTED_Y
@@ -1454,7 +2137,8 @@ static void wstRendererGLCommitDispmanx( WstRendererGL *rendererGL, WstRenderSur
                       (surface->memWidth != bufferWidth) ||
                       (surface->memHeight != bufferHeight) ||
                       (surface->memFormatGL != formatGL) ||
-                      (surface->memType != type)
+                      (surface->memType != type) ||
+                      (surface->memStride != stride)
                     )
                   )
                {
@@ -1485,8 +2169,13 @@ static void wstRendererGLCommitDispmanx( WstRendererGL *rendererGL, WstRenderSur
                      surface->bufferHeight= bufferHeight;
                      surface->memWidth= bufferWidth;
                      surface->memHeight= bufferHeight;
+                     surface->memStride= stride;
                      surface->memFormatGL= formatGL;
                      surface->memType= type;
+                     surface->memDirtyRect.x= 0;
+                     surface->memDirtyRect.y= 0;
+                     surface->memDirtyRect.width= bufferWidth;
+                     surface->memDirtyRect.height= bufferHeight;
                      surface->memDirty= true;
                   }
                }            
@@ -1513,15 +2202,29 @@ static void wstRendererGLCommitDispmanx( WstRendererGL *rendererGL, WstRenderSur
 }
 #endif
 
-static void wstRendererGLRenderSurface( WstRendererGL *renderer, WstRenderSurface *surface )
+static void wstRendererGLPrepareSurface( WstRendererGL *renderer, WstRenderSurface *surface )
 {
-   if ( (surface->textureId[0] == GL_NONE) || surface->memDirty || surface->externalImage )
+   if ( surface->inAtlas )
+   {
+      if ( surface->mem && surface->memDirty )
+      {
+         glActiveTexture(GL_TEXTURE1);
+         glBindTexture(GL_TEXTURE_2D, renderer->atlasTextureId );
+         wstRendererGLUploadTexture( renderer, surface->mem, surface->memStride, surface->memWidth,
+                                     surface->memFormatGL, surface->memType, &surface->memDirtyRect,
+                                     surface->atlasRect.x, surface->atlasRect.y );
+         surface->memDirty= false;
+      }
+   }
+   else if ( (surface->textureId[0] == GL_NONE) || surface->memDirty || surface->externalImage )
    {
       for ( int i= 0; i < surface->textureCount; ++i )
       {
+         bool newTexture= false;
          if ( surface->textureId[i] == GL_NONE )
          {
             glGenTextures(1, &surface->textureId[i] );
+            newTexture= true;
          }
        
          /* Bind the egl image as a texture */
@@ -1547,22 +2250,33 @@ static void wstRendererGLRenderSurface( WstRendererGL *renderer, WstRenderSurfac
          #endif
          if ( i == 0 )
          {
-            if ( surface->mem )
+            if ( surface->mem && (surface->memDirty || newTexture) )
             {
-               glTexImage2D( GL_TEXTURE_2D,
-                             0, //level
-                             surface->memFormatGL, //internalFormat
-                             surface->memWidth,
-                             surface->memHeight,
-                             0, // border
-                             surface->memFormatGL, //format
-                             surface->memType,
-                             surface->mem );
-               surface->memDirty= false;
-            }
-         }
-         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+               WstRect r;
+
+               if ( newTexture )
+               {
+                  surface->texWidth= 0;
+               }
+               if ( wstRendererGLAllocTextureStorage( surface, surface->memWidth, surface->memHeight,
+                                                      surface->memFormatGL, surface->memType ) )
+               {
+                  r.x= 0;
+                  r.y= 0;
+                  r.width= surface->memWidth;
+                  r.height= surface->memHeight;
+               }
+               else
+               {
+                  r= surface->memDirtyRect;
+               }
+               wstRendererGLUploadTexture( renderer, surface->mem, surface->memStride, surface->memWidth,
+                                           surface->memFormatGL, surface->memType, &r, 0, 0 );
+               surface->memDirty= false;
+            }
+         }
+         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
          glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
          glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
       }
@@ -1573,31 +2287,149 @@ static void wstRendererGLRenderSurface( WstRendererGL *renderer, WstRenderSurfac
       surface->width= surface->bufferWidth;
       surface->height= surface->bufferHeight;
    }
+}
 
-   const float verts[4][2] =
+/*
+ * Add a quad for the visible part of a surface to the frame's draw batches.
+ * A surface joins the most recent batch with the same shader, textures and
+ * blending provided it does not overlap anything drawn after that batch, so
+ * the result is the same as drawing the surfaces in z order.
+ */
+static void wstRendererGLBatchSurface( WstRendererGL *renderer, WstRenderSurface *surface )
+{
+   WstShader *shader;
+   GLuint textureId, textureUVId;
+   bool blend;
+   WstBatchQuad quad;
+   WstRect *r= &surface->drawRect;
+   float sx, sy, sw, sh;
+   float u0, v0, u1, v1;
+   float x1, y1, x2, y2;
+   float tu1, tv1, tu2, tv2;
+   int batch= -1;
+
+   if ( surface->textureCount == 1 )
    {
-      { float(surface->x), float(surface->y) },
-      { float(surface->x+surface->width), float(surface->y) },
-      { float(surface->x), float(surface->y+surface->height) },
-      { float(surface->x+surface->width), float(surface->y+surface->height) }
-   };
+      shader= (surface->externalImage ? renderer->textureShaderExternal : renderer->textureShader);
+      textureId= (surface->inAtlas ? renderer->atlasTextureId : surface->textureId[0]);
+      textureUVId= GL_NONE;
+   }
+   else
+   {
+      shader= renderer->textureShaderYUV;
+      textureId= surface->textureId[0];
+      textureUVId= surface->textureId[1];
+   }
+   if ( !shader )
+   {
+      return;
+   }
+   blend= !surface->drawOpaque;
 
-   const float uvNormal[4][2] =
+   sx= surface->x;
+   sy= surface->y;
+   sw= surface->width;
+   sh= surface->height;
+   if ( (sw <= 0) || (sh <= 0) )
    {
-      { 0,  0 },
-      { 1,  0 },
-      { 0,  1 },
-      { 1,  1 }
-   };
+      return;
+   }
+
+   u0= 0;
+   v0= 0;
+   u1= 1;
+   v1= 1;
+   if ( surface->inAtlas )
+   {
+      float inset= 0;
+
+      // Keep filtering of scaled surfaces from sampling their neighbours
+      if ( (surface->width != surface->atlasRect.width) || (surface->height != surface->atlasRect.height) )
+      {
+         inset= 0.5;
+      }
+      u0= (surface->atlasRect.x+inset)/ATLAS_SIZE;
+      v0= (surface->atlasRect.y+inset)/ATLAS_SIZE;
+      u1= (surface->atlasRect.x+surface->atlasRect.width-inset)/ATLAS_SIZE;
+      v1= (surface->atlasRect.y+surface->atlasRect.height-inset)/ATLAS_SIZE;
+   }
+   if ( surface->invertedY )
+   {
+      float t= v0;
+      v0= v1;
+      v1= t;
+   }
 
-   const float uvYInverted[4][2] =
+   // Clip the quad to the area that needs drawing
+   x1= r->x;
+   y1= r->y;
+   x2= r->x+r->width;
+   y2= r->y+r->height;
+   tu1= u0+(u1-u0)*(x1-sx)/sw;
+   tu2= u0+(u1-u0)*(x2-sx)/sw;
+   tv1= v0+(v1-v0)*(y1-sy)/sh;
+   tv2= v0+(v1-v0)*(y2-sy)/sh;
+
+   const WstBatchVertex verts[6]=
    {
-      { 0,  1 },
-      { 1,  1 },
-      { 0,  0 },
-      { 1,  0 }
+      { x1, y1, tu1, tv1, surface->opacity },
+      { x2, y1, tu2, tv1, surface->opacity },
+      { x1, y2, tu1, tv2, surface->opacity },
+      { x1, y2, tu1, tv2, surface->opacity },
+      { x2, y1, tu2, tv1, surface->opacity },
+      { x2, y2, tu2, tv2, surface->opacity }
    };
 
+   for( int i= renderer->batches.size()-1; i >= 0; --i )
+   {
+      WstDrawBatch *b= &renderer->batches[i];
+      if ( (b->shader == shader) &&
+           (b->textureId == textureId) &&
+           (b->textureUVId == textureUVId) &&
+           (b->blend == blend) )
+      {
+         batch= i;
+         break;
+      }
+      if ( (b->bounds.x < r->x+r->width) && (r->x < b->bounds.x+b->bounds.width) &&
+           (b->bounds.y < r->y+r->height) && (r->y < b->bounds.y+b->bounds.height) )
+      {
+         break;
+      }
+   }
+   if ( batch < 0 )
+   {
+      WstDrawBatch b;
+
+      b.shader= shader;
+      b.textureId= textureId;
+      b.textureUVId= textureUVId;
+      b.blend= blend;
+      b.bounds= *r;
+      b.quadCount= 0;
+      b.first= 0;
+      b.count= 0;
+      renderer->batches.push_back( b );
+      batch= renderer->batches.size()-1;
+   }
+   else
+   {
+      wstRectUnion( &renderer->batches[batch].bounds, r->x, r->y, r->width, r->height );
+   }
+   renderer->batches[batch].quadCount += 1;
+
+   quad.batch= batch;
+   memcpy( quad.v, verts, sizeof(verts) );
+   renderer->batchQuads.push_back( quad );
+}
+
+/*
+ * Pack the frame's quads into a single vertex buffer grouped by batch and
+ * issue one draw per batch, changing program, texture and blend state only
+ * when it differs from the previous batch.
+ */
+static void wstRendererGLDrawBatches( WstRendererGL *renderer )
+{
    const float identityMatrix[4][4] =
    {
       {1, 0, 0, 0},
@@ -1605,42 +2437,470 @@ static void wstRendererGLRenderSurface( WstRendererGL *renderer, WstRenderSurfac
       {0, 0, 1, 0},
       {0, 0, 0, 1}
    };
+   WstShader *shader= 0;
+   GLuint textureId= GL_NONE, textureUVId= GL_NONE;
+   bool blend= true;
+   int first= 0;
+   int resW, resH;
 
-   const float *uv= surface->invertedY ? (const float*)uvYInverted : (const float*)uvNormal;
+   if ( renderer->batchQuads.size() == 0 )
+   {
+      return;
+   }
 
-   float *matrix= (float*)identityMatrix;
+   for( int i= 0; i < renderer->batches.size(); ++i )
+   {
+      renderer->batches[i].first= first;
+      renderer->batches[i].count= 0;
+      first += renderer->batches[i].quadCount*6;
+   }
+   renderer->batchVertices.resize( first );
+   for( int i= 0; i < renderer->batchQuads.size(); ++i )
+   {
+      WstBatchQuad *quad= &renderer->batchQuads[i];
+      WstDrawBatch *b= &renderer->batches[quad->batch];
+      memcpy( &renderer->batchVertices[b->first+b->count], quad->v, sizeof(quad->v) );
+      b->count += 6;
+   }
 
-   int resW, resH;
-   GLint viewport[4];
+   if ( renderer->batchBuffer == GL_NONE )
+   {
+      glGenBuffers( 1, &renderer->batchBuffer );
+   }
+   glBindBuffer( GL_ARRAY_BUFFER, renderer->batchBuffer );
+   glBufferData( GL_ARRAY_BUFFER,
+                 renderer->batchVertices.size()*sizeof(WstBatchVertex),
+                 &renderer->batchVertices[0],
+                 GL_STREAM_DRAW );
+
+   // Attribute locations are the same for every shader
+   glVertexAttribPointer( 0, 2, GL_FLOAT, GL_FALSE, sizeof(WstBatchVertex), (void*)offsetof(WstBatchVertex,x) );
+   glVertexAttribPointer( 1, 2, GL_FLOAT, GL_FALSE, sizeof(WstBatchVertex), (void*)offsetof(WstBatchVertex,u) );
+   glVertexAttribPointer( 2, 2, GL_FLOAT, GL_FALSE, sizeof(WstBatchVertex), (void*)offsetof(WstBatchVertex,u) );
+   glVertexAttribPointer( 3, 1, GL_FLOAT, GL_FALSE, sizeof(WstBatchVertex), (void*)offsetof(WstBatchVertex,opacity) );
+   for( int i= 0; i < 4; ++i )
+   {
+      glEnableVertexAttribArray( i );
+   }
 
    resW= renderer->renderer->outputWidth;
    resH= renderer->renderer->outputHeight;
 
-   if ( surface->textureCount == 1 )
+   for( int i= 0; i < renderer->batches.size(); ++i )
+   {
+      WstDrawBatch *b= &renderer->batches[i];
+
+      if ( b->shader != shader )
+      {
+         shader= b->shader;
+         wstRendererGLShaderUse( shader, resW, resH, (float*)identityMatrix );
+      }
+      if ( b->blend != blend )
+      {
+         blend= b->blend;
+         if ( blend )
+         {
+            glEnable(GL_BLEND);
+         }
+         else
+         {
+            glDisable(GL_BLEND);
+         }
+      }
+      if ( (b->textureId != textureId) || (i == 0) )
+      {
+         textureId= b->textureId;
+         glActiveTexture(GL_TEXTURE1);
+         glBindTexture( GL_TEXTURE_2D, textureId );
+      }
+      if ( shader->isYUV && ((b->textureUVId != textureUVId) || (i == 0)) )
+      {
+         textureUVId= b->textureUVId;
+         glActiveTexture(GL_TEXTURE2);
+         glBindTexture( GL_TEXTURE_2D, textureUVId );
+      }
+      glDrawArrays( GL_TRIANGLES, b->first, b->count );
+   }
+
+   for( int i= 0; i < 4; ++i )
+   {
+      glDisableVertexAttribArray( i );
+   }
+   glBindBuffer( GL_ARRAY_BUFFER, 0 );
+   if ( !blend )
+   {
+      glEnable(GL_BLEND);
+   }
+}
+
+static void wstRectUnion( WstRect *r, int x, int y, int width, int height )
+{
+   if ( (width <= 0) || (height <= 0) )
+   {
+      return;
+   }
+   if ( (r->width <= 0) || (r->height <= 0) )
    {
-      wstRendererGLShaderDraw( surface->externalImage ? renderer->textureShaderExternal : renderer->textureShader,
-                               resW,
-                               resH,
-                               (float*)matrix,
-                               surface->opacity,
-                               surface->textureId[0],
-                               GL_NONE,
-                               4,
-                               (const float*)verts,
-                               (const float*)uv );
+      r->x= x;
+      r->y= y;
+      r->width= width;
+      r->height= height;
    }
    else
    {
-      wstRendererGLShaderDraw( renderer->textureShaderYUV,
-                               resW,
-                               resH,
-                               (float*)matrix,
-                               surface->opacity,
-                               surface->textureId[0],
-                               surface->textureId[1],
-                               4,
-                               (const float*)verts,
-                               (const float*)uv );
+      int x2= ((r->x+r->width > x+width) ? r->x+r->width : x+width);
+      int y2= ((r->y+r->height > y+height) ? r->y+r->height : y+height);
+      r->x= ((x < r->x) ? x : r->x);
+      r->y= ((y < r->y) ? y : r->y);
+      r->width= x2-r->x;
+      r->height= y2-r->y;
+   }
+}
+
+static void wstRendererGLAddDamage( WstRendererGL *renderer, int x, int y, int width, int height )
+{
+   wstRectUnion( &renderer->frameDamage, x, y, width, height );
+}
+
+static void wstRendererGLAddSurfaceDamage( WstRendererGL *renderer, WstRenderSurface *surface )
+{
+   int width, height;
+
+   width= (surface->sizeOverride ? surface->width : surface->bufferWidth);
+   height= (surface->sizeOverride ? surface->height : surface->bufferHeight);
+
+   wstRendererGLAddDamage( renderer, surface->x, surface->y, width, height );
+}
+
+static void wstRendererGLAddBufferDamage( WstRendererGL *renderer, WstRenderSurface *surface, WstRect *r )
+{
+   int width, height;
+   long long x1, y1, x2, y2;
+
+   if ( (surface->bufferWidth <= 0) || (surface->bufferHeight <= 0) )
+   {
+      return;
+   }
+
+   width= (surface->sizeOverride ? surface->width : surface->bufferWidth);
+   height= (surface->sizeOverride ? surface->height : surface->bufferHeight);
+
+   // Map the buffer rectangle onto the output, rounding outwards
+   x1= ((long long)r->x*width)/surface->bufferWidth;
+   y1= ((long long)r->y*height)/surface->bufferHeight;
+   x2= ((long long)(r->x+r->width)*width+surface->bufferWidth-1)/surface->bufferWidth;
+   y2= ((long long)(r->y+r->height)*height+surface->bufferHeight-1)/surface->bufferHeight;
+
+   if ( (width != surface->bufferWidth) || (height != surface->bufferHeight) )
+   {
+      // Allow for texture filtering bleeding into neighbouring pixels
+      x1 -= 1;
+      y1 -= 1;
+      x2 += 1;
+      y2 += 1;
+   }
+
+   wstRendererGLAddDamage( renderer, surface->x+(int)x1, surface->y+(int)y1, (int)(x2-x1), (int)(y2-y1) );
+}
+
+/*
+ * Record the time at which the current frame was presented.  Idle frames that
+ * keep the current front buffer on screen count as presented so that the
+ * presentation timing fallback does not report stale timestamps.
+ */
+static long long wstRendererGLUpdateFrameTiming( WstRendererGL *renderer )
+{
+   struct timespec tm;
+
+   clock_gettime( CLOCK_MONOTONIC, &tm );
+   renderer->swapTime= tm.tv_sec*1000000LL+(tm.tv_nsec/1000LL);
+   ++renderer->swapCount;
+
+   return renderer->swapTime;
+}
+
+/*
+ * Determine the area of the output that must be repainted this frame.  When
+ * the age of the back buffer is known the repaint area is the damage accumulated
+ * over the frames since that buffer was last drawn.  Returns false if the
+ * whole output must be repainted.
+ */
+static bool wstRendererGLGetRepaintRect( WstRendererGL *renderer, WstRect *rect )
+{
+   bool partial= false;
+   EGLint age= 0;
+   int i;
+
+   #if defined (EGL_BUFFER_AGE_EXT)
+   if ( renderer->haveBufferAge && !renderer->fullDamage )
+   {
+      if ( !eglQuerySurface( renderer->eglDisplay, renderer->eglSurface, EGL_BUFFER_AGE_EXT, &age ) )
+      {
+         age= 0;
+      }
+   }
+   #endif
+
+   *rect= renderer->frameDamage;
+   if ( (age > 0) && (age <= renderer->damageHistoryCount+1) )
+   {
+      for( i= 0; i < age-1; ++i )
+      {
+         WstRect *r= &renderer->damageHistory[i];
+         wstRectUnion( rect, r->x, r->y, r->width, r->height );
+      }
+      partial= true;
+   }
+
+   // Record this frame's damage as the most recent history entry
+   for( i= MAX_DAMAGE_HISTORY-1; i > 0; --i )
+   {
+      renderer->damageHistory[i]= renderer->damageHistory[i-1];
+   }
+   renderer->damageHistory[0]= renderer->frameDamage;
+   if ( renderer->fullDamage )
+   {
+      renderer->damageHistory[0].x= 0;
+      renderer->damageHistory[0].y= 0;
+      renderer->damageHistory[0].width= renderer->outputWidth;
+      renderer->damageHistory[0].height= renderer->outputHeight;
+   }
+   if ( renderer->damageHistoryCount < MAX_DAMAGE_HISTORY )
+   {
+      ++renderer->damageHistoryCount;
+   }
+
+   renderer->fullDamage= false;
+   renderer->frameDamage.x= 0;
+   renderer->frameDamage.y= 0;
+   renderer->frameDamage.width= 0;
+   renderer->frameDamage.height= 0;
+
+   if ( partial )
+   {
+      int x2, y2;
+
+      // Clip to the output
+      x2= rect->x+rect->width;
+      y2= rect->y+rect->height;
+      if ( rect->x < 0 ) rect->x= 0;
+      if ( rect->y < 0 ) rect->y= 0;
+      if ( x2 > renderer->outputWidth ) x2= renderer->outputWidth;
+      if ( y2 > renderer->outputHeight ) y2= renderer->outputHeight;
+      rect->width= (x2 > rect->x ? x2-rect->x : 0);
+      rect->height= (y2 > rect->y ? y2-rect->y : 0);
+   }
+
+   return partial;
+}
+
+static bool wstRendererGLSurfaceHasContent( WstRenderSurface *surface )
+{
+   return (
+            #if defined (WESTEROS_PLATFORM_EMBEDDED) || defined (WESTEROS_HAVE_WAYLAND_EGL)
+            surface->eglImage[0] ||
+            #endif
+            surface->memDirty ||
+            surface->inAtlas ||
+            (surface->textureId[0] != GL_NONE)
+          );
+}
+
+static void wstRendererGLGetSurfaceRect( WstRenderSurface *surface, WstRect *r )
+{
+   r->x= surface->x;
+   r->y= surface->y;
+   r->width= (surface->sizeOverride ? surface->width : surface->bufferWidth);
+   r->height= (surface->sizeOverride ? surface->height : surface->bufferHeight);
+}
+
+/*
+ * Get the opaque areas of a surface in output coordinates.  A surface is only
+ * treated as opaque where its content is opaque and it is drawn at full opacity.
+ */
+static int wstRendererGLGetOpaqueRects( WstRenderSurface *surface, WstRect *rects, int maxRects, bool *fullyOpaque )
+{
+   int count= 0;
+   WstRect sr;
+
+   *fullyOpaque= false;
+
+   if ( (surface->opacity < 1.0) || (surface->bufferWidth <= 0) || (surface->bufferHeight <= 0) )
+   {
+      return 0;
+   }
+
+   wstRendererGLGetSurfaceRect( surface, &sr );
+   if ( (sr.width <= 0) || (sr.height <= 0) )
+   {
+      return 0;
+   }
+
+   // RGBX, RGB565 and YUV content has no alpha
+   if ( surface->opaqueFormat || (surface->textureCount == 2) )
+   {
+      *fullyOpaque= true;
+      rects[count++]= sr;
+      return count;
+   }
+
+   for( int i= 0; (i < surface->opaqueRegion.size()) && (count < maxRects); ++i )
+   {
+      WstRect *o= &surface->opaqueRegion[i];
+      long long x1, y1, x2, y2;
+
+      x1= o->x;
+      y1= o->y;
+      x2= (long long)o->x+o->width;
+      y2= (long long)o->y+o->height;
+      if ( x1 < 0 ) x1= 0;
+      if ( y1 < 0 ) y1= 0;
+      if ( x2 > surface->bufferWidth ) x2= surface->bufferWidth;
+      if ( y2 > surface->bufferHeight ) y2= surface->bufferHeight;
+      if ( (x2 <= x1) || (y2 <= y1) )
+      {
+         continue;
+      }
+
+      if ( (x1 == 0) && (y1 == 0) && (x2 == surface->bufferWidth) && (y2 == surface->bufferHeight) )
+      {
+         *fullyOpaque= true;
+      }
+
+      if ( (sr.width != surface->bufferWidth) || (sr.height != surface->bufferHeight) )
+      {
+         // Map onto the output rounding inwards and allow for filtering at the edges
+         x1= (x1*sr.width+surface->bufferWidth-1)/surface->bufferWidth+1;
+         y1= (y1*sr.height+surface->bufferHeight-1)/surface->bufferHeight+1;
+         x2= (x2*sr.width)/surface->bufferWidth-1;
+         y2= (y2*sr.height)/surface->bufferHeight-1;
+         if ( (x2 <= x1) || (y2 <= y1) )
+         {
+            continue;
+         }
+      }
+
+      rects[count].x= sr.x+(int)x1;
+      rects[count].y= sr.y+(int)y1;
+      rects[count].width= (int)(x2-x1);
+      rects[count].height= (int)(y2-y1);
+      ++count;
+   }
+
+   return count;
+}
+
+static void wstRectIntersect( WstRect *r, WstRect *clip )
+{
+   int x1, y1, x2, y2;
+
+   x1= ((r->x > clip->x) ? r->x : clip->x);
+   y1= ((r->y > clip->y) ? r->y : clip->y);
+   x2= ((r->x+r->width < clip->x+clip->width) ? r->x+r->width : clip->x+clip->width);
+   y2= ((r->y+r->height < clip->y+clip->height) ? r->y+r->height : clip->y+clip->height);
+
+   r->x= x1;
+   r->y= y1;
+   r->width= ((x2 > x1) ? x2-x1 : 0);
+   r->height= ((y2 > y1) ? y2-y1 : 0);
+}
+
+/*
+ * Remove the part of r hidden by an occluder when what remains is still a
+ * rectangle: either r is fully covered or the occluder spans a full edge.
+ */
+static void wstRectTrim( WstRect *r, WstRect *occluder )
+{
+   int rx2, ry2, ox2, oy2;
+
+   if ( (r->width <= 0) || (r->height <= 0) )
+   {
+      return;
+   }
+
+   rx2= r->x+r->width;
+   ry2= r->y+r->height;
+   ox2= occluder->x+occluder->width;
+   oy2= occluder->y+occluder->height;
+
+   if ( (occluder->x >= rx2) || (ox2 <= r->x) || (occluder->y >= ry2) || (oy2 <= r->y) )
+   {
+      return;
+   }
+
+   if ( (occluder->x <= r->x) && (ox2 >= rx2) )
+   {
+      if ( (occluder->y <= r->y) && (oy2 >= ry2) )
+      {
+         r->width= 0;
+         r->height= 0;
+      }
+      else if ( occluder->y <= r->y )
+      {
+         r->y= oy2;
+         r->height= ry2-oy2;
+      }
+      else if ( oy2 >= ry2 )
+      {
+         r->height= occluder->y-r->y;
+      }
+   }
+   else if ( (occluder->y <= r->y) && (oy2 >= ry2) )
+   {
+      if ( occluder->x <= r->x )
+      {
+         r->x= ox2;
+         r->width= rx2-ox2;
+      }
+      else if ( ox2 >= rx2 )
+      {
+         r->width= occluder->x-r->x;
+      }
+   }
+}
+
+/*
+ * Walk the surfaces from top to bottom determining the area of each that
+ * needs to be drawn.  Surfaces hidden by opaque surfaces above them are
+ * culled and surfaces that are fully opaque are flagged so they can be
+ * drawn without blending.
+ */
+static void wstRendererGLCullSurfaces( WstRendererGL *renderer, WstRect *clip )
+{
+   WstRect occluders[MAX_OCCLUDERS];
+   int occluderCount= 0;
+
+   for( int i= renderer->surfaces.size()-1; i >= 0; --i )
+   {
+      WstRenderSurface *surface= renderer->surfaces[i];
+      WstRect opaque[MAX_OCCLUDERS];
+      int opaqueCount;
+
+      surface->occluded= true;
+      surface->drawOpaque= false;
+
+      if ( !surface->visible || !wstRendererGLSurfaceHasContent( surface ) )
+      {
+         continue;
+      }
+
+      wstRendererGLGetSurfaceRect( surface, &surface->drawRect );
+      wstRectIntersect( &surface->drawRect, clip );
+      for( int j= 0; j < occluderCount; ++j )
+      {
+         wstRectTrim( &surface->drawRect, &occluders[j] );
+      }
+      if ( (surface->drawRect.width <= 0) || (surface->drawRect.height <= 0) )
+      {
+         continue;
+      }
+      surface->occluded= false;
+
+      opaqueCount= wstRendererGLGetOpaqueRects( surface, opaque, MAX_OCCLUDERS, &surface->drawOpaque );
+      for( int j= 0; (j < opaqueCount) && (occluderCount < MAX_OCCLUDERS); ++j )
+      {
+         occluders[occluderCount++]= opaque[j];
+      }
    }
 }
 
@@ -1826,7 +3086,6 @@ static WstShader* wstRendererGLCreateShader( WstRendererGL *renderer, int shader
    const char *typeName= 0, *src= 0;
    GLint shader, status, len;
    bool yuv= (shaderType == WstShaderType_yuv);
-   bool noalpha;
 
    shaderNew= (WstShader*)calloc( 1, sizeof(WstShader));
    if ( !shaderNew )
@@ -1841,7 +3100,6 @@ static WstShader* wstRendererGLCreateShader( WstRendererGL *renderer, int shader
    shaderNew->vertShader= GL_NONE;
    shaderNew->uniRes= -1;
    shaderNew->uniMatrix= -1;
-   shaderNew->uniAlpha= -1;
    shaderNew->uniTexture= -1;
    shaderNew->uniTextureuv= -1;
 
@@ -1851,7 +3109,6 @@ static WstShader* wstRendererGLCreateShader( WstRendererGL *renderer, int shader
       {
          type= GL_FRAGMENT_SHADER;
          typeName= "fragment";
-         noalpha= true;
          if ( yuv )
          {
             src= (renderer->haveDmaBufImport ? fShaderText_Y_UV : fShaderTextYUV);
@@ -1863,7 +3120,6 @@ static WstShader* wstRendererGLCreateShader( WstRendererGL *renderer, int shader
          else
          {
             src= fShaderText;
-            noalpha= false;
          }
       }
       else
@@ -1912,6 +3168,8 @@ static WstShader* wstRendererGLCreateShader( WstRendererGL *renderer, int shader
       shaderNew->attrTexcoorduv= 2;
       glBindAttribLocation(shaderNew->program, shaderNew->attrTexcoorduv, "texcoorduv");
    }
+   shaderNew->attrOpacity= 3;
+   glBindAttribLocation(shaderNew->program, shaderNew->attrOpacity, "opacity");
 
    glLinkProgram(shaderNew->program);
    glGetProgramiv(shaderNew->program, GL_LINK_STATUS, &status);
@@ -1922,129 +3180,407 @@ static WstShader* wstRendererGLCreateShader( WstRendererGL *renderer, int shader
       goto exit;
    }
 
-   shaderNew->uniRes= glGetUniformLocation(shaderNew->program, "resolution");
-   if ( shaderNew->uniRes == -1 )
+   shaderNew->uniRes= glGetUniformLocation(shaderNew->program, "resolution");
+   if ( shaderNew->uniRes == -1 )
+   {
+      printf("wstRendererGLCreateShader: uniformn 'resolution' location error\n");
+      goto exit;
+   }
+
+   shaderNew->uniMatrix= glGetUniformLocation(shaderNew->program, "matrix");
+   if ( shaderNew->uniMatrix == -1 )
+   {
+      printf("wstRendererGLCreateShader: uniformn 'matrix' location error\n");
+      goto exit;
+   }
+
+   shaderNew->uniTexture= glGetUniformLocation(shaderNew->program, "texture");
+   if ( shaderNew->uniTexture == -1 )
+   {
+      printf("wstRendererGLCreateShader: uniformn 'texture' location error\n");
+      goto exit;
+   }
+
+   if ( yuv )
+   {
+      shaderNew->uniTextureuv= glGetUniformLocation(shaderNew->program, "textureuv");
+      if ( shaderNew->uniTextureuv == -1 )
+      {
+         printf("wstRendererGLCreateShader: uniformn 'textureuv' location error\n");
+         goto exit;
+      }
+   }
+
+exit:
+
+   return shaderNew;
+}
+
+static void wstRendererGLDestroyShader( WstShader *shader )
+{
+   if ( shader )
+   {
+      if ( shader->program != GL_NONE )
+      {
+         if ( shader->fragShader != GL_NONE )
+         {
+            glDetachShader( shader->program, shader->fragShader );
+            glDeleteShader( shader->fragShader );
+            shader->fragShader= GL_NONE;
+         }
+         if ( shader->vertShader != GL_NONE )
+         {
+            glDetachShader( shader->program, shader->vertShader );
+            glDeleteShader( shader->vertShader );
+            shader->vertShader= GL_NONE;
+         }
+         glDeleteProgram( shader->program );
+         shader->program= GL_NONE;
+      }
+      free( shader );
+   }
+}
+
+static void wstRendererGLShaderUse( WstShader *shader, int width, int height, float* matrix )
+{
+    glUseProgram( shader->program );
+    glUniformMatrix4fv( shader->uniMatrix, 1, GL_FALSE, matrix );
+    glUniform2f( shader->uniRes, width, height );
+    glUniform1i( shader->uniTexture, 1 );
+    if ( shader->isYUV )
+    {
+       glUniform1i( shader->uniTextureuv, 2 );
+    }
+}
+
+static void wstRendererTerm( WstRenderer *renderer )
+{
+   WstRendererGL *rendererGL= (WstRendererGL*)renderer->renderer;
+   if ( rendererGL )
+   {
+      wstRendererGLDestroy( rendererGL );
+      renderer->renderer= 0;
+   }
+}
+
+#ifdef WST_RENDER_SCANOUT
+static bool wstRendererGLScanoutFormat( uint32_t format )
+{
+   // Only formats without alpha: nothing composed beneath can show through
+   switch( format )
+   {
+      case DRM_FORMAT_XRGB8888:
+      case DRM_FORMAT_XBGR8888:
+      case DRM_FORMAT_RGB565:
+      case DRM_FORMAT_NV12:
+      case DRM_FORMAT_NV21:
+      case DRM_FORMAT_YUV420:
+         return true;
+      default:
+         return false;
+   }
+}
+
+static void wstRendererGLSetScanoutResource( WstRenderSurface *surface, struct wl_resource *resource )
+{
+   if ( surface->scanoutResource )
+   {
+      wl_list_remove( &surface->scanoutResourceDestroyListener.link );
+      surface->scanoutResource= 0;
+   }
+   if ( resource )
+   {
+      surface->scanoutResource= resource;
+      surface->scanoutResourceDestroyListener.notify= wstRendererGLScanoutResourceDestroyed;
+      wl_resource_add_destroy_listener( resource, &surface->scanoutResourceDestroyListener );
+   }
+}
+
+static void wstRendererGLScanoutResourceDestroyed( struct wl_listener *listener, void *data )
+{
+   WstRenderSurface *surface= wl_container_of( listener, surface, scanoutResourceDestroyListener );
+
+   // The buffer fds are gone with it so the surface can't be given to the plane again
+   surface->scanoutResource= 0;
+   surface->scanoutCapable= false;
+   surface->scanoutPending= false;
+}
+
+/*
+ * The refresh thread reports retired frames through a pipe so buffers are
+ * released on the compositor thread, from its event loop.
+ */
+static bool wstRendererGLScanoutRetireInit( WstRendererGL *renderer )
+{
+   bool result= false;
+   struct wl_event_loop *loop;
+
+   if ( renderer->scanoutRetireSource )
+   {
+      result= true;
+      goto exit;
+   }
+
+   if ( pipe2( renderer->scanoutRetirePipe, O_CLOEXEC|O_NONBLOCK ) )
    {
-      printf("wstRendererGLCreateShader: uniformn 'resolution' location error\n");
+      printf("wstRendererGLScanoutRetireInit: pipe failed: errno %d\n", errno);
       goto exit;
    }
 
-   shaderNew->uniMatrix= glGetUniformLocation(shaderNew->program, "matrix");
-   if ( shaderNew->uniMatrix == -1 )
+   loop= wl_display_get_event_loop( renderer->renderer->display );
+   renderer->scanoutRetireSource= wl_event_loop_add_fd( loop, renderer->scanoutRetirePipe[0], WL_EVENT_READABLE,
+                                                        wstRendererGLScanoutRetireEvent, renderer );
+   if ( !renderer->scanoutRetireSource )
    {
-      printf("wstRendererGLCreateShader: uniformn 'matrix' location error\n");
+      printf("wstRendererGLScanoutRetireInit: unable to add event source\n");
+      close( renderer->scanoutRetirePipe[0] );
+      close( renderer->scanoutRetirePipe[1] );
       goto exit;
    }
 
-   shaderNew->uniAlpha= glGetUniformLocation(shaderNew->program, "alpha");
-   if ( (shaderNew->uniAlpha == -1) && !noalpha )
+   result= true;
+
+exit:
+   return result;
+}
+
+static void wstRendererGLScanoutRetireTerm( WstRendererGL *renderer )
+{
+   if ( renderer->scanoutRetireSource )
    {
-      printf("wstRendererGLCreateShader: uniformn 'alpha' location error\n");
-      goto exit;
+      wl_event_source_remove( renderer->scanoutRetireSource );
+      renderer->scanoutRetireSource= 0;
+      close( renderer->scanoutRetirePipe[0] );
+      close( renderer->scanoutRetirePipe[1] );
    }
+}
 
-   shaderNew->uniTexture= glGetUniformLocation(shaderNew->program, "texture");
-   if ( shaderNew->uniTexture == -1 )
+static void wstRendererGLScanoutRetired( void *userData, int frameNumber )
+{
+   WstRendererGL *renderer= (WstRendererGL*)userData;
+
+   // A full pipe already holds a wakeup and the next report supersedes this one
+   if ( write( renderer->scanoutRetirePipe[1], &frameNumber, sizeof(frameNumber) ) != sizeof(frameNumber) )
    {
-      printf("wstRendererGLCreateShader: uniformn 'texture' location error\n");
-      goto exit;
+      WST_TRACE("scanout retire report of frame %d dropped", frameNumber);
    }
+}
 
-   if ( yuv )
+static int wstRendererGLScanoutRetireEvent( int fd, uint32_t mask, void *data )
+{
+   WstRendererGL *renderer= (WstRendererGL*)data;
+   int frameNumber, retired= 0;
+
+   WST_UNUSED(mask);
+   while( read( fd, &frameNumber, sizeof(frameNumber) ) == sizeof(frameNumber) )
    {
-      shaderNew->uniTextureuv= glGetUniformLocation(shaderNew->program, "textureuv");
-      if ( shaderNew->uniTextureuv == -1 )
+      if ( frameNumber > retired )
       {
-         printf("wstRendererGLCreateShader: uniformn 'textureuv' location error\n");
-         goto exit;
+         retired= frameNumber;
       }
    }
+   if ( retired )
+   {
+      wstRendererGLReleaseScanoutHolds( renderer, retired );
+   }
 
-exit:
+   return 0;
+}
 
-   return shaderNew;
+static void wstRendererGLHoldScanoutBuffer( WstRendererGL *renderer, struct wl_resource *resource, int frameNumber )
+{
+   WstScanoutHold *hold;
+
+   for( std::vector<WstScanoutHold*>::iterator it= renderer->scanoutHolds.begin();
+        it != renderer->scanoutHolds.end();
+        ++it )
+   {
+      hold= (*it);
+      if ( hold->resource == resource )
+      {
+         hold->frameNumber= frameNumber;
+         return;
+      }
+   }
+
+   hold= (WstScanoutHold*)calloc( 1, sizeof(WstScanoutHold) );
+   if ( hold )
+   {
+      hold->renderer= renderer;
+      hold->resource= resource;
+      hold->frameNumber= frameNumber;
+      hold->destroyListener.notify= wstRendererGLScanoutHoldDestroyed;
+      wl_resource_add_destroy_listener( resource, &hold->destroyListener );
+      renderer->scanoutHolds.push_back( hold );
+   }
 }
 
-static void wstRendererGLDestroyShader( WstShader *shader )
+static void wstRendererGLReleaseScanoutHolds( WstRendererGL *renderer, int retired )
 {
-   if ( shader )
+   for( std::vector<WstScanoutHold*>::iterator it= renderer->scanoutHolds.begin();
+        it != renderer->scanoutHolds.end(); )
    {
-      if ( shader->program != GL_NONE )
+      WstScanoutHold *hold= (*it);
+      if ( hold->frameNumber <= retired )
       {
-         if ( shader->fragShader != GL_NONE )
-         {
-            glDetachShader( shader->program, shader->fragShader );
-            glDeleteShader( shader->fragShader );
-            shader->fragShader= GL_NONE;
-         }
-         if ( shader->vertShader != GL_NONE )
+         wl_list_remove( &hold->destroyListener.link );
+         if ( hold->releaseOwed )
          {
-            glDetachShader( shader->program, shader->vertShader );
-            glDeleteShader( shader->vertShader );
-            shader->vertShader= GL_NONE;
+            wl_buffer_send_release( hold->resource );
          }
-         glDeleteProgram( shader->program );
-         shader->program= GL_NONE;
+         free( hold );
+         it= renderer->scanoutHolds.erase( it );
+      }
+      else
+      {
+         ++it;
       }
-      free( shader );
    }
 }
 
-static void wstRendererGLShaderDraw( WstShader *shader,
-                                      int width, int height, float* matrix, float alpha,
-                                      GLuint textureId, GLuint textureUVId,
-                                      int count, const float* vc, const float* txc )
+static void wstRendererGLScanoutHoldDestroyed( struct wl_listener *listener, void *data )
 {
-    glUseProgram( shader->program );
-    glUniformMatrix4fv( shader->uniMatrix, 1, GL_FALSE, matrix );
-    glUniform2f( shader->uniRes, width, height );
-    if ( shader->uniAlpha != -1 )
-    {
-       glUniform1f( shader->uniAlpha, alpha );
-    }
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture( GL_TEXTURE_2D, textureId );
-    glUniform1i( shader->uniTexture, 1 );
-    if ( shader->isYUV )
-    {
-       glActiveTexture(GL_TEXTURE2);
-       glBindTexture( GL_TEXTURE_2D, textureUVId );
-       glUniform1i( shader->uniTextureuv, 2 );
-    }
-    glVertexAttribPointer( shader->attrPos, 2, GL_FLOAT, GL_FALSE, 0, vc );
-    glVertexAttribPointer( shader->attrTexcoord, 2, GL_FLOAT, GL_FALSE, 0, txc );
-    if ( shader->isYUV )
-    {
-       glVertexAttribPointer( shader->attrTexcoorduv, 2, GL_FLOAT, GL_FALSE, 0, txc );
-    }
-    glEnableVertexAttribArray( shader->attrPos );
-    glEnableVertexAttribArray( shader->attrTexcoord );
-    if ( shader->isYUV )
-    {
-       glEnableVertexAttribArray( shader->attrTexcoorduv );
-    }
-    glDrawArrays( GL_TRIANGLE_STRIP, 0, count );
-    glDisableVertexAttribArray( shader->attrPos );
-    glDisableVertexAttribArray( shader->attrTexcoord );
-    if ( shader->isYUV )
-    {
-       glDisableVertexAttribArray( shader->attrTexcoorduv );
-    }
+   WstScanoutHold *hold= wl_container_of( listener, hold, destroyListener );
+   WstRendererGL *renderer= hold->renderer;
+
+   for( std::vector<WstScanoutHold*>::iterator it= renderer->scanoutHolds.begin();
+        it != renderer->scanoutHolds.end();
+        ++it )
+   {
+      if ( (*it) == hold )
+      {
+         renderer->scanoutHolds.erase( it );
+         break;
+      }
+   }
+   free( hold );
 }
 
-static void wstRendererTerm( WstRenderer *renderer )
+/*
+ * Show the topmost surface directly on an overlay plane when nothing else
+ * visible lies outside it, so the scene needs no composition.  The graphics
+ * plane is cleared once to let the overlay show through.  Returns true if
+ * the scene is being scanned out and GL drawing should be skipped.
+ */
+static bool wstRendererGLUpdateScanout( WstRendererGL *renderer )
 {
-   WstRendererGL *rendererGL= (WstRendererGL*)renderer->renderer;
-   if ( rendererGL )
+   bool result= false;
+   WstRenderSurface *top= 0;
+   WstRect topRect;
+
+   if ( !renderer->useScanout || renderer->renderer->displayNested )
    {
-      wstRendererGLDestroy( rendererGL );
-      renderer->renderer= 0;
+      goto exit;
+   }
+
+   for( int i= renderer->surfaces.size()-1; i >= 0; --i )
+   {
+      WstRenderSurface *surface= renderer->surfaces[i];
+      WstRect r;
+
+      if ( !surface->visible || !(surface->scanoutCapable || wstRendererGLSurfaceHasContent( surface )) )
+      {
+         continue;
+      }
+
+      wstRendererGLGetSurfaceRect( surface, &r );
+      if ( !top )
+      {
+         if ( !surface->scanoutCapable || (surface->opacity < 1.0) || surface->invertedY ||
+              (r.width <= 0) || (r.height <= 0) )
+         {
+            break;
+         }
+         top= surface;
+         topRect= r;
+      }
+      else if ( (r.x < topRect.x) || (r.y < topRect.y) ||
+                (r.x+r.width > topRect.x+topRect.width) ||
+                (r.y+r.height > topRect.y+topRect.height) )
+      {
+         // Part of this surface is visible so the scene must be composed
+         top= 0;
+         break;
+      }
+   }
+
+   if ( top )
+   {
+      if ( !renderer->scanout && wstRendererGLScanoutRetireInit( renderer ) )
+      {
+         renderer->scanout= WstGLCreateScanout( renderer->glCtx, wstRendererGLScanoutRetired, renderer );
+      }
+      if ( renderer->scanout && top->scanoutResource )
+      {
+         int frameNumber;
+
+         result= true;
+         if ( top->scanoutPending ||
+              !renderer->scanoutActive ||
+              (top != renderer->scanoutSurface) ||
+              (topRect.x != renderer->scanoutRect.x) ||
+              (topRect.y != renderer->scanoutRect.y) ||
+              (topRect.width != renderer->scanoutRect.width) ||
+              (topRect.height != renderer->scanoutRect.height) )
+         {
+            result= WstGLSetScanoutBuffer( renderer->glCtx, renderer->scanout, &top->scanoutBuffer,
+                                           topRect.x, topRect.y, topRect.width, topRect.height, &frameNumber );
+            if ( result )
+            {
+               wstRendererGLHoldScanoutBuffer( renderer, top->scanoutResource, frameNumber );
+               top->scanoutPending= false;
+               renderer->scanoutSurface= top;
+               renderer->scanoutRect= topRect;
+            }
+            else
+            {
+               // Compose this buffer from now on
+               top->scanoutCapable= false;
+            }
+         }
+      }
+   }
+
+   if ( result )
+   {
+      renderer->scanoutHidePending= false;
+      if ( !renderer->scanoutActive )
+      {
+         renderer->scanoutActive= true;
+
+         glViewport( 0, 0, renderer->outputWidth, renderer->outputHeight );
+         glDisable(GL_SCISSOR_TEST);
+         glClearColor( 0.0, 0.0, 0.0, 0.0 );
+         glClear( GL_COLOR_BUFFER_BIT );
+         eglSwapBuffers(renderer->eglDisplay, renderer->eglSurface);
+      }
+
+      // Damage is recomputed in full when composition resumes
+      renderer->frameDamage.x= 0;
+      renderer->frameDamage.y= 0;
+      renderer->frameDamage.width= 0;
+      renderer->frameDamage.height= 0;
    }
+   else if ( renderer->scanoutActive )
+   {
+      // Hide the plane once the composed scene has been swapped
+      renderer->scanoutActive= false;
+      renderer->scanoutHidePending= true;
+      renderer->scanoutSurface= 0;
+      renderer->fullDamage= true;
+   }
+
+exit:
+   return result;
 }
+#endif
 
 static void wstRendererUpdateScene( WstRenderer *renderer )
 {
    WstRendererGL *rendererGL= (WstRendererGL*)renderer->renderer;
+   WstRect repaint;
+   bool partial;
+   long long swapStart;
 
    if ( emitFPS )
    {
@@ -2065,6 +3601,11 @@ static void wstRendererUpdateScene( WstRenderer *renderer )
       }
    }
 
+   // Shm content uploaded at commit time counts towards this frame
+   memset( &rendererGL->frameStats, 0, sizeof(WstRenderStats) );
+   rendererGL->frameStats.bytesUploaded= rendererGL->bytesUploaded;
+   rendererGL->bytesUploaded= 0;
+
    if ( rendererGL->eglSurface == EGL_NO_SURFACE ) return;
 
    if ( (renderer->outputWidth != rendererGL->outputWidth) ||
@@ -2072,6 +3613,7 @@ static void wstRendererUpdateScene( WstRenderer *renderer )
    {
       rendererGL->outputWidth= renderer->outputWidth;
       rendererGL->outputHeight= renderer->outputHeight;
+      rendererGL->fullDamage= true;
       if ( renderer->displayNested )
       {
          if ( rendererGL->nativeWindow )
@@ -2101,8 +3643,40 @@ static void wstRendererUpdateScene( WstRenderer *renderer )
       rendererGL->eglContext= eglGetCurrentContext();
    }
 
+   #ifdef WST_RENDER_SCANOUT
+   if ( wstRendererGLUpdateScanout( rendererGL ) )
+   {
+      wstRendererGLUpdateFrameTiming( rendererGL );
+      return;
+   }
+   #endif
+
+   if ( forceFullRepaint )
+   {
+      rendererGL->fullDamage= true;
+   }
+
+   if ( !rendererGL->fullDamage &&
+        ((rendererGL->frameDamage.width <= 0) || (rendererGL->frameDamage.height <= 0)) )
+   {
+      // Nothing on screen has changed: keep presenting the current front buffer
+      wstRendererGLUpdateFrameTiming( rendererGL );
+      return;
+   }
+
+   partial= wstRendererGLGetRepaintRect( rendererGL, &repaint );
+
    glViewport( 0, 0, renderer->outputWidth, renderer->outputHeight );
    glClearColor( 0.0, 0.0, 0.0, 0.0 );
+   if ( partial )
+   {
+      glEnable(GL_SCISSOR_TEST);
+      glScissor( repaint.x, renderer->outputHeight-(repaint.y+repaint.height), repaint.width, repaint.height );
+   }
+   else
+   {
+      glDisable(GL_SCISSOR_TEST);
+   }
    glClear( GL_COLOR_BUFFER_BIT );
    
    glEnable(GL_BLEND);
@@ -2110,30 +3684,39 @@ static void wstRendererUpdateScene( WstRenderer *renderer )
    glDisable(GL_STENCIL_TEST);
    glDisable(GL_DEPTH_TEST);
    glDisable(GL_CULL_FACE);
-   glDisable(GL_SCISSOR_TEST);
    glBlendFuncSeparate( GL_ONE, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE );
 
+   if ( !partial )
+   {
+      repaint.x= 0;
+      repaint.y= 0;
+      repaint.width= renderer->outputWidth;
+      repaint.height= renderer->outputHeight;
+   }
+   wstRendererGLCullSurfaces( rendererGL, &repaint );
+
    /*
-    * Render surfaces from bottom to top
-    */   
+    * Batch surfaces from bottom to top and draw them
+    */
+   rendererGL->batches.clear();
+   rendererGL->batchQuads.clear();
    int imax= rendererGL->surfaces.size();
    for( int i= 0; i < imax; ++i )
    {
       WstRenderSurface *surface= rendererGL->surfaces[i];
       
-      if ( surface->visible && 
-          (
-            #if defined (WESTEROS_PLATFORM_EMBEDDED) || defined (WESTEROS_HAVE_WAYLAND_EGL)
-            surface->eglImage[0] ||
-            #endif
-            surface->memDirty ||
-            (surface->textureId[0] != GL_NONE)
-          )
-        )
+      if ( !surface->occluded )
       {
-         wstRendererGLRenderSurface( rendererGL, surface );
+         wstRendererGLPrepareSurface( rendererGL, surface );
+         wstRendererGLBatchSurface( rendererGL, surface );
       }
    }
+   wstRendererGLDrawBatches( rendererGL );
+   glDisable(GL_SCISSOR_TEST);
+
+   rendererGL->frameStats.surfaceCount= rendererGL->batchQuads.size();
+   rendererGL->frameStats.bytesUploaded += rendererGL->bytesUploaded;
+   rendererGL->bytesUploaded= 0;
  
    #if defined (WESTEROS_PLATFORM_NEXUS )
    {
@@ -2149,9 +3732,40 @@ static void wstRendererUpdateScene( WstRenderer *renderer )
    }
    #endif
 
+   {
+      struct timespec tm;
+
+      clock_gettime( CLOCK_MONOTONIC, &tm );
+      swapStart= tm.tv_sec*1000000LL+(tm.tv_nsec/1000LL);
+   }
+
    #if defined (WESTEROS_PLATFORM_EMBEDDED) || defined (WESTEROS_HAVE_WAYLAND_EGL)
+   #if defined (EGL_EXT_swap_buffers_with_damage)
+   if ( partial && rendererGL->eglSwapBuffersWithDamage )
+   {
+      EGLint rect[4];
+
+      // Damage rectangles are specified with a bottom left origin
+      rect[0]= repaint.x;
+      rect[1]= renderer->outputHeight-(repaint.y+repaint.height);
+      rect[2]= repaint.width;
+      rect[3]= repaint.height;
+      rendererGL->eglSwapBuffersWithDamage(rendererGL->eglDisplay, rendererGL->eglSurface, rect, 1);
+   }
+   else
+   #endif
    eglSwapBuffers(rendererGL->eglDisplay, rendererGL->eglSurface);
    #endif
+
+   rendererGL->frameStats.swapTime= wstRendererGLUpdateFrameTiming( rendererGL )-swapStart;
+
+   #ifdef WST_RENDER_SCANOUT
+   if ( rendererGL->scanoutHidePending )
+   {
+      rendererGL->scanoutHidePending= false;
+      WstGLHideScanout( rendererGL->glCtx, rendererGL->scanout );
+   }
+   #endif
 }
 
 static WstRenderSurface* wstRendererSurfaceCreate( WstRenderer *renderer )
@@ -2189,20 +3803,31 @@ static void wstRendererSurfaceDestroy( WstRenderer *renderer, WstRenderSurface *
          break;   
       }
    }   
+
+   wstRendererGLAddSurfaceDamage( rendererGL, surface );
    
    wstRendererGLDestroySurface( rendererGL, surface );
 }
 
-static void wstRendererSurfaceCommit( WstRenderer *renderer, WstRenderSurface *surface, struct wl_resource *resource )
+static void wstRendererGLSurfaceCommit( WstRendererGL *rendererGL, WstRenderSurface *surface, struct wl_resource *resource,
+                                        std::vector<WstRect> *damage )
 {
-   WstRendererGL *rendererGL= (WstRendererGL*)renderer->renderer;
    EGLint value;
 
    if ( resource )
    {
+      bool surfaceDamage= true;
+
+      surface->opaqueFormat= false;
+      #ifdef WST_RENDER_SCANOUT
+      surface->scanoutCapable= false;
+      wstRendererGLSetScanoutResource( surface, 0 );
+      #endif
       if ( wl_shm_buffer_get( resource ) )
       {
-         wstRendererGLCommitShm( rendererGL, surface, resource );
+         // Shm commits add damage for just the rectangles that changed
+         wstRendererGLCommitShm( rendererGL, surface, resource, damage );
+         surfaceDamage= false;
       }
       #if defined (WESTEROS_HAVE_WAYLAND_EGL)
       else if ( rendererGL->haveWaylandEGL && 
@@ -2230,20 +3855,59 @@ static void wstRendererSurfaceCommit( WstRenderer *renderer, WstRenderSurface *s
       {
          printf("wstRenderSurfaceCommit: unsupported buffer type\n");
       }
+
+      if ( surfaceDamage )
+      {
+         // Texture storage is now provided by an EGL image
+         surface->texWidth= 0;
+         wstRendererGLAtlasRelease( rendererGL, surface );
+         wstRendererGLAddSurfaceDamage( rendererGL, surface );
+      }
    }
    else
    {
+      wstRendererGLAddSurfaceDamage( rendererGL, surface );
       wstRendererGLFlushSurface( rendererGL, surface );
    }
 }
 
+static void wstRendererSurfaceCommit( WstRenderer *renderer, WstRenderSurface *surface, struct wl_resource *resource )
+{
+   WstRendererGL *rendererGL= (WstRendererGL*)renderer->renderer;
+
+   wstRendererGLSurfaceCommit( rendererGL, surface, resource, 0 );
+}
+
+static void wstRendererSurfaceCommitDamage( WstRenderer *renderer, WstRenderSurface *surface, struct wl_resource *resource,
+                                            std::vector<WstRect> &damage )
+{
+   WstRendererGL *rendererGL= (WstRendererGL*)renderer->renderer;
+
+   wstRendererGLSurfaceCommit( rendererGL, surface, resource, &damage );
+}
+
+static void wstRendererSurfaceSetOpaqueRegion( WstRenderer *renderer, WstRenderSurface *surface, std::vector<WstRect> &rects )
+{
+   WstRendererGL *rendererGL= (WstRendererGL*)renderer->renderer;
+
+   if ( surface )
+   {
+      surface->opaqueRegion= rects;
+      wstRendererGLAddSurfaceDamage( rendererGL, surface );
+   }
+}
+
 static void wstRendererSurfaceSetVisible( WstRenderer *renderer, WstRenderSurface *surface, bool visible )
 {
    WstRendererGL *rendererGL= (WstRendererGL*)renderer->renderer;
 
    if ( surface )
    {
-      surface->visible= visible;
+      if ( visible != surface->visible )
+      {
+         surface->visible= visible;
+         wstRendererGLAddSurfaceDamage( rendererGL, surface );
+      }
    }
 }
 
@@ -2268,6 +3932,7 @@ static void wstRendererSurfaceSetGeometry( WstRenderer *renderer, WstRenderSurfa
    
    if ( surface )
    {
+      wstRendererGLAddSurfaceDamage( rendererGL, surface );
       if ( (width != surface->width) || (height != surface->height) )
       {
          surface->sizeOverride= true;
@@ -2276,6 +3941,7 @@ static void wstRendererSurfaceSetGeometry( WstRenderer *renderer, WstRenderSurfa
       surface->y= y;
       surface->width= width;
       surface->height= height;
+      wstRendererGLAddSurfaceDamage( rendererGL, surface );
    }
 }
 
@@ -2298,7 +3964,11 @@ static void wstRendererSurfaceSetOpacity( WstRenderer *renderer, WstRenderSurfac
    
    if ( surface )
    {
-      surface->opacity= opacity;
+      if ( opacity != surface->opacity )
+      {
+         surface->opacity= opacity;
+         wstRendererGLAddSurfaceDamage( rendererGL, surface );
+      }
    }
 }
 
@@ -2348,6 +4018,8 @@ static void wstRendererSurfaceSetZOrder( WstRenderer *renderer, WstRenderSurface
          ++it;
       }
       rendererGL->surfaces.insert(it,surface);
+
+      wstRendererGLAddSurfaceDamage( rendererGL, surface );
    }
 }
 
@@ -2439,6 +4111,77 @@ exit:
 #endif
 
 
+static bool wstRendererGetPresentationInfo( WstRenderer *renderer, WstPresentationInfo *info )
+{
+   WstRendererGL *rendererGL= (WstRendererGL*)renderer->renderer;
+   bool result= false;
+
+   #if defined (WESTEROS_PLATFORM_EMBEDDED) && defined (WESTEROS_GL_VBLANK_INFO)
+   if ( !renderer->displayNested )
+   {
+      WstGLVBlankInfo vblankInfo;
+
+      if ( WstGLGetVBlankInfo( rendererGL->glCtx, &vblankInfo ) )
+      {
+         info->vblankTime= vblankInfo.vblankTime;
+         info->vblankInterval= vblankInfo.vblankInterval;
+         info->vblankCount= vblankInfo.vblankCount;
+         info->hwClock= true;
+         // The refresh thread flips to the new buffer on the vblank following
+         // the swap, so it becomes visible one vblank later
+         info->presentLatency= 1;
+         result= true;
+      }
+   }
+   #endif
+
+   if ( !result && rendererGL->swapCount )
+   {
+      // Fall back to the time at which the last eglSwapBuffers completed
+      info->vblankTime= rendererGL->swapTime;
+      info->vblankInterval= 0;
+      info->vblankCount= rendererGL->swapCount;
+      info->hwClock= false;
+      info->presentLatency= 0;
+      result= true;
+   }
+
+   return result;
+}
+
+static bool wstRendererGetRenderStats( WstRenderer *renderer, WstRenderStats *stats )
+{
+   WstRendererGL *rendererGL= (WstRendererGL*)renderer->renderer;
+
+   *stats= rendererGL->frameStats;
+
+   return true;
+}
+
+#ifdef WST_RENDER_SCANOUT
+static bool wstRendererRetainBuffer( WstRenderer *renderer, struct wl_resource *resource )
+{
+   bool result= false;
+   WstRendererGL *rendererGL= (WstRendererGL*)renderer->renderer;
+
+   for( std::vector<WstScanoutHold*>::iterator it= rendererGL->scanoutHolds.begin();
+        it != rendererGL->scanoutHolds.end();
+        ++it )
+   {
+      WstScanoutHold *hold= (*it);
+      if ( hold->resource == resource )
+      {
+         // Still on screen or awaiting the flip that replaces it
+         hold->releaseOwed= true;
+         result= true;
+         break;
+      }
+   }
+
+   return result;
+}
+#endif
+
 #ifndef WESTEROS_PLATFORM_QEMUX86
 static void wstRendererResolutionChangeBegin( WstRenderer *renderer )
 {
@@ -2489,6 +4232,8 @@ static void wstRendererResolutionChangeEnd( WstRenderer *renderer )
       }
       #endif
       #endif
+
+      rendererGL->fullDamage= true;
    }
 }
 #endif
@@ -2510,6 +4255,13 @@ int renderer_init( WstRenderer *renderer, int argc, char **argv )
       renderer->surfaceCreate= wstRendererSurfaceCreate;
       renderer->surfaceDestroy= wstRendererSurfaceDestroy;
       renderer->surfaceCommit= wstRendererSurfaceCommit;
+      renderer->surfaceCommitDamage= wstRendererSurfaceCommitDamage;
+      renderer->surfaceSetOpaqueRegion= wstRendererSurfaceSetOpaqueRegion;
+      renderer->getPresentationInfo= wstRendererGetPresentationInfo;
+      renderer->getRenderStats= wstRendererGetRenderStats;
+      #ifdef WST_RENDER_SCANOUT
+      renderer->retainBuffer= wstRendererRetainBuffer;
+      #endif
       renderer->surfaceSetVisible= wstRendererSurfaceSetVisible;
       renderer->surfaceGetVisible= wstRendererSurfaceGetVisible;
       renderer->surfaceSetGeometry= wstRendererSurfaceSetGeometry;
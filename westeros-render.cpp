@@ -184,6 +184,27 @@ void WstRendererSurfaceCommit( WstRenderer *renderer, WstRenderSurface *surface,
    renderer->surfaceCommit( renderer, surface, resource );
 }
 
+void WstRendererSurfaceCommitDamage( WstRenderer *renderer, WstRenderSurface *surface, struct wl_resource *resource,
+                                     std::vector<WstRect> &damage )
+{
+   if ( renderer->surfaceCommitDamage )
+   {
+      renderer->surfaceCommitDamage( renderer, surface, resource, damage );
+   }
+   else
+   {
+      renderer->surfaceCommit( renderer, surface, resource );
+   }
+}
+
+void WstRendererSurfaceSetOpaqueRegion( WstRenderer *renderer, WstRenderSurface *surface, std::vector<WstRect> &rects )
+{
+   if ( renderer->surfaceSetOpaqueRegion )
+   {
+      renderer->surfaceSetOpaqueRegion( renderer, surface, rects );
+   }
+}
+
 void WstRendererSurfaceSetVisible( WstRenderer *renderer, WstRenderSurface *surface, bool visible )
 {
    renderer->surfaceSetVisible( renderer, surface, visible );
@@ -280,3 +301,39 @@ void WstRendererResolutionChangeEnd( WstRenderer *renderer )
    }
 }
 
+bool WstRendererGetPresentationInfo( WstRenderer *renderer, WstPresentationInfo *info )
+{
+   bool result= false;
+
+   if ( renderer->getPresentationInfo )
+   {
+      result= renderer->getPresentationInfo( renderer, info );
+   }
+
+   return result;
+}
+
+bool WstRendererGetRenderStats( WstRenderer *renderer, WstRenderStats *stats )
+{
+   bool result= false;
+
+   if ( renderer->getRenderStats )
+   {
+      result= renderer->getRenderStats( renderer, stats );
+   }
+
+   return result;
+}
+
+bool WstRendererRetainBuffer( WstRenderer *renderer, struct wl_resource *resource )
+{
+   bool result= false;
+
+   if ( renderer->retainBuffer )
+   {
+      result= renderer->retainBuffer( renderer, resource );
+   }
+
+   return result;
+}
+
@@ -65,6 +65,22 @@ typedef enum _WstHints
    WstHints_hidden= (1<<5),
 } WstHints;
 
+typedef struct _WstPresentationInfo
+{
+   long long vblankTime;            // CLOCK_MONOTONIC time in microseconds of the most recent vblank/presentation
+   long long vblankInterval;        // refresh interval in microseconds, 0 if unknown
+   unsigned long long vblankCount;  // vblank sequence count, 0 if unknown
+   bool hwClock;                    // true if vblankTime comes from the display hardware
+   int presentLatency;              // vblanks from the first vblank after a frame is rendered until it is scanned out
+} WstPresentationInfo;
+
+typedef struct _WstRenderStats
+{
+   int surfaceCount;                // surfaces drawn by the most recent scene update
+   long long bytesUploaded;         // bytes of pixel data uploaded for the most recent scene update
+   long long swapTime;              // microseconds spent presenting the most recent scene update
+} WstRenderStats;
+
 typedef struct _WstRenderer WstRenderer;
 typedef struct _WstRenderSurface WstRenderSurface;
 typedef struct _WstNestedConnection WstNestedConnection;
@@ -75,6 +91,9 @@ typedef void (*WSTMethodUpdateScene)( WstRenderer *renderer );
 typedef WstRenderSurface* (*WSTMethodSurfaceCreate)( WstRenderer *renderer );
 typedef void (*WSTMethodSurfaceDestroy)( WstRenderer *renderer, WstRenderSurface *surf );
 typedef void (*WSTMethodSurfaceCommit)( WstRenderer *renderer, WstRenderSurface *surface, struct wl_resource *resource );
+typedef void (*WSTMethodSurfaceCommitDamage)( WstRenderer *renderer, WstRenderSurface *surface, struct wl_resource *resource,
+                                              std::vector<WstRect> &damage );
+typedef void (*WSTMethodSurfaceSetOpaqueRegion)( WstRenderer *renderer, WstRenderSurface *surface, std::vector<WstRect> &rects );
 typedef void (*WSTMethodSurfaceSetVisible)( WstRenderer *renderer, WstRenderSurface *surface, bool visible );
 typedef bool (*WSTMethodSurfaceGetVisible)( WstRenderer *renderer, WstRenderSurface *surface, bool *visible );
 typedef void (*WSTMethodSurfaceSetGeometry)( WstRenderer *renderer, WstRenderSurface *surface, int x, int y, int width, int height );
@@ -90,6 +109,9 @@ typedef void (*WSTMethodDelegateUpdateScene)( WstRenderer *renderer, std::vector
 typedef void (*WSTMethodHolePunch)( WstRenderer *renderr, int x, int y, int width, int height );
 typedef void (*WSTMethodResolutionChangeBegin)( WstRenderer *renderer );
 typedef void (*WSTMethodResolutionChangeEnd)( WstRenderer *renderer );
+typedef bool (*WSTMethodGetPresentationInfo)( WstRenderer *renderer, WstPresentationInfo *info );
+typedef bool (*WSTMethodGetRenderStats)( WstRenderer *renderer, WstRenderStats *stats );
+typedef bool (*WSTMethodRetainBuffer)( WstRenderer *renderer, struct wl_resource *resource );
 
 typedef struct _WstRenderer
 {
@@ -119,6 +141,11 @@ typedef struct _WstRenderer
    WSTMethodHolePunch holePunch;
    WSTMethodResolutionChangeBegin resolutionChangeBegin;
    WSTMethodResolutionChangeEnd resolutionChangeEnd;
+   WSTMethodSurfaceCommitDamage surfaceCommitDamage;
+   WSTMethodSurfaceSetOpaqueRegion surfaceSetOpaqueRegion;
+   WSTMethodGetPresentationInfo getPresentationInfo;
+   WSTMethodGetRenderStats getRenderStats;
+   WSTMethodRetainBuffer retainBuffer;
 
    // For nested composition
    WstNestedConnection *nc;
@@ -144,6 +171,22 @@ void WstRendererUpdateScene( WstRenderer *renderer );
 WstRenderSurface* WstRendererSurfaceCreate( WstRenderer *renderer );
 void WstRendererSurfaceDestroy( WstRenderer *renderer, WstRenderSurface *surface );
 void WstRendererSurfaceCommit( WstRenderer *renderer, WstRenderSurface *surface, struct wl_resource *resource );
+
+/*
+ * Commit a buffer along with the list of rectangles, in buffer coordinates, that
+ * have changed since the previous commit.  Renderers that do not supply the
+ * surfaceCommitDamage method treat every commit as full surface damage.
+ */
+void WstRendererSurfaceCommitDamage( WstRenderer *renderer, WstRenderSurface *surface, struct wl_resource *resource,
+                                     std::vector<WstRect> &damage );
+
+/*
+ * Set the region of a surface, in surface coordinates, whose content is fully
+ * opaque.  Renderers may use it to skip drawing surfaces hidden beneath opaque
+ * surfaces and to draw opaque surfaces without blending.
+ */
+void WstRendererSurfaceSetOpaqueRegion( WstRenderer *renderer, WstRenderSurface *surface, std::vector<WstRect> &rects );
+
 void WstRendererSurfaceSetVisible( WstRenderer *renderer, WstRenderSurface *surface, bool visible );
 bool WstRendererSurfaceGetVisible( WstRenderer *renderer, WstRenderSurface *surface, bool *visible );
 void WstRendererSurfaceSetGeometry( WstRenderer *renderer, WstRenderSurface *surface, int x, int y, int width, int height );
@@ -159,5 +202,19 @@ void WstRendererDelegateUpdateScene( WstRenderer *renderer, std::vector<WstRect>
 void WstRendererResolutionChangeBegin( WstRenderer *renderer );
 void WstRendererResolutionChangeEnd( WstRenderer *renderer );
 
+/*
+ * Obtain the timing of the most recent vblank or presentation of output
+ * composed by the renderer.  Returns false if the renderer can't supply it.
+ */
+bool WstRendererGetPresentationInfo( WstRenderer *renderer, WstPresentationInfo *info );
+bool WstRendererGetRenderStats( WstRenderer *renderer, WstRenderStats *stats );
+
+/*
+ * Called when a buffer would be released to its client.  Returns true if the
+ * renderer is still displaying it, in which case the renderer sends the
+ * release itself once the buffer is no longer in use.
+ */
+bool WstRendererRetainBuffer( WstRenderer *renderer, struct wl_resource *resource );
+
 #endif
 
@@ -3028,6 +3028,11 @@ void gst_westeros_sink_soc_update_video_position( GstWesterosSink *sink )
    }
 }
 
+void gst_westeros_sink_soc_window_change( GstWesterosSink *sink )
+{
+   WESTEROS_UNUSED(sink);
+}
+
 gboolean gst_westeros_sink_soc_query( GstWesterosSink *sink, GstQuery *query )
 {
    gboolean rv = FALSE;
@@ -120,6 +120,9 @@ void gst_westeros_sink_soc_term (GstBaseSink *base_sink)
 void gst_westeros_sink_soc_update_video_position(GstWesterosSink *sink)
 {
 }
+void gst_westeros_sink_soc_window_change(GstWesterosSink *sink)
+{
+}
 void gst_westeros_sink_soc_set_video_path( GstWesterosSink *sink, uint32_t new_pathway)
 {
    WESTEROS_UNUSED(sink);
@@ -48,6 +48,7 @@
 #endif
 
 #include "westeros-sink.h"
+#include "../../westeros-sink/westeros-sink-copy.c"
 
 #define DEFAULT_VIDEO_SERVER "video"
 #define DEFAULT_OVERSCAN (0)
@@ -544,6 +545,8 @@ gboolean gst_westeros_sink_soc_init( GstWesterosSink *sink )
          sink->soc.drmBuffer[i].fd[1]= -1;
          sink->soc.drmBuffer[i].handle[0]= 0;
          sink->soc.drmBuffer[i].handle[1]= 0;
+         sink->soc.drmBuffer[i].map[0]= 0;
+         sink->soc.drmBuffer[i].map[1]= 0;
          sink->soc.drmBuffer[i].gstbuf= 0;
          sink->soc.drmBuffer[i].localAlloc= false;
       }
@@ -1201,7 +1204,6 @@ void gst_westeros_sink_soc_render( GstWesterosSink *sink, GstBuffer *buffer )
 
                if ( !importedBuffer )
                {
-                  unsigned char *data;
                   unsigned char *Y, *U, *V;
                   int Ystride, Ustride, Vstride;
                   #ifdef USE_GST_VIDEO
@@ -1255,64 +1257,21 @@ void gst_westeros_sink_soc_render( GstWesterosSink *sink, GstBuffer *buffer )
                         break;
                   }
 
-                  if ( Y )
+                  if ( Y && drmBuff->map[0] && drmBuff->map[1] )
                   {
-                     data= (unsigned char*)mmap( NULL, drmBuff->size[0], PROT_READ | PROT_WRITE, MAP_SHARED, sink->soc.drmFd, drmBuff->offset[0] );
-                     if ( data )
-                     {
-                        int row;
-                        unsigned char *destRow= data;
-                        unsigned char *srcYRow= Y;
-                        for( row= 0; row < sink->soc.frameHeight; ++row )
-                        {
-                           memcpy( destRow, srcYRow, Ystride );
-                           destRow += drmBuff->pitch[0];
-                           srcYRow += Ystride;
-                        }
-                        munmap( data, drmBuff->size[0] );
-                     }
+                     int chromaHeight= (sink->soc.frameHeight+1)/2;
+
+                     wstCopyPlane( drmBuff->map[0], drmBuff->pitch[0], Y, Ystride, sink->soc.frameWidth, sink->soc.frameHeight );
                      if ( U && !V )
                      {
-                        data= (unsigned char*)mmap( NULL, drmBuff->size[1], PROT_READ | PROT_WRITE, MAP_SHARED, sink->soc.drmFd, drmBuff->offset[1] );
-                        if ( data )
-                        {
-                           int row;
-                           unsigned char *destRow= data;
-                           unsigned char *srcURow= U;
-                           for( row= 0; row < sink->soc.frameHeight; row += 2 )
-                           {
-                              memcpy( destRow, srcURow, Ustride );
-                              destRow += drmBuff->pitch[1];
-                              srcURow += Ustride;
-                           }
-                           munmap( data, drmBuff->size[1] );
-                        }
+                        wstCopyPlane( drmBuff->map[1], drmBuff->pitch[1], U, Ustride, (sink->soc.frameWidth+1)&~1, chromaHeight );
                      }
                      if ( U && V )
                      {
-                        data= (unsigned char*)mmap( NULL, drmBuff->size[1], PROT_READ | PROT_WRITE, MAP_SHARED, sink->soc.drmFd, drmBuff->offset[1] );
-                        if ( data )
-                        {
-                           int row, col;
-                           unsigned char *dest, *destRow= data;
-                           unsigned char *srcU, *srcURow= U;
-                           unsigned char *srcV, *srcVRow= V;
-                           for( row= 0; row < sink->soc.frameHeight; row += 2 )
-                           {
-                              dest= destRow;
-                              srcU= srcURow;
-                              srcV= srcVRow;
-                              for( col= 0; col < sink->soc.frameWidth; col += 2 )
-                              {
-                                 *dest++= *srcU++;
-                                 *dest++= *srcV++;
-                              }
-                              destRow += drmBuff->pitch[1];
-                              srcURow += Ustride;
-                              srcVRow += Vstride;
-                           }
-                           munmap( data, drmBuff->size[1] );
-                        }
+                        wstInterleaveUV( drmBuff->map[1], drmBuff->pitch[1],
+                                         U, Ustride,
+                                         V, Vstride,
+                                         (sink->soc.frameWidth+1)/2, chromaHeight );
                      }
                   }
                }
@@ -1628,6 +1587,11 @@ void gst_westeros_sink_soc_update_video_position( GstWesterosSink *sink )
    }
 }
 
+void gst_westeros_sink_soc_window_change( GstWesterosSink *sink )
+{
+   WESTEROS_UNUSED(sink);
+}
+
 gboolean gst_westeros_sink_soc_query( GstWesterosSink *sink, GstQuery *query )
 {
    return FALSE;
@@ -3269,6 +3233,14 @@ static bool drmAllocBuffer( GstWesterosSink *sink, int buffIndex, int width, int
          goto exit;
       }
 
+      drmBuff->map[0]= (unsigned char*)mmap( NULL, drmBuff->size[0], PROT_READ | PROT_WRITE, MAP_SHARED, sink->soc.drmFd, drmBuff->offset[0] );
+      if ( drmBuff->map[0] == MAP_FAILED )
+      {
+         GST_ERROR("mmap failed: errno %d", errno);
+         drmBuff->map[0]= 0;
+         goto exit;
+      }
+
       memset( &createDumb, 0, sizeof(createDumb) );
       createDumb.width= width;
       createDumb.height= height/2;
@@ -3299,6 +3271,14 @@ static bool drmAllocBuffer( GstWesterosSink *sink, int buffIndex, int width, int
          goto exit;
       }
 
+      drmBuff->map[1]= (unsigned char*)mmap( NULL, drmBuff->size[1], PROT_READ | PROT_WRITE, MAP_SHARED, sink->soc.drmFd, drmBuff->offset[1] );
+      if ( drmBuff->map[1] == MAP_FAILED )
+      {
+         GST_ERROR("mmap failed: errno %d", errno);
+         drmBuff->map[1]= 0;
+         goto exit;
+      }
+
       drmBuff->bufferId= buffIndex;
       drmBuff->localAlloc= true;
 
@@ -3332,6 +3312,11 @@ static void drmFreeBuffer( GstWesterosSink *sink, int buffIndex )
          int *fd, *handle;
          fd= &drmBuff->fd[i];
          handle= &drmBuff->handle[i];
+         if ( drmBuff->map[i] )
+         {
+            munmap( drmBuff->map[i], drmBuff->size[i] );
+            drmBuff->map[i]= 0;
+         }
          if ( *fd >= 0 )
          {
             close( *fd );
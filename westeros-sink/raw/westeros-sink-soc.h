@@ -65,6 +65,7 @@ typedef struct _WstDrmBuffer
    gsize size[WST_MAX_PLANE];
    off_t offset[WST_MAX_PLANE];
    gsize pitch[WST_MAX_PLANE];
+   unsigned char *map[WST_MAX_PLANE];
    gint64 frameTime; /* in microseconds */
    int buffIndex;
    int frameNumber;
@@ -199,6 +200,7 @@ gboolean gst_westeros_sink_soc_start_video( GstWesterosSink *sink );
 void gst_westeros_sink_soc_eos_event( GstWesterosSink *sink );
 void gst_westeros_sink_soc_set_video_path( GstWesterosSink *sink, bool useGfxPath );
 void gst_westeros_sink_soc_update_video_position( GstWesterosSink *sink );
+void gst_westeros_sink_soc_window_change( GstWesterosSink *sink );
 gboolean gst_westeros_sink_soc_query( GstWesterosSink *sink, GstQuery *query );
 
 #endif
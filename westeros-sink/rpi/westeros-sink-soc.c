@@ -2267,6 +2267,11 @@ void gst_westeros_sink_soc_update_video_position( GstWesterosSink *sink )
    }
 }
 
+void gst_westeros_sink_soc_window_change( GstWesterosSink *sink )
+{
+   WESTEROS_UNUSED(sink);
+}
+
 void transitionToRenderer( GstWesterosSink *sink, WstOmxComponent *rend )
 {
    OMX_ERRORTYPE omxerr;
@@ -31,6 +31,8 @@
 #include <dirent.h>
 #include <fcntl.h>
 #include <poll.h>
+#include <limits.h>
+#include <sys/eventfd.h>
 
 #ifdef USE_GST_VIDEO
 #include <gst/video/video-color.h>
@@ -49,6 +51,10 @@
 
 #include "westeros-sink.h"
 
+#ifdef ENABLE_SW_DECODE
+#include "../../westeros-sink/westeros-sink-copy.c"
+#endif
+
 #define DEFAULT_DEVICE_NAME "/dev/video10"
 #define DEFAULT_VIDEO_SERVER "video"
 
@@ -61,6 +67,7 @@
 #define MIN_OUTPUT_BUFFERS (3)
 
 #define QOS_INTERVAL (120)
+#define OUTPUT_ERROR_RETRY_TIMEOUT (32)
 #define DEFAULT_OVERSCAN (0)
 
 #define SYNC_VMASTER (0)
@@ -149,6 +156,7 @@ static void wstProcessEvents( GstWesterosSink *sink );
 static void wstGetMaxFrameSize( GstWesterosSink *sink );
 static bool wstGetInputFormats( GstWesterosSink *sink );
 static bool wstGetOutputFormats( GstWesterosSink *sink );
+static int wstInputBufferSize( GstWesterosSink *sink );
 static bool wstSetInputFormat( GstWesterosSink *sink );
 static bool wstSetOutputFormat( GstWesterosSink *sink );
 static bool wstSetupInputBuffers( GstWesterosSink *sink );
@@ -162,6 +170,11 @@ static void wstTearDownOutputBuffersMMap( GstWesterosSink *sink );
 static void wstSetInputMemMode( GstWesterosSink *sink, int mode );
 static void wstSetupInput( GstWesterosSink *sink );
 static int wstGetInputBuffer( GstWesterosSink *sink );
+static void wstReleaseInputBuffer( GstWesterosSink *sink, int buffIndex );
+#ifdef USE_GST1
+static int wstQueueUserPtrInput( GstWesterosSink *sink, GstBuffer *buffer, GstMapInfo *map );
+static gboolean wstProposeAllocation( GstBaseSink *base_sink, GstQuery *query );
+#endif
 static void wstSetOutputMemMode( GstWesterosSink *sink, int mode );
 static void wstSetupOutput( GstWesterosSink *sink );
 static int wstGetOutputBuffer( GstWesterosSink *sink );
@@ -178,6 +191,15 @@ static bool wstSendFrameVideoClientConnection( WstVideoClientConnection *conn, i
 static void wstSendFrameAdvanceVideoClientConnection( WstVideoClientConnection *conn );
 static void wstSendRectVideoClientConnection( WstVideoClientConnection *conn );
 static void wstSendKeepFrameVideoClientConnection( WstVideoClientConnection *conn );
+static void wstSendProtocolVersionVideoClientConnection( WstVideoClientConnection *conn );
+static void wstSetupRingVideoClientConnection( WstVideoClientConnection *conn );
+static void wstTermRingVideoClientConnection( WstVideoClientConnection *conn );
+static void wstDrainRingVideoClientConnection( WstVideoClientConnection *conn );
+static bool wstRegisterBufferVideoClientConnection( WstVideoClientConnection *conn, int bufferId, int fd0, int fd1, int fd2 );
+static void wstSendPurgeVideoClientConnection( WstVideoClientConnection *conn );
+static void wstReleaseBufferVideoClientConnection( WstVideoClientConnection *conn, int bid );
+static void wstProcessReleasesVideoClientConnection( WstVideoClientConnection *conn );
+static bool wstSendRingFrameVideoClientConnection( WstVideoClientConnection *conn, int buffIndex, WstVideoRingFrame *desc, int fd0, int fd1, int fd2 );
 static void wstDecoderReset( GstWesterosSink *sink, bool hard );
 static void wstGetVideoBounds( GstWesterosSink *sink, int *x, int *y, int *w, int *h );
 static void wstSetTextureCrop( GstWesterosSink *sink, int vx, int vy, int vw, int vh );
@@ -185,6 +207,8 @@ static void wstProcessTextureSignal( GstWesterosSink *sink, int buffIndex );
 static bool wstProcessTextureWayland( GstWesterosSink *sink, int buffIndex );
 static int wstFindVideoBuffer( GstWesterosSink *sink, int frameNumber );
 static int wstFindCurrentVideoBuffer( GstWesterosSink *sink );
+static void wstWakeVideoOutputThread( GstWesterosSink *sink );
+static short wstWaitVideoOutputThread( GstWesterosSink *sink, bool waitDecoder, bool waitServer, bool havePriEvent );
 static gpointer wstVideoOutputThread(gpointer data);
 static gpointer wstEOSDetectionThread(gpointer data);
 static gpointer wstDispatchThread(gpointer data);
@@ -653,6 +677,9 @@ void gst_westeros_sink_soc_class_init(GstWesterosSinkClass *klass)
    wstDiscoverVideoDecoder(klass);
 
    gstbasesink_class->preroll= GST_DEBUG_FUNCPTR(prerollSinkSoc);
+   #ifdef USE_GST1
+   gstbasesink_class->propose_allocation= GST_DEBUG_FUNCPTR(wstProposeAllocation);
+   #endif
 
    g_object_class_install_property (gobject_class, PROP_DEVICE,
    g_param_spec_string ("device",
@@ -920,6 +947,11 @@ gboolean gst_westeros_sink_soc_init( GstWesterosSink *sink )
    sink->soc.quitEOSDetectionThread= FALSE;
    sink->soc.quitDispatchThread= FALSE;
    sink->soc.videoOutputThread= NULL;
+   sink->soc.outputWakeFd= eventfd( 0, EFD_NONBLOCK|EFD_CLOEXEC );
+   if ( sink->soc.outputWakeFd < 0 )
+   {
+      GST_WARNING("unable to create output thread eventfd: errno %d", errno);
+   }
    sink->soc.eosDetectionThread= NULL;
    sink->soc.dispatchThread= NULL;
    sink->soc.videoPlaying= FALSE;
@@ -955,6 +987,8 @@ gboolean gst_westeros_sink_soc_init( GstWesterosSink *sink )
    sink->soc.prerollBuffer= 0;
    sink->soc.frameStepOnPreroll= FALSE;
    sink->soc.lowMemoryMode= FALSE;
+   sink->soc.useFrameRing= TRUE;
+   sink->soc.useUserPtrInput= FALSE;
    sink->soc.forceAspectRatio= FALSE;
    sink->soc.secureVideo= FALSE;
    sink->soc.useDmabufOutput= FALSE;
@@ -991,8 +1025,20 @@ gboolean gst_westeros_sink_soc_init( GstWesterosSink *sink )
          sink->soc.swBuffer[i].fd1= -1;
          sink->soc.swBuffer[i].handle0= 0;
          sink->soc.swBuffer[i].handle1= 0;
+         sink->soc.swBuffer[i].map0= 0;
+         sink->soc.swBuffer[i].map1= 0;
+         sink->soc.swBuffer[i].frameHold= 0;
       }
    }
+   /*
+    * Dumb buffers are usually mapped write-combined, which makes the decoder's
+    * reference reads slower than a copy from cached memory.  Only decode into
+    * them on drivers known to give cached mappings.
+    */
+   if ( getenv("WESTEROS_SINK_SW_ZERO_COPY") )
+   {
+      sink->swZeroCopy= TRUE;
+   }
    #endif
 
    sink->useSegmentPosition= TRUE;
@@ -1047,6 +1093,18 @@ gboolean gst_westeros_sink_soc_init( GstWesterosSink *sink )
       printf("westeros-sink: low memory mode\n");
    }
 
+   if ( getenv("WESTEROS_SINK_NO_FRAME_RING") )
+   {
+      sink->soc.useFrameRing= FALSE;
+      printf("westeros-sink: frame ring disabled\n");
+   }
+
+   if ( getenv("WESTEROS_SINK_USE_USERPTR") )
+   {
+      sink->soc.useUserPtrInput= TRUE;
+      printf("westeros-sink: userptr input\n");
+   }
+
    #ifdef USE_AMLOGIC_MESON_MSYNC
    printf("westeros-sink: msync enabled\n");
    #endif
@@ -1069,6 +1127,12 @@ gboolean gst_westeros_sink_soc_init( GstWesterosSink *sink )
 
 void gst_westeros_sink_soc_term( GstWesterosSink *sink )
 {
+   if ( sink->soc.outputWakeFd >= 0 )
+   {
+      close( sink->soc.outputWakeFd );
+      sink->soc.outputWakeFd= -1;
+   }
+
    if ( sink->soc.devname )
    {
       free( sink->soc.devname );
@@ -1131,6 +1195,7 @@ void gst_westeros_sink_soc_set_property(GObject *object, guint prop_id, const GV
                      LOCK(sink);
                      sink->soc.frameAdvance= TRUE;
                      UNLOCK(sink);
+                     wstWakeVideoOutputThread( sink );
                      GST_BASE_SINK(sink)->need_preroll= FALSE;
                      GST_BASE_SINK(sink)->have_preroll= TRUE;
                   }
@@ -1188,6 +1253,7 @@ void gst_westeros_sink_soc_set_property(GObject *object, guint prop_id, const GV
                GST_DEBUG("set show-video-window to %d", show);
                sink->soc.showChanged= TRUE;
                sink->show= show;
+               wstWakeVideoOutputThread( sink );
 
                sink->visible= sink->show;
             }
@@ -1250,6 +1316,7 @@ void gst_westeros_sink_soc_set_property(GObject *object, guint prop_id, const GV
             if ( (keep != sink->soc.keepLastFrame) && sink->soc.conn )
             {
                sink->soc.keepLastFrameChanged= TRUE;
+               wstWakeVideoOutputThread( sink );
             }
             sink->soc.keepLastFrame= keep;
             GST_DEBUG("set keepLastFrame %d", sink->soc.keepLastFrame);
@@ -1463,6 +1530,7 @@ gboolean gst_westeros_sink_soc_paused_to_playing( GstWesterosSink *sink, gboolea
       sink->soc.updateSession= TRUE;
    }
    UNLOCK( sink );
+   wstWakeVideoOutputThread( sink );
 
    return TRUE;
 }
@@ -1473,6 +1541,7 @@ gboolean gst_westeros_sink_soc_playing_to_paused( GstWesterosSink *sink, gboolea
    sink->soc.videoPlaying= FALSE;
    sink->soc.videoPaused= TRUE;
    UNLOCK( sink );
+   wstWakeVideoOutputThread( sink );
 
    if (gst_base_sink_is_async_enabled(GST_BASE_SINK(sink)))
    {
@@ -1961,6 +2030,13 @@ void gst_westeros_sink_soc_render( GstWesterosSink *sink, GstBuffer *buffer )
             memMode= V4L2_MEMORY_MMAP;
          }
          #endif
+         #if defined(USE_GST1) && !defined(WESTEROS_SINK_SVP)
+         if ( (memMode == V4L2_MEMORY_MMAP) && sink->soc.useUserPtrInput )
+         {
+            GST_DEBUG("using userptr for input");
+            memMode= V4L2_MEMORY_USERPTR;
+         }
+         #endif
          wstSetInputMemMode( sink, memMode );
          wstSetupInput( sink );
       }
@@ -2097,10 +2173,12 @@ void gst_westeros_sink_soc_render( GstWesterosSink *sink, GstBuffer *buffer )
       }
       else
       #endif
-      if ( sink->soc.inputMemMode == V4L2_MEMORY_MMAP )
+      if ( (sink->soc.inputMemMode == V4L2_MEMORY_MMAP) ||
+           (sink->soc.inputMemMode == V4L2_MEMORY_USERPTR) )
       {
          #ifdef USE_GST1
          GstMapInfo map;
+         bool imported= false;
          gst_buffer_map(buffer, &map, (GstMapFlags)GST_MAP_READ);
          inSize= map.size;
          inData= map.data;
@@ -2116,6 +2194,23 @@ void gst_westeros_sink_soc_render( GstWesterosSink *sink, GstBuffer *buffer )
             int headerlen;
             avail= inSize;
             offset= 0;
+            #ifdef USE_GST1
+            if ( (sink->soc.inputMemMode == V4L2_MEMORY_USERPTR) &&
+                 !(sink->soc.codecData && !sink->soc.codecDataInjected) )
+            {
+               rc= wstQueueUserPtrInput( sink, buffer, &map );
+               if ( rc < 0 )
+               {
+                  gst_buffer_unmap( buffer, &map);
+                  goto exit;
+               }
+               if ( rc > 0 )
+               {
+                  imported= true;
+                  offset= inSize;
+               }
+            }
+            #endif
             while( offset < inSize )
             {
                guint8 *start;
@@ -2171,6 +2266,20 @@ void gst_westeros_sink_soc_render( GstWesterosSink *sink, GstBuffer *buffer )
                {
                   sink->soc.inBuffers[buffIndex].buf.m.planes[0].bytesused= copylen + headerlen;
                }
+               if ( sink->soc.inputMemMode == V4L2_MEMORY_USERPTR )
+               {
+                  /* Copied into the staging memory allocated for this slot */
+                  if ( sink->soc.isMultiPlane )
+                  {
+                     sink->soc.inBuffers[buffIndex].buf.m.planes[0].m.userptr= (unsigned long)sink->soc.inBuffers[buffIndex].start;
+                     sink->soc.inBuffers[buffIndex].buf.m.planes[0].length= sink->soc.inBuffers[buffIndex].capacity;
+                  }
+                  else
+                  {
+                     sink->soc.inBuffers[buffIndex].buf.m.userptr= (unsigned long)sink->soc.inBuffers[buffIndex].start;
+                     sink->soc.inBuffers[buffIndex].buf.length= sink->soc.inBuffers[buffIndex].capacity;
+                  }
+               }
                rc= IOCTL( sink->soc.v4l2Fd, VIDIOC_QBUF, &sink->soc.inBuffers[buffIndex].buf );
                if ( rc < 0 )
                {
@@ -2186,7 +2295,10 @@ void gst_westeros_sink_soc_render( GstWesterosSink *sink, GstBuffer *buffer )
          }
 
          #ifdef USE_GST1
-         gst_buffer_unmap( buffer, &map);
+         if ( !imported )
+         {
+            gst_buffer_unmap( buffer, &map);
+         }
          #endif
       }
 
@@ -2310,6 +2422,9 @@ void gst_westeros_sink_soc_eos_event( GstWesterosSink *sink )
    WESTEROS_UNUSED(sink);
    if ( swIsSWDecode( sink ) )
    {
+      #ifdef ENABLE_SW_DECODE
+      wstsw_drain( sink );
+      #endif
       g_print("westeros-sink: EOS detected\n");
       gst_westeros_sink_eos_detected( sink );
       return;
@@ -2337,6 +2452,15 @@ void gst_westeros_sink_soc_eos_event( GstWesterosSink *sink )
    }
 }
 
+/*
+ * Called by the common sink code when it has set windowChange so that the
+ * video output thread applies the new window rectangle.
+ */
+void gst_westeros_sink_soc_window_change( GstWesterosSink *sink )
+{
+   wstWakeVideoOutputThread( sink );
+}
+
 void gst_westeros_sink_soc_set_video_path( GstWesterosSink *sink, bool useGfxPath )
 {
    if ( useGfxPath && sink->soc.lowMemoryMode )
@@ -2378,6 +2502,8 @@ void gst_westeros_sink_soc_set_video_path( GstWesterosSink *sink, bool useGfxPat
       }
       sink->soc.framesBeforeHideGfx= sink->soc.hideGfxFramesDelay;
    }
+   wstWakeVideoOutputThread( sink );
+
    if ( needBounds(sink) && sink->vpcSurface )
    {
       /* Use nominal display size provided to us by
@@ -2497,6 +2623,7 @@ static void wstSinkSocStopVideo( GstWesterosSink *sink )
    if ( sink->soc.videoOutputThread || sink->soc.eosDetectionThread || sink->soc.dispatchThread )
    {
       sink->soc.quitVideoOutputThread= TRUE;
+      wstWakeVideoOutputThread( sink );
       sink->soc.quitEOSDetectionThread= TRUE;
       if ( !sink->soc.keepLastFrame )
       {
@@ -2584,6 +2711,7 @@ static void wstSinkSocStopVideo( GstWesterosSink *sink )
    if ( sink->soc.videoOutputThread )
    {
       sink->soc.quitVideoOutputThread= TRUE;
+      wstWakeVideoOutputThread( sink );
       g_thread_join( sink->soc.videoOutputThread );
       sink->soc.videoOutputThread= NULL;
    }
@@ -3244,6 +3372,11 @@ exit:
    return result;
 }
 
+static int wstInputBufferSize( GstWesterosSink *sink )
+{
+   return (sink->soc.lowMemoryMode ? 1*1024*1024 : 4*1024*1024);
+}
+
 static bool wstSetInputFormat( GstWesterosSink *sink )
 {
    bool result= false;
@@ -3253,14 +3386,7 @@ static bool wstSetInputFormat( GstWesterosSink *sink )
 
    bufferType= (sink->soc.isMultiPlane ? V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE : V4L2_BUF_TYPE_VIDEO_OUTPUT);
 
-   if (sink->soc.lowMemoryMode)
-   {
-      bufferSize= 1*1024*1024;
-   }
-   else
-   {
-      bufferSize= 4*1024*1024;
-   }
+   bufferSize= wstInputBufferSize( sink );
 
    memset( &sink->soc.fmtIn, 0, sizeof(struct v4l2_format) );
    sink->soc.fmtIn.type= bufferType;
@@ -3421,6 +3547,16 @@ static bool wstSetupInputBuffers( GstWesterosSink *sink )
    reqbuf.type= bufferType;
    reqbuf.memory= sink->soc.inputMemMode;
    rc= IOCTL( sink->soc.v4l2Fd, VIDIOC_REQBUFS, &reqbuf );
+   if ( (rc < 0) && (sink->soc.inputMemMode == V4L2_MEMORY_USERPTR) )
+   {
+      GST_WARNING("wstSetupInputBuffers: userptr not supported for input: rc %d errno %d: using mmap", rc, errno);
+      sink->soc.inputMemMode= V4L2_MEMORY_MMAP;
+      memset( &reqbuf, 0, sizeof(reqbuf) );
+      reqbuf.count= neededBuffers;
+      reqbuf.type= bufferType;
+      reqbuf.memory= sink->soc.inputMemMode;
+      rc= IOCTL( sink->soc.v4l2Fd, VIDIOC_REQBUFS, &reqbuf );
+   }
    if ( rc < 0 )
    {
       GST_ERROR("wstSetupInputBuffers: failed to request %d mmap buffers for input: rc %d errno %d", neededBuffers, rc, errno);
@@ -3511,6 +3647,20 @@ static bool wstSetupInputBuffers( GstWesterosSink *sink )
             sink->soc.inBuffers[i].planes[j].m.fd= -1;
          }
       }
+      else if ( sink->soc.inputMemMode == V4L2_MEMORY_USERPTR )
+      {
+         /* Staging memory for buffers that can't be queued in place */
+         memLength= (sink->soc.isMultiPlane ? bufIn->m.planes[0].length : bufIn->length);
+         if ( posix_memalign( &bufStart, getpagesize(), memLength ) != 0 )
+         {
+            UNLOCK(sink);
+            GST_ERROR("wstSetupInputBuffers: no memory for input buffer %d staging (%u bytes)", i, memLength);
+            goto exit;
+         }
+         GST_DEBUG("Input buffer: %d userptr staging %p length %d", i, bufStart, memLength);
+         sink->soc.inBuffers[i].start= bufStart;
+         sink->soc.inBuffers[i].capacity= memLength;
+      }
       sink->soc.inBuffers[i].fd= -1;
    }
    UNLOCK(sink);
@@ -3547,15 +3697,16 @@ static void wstTearDownInputBuffers( GstWesterosSink *sink )
       {
          if ( sink->soc.inBuffers[i].start )
          {
-            munmap( sink->soc.inBuffers[i].start, sink->soc.inBuffers[i].capacity );
-         }
-         #ifdef USE_GST_ALLOCATORS
-         if ( sink->soc.inBuffers[i].gstbuf )
-         {
-            gst_buffer_unref( sink->soc.inBuffers[i].gstbuf );
-            sink->soc.inBuffers[i].gstbuf= 0;
+            if ( sink->soc.inputMemMode == V4L2_MEMORY_USERPTR )
+            {
+               free( sink->soc.inBuffers[i].start );
+            }
+            else
+            {
+               munmap( sink->soc.inBuffers[i].start, sink->soc.inBuffers[i].capacity );
+            }
          }
-         #endif
+         wstReleaseInputBuffer( sink, i );
       }
       free( sink->soc.inBuffers );
       sink->soc.inBuffers= 0;
@@ -3821,6 +3972,8 @@ static void wstTearDownOutputBuffers( GstWesterosSink *sink )
 
       sink->soc.bufferIdOutBase += sink->soc.numBuffersOut;
 
+      wstSendPurgeVideoClientConnection( sink->soc.conn );
+
       if ( sink->soc.outputMemMode == V4L2_MEMORY_DMABUF )
       {
          wstTearDownOutputBuffersDmabuf( sink );
@@ -3988,6 +4141,10 @@ static int wstGetInputBuffer( GstWesterosSink *sink )
    {
       sink->soc.inBuffers[bufferIndex].buf.timestamp.tv_sec= -1;
       sink->soc.inBuffers[bufferIndex].buf.timestamp.tv_usec= 0;
+      if ( sink->soc.inputMemMode == V4L2_MEMORY_USERPTR )
+      {
+         wstReleaseInputBuffer( sink, bufferIndex );
+      }
    }
    UNLOCK(sink);
 
@@ -3995,6 +4152,172 @@ static int wstGetInputBuffer( GstWesterosSink *sink )
    return bufferIndex;
 }
 
+/*
+ * Drop the hold on any upstream buffer that was queued in place in an
+ * input slot.  Called with the sink lock held once the decoder has
+ * returned the slot.
+ */
+static void wstReleaseInputBuffer( GstWesterosSink *sink, int buffIndex )
+{
+   WstBufferInfo *binfo= &sink->soc.inBuffers[buffIndex];
+
+   #ifdef USE_GST1
+   if ( binfo->mapped )
+   {
+      gst_buffer_unmap( binfo->gstbuf, &binfo->map );
+      binfo->mapped= false;
+   }
+   #endif
+   if ( binfo->gstbuf )
+   {
+      gst_buffer_unref( binfo->gstbuf );
+      binfo->gstbuf= 0;
+   }
+}
+
+#ifdef USE_GST1
+/*
+ * Queue compressed data to the decoder in place with USERPTR.  This is only
+ * possible when the data is page aligned, fits in a decoder input buffer and
+ * its allocation covers the size of one, as it will for buffers from the pool
+ * offered by wstProposeAllocation.  The buffer stays mapped and referenced until
+ * the decoder returns its slot.  Returns 1 if queued, 0 if the data must be
+ * copied and -1 on error.
+ */
+static int wstQueueUserPtrInput( GstWesterosSink *sink, GstBuffer *buffer, GstMapInfo *map )
+{
+   int result= -1;
+   int rc, buffIndex;
+   WstBufferInfo *binfo;
+
+   LOCK(sink);
+   if ( !sink->soc.inBuffers ||
+        ((uintptr_t)map->data & (getpagesize()-1)) ||
+        (map->size > (gsize)sink->soc.inBuffers[0].capacity) ||
+        (map->maxsize < (gsize)sink->soc.inBuffers[0].capacity) )
+   {
+      UNLOCK(sink);
+      result= 0;
+      goto exit;
+   }
+   UNLOCK(sink);
+
+   buffIndex= wstGetInputBuffer( sink );
+   if ( (buffIndex < 0) && !sink->flushStarted )
+   {
+      GST_ERROR("wstQueueUserPtrInput: unable to get input buffer");
+      goto exit;
+   }
+
+   if ( sink->flushStarted )
+   {
+      goto exit;
+   }
+
+   LOCK(sink);
+   if ( !sink->soc.inBuffers )
+   {
+      UNLOCK(sink);
+      goto exit;
+   }
+   binfo= &sink->soc.inBuffers[buffIndex];
+
+   if (GST_BUFFER_PTS_IS_VALID(buffer) )
+   {
+      GstClockTime timestamp= GST_BUFFER_PTS(buffer) + 500LL;
+      GST_TIME_TO_TIMEVAL( timestamp, binfo->buf.timestamp );
+   }
+   binfo->buf.bytesused= map->size;
+   if ( sink->soc.isMultiPlane )
+   {
+      binfo->buf.m.planes[0].m.userptr= (unsigned long)map->data;
+      binfo->buf.m.planes[0].length= binfo->capacity;
+      binfo->buf.m.planes[0].bytesused= map->size;
+   }
+   else
+   {
+      binfo->buf.m.userptr= (unsigned long)map->data;
+      binfo->buf.length= binfo->capacity;
+   }
+   rc= IOCTL( sink->soc.v4l2Fd, VIDIOC_QBUF, &binfo->buf );
+   if ( rc < 0 )
+   {
+      UNLOCK(sink);
+      GST_ERROR("wstQueueUserPtrInput: queuing input buffer failed: rc %d errno %d", rc, errno );
+      goto exit;
+   }
+   ++sink->soc.inQueuedCount;
+   binfo->queued= true;
+   binfo->gstbuf= gst_buffer_ref(buffer);
+   binfo->map= *map;
+   binfo->mapped= true;
+   UNLOCK(sink);
+
+   GST_LOG("wstQueueUserPtrInput: buffer %p len %d queued in place", buffer, (int)map->size);
+   avProgLog( GST_BUFFER_PTS(buffer), sink->resAssignedId, "StoD", wstInFullness(sink));
+
+   result= 1;
+
+exit:
+   return result;
+}
+
+/*
+ * When userptr input is enabled, offer upstream page aligned memory at
+ * least as large as a decoder input buffer so that compressed data can be
+ * handed to the decoder without a copy.
+ */
+static gboolean wstProposeAllocation( GstBaseSink *base_sink, GstQuery *query )
+{
+   GstWesterosSink *sink= GST_WESTEROS_SINK(base_sink);
+   gboolean result= FALSE;
+   GstAllocationParams params;
+   GstBufferPool *pool;
+   GstStructure *config;
+   GstCaps *caps;
+   gboolean needPool;
+   guint size;
+
+   if ( !sink->soc.useUserPtrInput )
+   {
+      goto exit;
+   }
+
+   gst_query_parse_allocation( query, &caps, &needPool );
+
+   LOCK(sink);
+   size= (sink->soc.inBuffers ? sink->soc.inBuffers[0].capacity : wstInputBufferSize( sink ));
+   UNLOCK(sink);
+
+   gst_allocation_params_init( &params );
+   params.align= getpagesize()-1;
+   gst_query_add_allocation_param( query, NULL, &params );
+
+   if ( needPool && caps )
+   {
+      pool= gst_buffer_pool_new();
+      config= gst_buffer_pool_get_config( pool );
+      gst_buffer_pool_config_set_params( config, caps, size, 0, 0 );
+      gst_buffer_pool_config_set_allocator( config, NULL, &params );
+      if ( gst_buffer_pool_set_config( pool, config ) )
+      {
+         gst_query_add_allocation_pool( query, pool, size, 0, 0 );
+      }
+      else
+      {
+         GST_WARNING("wstProposeAllocation: unable to configure input pool");
+      }
+      gst_object_unref( pool );
+   }
+   GST_DEBUG("wstProposeAllocation: offer %u byte page aligned input buffers (pool %d)", size, needPool);
+
+   result= TRUE;
+
+exit:
+   return result;
+}
+#endif
+
 static void wstSetOutputMemMode( GstWesterosSink *sink, int mode )
 {
    int rc;
@@ -4159,6 +4482,9 @@ static WstVideoClientConnection *wstCreateVideoClientConnection( GstWesterosSink
       conn->socketFd= -1;
       conn->name= name;
       conn->sink= sink;
+      conn->protocolVersion= 1;
+      conn->frameDoorbellFd= -1;
+      conn->releaseDoorbellFd= -1;
 
       workingDir= getenv("XDG_RUNTIME_DIR");
       if ( !workingDir )
@@ -4198,6 +4524,8 @@ static WstVideoClientConnection *wstCreateVideoClientConnection( GstWesterosSink
 
       wstSendResourceVideoClientConnection( conn );
 
+      wstSendProtocolVersionVideoClientConnection( conn );
+
       wstSendKeepFrameVideoClientConnection( conn );
 
       error= false;
@@ -4220,6 +4548,8 @@ static void wstDestroyVideoClientConnection( WstVideoClientConnection *conn )
    {
       conn->addr.sun_path[0]= '\0';
 
+      wstTermRingVideoClientConnection( conn );
+
       if ( conn->socketFd >= 0 )
       {
          close( conn->socketFd );
@@ -4333,6 +4663,8 @@ static void wstSendFlushVideoClientConnection( WstVideoClientConnection *conn )
       int len;
       int sentLen;
 
+      wstDrainRingVideoClientConnection( conn );
+
       msg.msg_name= NULL;
       msg.msg_namelen= 0;
       msg.msg_iov= iov;
@@ -4374,6 +4706,8 @@ static void wstSendEosVideoClientConnection( WstVideoClientConnection *conn )
       int len;
       int sentLen;
 
+      wstDrainRingVideoClientConnection( conn );
+
       msg.msg_name= NULL;
       msg.msg_namelen= 0;
       msg.msg_iov= iov;
@@ -4415,6 +4749,8 @@ static void wstSendPauseVideoClientConnection( WstVideoClientConnection *conn, b
       int len;
       int sentLen;
 
+      wstDrainRingVideoClientConnection( conn );
+
       msg.msg_name= NULL;
       msg.msg_namelen= 0;
       msg.msg_iov= iov;
@@ -4459,6 +4795,8 @@ static void wstSendHideVideoClientConnection( WstVideoClientConnection *conn, bo
       int len;
       int sentLen;
 
+      wstDrainRingVideoClientConnection( conn );
+
       msg.msg_name= NULL;
       msg.msg_namelen= 0;
       msg.msg_iov= iov;
@@ -4511,6 +4849,8 @@ static void wstSendSessionInfoVideoClientConnection( WstVideoClientConnection *c
       int fdToSend= -1;
       #endif
 
+      wstDrainRingVideoClientConnection( conn );
+
       msg.msg_name= NULL;
       msg.msg_namelen= 0;
       msg.msg_iov= iov;
@@ -4587,6 +4927,8 @@ static void wstSendFrameAdvanceVideoClientConnection( WstVideoClientConnection *
       int len;
       int sentLen;
 
+      wstDrainRingVideoClientConnection( conn );
+
       msg.msg_name= NULL;
       msg.msg_namelen= 0;
       msg.msg_iov= iov;
@@ -4630,6 +4972,8 @@ static void wstSendRectVideoClientConnection( WstVideoClientConnection *conn )
       int vx, vy, vw, vh;
       GstWesterosSink *sink= conn->sink;
 
+      wstDrainRingVideoClientConnection( conn );
+
       vx= sink->soc.videoX;
       vy= sink->soc.videoY;
       vw= sink->soc.videoWidth;
@@ -4685,6 +5029,8 @@ static void wstSendRateVideoClientConnection( WstVideoClientConnection *conn )
       int sentLen;
       GstWesterosSink *sink= conn->sink;
 
+      wstDrainRingVideoClientConnection( conn );
+
       msg.msg_name= NULL;
       msg.msg_namelen= 0;
       msg.msg_iov= iov;
@@ -4729,6 +5075,8 @@ static void wstSendKeepFrameVideoClientConnection( WstVideoClientConnection *con
       int len;
       int sentLen;
 
+      wstDrainRingVideoClientConnection( conn );
+
       msg.msg_name= NULL;
       msg.msg_namelen= 0;
       msg.msg_iov= iov;
@@ -4761,54 +5109,398 @@ static void wstSendKeepFrameVideoClientConnection( WstVideoClientConnection *con
    }
 }
 
-#ifdef USE_GENERIC_AVSYNC
-#define AVSYNC_PREFIX "westeros-sink-av-"
-#define AVSYNC_TEMPLATE "/tmp/" AVSYNC_PREFIX "%d-"
-static void wstPruneAVSyncFiles( GstWesterosSink *sink )
+static void wstSendProtocolVersionVideoClientConnection( WstVideoClientConnection *conn )
 {
-   DIR *dir;
-   struct dirent *result;
-   struct stat fileinfo;
-   int prefixLen;
-   int pid, rc;
-   const char *path;
-   char work[34];
-   path= getenv("XDG_RUNTIME_DIR");
-   if ( path )
+   if ( conn )
    {
-      if ( NULL != (dir = opendir( path )) )
+      struct msghdr msg;
+      struct iovec iov[1];
+      unsigned char mbody[8];
+      int len;
+      int sentLen;
+
+      msg.msg_name= NULL;
+      msg.msg_namelen= 0;
+      msg.msg_iov= iov;
+      msg.msg_iovlen= 1;
+      msg.msg_control= 0;
+      msg.msg_controllen= 0;
+      msg.msg_flags= 0;
+
+      len= 0;
+      mbody[len++]= 'V';
+      mbody[len++]= 'S';
+      mbody[len++]= 5;
+      mbody[len++]= 'N';
+      len += putU32( &mbody[len], WST_VIDEO_PROTOCOL_VERSION );
+
+      iov[0].iov_base= (char*)mbody;
+      iov[0].iov_len= len;
+
+      do
       {
-         prefixLen= strlen(AVSYNC_PREFIX);
-         while( NULL != (result = readdir( dir )) )
-         {
-            if ( (result->d_type != DT_DIR) &&
-                !strncmp(result->d_name, AVSYNC_PREFIX, prefixLen) )
-            {
-               snprintf( work, sizeof(work), "%s/%s", path, result->d_name);
-               if ( sscanf( work, AVSYNC_TEMPLATE, &pid ) == 1 )
-               {
-                  // Check if the pid of this temp file is still valid
-                  snprintf(work, sizeof(work), "/proc/%d", pid);
-                  rc= stat( work, &fileinfo );
-                  if ( rc )
-                  {
-                     // The pid is not valid, delete the file
-                     snprintf( work, sizeof(work), "%s/%s", path, result->d_name);
-                     GST_DEBUG("removing temp file: %s", work);
-                     remove( work );
-                  }
-               }
-            }
-         }
+         sentLen= sendmsg( conn->socketFd, &msg, MSG_NOSIGNAL );
+      }
+      while ( (sentLen < 0) && (errno == EINTR));
 
-         closedir( dir );
+      if ( sentLen == len )
+      {
+         GST_LOG("sent protocol version %d to video server", WST_VIDEO_PROTOCOL_VERSION);
       }
    }
 }
 
-static AVSyncCtx* wstCreateAVSyncCtx( GstWesterosSink *sink )
+/*
+ * Create the shared memory frame ring and its doorbells and hand them to
+ * the video server.  Frames keep going over the socket until the server
+ * confirms the ring is active.
+ */
+static void wstSetupRingVideoClientConnection( WstVideoClientConnection *conn )
 {
-   AVSyncCtx *avsctx= 0;
+   const char *workingDir;
+   char filename[PATH_MAX];
+   int shmFd= -1;
+   WstVideoRingShm *ring= 0;
+   int frameDoorbellFd= -1, releaseDoorbellFd= -1;
+   struct msghdr msg;
+   struct cmsghdr *cmsg;
+   struct iovec iov[1];
+   unsigned char mbody[4];
+   char cmbody[CMSG_SPACE(3*sizeof(int))];
+   int *fd;
+   int len;
+   int sentLen;
+
+   if ( conn->ring )
+   {
+      goto exit;
+   }
+
+   workingDir= getenv("XDG_RUNTIME_DIR");
+   if ( !workingDir )
+   {
+      goto exit;
+   }
+   snprintf( filename, sizeof(filename), "%s/westeros-ring-XXXXXX", workingDir );
+   shmFd= mkostemp( filename, O_CLOEXEC );
+   if ( shmFd < 0 )
+   {
+      GST_ERROR("wstSetupRingVideoClientConnection: unable to create frame ring file: errno %d", errno);
+      goto exit;
+   }
+   unlink( filename );
+
+   if ( ftruncate( shmFd, sizeof(WstVideoRingShm) ) < 0 )
+   {
+      GST_ERROR("wstSetupRingVideoClientConnection: unable to size frame ring: errno %d", errno);
+      goto exit;
+   }
+
+   ring= (WstVideoRingShm*)mmap( NULL, sizeof(WstVideoRingShm), PROT_READ|PROT_WRITE, MAP_SHARED, shmFd, 0 );
+   if ( ring == MAP_FAILED )
+   {
+      GST_ERROR("wstSetupRingVideoClientConnection: unable to map frame ring: errno %d", errno);
+      ring= 0;
+      goto exit;
+   }
+   memset( ring, 0, sizeof(WstVideoRingShm) );
+   ring->magic= WST_VIDEO_RING_MAGIC;
+   ring->capacity= WST_VIDEO_RING_CAPACITY;
+   ring->version= WST_VIDEO_RING_VERSION;
+
+   frameDoorbellFd= eventfd( 0, EFD_NONBLOCK|EFD_CLOEXEC );
+   releaseDoorbellFd= eventfd( 0, EFD_NONBLOCK|EFD_CLOEXEC );
+   if ( (frameDoorbellFd < 0) || (releaseDoorbellFd < 0) )
+   {
+      GST_ERROR("wstSetupRingVideoClientConnection: unable to create doorbells: errno %d", errno);
+      goto exit;
+   }
+
+   len= 0;
+   mbody[len++]= 'V';
+   mbody[len++]= 'S';
+   mbody[len++]= 1;
+   mbody[len++]= 'M';
+
+   iov[0].iov_base= (char*)mbody;
+   iov[0].iov_len= len;
+
+   cmsg= (struct cmsghdr*)cmbody;
+   cmsg->cmsg_len= CMSG_LEN(3*sizeof(int));
+   cmsg->cmsg_level= SOL_SOCKET;
+   cmsg->cmsg_type= SCM_RIGHTS;
+
+   msg.msg_name= NULL;
+   msg.msg_namelen= 0;
+   msg.msg_iov= iov;
+   msg.msg_iovlen= 1;
+   msg.msg_control= cmsg;
+   msg.msg_controllen= cmsg->cmsg_len;
+   msg.msg_flags= 0;
+
+   fd= (int*)CMSG_DATA(cmsg);
+   fd[0]= shmFd;
+   fd[1]= frameDoorbellFd;
+   fd[2]= releaseDoorbellFd;
+
+   do
+   {
+      sentLen= sendmsg( conn->socketFd, &msg, MSG_NOSIGNAL );
+   }
+   while ( (sentLen < 0) && (errno == EINTR));
+
+   if ( sentLen == len )
+   {
+      GST_LOG("sent frame ring to video server");
+      conn->ring= ring;
+      conn->frameDoorbellFd= frameDoorbellFd;
+      conn->releaseDoorbellFd= releaseDoorbellFd;
+      ring= 0;
+      frameDoorbellFd= releaseDoorbellFd= -1;
+   }
+
+exit:
+   if ( ring )
+   {
+      munmap( ring, sizeof(WstVideoRingShm) );
+   }
+   if ( frameDoorbellFd >= 0 )
+   {
+      close( frameDoorbellFd );
+   }
+   if ( releaseDoorbellFd >= 0 )
+   {
+      close( releaseDoorbellFd );
+   }
+   if ( shmFd >= 0 )
+   {
+      close( shmFd );
+   }
+}
+
+static void wstTermRingVideoClientConnection( WstVideoClientConnection *conn )
+{
+   conn->useRing= false;
+   if ( conn->ring )
+   {
+      munmap( conn->ring, sizeof(WstVideoRingShm) );
+      conn->ring= 0;
+   }
+   if ( conn->frameDoorbellFd >= 0 )
+   {
+      close( conn->frameDoorbellFd );
+      conn->frameDoorbellFd= -1;
+   }
+   if ( conn->releaseDoorbellFd >= 0 )
+   {
+      close( conn->releaseDoorbellFd );
+      conn->releaseDoorbellFd= -1;
+   }
+   conn->poolCount= 0;
+   conn->poolNext= 0;
+}
+
+/*
+ * The video server handles socket messages ahead of frames still in the
+ * ring, so before sending a control message wait briefly for the server
+ * to take any frames already queued.
+ */
+static void wstDrainRingVideoClientConnection( WstVideoClientConnection *conn )
+{
+   if ( conn && conn->useRing )
+   {
+      WstVideoRingShm *ring= conn->ring;
+      int retry= 50;
+
+      while ( __atomic_load_n( &ring->frameTail, __ATOMIC_ACQUIRE ) != ring->frameHead )
+      {
+         if ( --retry == 0 )
+         {
+            GST_WARNING("timeout waiting for video server to drain frame ring");
+            break;
+         }
+         usleep( 1000 );
+      }
+   }
+}
+
+/*
+ * Register a decoder buffer with the video server for use by ring frames.
+ * The server mirrors this table, replacing its oldest entry when full.
+ */
+static bool wstRegisterBufferVideoClientConnection( WstVideoClientConnection *conn, int bufferId, int fd0, int fd1, int fd2 )
+{
+   bool result= false;
+   struct msghdr msg;
+   struct cmsghdr *cmsg;
+   struct iovec iov[1];
+   unsigned char mbody[8];
+   char cmbody[CMSG_SPACE(3*sizeof(int))];
+   int *fd;
+   int i, len, numFds;
+   int sentLen;
+
+   for( i= 0; i < conn->poolCount; ++i )
+   {
+      if ( conn->poolBufferId[i] == bufferId )
+      {
+         result= true;
+         goto exit;
+      }
+   }
+
+   len= 0;
+   mbody[len++]= 'V';
+   mbody[len++]= 'S';
+   mbody[len++]= 5;
+   mbody[len++]= 'O';
+   len += putU32( &mbody[len], bufferId );
+
+   iov[0].iov_base= (char*)mbody;
+   iov[0].iov_len= len;
+
+   numFds= 0;
+   cmsg= (struct cmsghdr*)cmbody;
+   fd= (int*)CMSG_DATA(cmsg);
+   fd[numFds++]= fd0;
+   if ( fd1 >= 0 )
+   {
+      fd[numFds++]= fd1;
+   }
+   if ( fd2 >= 0 )
+   {
+      fd[numFds++]= fd2;
+   }
+   cmsg->cmsg_len= CMSG_LEN(numFds*sizeof(int));
+   cmsg->cmsg_level= SOL_SOCKET;
+   cmsg->cmsg_type= SCM_RIGHTS;
+
+   msg.msg_name= NULL;
+   msg.msg_namelen= 0;
+   msg.msg_iov= iov;
+   msg.msg_iovlen= 1;
+   msg.msg_control= cmsg;
+   msg.msg_controllen= cmsg->cmsg_len;
+   msg.msg_flags= 0;
+
+   do
+   {
+      sentLen= sendmsg( conn->socketFd, &msg, MSG_NOSIGNAL );
+   }
+   while ( (sentLen < 0) && (errno == EINTR));
+
+   if ( sentLen == len )
+   {
+      FRAME("out:       registered buffer %d with video server", bufferId);
+      conn->poolBufferId[conn->poolNext]= bufferId;
+      conn->poolNext= (conn->poolNext+1) % WST_VIDEO_POOL_SIZE;
+      if ( conn->poolCount < WST_VIDEO_POOL_SIZE )
+      {
+         ++conn->poolCount;
+      }
+      result= true;
+   }
+
+exit:
+   return result;
+}
+
+/*
+ * Drop all buffer registrations, such as when the decoder output buffers
+ * are reallocated, so the server closes its references to them.
+ */
+static void wstSendPurgeVideoClientConnection( WstVideoClientConnection *conn )
+{
+   if ( conn && conn->useRing && conn->poolCount )
+   {
+      struct msghdr msg;
+      struct iovec iov[1];
+      unsigned char mbody[4];
+      int len;
+      int sentLen;
+
+      wstDrainRingVideoClientConnection( conn );
+
+      msg.msg_name= NULL;
+      msg.msg_namelen= 0;
+      msg.msg_iov= iov;
+      msg.msg_iovlen= 1;
+      msg.msg_control= 0;
+      msg.msg_controllen= 0;
+      msg.msg_flags= 0;
+
+      len= 0;
+      mbody[len++]= 'V';
+      mbody[len++]= 'S';
+      mbody[len++]= 1;
+      mbody[len++]= 'X';
+
+      iov[0].iov_base= (char*)mbody;
+      iov[0].iov_len= len;
+
+      do
+      {
+         sentLen= sendmsg( conn->socketFd, &msg, MSG_NOSIGNAL );
+      }
+      while ( (sentLen < 0) && (errno == EINTR));
+
+      if ( sentLen == len )
+      {
+         GST_LOG("sent buffer purge to video server");
+      }
+      conn->poolCount= 0;
+      conn->poolNext= 0;
+   }
+}
+
+#ifdef USE_GENERIC_AVSYNC
+#define AVSYNC_PREFIX "westeros-sink-av-"
+#define AVSYNC_TEMPLATE "/tmp/" AVSYNC_PREFIX "%d-"
+static void wstPruneAVSyncFiles( GstWesterosSink *sink )
+{
+   DIR *dir;
+   struct dirent *result;
+   struct stat fileinfo;
+   int prefixLen;
+   int pid, rc;
+   const char *path;
+   char work[34];
+   path= getenv("XDG_RUNTIME_DIR");
+   if ( path )
+   {
+      if ( NULL != (dir = opendir( path )) )
+      {
+         prefixLen= strlen(AVSYNC_PREFIX);
+         while( NULL != (result = readdir( dir )) )
+         {
+            if ( (result->d_type != DT_DIR) &&
+                !strncmp(result->d_name, AVSYNC_PREFIX, prefixLen) )
+            {
+               snprintf( work, sizeof(work), "%s/%s", path, result->d_name);
+               if ( sscanf( work, AVSYNC_TEMPLATE, &pid ) == 1 )
+               {
+                  // Check if the pid of this temp file is still valid
+                  snprintf(work, sizeof(work), "/proc/%d", pid);
+                  rc= stat( work, &fileinfo );
+                  if ( rc )
+                  {
+                     // The pid is not valid, delete the file
+                     snprintf( work, sizeof(work), "%s/%s", path, result->d_name);
+                     GST_DEBUG("removing temp file: %s", work);
+                     remove( work );
+                  }
+               }
+            }
+         }
+
+         closedir( dir );
+      }
+   }
+}
+
+static AVSyncCtx* wstCreateAVSyncCtx( GstWesterosSink *sink )
+{
+   AVSyncCtx *avsctx= 0;
    int static count= 0;
    int pid, len, rc;
    pthread_mutexattr_t attr;
@@ -5160,6 +5852,78 @@ static void wstSetSessionInfo( GstWesterosSink *sink )
    #endif
 }
 
+static void wstReleaseBufferVideoClientConnection( WstVideoClientConnection *conn, int bid )
+{
+   GstWesterosSink *sink= conn->sink;
+
+   if ( (bid >= sink->soc.bufferIdOutBase) && (bid < sink->soc.bufferIdOutBase+sink->soc.numBuffersOut) )
+   {
+      int bi= bid-sink->soc.bufferIdOutBase;
+      if ( sink->soc.outBuffers[bi].locked )
+      {
+         FRAME("out:       release received for buffer %d (%d)", bid, bi);
+         if ( sink->soc.useGfxSync &&
+              !sink->soc.videoPaused &&
+              (bi != sink->soc.pauseGfxBuffIndex) &&
+              (sink->soc.enableTextureSignal ||
+               (sink->soc.captureEnabled && sink->soc.sb)) )
+         {
+            int buffIndex= wstFindVideoBuffer( sink, sink->soc.outBuffers[bi].frameNumber+3 );
+            if ( buffIndex >= 0 )
+            {
+               if ( sink->soc.enableTextureSignal )
+               {
+                  wstProcessTextureSignal( sink, buffIndex );
+               }
+               else if ( sink->soc.captureEnabled && sink->soc.sb )
+               {
+                  wstProcessTextureWayland( sink, buffIndex );
+               }
+            }
+         }
+         if ( wstUnlockOutputBuffer( sink, bi ) )
+         {
+            wstRequeueOutputBuffer( sink, bi );
+         }
+      }
+      else
+      {
+         GST_ERROR("release received for non-locked buffer %d (%d)", bid, bi );
+         FRAME("out:       error: release received for non-locked buffer %d (%d)", bid, bi);
+      }
+   }
+   else
+   {
+      GST_DEBUG("release received for stale buffer %d", bid );
+      FRAME("out:       note: release received for stale buffer %d", bid);
+   }
+}
+
+/*
+ * Take buffer releases the video server has posted to the frame ring.
+ */
+static void wstProcessReleasesVideoClientConnection( WstVideoClientConnection *conn )
+{
+   WstVideoRingShm *ring= conn->ring;
+   uint64_t value;
+   uint32_t tail;
+
+   /* Clear the doorbell: the ring is checked whether or not it was rung */
+   if ( read( conn->releaseDoorbellFd, &value, sizeof(value) ) < 0 )
+   {
+      GST_TRACE("release doorbell: errno %d", errno);
+   }
+
+   tail= ring->releaseTail;
+   while( tail != __atomic_load_n( &ring->releaseHead, __ATOMIC_ACQUIRE ) )
+   {
+      int bid= ring->releases[tail & (WST_VIDEO_RING_CAPACITY-1)];
+      ++tail;
+      __atomic_store_n( &ring->releaseTail, tail, __ATOMIC_RELEASE );
+      wstReleaseBufferVideoClientConnection( conn, bid );
+   }
+}
+
 static void wstProcessMessagesVideoClientConnection( WstVideoClientConnection *conn )
 {
    if ( conn )
@@ -5226,46 +5990,32 @@ static void wstProcessMessagesVideoClientConnection( WstVideoClientConnection *c
                         if ( mlen >= 5)
                         {
                           int bid= getU32( &m[4] );
-                          if ( (bid >= sink->soc.bufferIdOutBase) && (bid < sink->soc.bufferIdOutBase+sink->soc.numBuffersOut) )
+                          wstReleaseBufferVideoClientConnection( conn, bid );
+                        }
+                        break;
+                     case 'N':
+                        if ( mlen >= 5)
+                        {
+                          conn->protocolVersion= getU32( &m[4] );
+                          GST_DEBUG("got protocol version %d from video server", conn->protocolVersion);
+                          if ( (conn->protocolVersion >= 2) && sink->soc.useFrameRing )
                           {
-                             int bi= bid-sink->soc.bufferIdOutBase;
-                             if ( sink->soc.outBuffers[bi].locked )
-                             {
-                                FRAME("out:       release received for buffer %d (%d)", bid, bi);
-                                if ( sink->soc.useGfxSync &&
-                                     !sink->soc.videoPaused &&
-                                     (bi != sink->soc.pauseGfxBuffIndex) &&
-                                     (sink->soc.enableTextureSignal ||
-                                      (sink->soc.captureEnabled && sink->soc.sb)) )
-                                {
-                                   int buffIndex= wstFindVideoBuffer( sink, sink->soc.outBuffers[bi].frameNumber+3 );
-                                   if ( buffIndex >= 0 )
-                                   {
-                                      if ( sink->soc.enableTextureSignal )
-                                      {
-                                         wstProcessTextureSignal( sink, buffIndex );
-                                      }
-                                      else if ( sink->soc.captureEnabled && sink->soc.sb )
-                                      {
-                                         wstProcessTextureWayland( sink, buffIndex );
-                                      }
-                                   }
-                                }
-                                if ( wstUnlockOutputBuffer( sink, bi ) )
-                                {
-                                   wstRequeueOutputBuffer( sink, bi );
-                                }
-                             }
-                             else
-                             {
-                                GST_ERROR("release received for non-locked buffer %d (%d)", bid, bi );
-                                FRAME("out:       error: release received for non-locked buffer %d (%d)", bid, bi);
-                             }
+                             wstSetupRingVideoClientConnection( conn );
+                          }
+                        }
+                        break;
+                     case 'M':
+                        if ( mlen >= 5)
+                        {
+                          bool active= (getU32( &m[4] ) != 0);
+                          GST_INFO("video server frame ring %s", (active ? "active" : "rejected"));
+                          if ( active && conn->ring )
+                          {
+                             conn->useRing= true;
                           }
                           else
                           {
-                             GST_DEBUG("release received for stale buffer %d", bid );
-                             FRAME("out:       note: release received for stale buffer %d", bid);
+                             wstTermRingVideoClientConnection( conn );
                           }
                         }
                         break;
@@ -5376,7 +6126,64 @@ static void wstProcessMessagesVideoClientConnection( WstVideoClientConnection *c
             }
          }
       }
+
+      if ( conn->useRing )
+      {
+         wstProcessReleasesVideoClientConnection( conn );
+      }
+   }
+}
+
+/*
+ * Post a frame to the shared memory ring.  The decoder buffer is registered
+ * with the video server the first time it is used so no fds are passed per
+ * frame.
+ */
+static bool wstSendRingFrameVideoClientConnection( WstVideoClientConnection *conn, int buffIndex, WstVideoRingFrame *desc, int fd0, int fd1, int fd2 )
+{
+   bool result= false;
+   GstWesterosSink *sink= conn->sink;
+   WstVideoRingShm *ring= conn->ring;
+   uint64_t value= 1;
+   uint32_t head;
+
+   if ( !wstRegisterBufferVideoClientConnection( conn, desc->bufferId, fd0, fd1, fd2 ) )
+   {
+      GST_ERROR("wstSendRingFrameVideoClientConnection: failed to register buffer %d", desc->bufferId);
+      goto exit;
+   }
+
+   head= ring->frameHead;
+   if ( head-__atomic_load_n( &ring->frameTail, __ATOMIC_ACQUIRE ) >= WST_VIDEO_RING_CAPACITY )
+   {
+      wstDrainRingVideoClientConnection( conn );
+      if ( head-__atomic_load_n( &ring->frameTail, __ATOMIC_ACQUIRE ) >= WST_VIDEO_RING_CAPACITY )
+      {
+         GST_WARNING("frame ring full: dropping buffer %d", desc->bufferId);
+         goto exit;
+      }
+   }
+
+   GST_LOG( "%lld: send ring frame: %d, fd (%d, %d, %d)", getCurrentTimeMillis(), buffIndex, fd0, fd1, fd2);
+   wstLockOutputBuffer( sink, buffIndex );
+   FRAME("out:       send frame %d buffer %d (%d)", sink->soc.frameOutCount-1, desc->bufferId, buffIndex);
+
+   avProgLog( desc->frameTime*1000L, sink->resAssignedId, "WtoW", "");
+
+   sink->soc.outBuffers[buffIndex].frameNumber= sink->soc.frameOutCount-1;
+
+   ring->frames[head & (WST_VIDEO_RING_CAPACITY-1)]= *desc;
+   __atomic_store_n( &ring->frameHead, head+1, __ATOMIC_RELEASE );
+
+   if ( write( conn->frameDoorbellFd, &value, sizeof(value) ) != sizeof(value) )
+   {
+      GST_WARNING("frame doorbell write failed: errno %d", errno);
    }
+
+   result= true;
+
+exit:
+   return result;
 }
 
 static bool wstSendFrameVideoClientConnection( WstVideoClientConnection *conn, int buffIndex )
@@ -5460,6 +6267,38 @@ static bool wstSendFrameVideoClientConnection( WstVideoClientConnection *conn, i
                break;
          }
 
+         vx= sink->soc.videoX;
+         vy= sink->soc.videoY;
+         vw= sink->soc.videoWidth;
+         vh= sink->soc.videoHeight;
+         if ( needBounds(sink) )
+         {
+            wstGetVideoBounds( sink, &vx, &vy, &vw, &vh );
+         }
+
+         if ( conn->useRing )
+         {
+            WstVideoRingFrame desc;
+
+            desc.bufferId= bufferId;
+            desc.frameWidth= conn->sink->soc.frameWidth;
+            desc.frameHeight= conn->sink->soc.frameHeight;
+            desc.frameFormat= pixelFormat;
+            desc.rectX= vx;
+            desc.rectY= vy;
+            desc.rectW= vw;
+            desc.rectH= vh;
+            desc.offset[0]= offset0;
+            desc.offset[1]= offset1;
+            desc.offset[2]= offset2;
+            desc.stride[0]= stride0;
+            desc.stride[1]= stride1;
+            desc.stride[2]= stride2;
+            desc.frameTime= sink->soc.outBuffers[buffIndex].frameTime;
+            result= wstSendRingFrameVideoClientConnection( conn, buffIndex, &desc, frameFd0, frameFd1, frameFd2 );
+            goto exit;
+         }
+
          fdToSend0= fcntl( frameFd0, F_DUPFD_CLOEXEC, 0 );
          if ( fdToSend0 < 0 )
          {
@@ -5487,15 +6326,6 @@ static bool wstSendFrameVideoClientConnection( WstVideoClientConnection *conn, i
             ++numFdToSend;
          }
 
-         vx= sink->soc.videoX;
-         vy= sink->soc.videoY;
-         vw= sink->soc.videoWidth;
-         vh= sink->soc.videoHeight;
-         if ( needBounds(sink) )
-         {
-            wstGetVideoBounds( sink, &vx, &vy, &vw, &vh );
-         }
-
          i= 0;
          mbody[i++]= 'V';
          mbody[i++]= 'S';
@@ -5590,6 +6420,7 @@ static void wstDecoderReset( GstWesterosSink *sink, bool hard )
    long long delay;
 
    sink->soc.quitVideoOutputThread= TRUE;
+   wstWakeVideoOutputThread( sink );
 
    delay= ((sink->soc.frameRate > 0) ? 1000000/sink->soc.frameRate : 1000000/60);
    usleep( delay );
@@ -5670,6 +6501,7 @@ static void buffer_release( void *data, struct wl_buffer *buffer )
          wstRequeueOutputBuffer( sink, binfo->buffIndex );
       }
       UNLOCK(sink);
+      wstWakeVideoOutputThread( sink );
    }
 
    --sink->soc.activeBuffers;
@@ -6292,6 +7124,97 @@ static int wstFindCurrentVideoBuffer( GstWesterosSink *sink )
    return buffIndex;
 }
 
+static void wstWakeVideoOutputThread( GstWesterosSink *sink )
+{
+   uint64_t value= 1;
+
+   if ( sink->soc.outputWakeFd >= 0 )
+   {
+      if ( write( sink->soc.outputWakeFd, &value, sizeof(value) ) != sizeof(value) )
+      {
+         GST_WARNING("output thread wake failed: errno %d", errno);
+      }
+   }
+}
+
+/*
+ * Block the video output thread until the decoder has a capture buffer or
+ * event, the video server has sent something, or another thread has called
+ * wstWakeVideoOutputThread after changing state the thread acts on.  Returns
+ * the decoder revents.
+ */
+static short wstWaitVideoOutputThread( GstWesterosSink *sink, bool waitDecoder, bool waitServer, bool havePriEvent )
+{
+   struct pollfd pfd[4];
+   int i, rc, count= 0, decoderIndex= -1;
+   short events= 0, revents= 0;
+   uint64_t value;
+
+   /* Once the last frame is dequeued the decoder stays readable */
+   if ( !sink->soc.decoderLastFrame )
+   {
+      events |= (POLLIN | POLLRDNORM);
+   }
+   if ( !havePriEvent )
+   {
+      events |= POLLPRI;
+   }
+
+   LOCK(sink);
+   if ( waitDecoder && events && (sink->soc.v4l2Fd >= 0) )
+   {
+      pfd[count].fd= sink->soc.v4l2Fd;
+      pfd[count].events= events;
+      decoderIndex= count++;
+   }
+   if ( waitServer && sink->soc.conn )
+   {
+      pfd[count].fd= sink->soc.conn->socketFd;
+      pfd[count].events= POLLIN;
+      ++count;
+      if ( sink->soc.conn->useRing )
+      {
+         pfd[count].fd= sink->soc.conn->releaseDoorbellFd;
+         pfd[count].events= POLLIN;
+         ++count;
+      }
+   }
+   if ( sink->soc.outputWakeFd >= 0 )
+   {
+      pfd[count].fd= sink->soc.outputWakeFd;
+      pfd[count].events= POLLIN;
+      ++count;
+   }
+   UNLOCK(sink);
+
+   for( i= 0; i < count; ++i )
+   {
+      pfd[i].revents= 0;
+   }
+
+   rc= poll( pfd, count, -1 );
+   if ( (rc > 0) && (decoderIndex >= 0) )
+   {
+      revents= pfd[decoderIndex].revents;
+      if ( (rc == 1) && !(revents & (POLLIN|POLLRDNORM|POLLPRI)) )
+      {
+         /* The decoder reports an error while it has no capture buffers queued:
+            wait for one to be released back to us instead */
+         poll( &pfd[decoderIndex+1], count-1, OUTPUT_ERROR_RETRY_TIMEOUT );
+      }
+   }
+
+   if ( sink->soc.outputWakeFd >= 0 )
+   {
+      if ( read( sink->soc.outputWakeFd, &value, sizeof(value) ) < 0 )
+      {
+         GST_TRACE("output thread wake: errno %d", errno);
+      }
+   }
+
+   return revents;
+}
+
 static gpointer wstVideoOutputThread(gpointer data)
 {
    GstWesterosSink *sink= (GstWesterosSink*)data;
@@ -6475,11 +7398,7 @@ capture_start:
          {
             struct pollfd pfd;
 
-            pfd.fd= sink->soc.v4l2Fd;
-            pfd.events= POLLIN | POLLRDNORM | POLLPRI;
-            pfd.revents= 0;
-
-            poll( &pfd, 1, 0);
+            pfd.revents= wstWaitVideoOutputThread( sink, true, false, havePriEvent );
 
             if ( sink->soc.quitVideoOutputThread ) break;
 
@@ -6494,6 +7413,10 @@ capture_start:
                   break;
                }
             }
+            else if ( pfd.revents & POLLPRI )
+            {
+               havePriEvent= true;
+            }
 
             if ( sink->soc.quitVideoOutputThread ) break;
 
@@ -6502,8 +7425,10 @@ capture_start:
                goto capture_ready;
             }
          }
-
-         usleep( 1000 );
+         else
+         {
+            wstWaitVideoOutputThread( sink, false, false, false );
+         }
       }
       else
       {
@@ -6564,11 +7489,7 @@ capture_start:
          {
             struct pollfd pfd;
 
-            pfd.fd= sink->soc.v4l2Fd;
-            pfd.events= POLLIN | POLLRDNORM | POLLPRI;
-            pfd.revents= 0;
-
-            poll( &pfd, 1, 0);
+            pfd.revents= wstWaitVideoOutputThread( sink, true, true, havePriEvent );
 
             if ( sink->soc.quitVideoOutputThread ) break;
 
@@ -6602,7 +7523,10 @@ capture_start:
                      goto exit;
                   }
                }
-               usleep( 1000 );
+               if ( pfd.revents & POLLPRI )
+               {
+                  havePriEvent= true;
+               }
                continue;
             }
             if ( pfd.revents & POLLPRI )
@@ -7006,6 +7930,7 @@ static GstFlowReturn prerollSinkSoc(GstBaseSink *base_sink, GstBuffer *buffer)
       LOCK(sink);
       sink->soc.frameAdvance= TRUE;
       UNLOCK(sink);
+      wstWakeVideoOutputThread( sink );
       GST_BASE_SINK(sink)->need_preroll= FALSE;
       GST_BASE_SINK(sink)->have_preroll= TRUE;
    }
@@ -7129,21 +8054,41 @@ static bool swIsSWDecode( GstWesterosSink *sink )
 }
 
 #ifdef ENABLE_SW_DECODE
+static void swReleaseSWFrame( GstWesterosSink *sink, int buffIndex )
+{
+   if ( sink->soc.swBuffer[buffIndex].frameHold )
+   {
+      wstsw_release_frame( sink, sink->soc.swBuffer[buffIndex].frameHold );
+      sink->soc.swBuffer[buffIndex].frameHold= 0;
+   }
+}
+
 static void swFreeSWBuffer( GstWesterosSink *sink, int buffIndex )
 {
    int i;
+   swReleaseSWFrame( sink, buffIndex );
    for( i= 0; i < 2; ++i )
    {
-      int *fd, *handle;
+      int *fd, *handle, size;
+      unsigned char **map;
       if ( i == 0 )
       {
          fd= &sink->soc.swBuffer[buffIndex].fd0;
          handle= &sink->soc.swBuffer[buffIndex].handle0;
+         map= &sink->soc.swBuffer[buffIndex].map0;
+         size= sink->soc.swBuffer[buffIndex].size0;
       }
       else
       {
          fd= &sink->soc.swBuffer[buffIndex].fd1;
          handle= &sink->soc.swBuffer[buffIndex].handle1;
+         map= &sink->soc.swBuffer[buffIndex].map1;
+         size= sink->soc.swBuffer[buffIndex].size1;
+      }
+      if ( *map )
+      {
+         munmap( *map, size );
+         *map= 0;
       }
       if ( *fd >= 0 )
       {
@@ -7160,7 +8105,11 @@ static void swFreeSWBuffer( GstWesterosSink *sink, int buffIndex )
    }
 }
 
-static bool swAllocSWBuffer( GstWesterosSink *sink, int buffIndex, int width, int height )
+/*
+ * Allocate the NV12 planes of a display buffer.  The Y plane is left out
+ * when frames arrive with their Y plane already in a dmabuf.
+ */
+static bool swAllocSWBuffer( GstWesterosSink *sink, int buffIndex, int width, int height, bool luma )
 {
    bool result= false;
    WstSWBuffer *swBuff= 0;
@@ -7175,34 +8124,45 @@ static bool swAllocSWBuffer( GstWesterosSink *sink, int buffIndex, int width, in
       swBuff->width= width;
       swBuff->height= height;
 
-      memset( &createDumb, 0, sizeof(createDumb) );
-      createDumb.width= width;
-      createDumb.height= height;
-      createDumb.bpp= 8;
-      rc= ioctl( sink->soc.drmFd, DRM_IOCTL_MODE_CREATE_DUMB, &createDumb );
-      if ( rc )
-      {
-         GST_ERROR("DRM_IOCTL_MODE_CREATE_DUMB failed: rc %d errno %d", rc, errno);
-         goto exit;
-      }
-      memset( &mapDumb, 0, sizeof(mapDumb) );
-      mapDumb.handle= createDumb.handle;
-      rc= ioctl( sink->soc.drmFd, DRM_IOCTL_MODE_MAP_DUMB, &mapDumb );
-      if ( rc )
+      if ( luma )
       {
-         GST_ERROR("DRM_IOCTL_MODE_MAP_DUMB failed: rc %d errno %d", rc, errno);
-         goto exit;
-      }
-      swBuff->handle0= createDumb.handle;
-      swBuff->pitch0= createDumb.pitch;
-      swBuff->size0= createDumb.size;
-      swBuff->offset0= mapDumb.offset;
+         memset( &createDumb, 0, sizeof(createDumb) );
+         createDumb.width= width;
+         createDumb.height= height;
+         createDumb.bpp= 8;
+         rc= ioctl( sink->soc.drmFd, DRM_IOCTL_MODE_CREATE_DUMB, &createDumb );
+         if ( rc )
+         {
+            GST_ERROR("DRM_IOCTL_MODE_CREATE_DUMB failed: rc %d errno %d", rc, errno);
+            goto exit;
+         }
+         memset( &mapDumb, 0, sizeof(mapDumb) );
+         mapDumb.handle= createDumb.handle;
+         rc= ioctl( sink->soc.drmFd, DRM_IOCTL_MODE_MAP_DUMB, &mapDumb );
+         if ( rc )
+         {
+            GST_ERROR("DRM_IOCTL_MODE_MAP_DUMB failed: rc %d errno %d", rc, errno);
+            goto exit;
+         }
+         swBuff->handle0= createDumb.handle;
+         swBuff->pitch0= createDumb.pitch;
+         swBuff->size0= createDumb.size;
+         swBuff->offset0= mapDumb.offset;
 
-      rc= drmPrimeHandleToFD( sink->soc.drmFd, swBuff->handle0, DRM_CLOEXEC | DRM_RDWR, &swBuff->fd0 );
-      if ( rc )
-      {
-         GST_ERROR("drmPrimeHandleToFD failed: rc %d errno %d", rc, errno);
-         goto exit;
+         rc= drmPrimeHandleToFD( sink->soc.drmFd, swBuff->handle0, DRM_CLOEXEC | DRM_RDWR, &swBuff->fd0 );
+         if ( rc )
+         {
+            GST_ERROR("drmPrimeHandleToFD failed: rc %d errno %d", rc, errno);
+            goto exit;
+         }
+
+         swBuff->map0= (unsigned char*)mmap( NULL, swBuff->size0, PROT_READ | PROT_WRITE, MAP_SHARED, sink->soc.drmFd, swBuff->offset0 );
+         if ( swBuff->map0 == MAP_FAILED )
+         {
+            GST_ERROR("mmap failed: errno %d", errno);
+            swBuff->map0= 0;
+            goto exit;
+         }
       }
 
       memset( &createDumb, 0, sizeof(createDumb) );
@@ -7235,6 +8195,14 @@ static bool swAllocSWBuffer( GstWesterosSink *sink, int buffIndex, int width, in
          goto exit;
       }
 
+      swBuff->map1= (unsigned char*)mmap( NULL, swBuff->size1, PROT_READ | PROT_WRITE, MAP_SHARED, sink->soc.drmFd, swBuff->offset1 );
+      if ( swBuff->map1 == MAP_FAILED )
+      {
+         GST_ERROR("mmap failed: errno %d", errno);
+         swBuff->map1= 0;
+         goto exit;
+      }
+
       result= true;
    }
 exit:
@@ -7245,16 +8213,17 @@ exit:
    return result;
 }
 
-WstSWBuffer *swGetSWBuffer( GstWesterosSink *sink, int buffIndex, int width, int height )
+WstSWBuffer *swGetSWBuffer( GstWesterosSink *sink, int buffIndex, int width, int height, bool luma )
 {
    WstSWBuffer *swBuff= 0;
    if ( buffIndex < WST_NUM_SW_BUFFERS )
    {
       swBuff= &sink->soc.swBuffer[buffIndex];
-      if ( (swBuff->width != width) || (swBuff->height != height) )
+      swReleaseSWFrame( sink, buffIndex );
+      if ( (swBuff->width != width) || (swBuff->height != height) || (luma && !swBuff->handle0) )
       {
          swFreeSWBuffer( sink, buffIndex );
-         if ( !swAllocSWBuffer( sink, buffIndex, width, height ) )
+         if ( !swAllocSWBuffer( sink, buffIndex, width, height, luma ) )
          {
             swBuff= 0;
          }
@@ -7288,6 +8257,7 @@ static bool swInit( GstWesterosSink *sink )
       GST_ERROR("Failed to open drm render node: %d", errno);
       goto exit;
    }
+   sink->swDrmFd= sink->soc.drmFd;
 
 exit:
    return true;
@@ -7313,10 +8283,11 @@ static void swTerm( GstWesterosSink *sink )
    {
       swFreeSWBuffer( sink, i );
    }
+   sink->swDrmFd= -1;
    if ( sink->soc.drmFd >= 0 )
    {
       close( sink->soc.drmFd );
-      sink->soc.drmFd= 1;
+      sink->soc.drmFd= -1;
    }
 }
 
@@ -7386,48 +8357,31 @@ void swDisplay( GstWesterosSink *sink, SWFrame *frame )
       sink->soc.nextSWBuffer= 0;
    }
 
-   swBuff= swGetSWBuffer( sink, bi, frame->width, frame->height );
+   swBuff= swGetSWBuffer( sink, bi, frame->width, frame->height, (frame->Yfd < 0) );
    if ( swBuff )
    {
-      unsigned char *data;
+      int fdY, sizeY, pitchY;
 
-      data= (unsigned char*)mmap( NULL, swBuff->size0, PROT_READ | PROT_WRITE, MAP_SHARED, sink->soc.drmFd, swBuff->offset0 );
-      if ( data )
+      if ( frame->Yfd >= 0 )
       {
-         int row;
-         unsigned char *destRow= data;
-         unsigned char *srcYRow= frame->Y;
-         for( row= 0; row < frame->height; ++row )
-         {
-            memcpy( destRow, srcYRow, frame->Ystride );
-            destRow += swBuff->pitch0;
-            srcYRow += frame->Ystride;
-         }
-         munmap( data, swBuff->size0 );
+         /* Y plane was decoded into a dmabuf: keep the frame until this slot is reused */
+         swBuff->frameHold= frame->hold;
+         frame->hold= 0;
+         fdY= frame->Yfd;
+         sizeY= frame->Ysize;
+         pitchY= frame->Ystride;
       }
-      data= (unsigned char*)mmap( NULL, swBuff->size1, PROT_READ | PROT_WRITE, MAP_SHARED, sink->soc.drmFd, swBuff->offset1 );
-      if ( data )
+      else
       {
-         int row, col;
-         unsigned char *dest, *destRow= data;
-         unsigned char *srcU, *srcURow= frame->U;
-         unsigned char *srcV, *srcVRow= frame->V;
-         for( row= 0; row < frame->height; row += 2 )
-         {
-            dest= destRow;
-            srcU= srcURow;
-            srcV= srcVRow;
-            for( col= 0; col < frame->width; col += 2 )
-            {
-               *dest++= *srcU++;
-               *dest++= *srcV++;
-            }
-            destRow += swBuff->pitch1;
-            srcURow += frame->Ustride;
-            srcVRow += frame->Vstride;
-         }
-         munmap( data, swBuff->size1 );
+         wstCopyPlane( swBuff->map0, swBuff->pitch0, frame->Y, frame->Ystride, frame->width, frame->height );
+         fdY= swBuff->fd0;
+         sizeY= swBuff->size0;
+         pitchY= swBuff->pitch0;
       }
+      wstInterleaveUV( swBuff->map1, swBuff->pitch1,
+                       frame->U, frame->Ustride,
+                       frame->V, frame->Vstride,
+                       (frame->width+1)/2, (frame->height+1)/2 );
 
       if ( frame->frameNumber == 0 )
       {
@@ -7452,13 +8406,13 @@ void swDisplay( GstWesterosSink *sink, SWFrame *frame )
          int fd0, l0, s0, fd1, l1, fd2, s1, l2, s2;
          void *p0, *p1, *p2;
 
-         fd0= swBuff->fd0;
+         fd0= fdY;
          fd1= swBuff->fd1;
          fd2= -1;
-         s0= swBuff->pitch0;
+         s0= pitchY;
          s1= swBuff->pitch1;
          s2= 0;
-         l0= swBuff->size0;
+         l0= sizeY;
          l1= swBuff->size1;
          l2= 0;
          p0= 0;
@@ -7486,10 +8440,10 @@ void swDisplay( GstWesterosSink *sink, SWFrame *frame )
             int fd0, fd1, fd2;
             int stride0, stride1;
             int offset1= 0;
-            fd0= swBuff->fd0;
+            fd0= fdY;
             fd1= swBuff->fd1;
             fd2= fd0;
-            stride0= swBuff->pitch0;
+            stride0= pitchY;
             stride1= swBuff->pitch1;
 
             binfo->sink= sink;
@@ -7524,6 +8478,11 @@ void swDisplay( GstWesterosSink *sink, SWFrame *frame )
          }
       }
    }
+   if ( frame->hold )
+   {
+      wstsw_release_frame( sink, frame->hold );
+      frame->hold= 0;
+   }
    LOCK(sink);
    ++sink->soc.frameOutCount;
    UNLOCK(sink);
@@ -20,6 +20,7 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <stddef.h>
 
 #include <sys/socket.h>
 #include <sys/un.h>
@@ -47,6 +48,62 @@
       "systemstream = (boolean) false, " \
       "width=(int) [1,MAX], " "height=(int) [1,MAX]" 
 
+/*
+ * Shared memory frame ring used with video server protocol version 2.  The
+ * layout must match the one used by the video server in westeros-gl.
+ */
+#define WST_VIDEO_PROTOCOL_VERSION (2)
+#define WST_VIDEO_RING_MAGIC (0x57535246)
+#define WST_VIDEO_RING_VERSION (1)
+#define WST_VIDEO_RING_CAPACITY (32)
+#define WST_VIDEO_POOL_SIZE (32)
+
+typedef struct _WstVideoRingFrame
+{
+   int32_t bufferId;
+   uint32_t frameWidth;
+   uint32_t frameHeight;
+   uint32_t frameFormat;
+   int32_t rectX;
+   int32_t rectY;
+   int32_t rectW;
+   int32_t rectH;
+   int32_t offset[3];
+   int32_t stride[3];
+   int64_t frameTime __attribute__((aligned(8)));
+} WstVideoRingFrame;
+
+typedef struct _WstVideoRingShm
+{
+   uint32_t magic;
+   uint32_t capacity;
+   uint32_t version;
+   uint32_t frameHead __attribute__((aligned(64)));
+   uint32_t frameTail __attribute__((aligned(64)));
+   uint32_t releaseHead __attribute__((aligned(64)));
+   uint32_t releaseTail __attribute__((aligned(64)));
+   WstVideoRingFrame frames[WST_VIDEO_RING_CAPACITY];
+   int32_t releases[WST_VIDEO_RING_CAPACITY];
+} WstVideoRingShm;
+
+/*
+ * Pin the ring layout so it can't drift from the copy in the westeros-gl
+ * video server, which checks the same values.  Any layout change must bump
+ * WST_VIDEO_RING_VERSION on both sides.
+ */
+_Static_assert( sizeof(WstVideoRingFrame) == 64, "WstVideoRingFrame layout changed" );
+_Static_assert( offsetof(WstVideoRingFrame, offset) == 32, "WstVideoRingFrame layout changed" );
+_Static_assert( offsetof(WstVideoRingFrame, stride) == 44, "WstVideoRingFrame layout changed" );
+_Static_assert( offsetof(WstVideoRingFrame, frameTime) == 56, "WstVideoRingFrame layout changed" );
+_Static_assert( sizeof(WstVideoRingShm) == 2496, "WstVideoRingShm layout changed" );
+_Static_assert( offsetof(WstVideoRingShm, version) == 8, "WstVideoRingShm layout changed" );
+_Static_assert( offsetof(WstVideoRingShm, frameHead) == 64, "WstVideoRingShm layout changed" );
+_Static_assert( offsetof(WstVideoRingShm, frameTail) == 128, "WstVideoRingShm layout changed" );
+_Static_assert( offsetof(WstVideoRingShm, releaseHead) == 192, "WstVideoRingShm layout changed" );
+_Static_assert( offsetof(WstVideoRingShm, releaseTail) == 256, "WstVideoRingShm layout changed" );
+_Static_assert( offsetof(WstVideoRingShm, frames) == 264, "WstVideoRingShm layout changed" );
+_Static_assert( offsetof(WstVideoRingShm, releases) == 2312, "WstVideoRingShm layout changed" );
+
 typedef struct _WstVideoClientConnection
 {
    GstWesterosSink *sink;
@@ -55,6 +112,14 @@ typedef struct _WstVideoClientConnection
    int socketFd;
    int serverRefreshRate;
    gint64 serverRefreshPeriod;
+   int protocolVersion;
+   bool useRing;
+   WstVideoRingShm *ring;
+   int frameDoorbellFd;
+   int releaseDoorbellFd;
+   int poolCount;
+   int poolNext;
+   int poolBufferId[WST_VIDEO_POOL_SIZE];
 } WstVideoClientConnection;
 
 typedef struct _WstPlaneInfo
@@ -84,6 +149,10 @@ typedef struct _WstBufferInfo
    WstPlaneInfo planeInfo[WST_MAX_PLANES];
    WstGemBuffer gemBuf;
    GstBuffer *gstbuf;
+   #ifdef USE_GST1
+   GstMapInfo map;
+   bool mapped;
+   #endif
    int bufferId;
    bool locked;
    int lockCount;
@@ -113,6 +182,9 @@ typedef struct _WstSWBuffer
    off_t offset1;
    int pitch0;
    int pitch1;
+   unsigned char *map0;
+   unsigned char *map1;
+   void *frameHold;
 } WstSWBuffer;
 #endif
 
@@ -257,6 +329,7 @@ struct _GstWesterosSinkSoc
    gboolean decodeError;
    gboolean quitVideoOutputThread;
    GThread *videoOutputThread;
+   int outputWakeFd;
    gboolean quitEOSDetectionThread;
    GThread *eosDetectionThread;
    gboolean quitDispatchThread;
@@ -301,6 +374,8 @@ struct _GstWesterosSinkSoc
    gboolean forceAspectRatio;
 
    gboolean lowMemoryMode;
+   gboolean useFrameRing;
+   gboolean useUserPtrInput;
    gboolean secureVideo;
    gboolean useDmabufOutput;
    int dwMode;
@@ -353,6 +428,7 @@ gboolean gst_westeros_sink_soc_start_video( GstWesterosSink *sink );
 void gst_westeros_sink_soc_eos_event( GstWesterosSink *sink );
 void gst_westeros_sink_soc_set_video_path( GstWesterosSink *sink, bool useGfxPath );
 void gst_westeros_sink_soc_update_video_position( GstWesterosSink *sink );
+void gst_westeros_sink_soc_window_change( GstWesterosSink *sink );
 gboolean gst_westeros_sink_soc_query( GstWesterosSink *sink, GstQuery *query );
 
 #endif
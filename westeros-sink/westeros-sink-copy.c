@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2019 RDK Management
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#include <string.h>
+
+#include "westeros-sink-copy.h"
+
+void wstCopyPlane( unsigned char *dst, int dstStride,
+                   const unsigned char *src, int srcStride,
+                   int width, int height )
+{
+   int row;
+
+   for( row= 0; row < height; ++row )
+   {
+      memcpy( dst, src, width );
+      dst += dstStride;
+      src += srcStride;
+   }
+}
+
+void wstInterleaveUV( unsigned char *dst, int dstStride,
+                      const unsigned char *srcU, int srcUStride,
+                      const unsigned char *srcV, int srcVStride,
+                      int width, int height )
+{
+   int row, i;
+
+   for( row= 0; row < height; ++row )
+   {
+      for( i= 0; i < width; ++i )
+      {
+         dst[i*2+0]= srcU[i];
+         dst[i*2+1]= srcV[i];
+      }
+      dst += dstStride;
+      srcU += srcUStride;
+      srcV += srcVStride;
+   }
+}
@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2019 RDK Management
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#ifndef __WESTEROS_SINK_COPY_H__
+#define __WESTEROS_SINK_COPY_H__
+
+/*
+ * Plane copies used by the sinks to fill mapped DRM buffers from decoded
+ * or raw video frames.  wstCopyPlane copies width bytes from each of
+ * height rows.  wstInterleaveUV builds an NV12 chroma plane from I420 U
+ * and V planes, where width is the number of U samples per row.  Rows may
+ * be unaligned.
+ */
+void wstCopyPlane( unsigned char *dst, int dstStride,
+                   const unsigned char *src, int srcStride,
+                   int width, int height );
+void wstInterleaveUV( unsigned char *dst, int dstStride,
+                      const unsigned char *srcU, int srcUStride,
+                      const unsigned char *srcV, int srcVStride,
+                      int width, int height );
+
+#endif
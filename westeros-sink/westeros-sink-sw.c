@@ -30,12 +30,78 @@ extern "C" {
 #endif
 
 #include <unistd.h>
+#include <pthread.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <drm/drm.h>
 
 GST_DEBUG_CATEGORY_EXTERN (gst_westeros_sink_debug);
 #define GST_CAT_DEFAULT gst_westeros_sink_debug
 
+#define SW_DECODE_QUEUE_SIZE (8)
+#define SW_DECODE_MAX_THREADS (16)
+
+/*
+ * Enough frame buffers for a full H.264 DPB, one in flight per decode
+ * thread and those still held by the display.
+ */
+#define SW_POOL_MAX_BUFFERS (48)
+#define SW_PLANE_ALIGN (64)
+#define SW_PLANE_PAD (128)
+#define SW_ALIGN( n, a ) (((n)+(a)-1) & ~((a)-1))
+
+/*
+ * A buffer waiting for the decode thread.  A null buffer asks the
+ * decode thread to drain the decoder.
+ */
+typedef struct _SWQueueEntry
+{
+   GstBuffer *buffer;
+   bool preroll;
+} SWQueueEntry;
+
+struct _SWBufferPool;
+
+/*
+ * A DRM dumb buffer that stays mapped for its lifetime and backs the Y
+ * plane of a decoded frame.
+ */
+typedef struct _SWPoolBuffer
+{
+   struct _SWBufferPool *pool;
+   bool inUse;
+   int width;
+   int height;
+   uint32_t handle;
+   int fd;
+   int pitch;
+   int size;
+   uint8_t *map;
+} SWPoolBuffer;
+
+/*
+ * Buffers are returned from FFmpeg's buffer free callback, which can run
+ * after the decoder is gone if the display still holds a frame, so the pool
+ * is freed by whichever of termSWDecoder or the last free happens later.
+ * drmFd is a dup of the sink's drm fd, set once the sink has opened it, so
+ * buffers share the display's drm file but can outlive swTerm.
+ */
+typedef struct _SWBufferPool
+{
+   pthread_mutex_t mutex;
+   int drmFd;
+   bool closed;
+   int inUseCount;
+   AVBufferPool *chromaPool;
+   int chromaPoolSize;
+   SWPoolBuffer buffer[SW_POOL_MAX_BUFFERS];
+} SWBufferPool;
+
 typedef struct _SWCtx
 {
+   GstWesterosSink *sink;
    AVCodec* codec;
    AVCodecContext* codecCtx;
    bool contextOpen;
@@ -50,10 +116,380 @@ typedef struct _SWCtx
    double frameRate;
    int outputFrameCount;
    gint64 prevFrameTime;
+   int threadCount;
+   pthread_mutex_t mutex;
+   pthread_cond_t cond;
+   pthread_t decodeThreadId;
+   bool decodeThreadStarted;
+   bool quitDecodeThread;
+   bool decoding;
+   bool flushPending;
+   bool drainPending;
+   SWQueueEntry queue[SW_DECODE_QUEUE_SIZE];
+   int queueHead;
+   int queueCount;
+   SWBufferPool *pool;
 } SWCtx;
 
 static bool initSWDecoder( GstWesterosSink *sink );
+static void swStopDecodeThread( SWCtx *swCtx );
 static void termSWDecoder( SWCtx *swCtx );
+static SWBufferPool* swCreatePool( void );
+static void swSetPoolDrmFd( SWBufferPool *pool, int drmFd );
+static void swClosePool( SWBufferPool *pool );
+static void swDestroyPoolBuffer( SWBufferPool *pool, SWPoolBuffer *buff );
+static SWPoolBuffer* swGetPoolBuffer( SWBufferPool *pool, int width, int height );
+static void swFreePoolBuffer( void *opaque, uint8_t *data );
+static SWPoolBuffer* swFramePoolBuffer( SWCtx *swCtx, AVFrame *frame );
+static int swGetBuffer2( AVCodecContext *ctx, AVFrame *frame, int flags );
+static SWBufferPool* swCreatePool( void )
+{
+   SWBufferPool *pool= 0;
+   int i;
+
+   pool= (SWBufferPool*)calloc( 1, sizeof(SWBufferPool) );
+   if ( !pool )
+   {
+      GST_ERROR("swCreatePool: no memory for pool");
+      goto exit;
+   }
+   pool->drmFd= -1;
+   for( i= 0; i < SW_POOL_MAX_BUFFERS; ++i )
+   {
+      pool->buffer[i].pool= pool;
+      pool->buffer[i].fd= -1;
+   }
+   pthread_mutex_init( &pool->mutex, 0 );
+
+exit:
+   return pool;
+}
+
+static void swSetPoolDrmFd( SWBufferPool *pool, int drmFd )
+{
+   pthread_mutex_lock( &pool->mutex );
+   if ( (pool->drmFd < 0) && (drmFd >= 0) )
+   {
+      pool->drmFd= fcntl( drmFd, F_DUPFD_CLOEXEC, 0 );
+      if ( pool->drmFd < 0 )
+      {
+         GST_WARNING("swSetPoolDrmFd: unable to dup drm fd %d: errno %d", drmFd, errno);
+      }
+   }
+   pthread_mutex_unlock( &pool->mutex );
+}
+
+static void swClosePool( SWBufferPool *pool )
+{
+   bool destroy;
+   int i;
+
+   pthread_mutex_lock( &pool->mutex );
+   pool->closed= true;
+   for( i= 0; i < SW_POOL_MAX_BUFFERS; ++i )
+   {
+      if ( !pool->buffer[i].inUse )
+      {
+         swDestroyPoolBuffer( pool, &pool->buffer[i] );
+      }
+   }
+   if ( pool->chromaPool )
+   {
+      av_buffer_pool_uninit( &pool->chromaPool );
+   }
+   destroy= (pool->inUseCount == 0);
+   pthread_mutex_unlock( &pool->mutex );
+
+   if ( destroy )
+   {
+      if ( pool->drmFd >= 0 )
+      {
+         close( pool->drmFd );
+      }
+      pthread_mutex_destroy( &pool->mutex );
+      free( pool );
+   }
+}
+
+static void swDestroyPoolBuffer( SWBufferPool *pool, SWPoolBuffer *buff )
+{
+   if ( buff->map )
+   {
+      munmap( buff->map, buff->size );
+      buff->map= 0;
+   }
+   if ( buff->fd >= 0 )
+   {
+      close( buff->fd );
+      buff->fd= -1;
+   }
+   if ( buff->handle )
+   {
+      struct drm_mode_destroy_dumb destroyDumb;
+      memset( &destroyDumb, 0, sizeof(destroyDumb) );
+      destroyDumb.handle= buff->handle;
+      ioctl( pool->drmFd, DRM_IOCTL_MODE_DESTROY_DUMB, &destroyDumb );
+      buff->handle= 0;
+   }
+   buff->width= 0;
+   buff->height= 0;
+}
+
+/*
+ * Find a free buffer of the requested size, replacing a free buffer of
+ * another size or filling an empty slot if there is none.  Called with
+ * the pool mutex held.
+ */
+static SWPoolBuffer* swGetPoolBuffer( SWBufferPool *pool, int width, int height )
+{
+   SWPoolBuffer *buff= 0;
+   struct drm_mode_create_dumb createDumb;
+   struct drm_mode_map_dumb mapDumb;
+   struct drm_prime_handle prime;
+   int i, rc;
+
+   for( i= 0; i < SW_POOL_MAX_BUFFERS; ++i )
+   {
+      if ( !pool->buffer[i].inUse && pool->buffer[i].map &&
+           (pool->buffer[i].width == width) && (pool->buffer[i].height == height) )
+      {
+         buff= &pool->buffer[i];
+         goto exit;
+      }
+   }
+   for( i= 0; i < SW_POOL_MAX_BUFFERS; ++i )
+   {
+      if ( !pool->buffer[i].inUse && !pool->buffer[i].map )
+      {
+         buff= &pool->buffer[i];
+         break;
+      }
+   }
+   if ( !buff )
+   {
+      for( i= 0; i < SW_POOL_MAX_BUFFERS; ++i )
+      {
+         if ( !pool->buffer[i].inUse )
+         {
+            buff= &pool->buffer[i];
+            swDestroyPoolBuffer( pool, buff );
+            break;
+         }
+      }
+   }
+   if ( !buff )
+   {
+      GST_WARNING("swGetPoolBuffer: no free buffers");
+      goto exit;
+   }
+
+   memset( &createDumb, 0, sizeof(createDumb) );
+   createDumb.width= width;
+   createDumb.height= height;
+   createDumb.bpp= 8;
+   rc= ioctl( pool->drmFd, DRM_IOCTL_MODE_CREATE_DUMB, &createDumb );
+   if ( rc )
+   {
+      GST_ERROR("swGetPoolBuffer: DRM_IOCTL_MODE_CREATE_DUMB failed: rc %d errno %d", rc, errno);
+      goto fail;
+   }
+   buff->handle= createDumb.handle;
+   buff->pitch= createDumb.pitch;
+   buff->size= createDumb.size;
+
+   memset( &mapDumb, 0, sizeof(mapDumb) );
+   mapDumb.handle= buff->handle;
+   rc= ioctl( pool->drmFd, DRM_IOCTL_MODE_MAP_DUMB, &mapDumb );
+   if ( rc )
+   {
+      GST_ERROR("swGetPoolBuffer: DRM_IOCTL_MODE_MAP_DUMB failed: rc %d errno %d", rc, errno);
+      goto fail;
+   }
+
+   memset( &prime, 0, sizeof(prime) );
+   prime.handle= buff->handle;
+   prime.flags= DRM_CLOEXEC | DRM_RDWR;
+   rc= ioctl( pool->drmFd, DRM_IOCTL_PRIME_HANDLE_TO_FD, &prime );
+   if ( rc )
+   {
+      GST_ERROR("swGetPoolBuffer: DRM_IOCTL_PRIME_HANDLE_TO_FD failed: rc %d errno %d", rc, errno);
+      goto fail;
+   }
+   buff->fd= prime.fd;
+
+   buff->map= (uint8_t*)mmap( NULL, buff->size, PROT_READ | PROT_WRITE, MAP_SHARED, pool->drmFd, mapDumb.offset );
+   if ( buff->map == MAP_FAILED )
+   {
+      GST_ERROR("swGetPoolBuffer: mmap failed: errno %d", errno);
+      buff->map= 0;
+      goto fail;
+   }
+   buff->width= width;
+   buff->height= height;
+
+   GST_DEBUG("swGetPoolBuffer: new buffer %d (%dx%d pitch %d size %d fd %d)",
+             (int)(buff-pool->buffer), width, height, buff->pitch, buff->size, buff->fd);
+
+   goto exit;
+
+fail:
+   swDestroyPoolBuffer( pool, buff );
+   buff= 0;
+
+exit:
+   return buff;
+}
+
+/*
+ * AVBuffer free callback: the decoder and display have both released
+ * the frame.
+ */
+static void swFreePoolBuffer( void *opaque, uint8_t *data )
+{
+   SWPoolBuffer *buff= (SWPoolBuffer*)opaque;
+   SWBufferPool *pool= buff->pool;
+   bool destroy= false;
+
+   WESTEROS_UNUSED(data);
+
+   pthread_mutex_lock( &pool->mutex );
+   buff->inUse= false;
+   --pool->inUseCount;
+   if ( pool->closed )
+   {
+      swDestroyPoolBuffer( pool, buff );
+      destroy= (pool->inUseCount == 0);
+   }
+   pthread_mutex_unlock( &pool->mutex );
+
+   if ( destroy )
+   {
+      if ( pool->drmFd >= 0 )
+      {
+         close( pool->drmFd );
+      }
+      pthread_mutex_destroy( &pool->mutex );
+      free( pool );
+   }
+}
+
+static SWPoolBuffer* swFramePoolBuffer( SWCtx *swCtx, AVFrame *frame )
+{
+   SWPoolBuffer *buff= 0;
+   SWBufferPool *pool= swCtx->pool;
+
+   if ( pool && frame->buf[0] )
+   {
+      SWPoolBuffer *candidate= (SWPoolBuffer*)av_buffer_get_opaque( frame->buf[0] );
+      if ( (candidate >= &pool->buffer[0]) && (candidate < &pool->buffer[SW_POOL_MAX_BUFFERS]) )
+      {
+         buff= candidate;
+      }
+   }
+
+   return buff;
+}
+
+/*
+ * Decode straight into DRM buffers so swDisplay can pass the Y plane to
+ * the compositor without a copy.  The H.264 decoder only produces planar
+ * 4:2:0 so U and V stay in system memory, where the display interleaves
+ * them for NV12.  Anything else uses the default allocator.  The decoder
+ * reads reference frames back from these buffers so this is only used when
+ * the soc knows its dumb buffer mappings are cached.
+ */
+static int swGetBuffer2( AVCodecContext *ctx, AVFrame *frame, int flags )
+{
+   SWCtx *swCtx= (SWCtx*)ctx->opaque;
+   SWBufferPool *pool= swCtx->pool;
+   SWPoolBuffer *buff= 0;
+   AVBufferRef *chroma= 0;
+   int linesizeAlign[AV_NUM_DATA_POINTERS];
+   int width, height, chromaStride, chromaPlaneSize;
+
+   if ( (frame->format != AV_PIX_FMT_YUV420P) && (frame->format != AV_PIX_FMT_YUVJ420P) )
+   {
+      goto fallback;
+   }
+
+   width= frame->width;
+   height= frame->height;
+   avcodec_align_dimensions2( ctx, &width, &height, linesizeAlign );
+   width= SW_ALIGN( width, SW_PLANE_ALIGN );
+   height= SW_ALIGN( height, 2 );
+   chromaStride= SW_ALIGN( width/2, SW_PLANE_ALIGN );
+   chromaPlaneSize= SW_ALIGN( chromaStride*(height/2)+SW_PLANE_PAD, SW_PLANE_ALIGN );
+
+   pthread_mutex_lock( &pool->mutex );
+   /* Extra rows cover the decoder reading past the last line */
+   if ( pool->drmFd >= 0 )
+   {
+      buff= swGetPoolBuffer( pool, width, height+2 );
+   }
+   if ( buff && (buff->pitch % SW_PLANE_ALIGN) )
+   {
+      GST_WARNING("swGetBuffer2: unusable pitch %d", buff->pitch);
+      buff= 0;
+   }
+   if ( buff )
+   {
+      if ( pool->chromaPoolSize != 2*chromaPlaneSize )
+      {
+         if ( pool->chromaPool )
+         {
+            av_buffer_pool_uninit( &pool->chromaPool );
+         }
+         pool->chromaPoolSize= 2*chromaPlaneSize;
+         pool->chromaPool= av_buffer_pool_init( pool->chromaPoolSize, NULL );
+      }
+      if ( pool->chromaPool )
+      {
+         chroma= av_buffer_pool_get( pool->chromaPool );
+      }
+   }
+   if ( buff && chroma )
+   {
+      buff->inUse= true;
+      ++pool->inUseCount;
+   }
+   pthread_mutex_unlock( &pool->mutex );
+
+   if ( !buff || !chroma )
+   {
+      goto fallback;
+   }
+
+   frame->buf[0]= av_buffer_create( buff->map, buff->size, swFreePoolBuffer, buff, 0 );
+   if ( !frame->buf[0] )
+   {
+      swFreePoolBuffer( buff, buff->map );
+      goto fallback;
+   }
+   frame->buf[1]= chroma;
+   frame->data[0]= buff->map;
+   frame->linesize[0]= buff->pitch;
+   frame->data[1]= chroma->data;
+   frame->linesize[1]= chromaStride;
+   frame->data[2]= chroma->data+chromaPlaneSize;
+   frame->linesize[2]= chromaStride;
+   frame->extended_data= frame->data;
+
+   return 0;
+
+fallback:
+   if ( chroma )
+   {
+      av_buffer_unref( &chroma );
+   }
+   return avcodec_default_get_buffer2( ctx, frame, flags );
+}
+
+static void swSetPaused( SWCtx *swCtx, bool paused );
+static void swDropQueue( SWCtx *swCtx );
+static bool swOutputFrames( GstWesterosSink *sink, SWCtx *swCtx );
+static void swDecodeBuffer( GstWesterosSink *sink, SWCtx *swCtx, GstBuffer *buffer );
+static void swDrainDecoder( GstWesterosSink *sink, SWCtx *swCtx );
+static void* swDecodeThread( void *arg );
 
 
 static bool initSWDecoder( GstWesterosSink *sink )
@@ -68,8 +504,22 @@ static bool initSWDecoder( GstWesterosSink *sink )
       GST_ERROR("initSWDecoder: no memory for SWCtx");
       goto exit;
    }
+   swCtx->sink= sink;
    swCtx->prevFrameTime= -1LL;
    swCtx->frameRate= 60.0;
+   pthread_mutex_init( &swCtx->mutex, 0 );
+   pthread_cond_init( &swCtx->cond, 0 );
+
+   swCtx->threadCount= sink->swDecodeThreads;
+   if ( swCtx->threadCount <= 0 )
+   {
+      long cpuCount= sysconf( _SC_NPROCESSORS_ONLN );
+      swCtx->threadCount= (cpuCount > 0) ? (int)cpuCount : 1;
+   }
+   if ( swCtx->threadCount > SW_DECODE_MAX_THREADS )
+   {
+      swCtx->threadCount= SW_DECODE_MAX_THREADS;
+   }
 
    avcodec_register_all();
    swCtx->codec= avcodec_find_decoder(AV_CODEC_ID_H264);
@@ -90,6 +540,23 @@ static bool initSWDecoder( GstWesterosSink *sink )
       goto exit;
    }
 
+   swCtx->codecCtx->thread_count= swCtx->threadCount;
+   swCtx->codecCtx->thread_type= FF_THREAD_FRAME | FF_THREAD_SLICE;
+
+   if ( sink->swZeroCopy && (swCtx->codec->capabilities & AV_CODEC_CAP_DR1) )
+   {
+      swCtx->pool= swCreatePool();
+      if ( swCtx->pool )
+      {
+         swCtx->codecCtx->opaque= swCtx;
+         swCtx->codecCtx->get_buffer2= swGetBuffer2;
+         #if LIBAVCODEC_VERSION_MAJOR < 59
+         swCtx->codecCtx->thread_safe_callbacks= 1;
+         #endif
+         GST_DEBUG("initSWDecoder: sw decode into drm buffers");
+      }
+   }
+
    rc= avcodec_open2( swCtx->codecCtx, swCtx->codec, (AVDictionary**)NULL );
    if ( rc != 0 )
    {
@@ -97,6 +564,7 @@ static bool initSWDecoder( GstWesterosSink *sink )
       goto exit;
    }
    swCtx->contextOpen= true;
+   g_print("westeros-sink: sw decode threads %d (type %X)\n", swCtx->codecCtx->thread_count, swCtx->codecCtx->active_thread_type);
 
    swCtx->parserCtx= av_parser_init( swCtx->codec->id );
    if ( !swCtx->parserCtx )
@@ -121,6 +589,14 @@ static bool initSWDecoder( GstWesterosSink *sink )
 
    swCtx->needInitData= true;
 
+   rc= pthread_create( &swCtx->decodeThreadId, NULL, swDecodeThread, swCtx );
+   if ( rc != 0 )
+   {
+      GST_ERROR("initSWDecoder: unable to start decode thread: rc %d", rc );
+      goto exit;
+   }
+   swCtx->decodeThreadStarted= true;
+
    sink->swCtx= swCtx;
 
    result= true;
@@ -137,8 +613,23 @@ exit:
    return result;
 }
 
+static void swStopDecodeThread( SWCtx *swCtx )
+{
+   if ( swCtx->decodeThreadStarted )
+   {
+      pthread_mutex_lock( &swCtx->mutex );
+      swCtx->quitDecodeThread= true;
+      pthread_cond_broadcast( &swCtx->cond );
+      pthread_mutex_unlock( &swCtx->mutex );
+      pthread_join( swCtx->decodeThreadId, NULL );
+      swCtx->decodeThreadStarted= false;
+   }
+}
+
 static void termSWDecoder( SWCtx *swCtx )
 {
+   swStopDecodeThread( swCtx );
+   swDropQueue( swCtx );
    if ( swCtx->parserCtx )
    {
       av_parser_close( swCtx->parserCtx );
@@ -164,9 +655,43 @@ static void termSWDecoder( SWCtx *swCtx )
       av_packet_free( &swCtx->packet );
       swCtx->packet= 0;
    }
+   if ( swCtx->pool )
+   {
+      swClosePool( swCtx->pool );
+      swCtx->pool= 0;
+   }
+   if ( swCtx->initData )
+   {
+      free( swCtx->initData );
+      swCtx->initData= 0;
+   }
+   pthread_cond_destroy( &swCtx->cond );
+   pthread_mutex_destroy( &swCtx->mutex );
    free( swCtx );
 }
 
+static void swSetPaused( SWCtx *swCtx, bool paused )
+{
+   pthread_mutex_lock( &swCtx->mutex );
+   swCtx->paused= paused;
+   pthread_cond_broadcast( &swCtx->cond );
+   pthread_mutex_unlock( &swCtx->mutex );
+}
+
+static void swDropQueue( SWCtx *swCtx )
+{
+   while( swCtx->queueCount > 0 )
+   {
+      if ( swCtx->queue[swCtx->queueHead].buffer )
+      {
+         gst_buffer_unref( swCtx->queue[swCtx->queueHead].buffer );
+         swCtx->queue[swCtx->queueHead].buffer= 0;
+      }
+      swCtx->queueHead= (swCtx->queueHead+1) % SW_DECODE_QUEUE_SIZE;
+      --swCtx->queueCount;
+   }
+}
+
 void wstsw_process_caps( GstWesterosSink *sink, GstCaps *caps )
 {
    SWCtx *swCtx= (SWCtx*)sink->swCtx;
@@ -207,221 +732,441 @@ void wstsw_process_caps( GstWesterosSink *sink, GstCaps *caps )
    }
 }
 
+/*
+ * The init data is copied since it is used on the decode thread.
+ */
 void wstsw_set_codec_init_data( GstWesterosSink *sink, int initDataLen, uint8_t *initData )
 {
    SWCtx *swCtx= (SWCtx*)sink->swCtx;
    if ( swCtx )
    {
+      uint8_t *data= 0;
+
       GST_DEBUG("wstsw_set_codec_init_data: data %p len %d", initData, initDataLen);
-      swCtx->initData= initData;
-      swCtx->initDataLen= initDataLen;
+      if ( initData && (initDataLen > 0) )
+      {
+         data= (uint8_t*)malloc( initDataLen );
+         if ( !data )
+         {
+            GST_ERROR("wstsw_set_codec_init_data: no memory for init data len %d", initDataLen);
+            return;
+         }
+         memcpy( data, initData, initDataLen );
+      }
+      pthread_mutex_lock( &swCtx->mutex );
+      if ( swCtx->initData )
+      {
+         free( swCtx->initData );
+      }
+      swCtx->initData= data;
+      swCtx->initDataLen= data ? initDataLen : 0;
+      pthread_mutex_unlock( &swCtx->mutex );
    }
 }
 
-bool wstsw_render( GstWesterosSink *sink, GstBuffer *buffer, gboolean preroll )
+/*
+ * Take every frame the decoder has ready, pace it to the stream frame rate
+ * and hand it to the display.
+ */
+static bool swOutputFrames( GstWesterosSink *sink, SWCtx *swCtx )
 {
    bool result= true;
-   SWCtx *swCtx= (SWCtx*)sink->swCtx;
-
-   GST_LOG("wstsw_render: buffer %p", buffer );
+   int rc;
 
-   while( swCtx->paused )
+   for( ; ; )
    {
-      if ( preroll == TRUE )
+      SWFrame swFrame;
+
+      rc= avcodec_receive_frame( swCtx->codecCtx, swCtx->frame );
+      if ( (rc == AVERROR(EAGAIN)) || (rc == AVERROR_EOF) )
       {
          break;
       }
-      usleep( 1000 );
-      if ( !swCtx->active || sink->flushStarted )
+      else if ( rc < 0 )
       {
-         goto exit;
+         GST_ERROR("swOutputFrames: avdecode_receive_frame error: rc %d", rc);
+         result= false;
+         break;
       }
-   }
+      GST_LOG("swOutputFrames: frame %d %dx%d : format %d key_frame %d ptype %d coded_picture_number %d data: %p, %p, %p, %p",
+              swCtx->outputFrameCount,
+              swCtx->frame->width,
+              swCtx->frame->height,
+              swCtx->frame->format,
+              swCtx->frame->key_frame,
+              swCtx->frame->pict_type,
+              swCtx->frame->coded_picture_number,
+              swCtx->frame->data[0],
+              swCtx->frame->data[1],
+              swCtx->frame->data[2],
+              swCtx->frame->data[3]
+             );
+
+      if ( sink->swDisplay && swCtx->active )
+      {
+         gint64 currFrameTime, currFramePTS;
+         SWPoolBuffer *buff;
+
+         swFrame.width= swCtx->frame->width;
+         swFrame.height= swCtx->frame->height;
+         swFrame.Y= swCtx->frame->data[0];
+         swFrame.Ystride= swCtx->frame->linesize[0];
+         swFrame.U= swCtx->frame->data[1];
+         swFrame.Ustride= swCtx->frame->linesize[1];
+         swFrame.V= swCtx->frame->data[2];
+         swFrame.Vstride= swCtx->frame->linesize[2];
+         swFrame.frameNumber= swCtx->outputFrameCount;
+         swFrame.pts= 0;
+         swFrame.Yfd= -1;
+         swFrame.Ysize= 0;
+         swFrame.hold= 0;
+
+         buff= swFramePoolBuffer( swCtx, swCtx->frame );
+         if ( buff )
+         {
+            swFrame.hold= av_frame_clone( swCtx->frame );
+            if ( swFrame.hold )
+            {
+               swFrame.Yfd= buff->fd;
+               swFrame.Ysize= buff->size;
+            }
+         }
 
-   if ( swCtx )
-   {
-      int rc;
-      int inputLen, parsedLen, consumed;
-      uint8_t *inputData, *parsedData;
-      #ifdef USE_GST1
-      GstMapInfo map;
-      #endif
-      int inSize= 0;
-      unsigned char *inData= 0;
-      int64_t pts= AV_NOPTS_VALUE;
-      int64_t dts= AV_NOPTS_VALUE;
+         currFrameTime= g_get_monotonic_time();
+         if ( swCtx->prevFrameTime != -1LL )
+         {
+            gint64 framePeriod= currFrameTime-swCtx->prevFrameTime;
+            gint64 nominalFramePeriod= 1000000LL / swCtx->frameRate;
+            gint64 delay= (nominalFramePeriod-framePeriod);
+            GST_LOG("swOutputFrames: time %lld prev_time %lld delay %lld", currFrameTime, swCtx->prevFrameTime, delay ); 
+            if ( (delay > 2) && (delay <= nominalFramePeriod) )
+            {
+               usleep( delay );
+               currFrameTime= g_get_monotonic_time();
+            }
+         }
+         swCtx->prevFrameTime= currFrameTime;
 
-      if ( GST_BUFFER_PTS_IS_VALID(buffer) )
-      {
-         pts= GST_BUFFER_PTS(buffer);
-      }
-      if ( GST_BUFFER_DTS_IS_VALID(buffer) )
-      {
-         dts= GST_BUFFER_DTS(buffer);
+         sink->position= sink->positionSegmentStart + ((swCtx->outputFrameCount * GST_SECOND) / swCtx->frameRate);
+         sink->currentPTS= sink->position / (GST_SECOND/90000LL);
+         GST_LOG("swOutputFrames: POSITION: %" GST_TIME_FORMAT, GST_TIME_ARGS (sink->position));
+
+         sink->swDisplay( sink, &swFrame );
       }
-      #ifdef USE_GST1
-      gst_buffer_map(buffer, &map, (GstMapFlags)GST_MAP_READ);
-      inSize= map.size;
-      inData= map.data;
-      #else
-      inSize= (int)GST_BUFFER_SIZE(buffer);
-      inData= GST_BUFFER_DATA(buffer);
-      #endif
 
-      while( inSize > 0 )
+      swCtx->outputFrameCount++;
+   }
+
+   return result;
+}
+
+/*
+ * Parse and decode one buffer on the decode thread.
+ */
+static void swDecodeBuffer( GstWesterosSink *sink, SWCtx *swCtx, GstBuffer *buffer )
+{
+   int rc;
+   int inputLen, parsedLen, consumed;
+   uint8_t *inputData, *parsedData;
+   uint8_t *initData= 0;
+   #ifdef USE_GST1
+   GstMapInfo map;
+   #endif
+   int inSize= 0;
+   unsigned char *inData= 0;
+   int64_t pts= AV_NOPTS_VALUE;
+   int64_t dts= AV_NOPTS_VALUE;
+
+   if ( GST_BUFFER_PTS_IS_VALID(buffer) )
+   {
+      pts= GST_BUFFER_PTS(buffer);
+   }
+   if ( GST_BUFFER_DTS_IS_VALID(buffer) )
+   {
+      dts= GST_BUFFER_DTS(buffer);
+   }
+   #ifdef USE_GST1
+   gst_buffer_map(buffer, &map, (GstMapFlags)GST_MAP_READ);
+   inSize= map.size;
+   inData= map.data;
+   #else
+   inSize= (int)GST_BUFFER_SIZE(buffer);
+   inData= GST_BUFFER_DATA(buffer);
+   #endif
+
+   while( inSize > 0 )
+   {
+      if ( swCtx->needInitData )
       {
-         if ( swCtx->needInitData && swCtx->initDataLen && swCtx->initData )
+         pthread_mutex_lock( &swCtx->mutex );
+         if ( swCtx->initDataLen && swCtx->initData )
          {
-            inputData= swCtx->initData;
+            initData= swCtx->initData;
             inputLen= swCtx->initDataLen;
-            swCtx->needInitData= false;
+            swCtx->initData= 0;
+            swCtx->initDataLen= 0;
          }
-         else
+         pthread_mutex_unlock( &swCtx->mutex );
+      }
+      if ( swCtx->needInitData && initData )
+      {
+         inputData= initData;
+         swCtx->needInitData= false;
+      }
+      else
+      {
+         if ( swCtx->needInitData )
          {
-            if ( swCtx->needInitData )
+            bool foundSPS= false;
+            int i;
+            for ( i= 0; i < inSize-5; ++i )
             {
-               bool foundSPS= false;
-               int i;
-               for ( i= 0; i < inSize-5; ++i )
-               {
-                  if ( (inData[i+0] == 0) &&
-                       (inData[i+1] == 0) &&
-                       (inData[i+2] == 0) &&
-                       (inData[i+3] == 1) &&
-                       (inData[i+4] == 0x67) )
-                  {
-                    GST_DEBUG("wstsw_render: found sps at offset %d", i);
-                    swCtx->needInitData= false;
-                    foundSPS= true;
-                    inData= inData+i;
-                    inSize= inSize-i;
-                    break;
-                  }
-               }
-               if ( !foundSPS )
+               if ( (inData[i+0] == 0) &&
+                    (inData[i+1] == 0) &&
+                    (inData[i+2] == 0) &&
+                    (inData[i+3] == 1) &&
+                    (inData[i+4] == 0x67) )
                {
-                  GST_DEBUG("wstsw_render: skipping data until sps");
-                  break;
+                 GST_DEBUG("swDecodeBuffer: found sps at offset %d", i);
+                 swCtx->needInitData= false;
+                 foundSPS= true;
+                 inData= inData+i;
+                 inSize= inSize-i;
+                 break;
                }
             }
+            if ( !foundSPS )
+            {
+               GST_DEBUG("swDecodeBuffer: skipping data until sps");
+               break;
+            }
+         }
+
+         inputData= (uint8_t*)inData;
+         inputLen= inSize;
+         inSize= 0;
+      }
 
-            inputData= (uint8_t*)inData;
-            inputLen= inSize;
-            inSize= 0;
+      while( inputLen > 0 )
+      {
+         parsedData= 0;
+         parsedLen= 0;
+         consumed= av_parser_parse2( swCtx->parserCtx,
+                                     swCtx->codecCtx,
+                                     &parsedData,
+                                     &parsedLen,
+                                     inputData,
+                                     inputLen,
+                                     pts,
+                                     dts,
+                                     0 );
+         if ( consumed < 0 )
+         {
+            GST_ERROR("swDecodeBuffer: av_parser_parse2 error: rc %d", consumed);
+            goto exit;
          }
 
-         while( inputLen > 0 )
+         inputData += consumed;
+         inputLen -= consumed;
+
+         if ( parsedLen )
          {
-            parsedData= 0;
-            parsedLen= 0;
-            consumed= av_parser_parse2( swCtx->parserCtx,
-                                        swCtx->codecCtx,
-                                        &parsedData,
-                                        &parsedLen,
-                                        inputData,
-                                        inputLen,
-                                        pts,
-                                        dts,
-                                        0 );
-            if ( consumed < 0 )
-            {
-               GST_ERROR("wstsw_render: av_parser_parse2 error: rc %d", consumed);
+            swCtx->packet->data= parsedData;
+            swCtx->packet->size= parsedLen;
+
+            rc= avcodec_send_packet( swCtx->codecCtx, swCtx->packet );
+            if ( rc != 0 )
+            {      
+               GST_ERROR("swDecodeBuffer: avdecode_send_packet error: rc %d", rc);
                goto exit;
             }
-
-            inputData += consumed;
-            inputLen -= consumed;
-
-            if ( parsedLen )
+            if ( !swOutputFrames( sink, swCtx ) )
             {
-               swCtx->packet->data= parsedData;
-               swCtx->packet->size= parsedLen;
-
-               rc= avcodec_send_packet( swCtx->codecCtx, swCtx->packet );
-               if ( rc != 0 )
-               {      
-                  GST_ERROR("wstsw_render: avdecode_send_packet error: rc %d", rc);
-                  goto exit;
-               }
-               while ( rc >= 0 )
-               {
-                  SWFrame swFrame;
-
-                  rc= avcodec_receive_frame( swCtx->codecCtx, swCtx->frame );
-                  if ( (rc == AVERROR(EAGAIN)) || (rc == AVERROR_EOF) )
-                  {
-                     break;
-                  }
-                  else if ( rc < 0 )
-                  {
-                     GST_ERROR("wstsw_render: avdecode_receive_frame error: rc %d", rc);
-                     goto exit;                  
-                  }
-                  GST_LOG("wst_render: frame %d %dx%d : format %d key_frame %d ptype %d coded_picture_number %d data: %p, %p, %p, %p",
-                          swCtx->outputFrameCount,
-                          swCtx->frame->width,
-                          swCtx->frame->height,
-                          swCtx->frame->format,
-                          swCtx->frame->key_frame,
-                          swCtx->frame->pict_type,
-                          swCtx->frame->coded_picture_number,
-                          swCtx->frame->data[0],
-                          swCtx->frame->data[1],
-                          swCtx->frame->data[2],
-                          swCtx->frame->data[3]
-                         );
-
-                  if ( sink->swDisplay )
-                  {
-                     gint64 currFrameTime, currFramePTS;
-
-                     swFrame.width= swCtx->frame->width;
-                     swFrame.height= swCtx->frame->height;
-                     swFrame.Y= swCtx->frame->data[0];
-                     swFrame.Ystride= swCtx->frame->linesize[0];
-                     swFrame.U= swCtx->frame->data[1];
-                     swFrame.Ustride= swCtx->frame->linesize[1];
-                     swFrame.V= swCtx->frame->data[2];
-                     swFrame.Vstride= swCtx->frame->linesize[2];
-                     swFrame.frameNumber= swCtx->outputFrameCount;
-                     swFrame.pts= 0;
-
-                     currFrameTime= g_get_monotonic_time();
-                     if ( swCtx->prevFrameTime != -1LL )
-                     {
-                        gint64 framePeriod= currFrameTime-swCtx->prevFrameTime;
-                        gint64 nominalFramePeriod= 1000000LL / swCtx->frameRate;
-                        gint64 delay= (nominalFramePeriod-framePeriod);
-                        GST_LOG("wstsw_render: time %lld prev_time %lld delay %lld", currFrameTime, swCtx->prevFrameTime, delay ); 
-                        if ( (delay > 2) && (delay <= nominalFramePeriod) )
-                        {
-                           usleep( delay );
-                           currFrameTime= g_get_monotonic_time();
-                        }
-                     }
-                     swCtx->prevFrameTime= currFrameTime;
-
-                     sink->position= sink->positionSegmentStart + ((swCtx->outputFrameCount * GST_SECOND) / swCtx->frameRate);
-                     sink->currentPTS= sink->position / (GST_SECOND/90000LL);
-                     GST_LOG("wstsw_render: POSITION: %" GST_TIME_FORMAT, GST_TIME_ARGS (sink->position));
-
-                     sink->swDisplay( sink, &swFrame );
-                  }
-
-                  swCtx->outputFrameCount++;
-               }
+               goto exit;
             }
          }
       }
    }
+
 exit:
-   if ( !swCtx->active )
+   if ( initData )
    {
-      result= false;
+      free( initData );
    }
+   #ifdef USE_GST1
+   gst_buffer_unmap( buffer, &map );
+   #endif
+   return;
+}
+
+/*
+ * Output the frames still held by the decoder, such as those in flight
+ * across frame threads, and reset it for further input.
+ */
+static void swDrainDecoder( GstWesterosSink *sink, SWCtx *swCtx )
+{
+   int rc;
+
+   rc= avcodec_send_packet( swCtx->codecCtx, NULL );
+   if ( rc == 0 )
+   {
+      swOutputFrames( sink, swCtx );
+   }
+   else
+   {
+      GST_WARNING("swDrainDecoder: avdecode_send_packet error: rc %d", rc);
+   }
+   avcodec_flush_buffers( swCtx->codecCtx );
+}
+
+/*
+ * Decode buffers queued by wstsw_render off the streaming thread.  Buffers
+ * are held while the sink is paused unless they are for preroll.
+ */
+static void* swDecodeThread( void *arg )
+{
+   SWCtx *swCtx= (SWCtx*)arg;
+   GstWesterosSink *sink= swCtx->sink;
+   SWQueueEntry entry;
+
+   GST_DEBUG("swDecodeThread: enter");
+
+   pthread_mutex_lock( &swCtx->mutex );
+   while( !swCtx->quitDecodeThread )
+   {
+      if ( swCtx->flushPending )
+      {
+         swCtx->flushPending= false;
+         pthread_mutex_unlock( &swCtx->mutex );
+         avcodec_flush_buffers( swCtx->codecCtx );
+         pthread_mutex_lock( &swCtx->mutex );
+         continue;
+      }
+
+      if ( (swCtx->queueCount == 0) ||
+           (swCtx->paused && swCtx->active && !swCtx->queue[swCtx->queueHead].preroll) )
+      {
+         pthread_cond_wait( &swCtx->cond, &swCtx->mutex );
+         continue;
+      }
+
+      entry= swCtx->queue[swCtx->queueHead];
+      swCtx->queue[swCtx->queueHead].buffer= 0;
+      swCtx->queueHead= (swCtx->queueHead+1) % SW_DECODE_QUEUE_SIZE;
+      --swCtx->queueCount;
+      swCtx->decoding= true;
+      pthread_cond_broadcast( &swCtx->cond );
+      pthread_mutex_unlock( &swCtx->mutex );
+
+      if ( entry.buffer )
+      {
+         if ( swCtx->active && !sink->flushStarted )
+         {
+            swDecodeBuffer( sink, swCtx, entry.buffer );
+         }
+         gst_buffer_unref( entry.buffer );
+         pthread_mutex_lock( &swCtx->mutex );
+      }
+      else
+      {
+         swDrainDecoder( sink, swCtx );
+         pthread_mutex_lock( &swCtx->mutex );
+         swCtx->drainPending= false;
+      }
+      swCtx->decoding= false;
+      pthread_cond_broadcast( &swCtx->cond );
+   }
+   pthread_mutex_unlock( &swCtx->mutex );
+
+   GST_DEBUG("swDecodeThread: exit");
+
+   return NULL;
+}
+
+bool wstsw_render( GstWesterosSink *sink, GstBuffer *buffer, gboolean preroll )
+{
+   bool result= true;
+   SWCtx *swCtx= (SWCtx*)sink->swCtx;
+
+   GST_LOG("wstsw_render: buffer %p", buffer );
+
+   if ( swCtx )
+   {
+      pthread_mutex_lock( &swCtx->mutex );
+      while( swCtx->active && !sink->flushStarted &&
+             ((swCtx->paused && !preroll) || (swCtx->queueCount >= SW_DECODE_QUEUE_SIZE)) )
+      {
+         pthread_cond_wait( &swCtx->cond, &swCtx->mutex );
+      }
+      if ( swCtx->active && !sink->flushStarted )
+      {
+         SWQueueEntry *entry= &swCtx->queue[(swCtx->queueHead+swCtx->queueCount) % SW_DECODE_QUEUE_SIZE];
+         entry->buffer= gst_buffer_ref( buffer );
+         entry->preroll= (preroll == TRUE);
+         ++swCtx->queueCount;
+         pthread_cond_broadcast( &swCtx->cond );
+      }
+      if ( !swCtx->active )
+      {
+         result= false;
+      }
+      pthread_mutex_unlock( &swCtx->mutex );
+   }
+
    return result;
 }
 
+void wstsw_flush( GstWesterosSink *sink )
+{
+   SWCtx *swCtx= (SWCtx*)sink->swCtx;
+   if ( swCtx )
+   {
+      pthread_mutex_lock( &swCtx->mutex );
+      swDropQueue( swCtx );
+      swCtx->flushPending= true;
+      swCtx->drainPending= false;
+      pthread_cond_broadcast( &swCtx->cond );
+      pthread_mutex_unlock( &swCtx->mutex );
+   }
+}
+
+void wstsw_drain( GstWesterosSink *sink )
+{
+   SWCtx *swCtx= (SWCtx*)sink->swCtx;
+   if ( swCtx )
+   {
+      pthread_mutex_lock( &swCtx->mutex );
+      while( swCtx->active && !sink->flushStarted && (swCtx->queueCount >= SW_DECODE_QUEUE_SIZE) )
+      {
+         pthread_cond_wait( &swCtx->cond, &swCtx->mutex );
+      }
+      if ( swCtx->active && !sink->flushStarted )
+      {
+         SWQueueEntry *entry= &swCtx->queue[(swCtx->queueHead+swCtx->queueCount) % SW_DECODE_QUEUE_SIZE];
+         entry->buffer= 0;
+         entry->preroll= false;
+         ++swCtx->queueCount;
+         swCtx->drainPending= true;
+         pthread_cond_broadcast( &swCtx->cond );
+         while( swCtx->drainPending && swCtx->active && !sink->flushStarted )
+         {
+            pthread_cond_wait( &swCtx->cond, &swCtx->mutex );
+         }
+      }
+      pthread_mutex_unlock( &swCtx->mutex );
+   }
+}
+
+void wstsw_release_frame( GstWesterosSink *sink, void *hold )
+{
+   WESTEROS_UNUSED(sink);
+   if ( hold )
+   {
+      AVFrame *frame= (AVFrame*)hold;
+      av_frame_free( &frame );
+   }
+}
+
 void wstsw_reset_time( GstWesterosSink *sink )
 {
    SWCtx *swCtx= (SWCtx*)sink->swCtx;
@@ -443,6 +1188,10 @@ static gboolean wstsw_null_to_ready( GstWesterosSink *sink, gboolean *passToDefa
          if ( sink->swInit( sink ) )
          {
             g_print("westerossink: using sw decode\n");
+            if ( sink->swCtx && ((SWCtx*)sink->swCtx)->pool )
+            {
+               swSetPoolDrmFd( ((SWCtx*)sink->swCtx)->pool, sink->swDrmFd );
+            }
          }
          else
          {
@@ -466,8 +1215,10 @@ static gboolean wstsw_ready_to_paused( GstWesterosSink *sink, gboolean *passToDe
    {
       sink->swLink( sink );
    }
+   pthread_mutex_lock( &swCtx->mutex );
    swCtx->active= true;
-   swCtx->paused= true;
+   pthread_mutex_unlock( &swCtx->mutex );
+   swSetPaused( swCtx, true );
 
    return TRUE;
 }
@@ -476,7 +1227,7 @@ static gboolean wstsw_paused_to_playing( GstWesterosSink *sink, gboolean *passTo
 {
    SWCtx *swCtx= (SWCtx*)sink->swCtx;
 
-   swCtx->paused= false;
+   swSetPaused( swCtx, false );
    if ( sink->swEvent )
    {
       sink->swEvent( sink, SWEvt_pause, (int)swCtx->paused, 0 );
@@ -489,7 +1240,7 @@ static gboolean wstsw_playing_to_paused( GstWesterosSink *sink, gboolean *passTo
 {
    SWCtx *swCtx= (SWCtx*)sink->swCtx;
 
-   swCtx->paused= true;   
+   swSetPaused( swCtx, true );
    if ( sink->swEvent )
    {
       sink->swEvent( sink, SWEvt_pause, (int)swCtx->paused, 0 );
@@ -502,7 +1253,16 @@ static gboolean wstsw_paused_to_ready( GstWesterosSink *sink, gboolean *passToDe
 {
    SWCtx *swCtx= (SWCtx*)sink->swCtx;
 
+   pthread_mutex_lock( &swCtx->mutex );
    swCtx->active= false;
+   swDropQueue( swCtx );
+   pthread_cond_broadcast( &swCtx->cond );
+   /* The decode thread uses the display resources that swUnLink frees */
+   while( swCtx->decoding )
+   {
+      pthread_cond_wait( &swCtx->cond, &swCtx->mutex );
+   }
+   pthread_mutex_unlock( &swCtx->mutex );
    if ( sink->swUnLink )
    {
       sink->swUnLink( sink );
@@ -513,6 +1273,10 @@ static gboolean wstsw_paused_to_ready( GstWesterosSink *sink, gboolean *passToDe
 
 static gboolean wstsw_ready_to_null( GstWesterosSink *sink, gboolean *passToDefault )
 {
+   if ( sink->swCtx )
+   {
+      swStopDecodeThread( (SWCtx*)sink->swCtx );
+   }
    if ( sink->swTerm )
    {
       sink->swTerm( sink );
@@ -29,7 +29,9 @@ typedef enum _SWEvt
 } SWEvt;
 
 /*
- * Decoded frame information
+ * Decoded frame information.  When Yfd is not -1 the Y plane is in a
+ * dmabuf that can be shown without a copy, and swDisplay owns hold, which
+ * keeps the frame alive until passed to wstsw_release_frame.
  */
 typedef struct _SWFrame
 {
@@ -43,11 +45,17 @@ typedef struct _SWFrame
    int Vstride;
    int frameNumber;
    long long pts;
+   int Yfd;
+   int Ysize;
+   void *hold;
 } SWFrame;
 
 void wstsw_process_caps( GstWesterosSink *sink, GstCaps *caps );
 void wstsw_set_codec_init_data( GstWesterosSink *sink, int initDataLen, uint8_t *initData );
 bool wstsw_render( GstWesterosSink *sink, GstBuffer *buffer, gboolean preroll );
+void wstsw_flush( GstWesterosSink *sink );
+void wstsw_drain( GstWesterosSink *sink );
+void wstsw_release_frame( GstWesterosSink *sink, void *hold );
 void wstsw_reset_time( GstWesterosSink *sink );
 static gboolean wstsw_null_to_ready( GstWesterosSink *sink, gboolean *passToDefault );
 static gboolean wstsw_ready_to_paused( GstWesterosSink *sink, gboolean *passToDefault );
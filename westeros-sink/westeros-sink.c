@@ -58,7 +58,10 @@ enum
   PROP_VIDEO_PTS,
   PROP_RES_PRIORITY,
   PROP_RES_USAGE,
-  PROP_DISPLAY_NAME
+  PROP_DISPLAY_NAME,
+  #ifdef ENABLE_SW_DECODE
+  PROP_SW_DECODE_THREADS
+  #endif
 };
 
 #ifdef USE_GST1
@@ -188,6 +191,7 @@ static void shellSurfaceStatus(void *data,
    sink->windowChange= true;
    sink->opacity= opacity;
    sink->zorder= zorder;
+   gst_westeros_sink_soc_window_change( sink );
 }
 
 static void shellGetSurfacesDone(void *data, struct wl_simple_shell *wl_simple_shell )
@@ -1113,6 +1117,13 @@ static void gst_westeros_sink_class_init(GstWesterosSinkClass *klass)
            "Name of wayland display to use",
            NULL, G_PARAM_WRITABLE));
 
+   #ifdef ENABLE_SW_DECODE
+   g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_SW_DECODE_THREADS,
+       g_param_spec_int ("sw-decode-threads", "sw decode threads",
+           "Number of threads used by software decode: 0 for one per CPU",
+           0, SW_DECODE_MAX_THREADS, 0, G_PARAM_READWRITE));
+   #endif
+
 #ifdef USE_GST1
   GST_DEBUG_CATEGORY_INIT (gst_westeros_sink_debug,
                            #ifdef USE_RAW_SINK
@@ -1274,6 +1285,9 @@ gst_westeros_sink_init(GstWesterosSink *sink, GstWesterosSinkClass *gclass)
    sink->releaseResources= 0;
    #ifdef ENABLE_SW_DECODE
    sink->swCtx= 0;
+   sink->swDecodeThreads= 0;
+   sink->swZeroCopy= FALSE;
+   sink->swDrmFd= -1;
    sink->swInit= 0;
    sink->swTerm= 0;
    sink->swLink= 0;
@@ -1408,6 +1422,7 @@ static void gst_westeros_sink_set_property(GObject *object, guint prop_id, const
                   }
                }
                UNLOCK( sink );
+               gst_westeros_sink_soc_window_change( sink );
             }
          }
 
@@ -1505,6 +1520,14 @@ static void gst_westeros_sink_set_property(GObject *object, guint prop_id, const
          break;
       }
 
+      #ifdef ENABLE_SW_DECODE
+      case PROP_SW_DECODE_THREADS:
+      {
+         sink->swDecodeThreads= g_value_get_int(value);
+         break;
+      }
+      #endif
+
       default:
          gst_westeros_sink_soc_set_property(object, prop_id, value, pspec);
          break;
@@ -1562,6 +1585,13 @@ static void gst_westeros_sink_get_property(GObject *object, guint prop_id, GValu
             UNLOCK(sink);
          }
          break;
+      #ifdef ENABLE_SW_DECODE
+      case PROP_SW_DECODE_THREADS:
+         {
+            g_value_set_int(value, sink->swDecodeThreads);
+         }
+         break;
+      #endif
       default:
          gst_westeros_sink_soc_get_property(object, prop_id, value, pspec);
          break;
@@ -1939,6 +1969,12 @@ static gboolean gst_westeros_sink_event(GstPad *pad, GstEvent *event)
          UNLOCK( sink );
          timeCodeFlush( sink );
          sinkStatsLogReset( sink );
+         #ifdef ENABLE_SW_DECODE
+         if ( sink->rm && (sink->resCurrCaps.capabilities & EssRMgrVidCap_software) )
+         {
+            wstsw_flush( sink );
+         }
+         #endif
          gst_westeros_sink_soc_flush( sink );
          passToDefault= TRUE;
          break;
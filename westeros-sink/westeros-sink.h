@@ -194,6 +194,9 @@ struct _GstWesterosSink
    SinkReleaseResources releaseResources;
    #ifdef ENABLE_SW_DECODE
    void *swCtx;
+   int swDecodeThreads;
+   gboolean swZeroCopy;
+   int swDrmFd;
    SinkSWInit swInit;
    SinkSWTerm swTerm;
    SinkSWLink swLink;